@@ -0,0 +1,109 @@
+/* This file contains sample code that demonstrates use of the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* --
+events.c:
+  Demonstrates receiving events with dhAdvise. Process starts are reported
+by WMI as they happen, instead of by waiting on NextEvent in a loop as in
+the wmi sample.
+
+  The events are raised by an SWbemSink object passed to
+ExecNotificationQueryAsync. Its OnObjectReady event is handled on the
+sink's handler thread while the main thread only dispatches messages.
+
+  Event sinks are an extra, so this sample must be compiled with the files
+in the source directory rather than the single file version.
+ -- */
+
+
+#include "disphelper.h"
+#include <stdio.h>
+#include <wchar.h>
+
+#define HR_TRY(func) if (FAILED(func)) { printf("\n## Fatal error on line %d.\n", __LINE__); goto cleanup; }
+
+
+/* **************************************************************************
+ * OnEvent:
+ *   Called on the sink's handler thread with each OnObjectReady event. The
+ * first argument is the event object, marshalled to this thread.
+ *
+ ============================================================================ */
+void OnEvent(LPCOLESTR szEvent, DISPID dispID, UINT cArgs, VARIANT * rgArgs, LPVOID pContext)
+{
+	LPSTR szName = NULL;
+	LONG nProcessId = 0;
+
+	if (cArgs < 1 || V_VT(&rgArgs[0]) != VT_DISPATCH) return;
+
+	dhGetValue(L"%s", &szName, V_DISPATCH(&rgArgs[0]), L".TargetInstance.Name");
+	dhGetValue(L"%d", &nProcessId, V_DISPATCH(&rgArgs[0]), L".TargetInstance.ProcessId");
+
+	printf("STARTED: %5ld %s\n", nProcessId, szName ? szName : "?");
+
+	dhFreeString(szName);
+}
+
+
+/* ============================================================================ */
+int main(void)
+{
+	DH_EVENT_STATISTICS stats;
+	PDH_EVENT_SINK pSink = NULL;
+	IDispatch * wmiSvc = NULL, * wmiSink = NULL;
+	DWORD dwEnd;
+	LONG lngLeft;
+	MSG msg;
+
+	dhInitialize(TRUE);
+	dhToggleExceptions(TRUE);
+
+	HR_TRY( dhGetObject(L"winmgmts:{impersonationLevel=impersonate}!\\\\.\\root\\cimv2", NULL, &wmiSvc) );
+	HR_TRY( dhCreateObject(L"WbemScripting.SWbemSink", NULL, &wmiSink) );
+
+	HR_TRY( dhAdvise(wmiSink, L"OnObjectReady", OnEvent, NULL, &pSink) );
+
+	HR_TRY( dhCallMethod(wmiSvc, L".ExecNotificationQueryAsync(%o, %S)", wmiSink,
+	                     L"SELECT * FROM __InstanceCreationEvent WITHIN 1 WHERE TargetInstance ISA 'Win32_Process'") );
+
+	printf("Start some programs in the next 30 seconds...\n\n");
+
+	/* The events reach the sink through this thread's message queue */
+	for (dwEnd = GetTickCount() + 30000; (lngLeft = (LONG) (dwEnd - GetTickCount())) > 0; )
+	{
+		if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) DispatchMessage(&msg);
+		else MsgWaitForMultipleObjects(0, NULL, FALSE, (DWORD) lngLeft, QS_ALLINPUT);
+	}
+
+	dhCallMethod(wmiSink, L".Cancel");
+
+	dhGetEventStatistics(pSink, &stats, FALSE);
+	printf("\n%lu events received, %lu delivered\n", stats.cReceived, stats.cDelivered);
+
+cleanup:
+	if (pSink) dhUnadvise(pSink);
+
+	SAFE_RELEASE(wmiSink);
+	SAFE_RELEASE(wmiSvc);
+
+	printf("\nPress ENTER to exit...\n");
+	getchar();
+
+	dhUninitialize(TRUE);
+	return 0;
+}
@@ -0,0 +1,226 @@
+/* This file contains sample code that demonstrates use of the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* --
+fanout.c:
+  Demonstrates spreading independent jobs across several server instances
+with a fan-out executor, and measures how throughput scales with the number
+of instances.
+
+  Rather than starting several copies of Excel, the jobs run against a small
+in-process stand-in server whose single method, Convert, sleeps to simulate
+the latency of an out of process call. Replace the factory with
+dhCreateFanOut(L"Excel.Application", NULL, cInstances, &pFanOut) to run
+real conversions.
+
+  The fan-out executor is an extra, so this sample must be compiled with
+the files in the source directory rather than the single file version.
+ -- */
+
+
+#include "disphelper.h"
+#include <stdio.h>
+#include <wchar.h>
+
+#define HR_TRY(func) if (FAILED(func)) { printf("\n## Fatal error on line %d.\n", __LINE__); goto cleanup; }
+
+#define JOB_COUNT       200
+#define JOB_LATENCY_MS  20
+
+
+/* ============================================================================
+ * The stand-in server: an IDispatch with a single method which sleeps.
+ * ========================================================================= */
+typedef struct tagSTANDIN
+{
+	IDispatchVtbl * lpVtbl;
+	LONG cRefs;
+} STANDIN;
+
+static HRESULT STDMETHODCALLTYPE StandIn_QueryInterface(IDispatch * This, REFIID riid, void ** ppv)
+{
+	if (!IsEqualIID(riid, &IID_IUnknown) && !IsEqualIID(riid, &IID_IDispatch))
+	{
+		*ppv = NULL;
+		return E_NOINTERFACE;
+	}
+
+	*ppv = This;
+	This->lpVtbl->AddRef(This);
+	return S_OK;
+}
+
+static ULONG STDMETHODCALLTYPE StandIn_AddRef(IDispatch * This)
+{
+	return InterlockedIncrement(&((STANDIN *) This)->cRefs);
+}
+
+static ULONG STDMETHODCALLTYPE StandIn_Release(IDispatch * This)
+{
+	LONG cRefs = InterlockedDecrement(&((STANDIN *) This)->cRefs);
+
+	if (cRefs == 0) HeapFree(GetProcessHeap(), 0, This);
+
+	return cRefs;
+}
+
+static HRESULT STDMETHODCALLTYPE StandIn_GetTypeInfoCount(IDispatch * This, UINT * pctinfo)
+{
+	*pctinfo = 0;
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE StandIn_GetTypeInfo(IDispatch * This, UINT iTInfo, LCID lcid, ITypeInfo ** ppTInfo)
+{
+	*ppTInfo = NULL;
+	return E_NOTIMPL;
+}
+
+static HRESULT STDMETHODCALLTYPE StandIn_GetIDsOfNames(IDispatch * This, REFIID riid, LPOLESTR * rgszNames,
+                                                       UINT cNames, LCID lcid, DISPID * rgDispId)
+{
+	if (cNames != 1 || _wcsicmp(rgszNames[0], L"Convert") != 0)
+	{
+		*rgDispId = DISPID_UNKNOWN;
+		return DISP_E_UNKNOWNNAME;
+	}
+
+	*rgDispId = 1;
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE StandIn_Invoke(IDispatch * This, DISPID dispIdMember, REFIID riid, LCID lcid,
+                                                WORD wFlags, DISPPARAMS * pDispParams, VARIANT * pVarResult,
+                                                EXCEPINFO * pExcepInfo, UINT * puArgErr)
+{
+	if (dispIdMember != 1) return DISP_E_MEMBERNOTFOUND;
+
+	/* Simulate the round trip to an out of process server */
+	Sleep(JOB_LATENCY_MS);
+
+	if (pVarResult)
+	{
+		V_VT(pVarResult) = VT_BOOL;
+		V_BOOL(pVarResult) = VARIANT_TRUE;
+	}
+
+	return S_OK;
+}
+
+static IDispatchVtbl f_StandInVtbl =
+{
+	StandIn_QueryInterface, StandIn_AddRef, StandIn_Release,
+	StandIn_GetTypeInfoCount, StandIn_GetTypeInfo, StandIn_GetIDsOfNames, StandIn_Invoke
+};
+
+
+/* **************************************************************************
+ * CreateStandIn:
+ *   Factory passed to dhCreateFanOutEx. It is called on each instance's thread.
+ *
+ ============================================================================ */
+HRESULT CreateStandIn(IDispatch ** ppServer, LPVOID pContext)
+{
+	STANDIN * pStandIn = HeapAlloc(GetProcessHeap(), 0, sizeof(STANDIN));
+
+	if (!pStandIn) return E_OUTOFMEMORY;
+
+	pStandIn->lpVtbl = &f_StandInVtbl;
+	pStandIn->cRefs  = 1;
+
+	*ppServer = (IDispatch *) pStandIn;
+	return S_OK;
+}
+
+
+/* **************************************************************************
+ * ConvertWorkbook:
+ *   A job. With Excel this would open, convert and close a workbook.
+ *
+ ============================================================================ */
+HRESULT ConvertWorkbook(IDispatch * pServer, LPVOID pContext)
+{
+	BOOL bConverted = FALSE;
+
+	return dhGetValue(L"%b", &bConverted, pServer, L".Convert(%d)", (int) (INT_PTR) pContext);
+}
+
+
+/* **************************************************************************
+ * RunBenchmark:
+ *   Runs the jobs against a number of instances and prints the throughput.
+ *
+ ============================================================================ */
+void RunBenchmark(UINT cInstances)
+{
+	PDH_FANOUT pFanOut = NULL;
+	DH_FANOUT_STATISTICS stats;
+	DWORD dwStart, dwElapsed;
+	UINT i;
+
+	HR_TRY( dhCreateFanOutEx(CreateStandIn, NULL, cInstances, &pFanOut) );
+
+	dwStart = GetTickCount();
+
+	for (i = 0; i < JOB_COUNT; i++)
+	{
+		HR_TRY( dhFanOutSubmit(pFanOut, ConvertWorkbook, (LPVOID) (INT_PTR) i) );
+	}
+
+	HR_TRY( dhFanOutWait(pFanOut, INFINITE) );
+
+	dwElapsed = GetTickCount() - dwStart;
+
+	printf("%2u instance(s): %4lu ms, %6.1f jobs/s\n", cInstances, dwElapsed,
+	       dwElapsed ? JOB_COUNT * 1000.0 / dwElapsed : 0.0);
+
+	for (i = 0; i < dhFanOutGetInstanceCount(pFanOut); i++)
+	{
+		dhFanOutGetStatistics(pFanOut, i, &stats);
+
+		printf("    instance %u: %3lu jobs (%lu stolen, %lu failed), %3.0f%% busy\n", i,
+		       stats.cCompleted, stats.cStolen, stats.cFailed,
+		       stats.ullElapsedUs ? 100.0 * (double) stats.ullBusyUs / (double) stats.ullElapsedUs : 0.0);
+	}
+
+cleanup:
+	dhDestroyFanOut(pFanOut);
+}
+
+
+/* ============================================================================ */
+int main(void)
+{
+	UINT cInstances;
+
+	dhInitialize(TRUE);
+	dhToggleExceptions(TRUE);
+
+	printf("Running %d jobs of %d ms against 1 to 8 stand-in servers...\n\n", JOB_COUNT, JOB_LATENCY_MS);
+
+	for (cInstances = 1; cInstances <= 8; cInstances *= 2)
+	{
+		RunBenchmark(cInstances);
+	}
+
+	printf("\nPress ENTER to exit...\n");
+	getchar();
+
+	dhUninitialize(TRUE);
+	return 0;
+}
@@ -0,0 +1,127 @@
+/* This file contains sample code that demonstrates use of the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* --
+remote_hosts.c:
+  Demonstrates spreading object creations across several hosts with the
+remote host registry.
+
+  So that it can run on a single computer, the hosts are registered with
+CLSCTX_LOCAL_SERVER: their names are only labels and each creation starts
+a local Excel instance. To use real hosts, leave dwClsContext at zero and
+fill in the host names and, if needed, the credentials (see
+dcom_alt_creds.c for the precautions that apply to them).
+
+  The remote host registry is an extra, so this sample must be compiled
+with the files in the source directory rather than the single file version.
+ -- */
+
+
+#include "disphelper.h"
+#include <stdio.h>
+#include <wchar.h>
+
+#define HR_TRY(func) if (FAILED(func)) { printf("\n## Fatal error on line %d.\n", __LINE__); goto cleanup; }
+
+#define OBJECT_COUNT 4
+
+static LPCWSTR f_rgszHosts[] = { L"standin_a", L"standin_b" };
+
+
+/* **************************************************************************
+ * PrintHosts:
+ *   Prints the load and latency of each host.
+ *
+ ============================================================================ */
+void PrintHosts(void)
+{
+	DH_REMOTE_HOST_STATISTICS stats;
+	UINT i;
+
+	for (i = 0; i < sizeof(f_rgszHosts) / sizeof(f_rgszHosts[0]); i++)
+	{
+		if (SUCCEEDED(dhGetRemoteHostStatistics(f_rgszHosts[i], &stats)))
+		{
+			wprintf(L"  %s: %u active, %lu created (%lu with a cached factory), %lu failed, %lu us\n",
+			        f_rgszHosts[i], stats.cActive, stats.cCreated, stats.cFactoryHits,
+			        stats.cFailed, stats.ulLatencyUs);
+		}
+	}
+}
+
+
+/* ============================================================================ */
+int main(void)
+{
+	DH_REMOTE_HOST_OPTIONS options = { 0 };
+	IDispatch * rgApps[OBJECT_COUNT] = { 0 };
+	int cWorkbooks;
+	UINT i;
+
+	dhInitialize(TRUE);
+	dhToggleExceptions(TRUE);
+
+	options.dwClsContext = CLSCTX_LOCAL_SERVER;
+
+	for (i = 0; i < sizeof(f_rgszHosts) / sizeof(f_rgszHosts[0]); i++)
+	{
+		options.szMachine = f_rgszHosts[i];
+		HR_TRY( dhAddRemoteHost(&options) );
+	}
+
+	/* Each creation goes to the host with the lowest load */
+	for (i = 0; i < OBJECT_COUNT; i++)
+	{
+		HR_TRY( dhCreateRemoteObject(L"Excel.Application", NULL, &rgApps[i]) );
+
+		/* Sub objects get their host's security blanket */
+		HR_TRY( dhCallMethod(rgApps[i], L".Workbooks.Add") );
+	}
+
+	printf("After creating %d objects:\n", OBJECT_COUNT);
+	PrintHosts();
+
+	for (i = 0; i < OBJECT_COUNT; i++)
+	{
+		if (SUCCEEDED(dhGetValue(L"%d", &cWorkbooks, rgApps[i], L".Workbooks.Count")))
+		{
+			printf("Object %u has %d workbook(s).\n", i, cWorkbooks);
+		}
+	}
+
+cleanup:
+	for (i = 0; i < OBJECT_COUNT; i++)
+	{
+		if (rgApps[i])
+		{
+			dhCallMethod(rgApps[i], L".Quit");
+			dhReleaseRemoteObject(rgApps[i]);
+		}
+	}
+
+	printf("After releasing them:\n");
+	PrintHosts();
+
+	dhRemoveRemoteHost(NULL);
+
+	printf("\nPress ENTER to exit...\n");
+	getchar();
+
+	dhUninitialize(TRUE);
+	return 0;
+}
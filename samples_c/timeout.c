@@ -0,0 +1,226 @@
+/* This file contains sample code that demonstrates use of the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* --
+timeout.c:
+  Demonstrates call timeouts. A call which does not complete in time is
+cancelled and fails with DH_E_CALL_TIMEOUT instead of blocking the thread.
+
+  The calls are made to a small in-process stand-in server whose single
+method, Wait, sleeps for the requested number of milliseconds. It runs in
+its own apartment, on its own thread, so that calls to it go through a
+proxy and can be cancelled, as calls to Excel or a WMI provider would.
+ -- */
+
+
+#include "disphelper.h"
+#include <stdio.h>
+#include <wchar.h>
+
+#define HR_TRY(func) if (FAILED(func)) { printf("\n## Fatal error on line %d.\n", __LINE__); goto cleanup; }
+
+static IStream * f_pStream = NULL;
+static HANDLE f_hServerReady = NULL;
+
+
+/* ============================================================================
+ * The stand-in server: an IDispatch with a single method which sleeps.
+ * ========================================================================= */
+typedef struct tagSTANDIN
+{
+	IDispatchVtbl * lpVtbl;
+	LONG cRefs;
+} STANDIN;
+
+static HRESULT STDMETHODCALLTYPE StandIn_QueryInterface(IDispatch * This, REFIID riid, void ** ppv)
+{
+	if (!IsEqualIID(riid, &IID_IUnknown) && !IsEqualIID(riid, &IID_IDispatch))
+	{
+		*ppv = NULL;
+		return E_NOINTERFACE;
+	}
+
+	*ppv = This;
+	This->lpVtbl->AddRef(This);
+	return S_OK;
+}
+
+static ULONG STDMETHODCALLTYPE StandIn_AddRef(IDispatch * This)
+{
+	return InterlockedIncrement(&((STANDIN *) This)->cRefs);
+}
+
+static ULONG STDMETHODCALLTYPE StandIn_Release(IDispatch * This)
+{
+	LONG cRefs = InterlockedDecrement(&((STANDIN *) This)->cRefs);
+
+	if (cRefs == 0) HeapFree(GetProcessHeap(), 0, This);
+
+	return cRefs;
+}
+
+static HRESULT STDMETHODCALLTYPE StandIn_GetTypeInfoCount(IDispatch * This, UINT * pctinfo)
+{
+	*pctinfo = 0;
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE StandIn_GetTypeInfo(IDispatch * This, UINT iTInfo, LCID lcid, ITypeInfo ** ppTInfo)
+{
+	*ppTInfo = NULL;
+	return E_NOTIMPL;
+}
+
+static HRESULT STDMETHODCALLTYPE StandIn_GetIDsOfNames(IDispatch * This, REFIID riid, LPOLESTR * rgszNames,
+                                                       UINT cNames, LCID lcid, DISPID * rgDispId)
+{
+	if (cNames != 1 || _wcsicmp(rgszNames[0], L"Wait") != 0)
+	{
+		*rgDispId = DISPID_UNKNOWN;
+		return DISP_E_UNKNOWNNAME;
+	}
+
+	*rgDispId = 1;
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE StandIn_Invoke(IDispatch * This, DISPID dispIdMember, REFIID riid, LCID lcid,
+                                                WORD wFlags, DISPPARAMS * pDispParams, VARIANT * pVarResult,
+                                                EXCEPINFO * pExcepInfo, UINT * puArgErr)
+{
+	if (dispIdMember != 1) return DISP_E_MEMBERNOTFOUND;
+
+	if (pDispParams->cArgs != 1 || V_VT(&pDispParams->rgvarg[0]) != VT_I4) return DISP_E_BADPARAMCOUNT;
+
+	/* Simulate a server which hangs */
+	Sleep(V_I4(&pDispParams->rgvarg[0]));
+
+	return S_OK;
+}
+
+static IDispatchVtbl f_StandInVtbl =
+{
+	StandIn_QueryInterface, StandIn_AddRef, StandIn_Release,
+	StandIn_GetTypeInfoCount, StandIn_GetTypeInfo, StandIn_GetIDsOfNames, StandIn_Invoke
+};
+
+
+/* **************************************************************************
+ * ServerThread:
+ *   Creates the stand-in server in a single threaded apartment, passes it
+ * to the main thread and dispatches the calls made to it until WM_QUIT.
+ *
+ ============================================================================ */
+DWORD WINAPI ServerThread(LPVOID lpParameter)
+{
+	STANDIN * pStandIn;
+	MSG msg;
+
+	dhInitialize(TRUE);
+
+	if ((pStandIn = HeapAlloc(GetProcessHeap(), 0, sizeof(STANDIN))) != NULL)
+	{
+		pStandIn->lpVtbl = &f_StandInVtbl;
+		pStandIn->cRefs  = 1;
+
+		CoMarshalInterThreadInterfaceInStream(&IID_IDispatch, (IUnknown *) pStandIn, &f_pStream);
+		StandIn_Release((IDispatch *) pStandIn);
+	}
+
+	/* Create this thread's message queue and let the main thread continue */
+	PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE);
+	SetEvent(f_hServerReady);
+
+	while (GetMessage(&msg, NULL, 0, 0) > 0) DispatchMessage(&msg);
+
+	dhUninitialize(TRUE);
+	return 0;
+}
+
+
+/* **************************************************************************
+ * TimedWait:
+ *   Calls Wait on the stand-in and prints how it ended.
+ *
+ ============================================================================ */
+void TimedWait(IDispatch * pServer, int nMilliseconds)
+{
+	DWORD dwStart = GetTickCount();
+	HRESULT hr = dhCallMethod(pServer, L".Wait(%d)", nMilliseconds);
+
+	printf("Wait(%4d): %s after %lu ms\n", nMilliseconds,
+	       hr == DH_E_CALL_TIMEOUT ? "timed out" : (SUCCEEDED(hr) ? "completed" : "failed"),
+	       GetTickCount() - dwStart);
+}
+
+
+/* ============================================================================ */
+int main(void)
+{
+	DH_CALL_STATISTICS stats;
+	IDispatch * pServer = NULL;
+	HANDLE hThread = NULL;
+	DWORD dwThreadId, dwIndex;
+	DWORD dwPrevious;
+
+	dhInitialize(TRUE);
+	dhToggleExceptions(FALSE);
+
+	f_hServerReady = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	hThread = CreateThread(NULL, 0, ServerThread, NULL, 0, &dwThreadId);
+	if (!hThread) goto cleanup;
+
+	/* Wait for the server to be marshalled */
+	WaitForSingleObject(f_hServerReady, INFINITE);
+
+	HR_TRY( CoGetInterfaceAndReleaseStream(f_pStream, &IID_IDispatch, (void **) &pServer) );
+
+	dwPrevious = dhSetCallTimeout(500);
+
+	TimedWait(pServer, 50);
+	TimedWait(pServer, 200);
+	TimedWait(pServer, 3000);   /* Cancelled after 500 ms */
+
+	dhSetCallTimeout(dwPrevious);
+
+	dhGetCallStatistics(&stats, FALSE);
+
+	printf("\n%lu timed calls, %lu timed out\n", stats.cCalls, stats.cTimeouts);
+	printf("< 1ms: %lu, < 10ms: %lu, < 100ms: %lu, < 1s: %lu, longer: %lu\n",
+	       stats.rgHistogram[0], stats.rgHistogram[1], stats.rgHistogram[2],
+	       stats.rgHistogram[3], stats.rgHistogram[4]);
+
+cleanup:
+	SAFE_RELEASE(pServer);
+
+	if (hThread)
+	{
+		PostThreadMessage(dwThreadId, WM_QUIT, 0, 0);
+		CoWaitForMultipleHandles(0, INFINITE, 1, &hThread, &dwIndex);
+		CloseHandle(hThread);
+	}
+
+	if (f_hServerReady) CloseHandle(f_hServerReady);
+
+	printf("\nPress ENTER to exit...\n");
+	getchar();
+
+	dhUninitialize(TRUE);
+	return 0;
+}
@@ -84,11 +84,9 @@ void HotFixes(LPCWSTR szComputer)
 		{
 			QFix QuickFix = { 0 };
 
-			dhGetValue(L"%s", &QuickFix.szCSName,      objQuickFix, L".CSName");
-			dhGetValue(L"%s", &QuickFix.szDescription, objQuickFix, L".Description");
-			dhGetValue(L"%s", &QuickFix.szHotFixID,    objQuickFix, L".HotFixID");
-			dhGetValue(L"%s", &QuickFix.szFixComments, objQuickFix, L".FixComments");
-			dhGetValue(L"%s", &QuickFix.szInstalledBy, objQuickFix, L".InstalledBy");
+			dhGetValues(objQuickFix, L".CSName:%s;.Description:%s;.HotFixID:%s;.FixComments:%s;.InstalledBy:%s",
+			            &QuickFix.szCSName, &QuickFix.szDescription, &QuickFix.szHotFixID,
+			            &QuickFix.szFixComments, &QuickFix.szInstalledBy);
 
 			cout << "Computer: "     << QuickFix.szCSName      << endl
 			     << "Description: "  << QuickFix.szDescription << endl
@@ -60,27 +60,285 @@ HRESULT ConvertBStrToAnsiStr(BSTR bstrIn, LPSTR * lpszOut);
 
 /* ----- dh_create.c ----- */
 
-HRESULT dhCreateObjectEx(LPCOLESTR szProgId, REFIID riid, DWORD dwClsContext,
-			    COSERVERINFO * pServerInfo, void ** ppv)
+typedef struct tagDH_FACTORY_ENTRY
+{
+	LPWSTR szProgId;
+	CLSID clsid;
+	DWORD dwClsContext;
+	IClassFactory * pCf;
+	DWORD dwCreated;
+	DWORD dwLastUse;
+} DH_FACTORY_ENTRY;
+
+typedef struct tagDH_FACTORY_CACHE
+{
+	UINT  cEntries;
+	DWORD dwClock;
+	DH_FACTORY_ENTRY rgEntries[1];
+} DH_FACTORY_CACHE;
+
+static LONG  f_cFactoryEntries = 0;
+static LONG  f_dwFactoryTimeToLive = 0;
+static LONG  f_lngFactoryTlsInitBegin = -1, f_lngFactoryTlsInitEnd = -1;
+static DWORD f_TlsIdxFactory;
+
+#define GetFactoryCache()          ((DH_FACTORY_CACHE *) TlsGetValue(f_TlsIdxFactory))
+#define SetFactoryCache(pCache)    TlsSetValue(f_TlsIdxFactory, pCache)
+#define CheckFactoryTlsInitialized() if (f_lngFactoryTlsInitEnd != 0) InitializeFactoryTlsIndex();
+
+#define IsServerGone(hr) ((hr) == RPC_E_DISCONNECTED || (hr) == CO_E_OBJNOTCONNECTED || \
+                          (hr) == HRESULT_FROM_WIN32(RPC_S_SERVER_UNAVAILABLE))
+
+static void InitializeFactoryTlsIndex(void)
+{
+	if (0 == InterlockedIncrement(&f_lngFactoryTlsInitBegin))
+	{
+		f_TlsIdxFactory        = TlsAlloc();
+		f_lngFactoryTlsInitEnd = 0;
+	}
+	else
+	{
+		while (f_lngFactoryTlsInitEnd != 0) Sleep(5);
+	}
+}
+
+static void FreeFactoryEntry(DH_FACTORY_ENTRY * pEntry)
+{
+	if (!pEntry->szProgId) return;
+
+	if (pEntry->pCf)
+	{
+		pEntry->pCf->lpVtbl->LockServer(pEntry->pCf, FALSE);
+		pEntry->pCf->lpVtbl->Release(pEntry->pCf);
+	}
+
+	HeapFree(GetProcessHeap(), 0, pEntry->szProgId);
+	ZeroMemory(pEntry, sizeof(DH_FACTORY_ENTRY));
+}
+
+static DH_FACTORY_ENTRY * FindFactoryEntry(LPCOLESTR szProgId, DWORD dwClsContext, DH_FACTORY_ENTRY ** ppVictim)
+{
+	DH_FACTORY_CACHE * pCache;
+	DH_FACTORY_ENTRY * pEntry, * pVictim = NULL;
+	UINT cEntries = (UINT) f_cFactoryEntries;
+	DWORD dwTimeToLive = (DWORD) f_dwFactoryTimeToLive;
+	UINT iEntry;
+
+	if (ppVictim) *ppVictim = NULL;
+
+	if (cEntries == 0)
+	{
+		if (f_lngFactoryTlsInitEnd == 0 && GetFactoryCache()) dhCleanupThreadFactoryCache();
+		return NULL;
+	}
+
+	CheckFactoryTlsInitialized();
+	pCache = GetFactoryCache();
+
+	if (pCache && pCache->cEntries != cEntries)
+	{
+		dhCleanupThreadFactoryCache();
+		pCache = NULL;
+	}
+
+	if (!pCache)
+	{
+		if (!ppVictim) return NULL;
+
+		pCache = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
+		                   sizeof(DH_FACTORY_CACHE) + (cEntries - 1) * sizeof(DH_FACTORY_ENTRY));
+		if (!pCache) return NULL;
+
+		pCache->cEntries = cEntries;
+		SetFactoryCache(pCache);
+	}
+
+	pCache->dwClock++;
+
+	for (iEntry = 0; iEntry < cEntries; iEntry++)
+	{
+		pEntry = &pCache->rgEntries[iEntry];
+
+		if (pEntry->szProgId && dwTimeToLive && GetTickCount() - pEntry->dwCreated >= dwTimeToLive)
+		{
+			FreeFactoryEntry(pEntry);
+		}
+
+		if (pEntry->szProgId && (dwClsContext == 0 || pEntry->dwClsContext == dwClsContext) &&
+		    lstrcmpiW(pEntry->szProgId, szProgId) == 0)
+		{
+			pEntry->dwLastUse = pCache->dwClock;
+			return pEntry;
+		}
+
+		if (!pVictim || pEntry->dwLastUse < pVictim->dwLastUse) pVictim = pEntry;
+	}
+
+	if (ppVictim)
+	{
+		FreeFactoryEntry(pVictim);
+		pVictim->dwLastUse = pCache->dwClock;
+		*ppVictim = pVictim;
+	}
+
+	return NULL;
+}
+
+static HRESULT ResolveClsid(LPCOLESTR szProgId, CLSID * pClsid)
+{
+	DH_FACTORY_ENTRY * pEntry;
+
+	if (L'{' == szProgId[0]) return CLSIDFromString((LPOLESTR) szProgId, pClsid);
+
+	if ((pEntry = FindFactoryEntry(szProgId, 0, NULL)) != NULL)
+	{
+		*pClsid = pEntry->clsid;
+		return NOERROR;
+	}
+
+	return CLSIDFromProgID(szProgId, pClsid);
+}
+
+static BOOL IsLocalServerFactory(IClassFactory * pCf)
 {
+	IClientSecurity * pSecurity;
+
+	if (FAILED(pCf->lpVtbl->QueryInterface(pCf, &IID_IClientSecurity, (void **) &pSecurity))) return FALSE;
+
+	pSecurity->lpVtbl->Release(pSecurity);
+	return TRUE;
+}
+
+static HRESULT GetClassFactory(LPCOLESTR szProgId, DWORD dwClsContext, COSERVERINFO * pServerInfo,
+                               IClassFactory ** ppCf, BOOL * pbCached)
+{
+	DH_FACTORY_ENTRY * pEntry, * pVictim;
 	CLSID clsid;
+	SIZE_T cb;
 	HRESULT hr;
-	IClassFactory * pCf = NULL;
 
-	DH_ENTER(L"CreateObjectEx");
+	*pbCached = FALSE;
 
-	if (!szProgId || !riid || !ppv) return DH_EXIT(E_INVALIDARG, szProgId);
+	if ((pEntry = FindFactoryEntry(szProgId, dwClsContext, &pVictim)) != NULL)
+	{
+		if (pEntry->pCf && !pServerInfo)
+		{
+			*ppCf = pEntry->pCf;
+			(*ppCf)->lpVtbl->AddRef(*ppCf);
+			*pbCached = TRUE;
+			return NOERROR;
+		}
+
+		return CoGetClassObject(&pEntry->clsid, dwClsContext, pServerInfo, &IID_IClassFactory, (void **) ppCf);
+	}
 
 	if (L'{' == szProgId[0])
 		hr = CLSIDFromString((LPOLESTR) szProgId, &clsid);
 	else
 		hr = CLSIDFromProgID(szProgId, &clsid);
 
-	if (SUCCEEDED(hr)) hr = CoGetClassObject(&clsid, dwClsContext, pServerInfo, &IID_IClassFactory, (void **) &pCf);
+	if (SUCCEEDED(hr)) hr = CoGetClassObject(&clsid, dwClsContext, pServerInfo, &IID_IClassFactory, (void **) ppCf);
+
+	if (SUCCEEDED(hr) && pVictim)
+	{
+		cb = (wcslen(szProgId) + 1) * sizeof(WCHAR);
+
+		if ((pVictim->szProgId = HeapAlloc(GetProcessHeap(), 0, cb)) != NULL)
+		{
+			CopyMemory(pVictim->szProgId, szProgId, cb);
+			pVictim->clsid        = clsid;
+			pVictim->dwClsContext = dwClsContext;
+			pVictim->dwCreated    = GetTickCount();
+
+			if (!pServerInfo && IsLocalServerFactory(*ppCf) && SUCCEEDED((*ppCf)->lpVtbl->LockServer(*ppCf, TRUE)))
+			{
+				pVictim->pCf = *ppCf;
+				pVictim->pCf->lpVtbl->AddRef(pVictim->pCf);
+			}
+		}
+	}
+
+	return hr;
+}
+
+HRESULT dhSetClassFactoryCache(UINT cEntries, DWORD dwTimeToLive)
+{
+	if (cEntries > 1024) return E_INVALIDARG;
+
+	InterlockedExchange(&f_dwFactoryTimeToLive, (LONG) dwTimeToLive);
+	InterlockedExchange(&f_cFactoryEntries, (LONG) cEntries);
+
+	if (cEntries == 0) dhCleanupThreadFactoryCache();
+
+	return NOERROR;
+}
+
+HRESULT dhFlushClassFactoryCache(LPCOLESTR szProgId)
+{
+	DH_FACTORY_CACHE * pCache;
+	UINT iEntry;
+
+	CheckFactoryTlsInitialized();
+	pCache = GetFactoryCache();
+
+	if (!pCache) return NOERROR;
+
+	for (iEntry = 0; iEntry < pCache->cEntries; iEntry++)
+	{
+		if (pCache->rgEntries[iEntry].szProgId &&
+		    (!szProgId || lstrcmpiW(pCache->rgEntries[iEntry].szProgId, szProgId) == 0))
+		{
+			FreeFactoryEntry(&pCache->rgEntries[iEntry]);
+		}
+	}
+
+	return NOERROR;
+}
+
+void dhCleanupThreadFactoryCache(void)
+{
+	DH_FACTORY_CACHE * pCache;
+
+	CheckFactoryTlsInitialized();
+	pCache = GetFactoryCache();
+
+	if (pCache)
+	{
+		dhFlushClassFactoryCache(NULL);
+		HeapFree(GetProcessHeap(), 0, pCache);
+		SetFactoryCache(NULL);
+	}
+}
+
+HRESULT dhCreateObjectEx(LPCOLESTR szProgId, REFIID riid, DWORD dwClsContext,
+			    COSERVERINFO * pServerInfo, void ** ppv)
+{
+	HRESULT hr;
+	IClassFactory * pCf = NULL;
+	BOOL bCached;
+
+	DH_ENTER(L"CreateObjectEx");
+
+	if (!szProgId || !riid || !ppv) return DH_EXIT(E_INVALIDARG, szProgId);
+
+	hr = GetClassFactory(szProgId, dwClsContext, pServerInfo, &pCf, &bCached);
+
 	if (SUCCEEDED(hr)) hr = pCf->lpVtbl->CreateInstance(pCf, NULL, riid, ppv);
 
 	if (pCf) pCf->lpVtbl->Release(pCf);
 
+	if (bCached && IsServerGone(hr))
+	{
+		pCf = NULL;
+		dhFlushClassFactoryCache(szProgId);
+
+		hr = GetClassFactory(szProgId, dwClsContext, pServerInfo, &pCf, &bCached);
+
+		if (SUCCEEDED(hr)) hr = pCf->lpVtbl->CreateInstance(pCf, NULL, riid, ppv);
+
+		if (pCf) pCf->lpVtbl->Release(pCf);
+	}
+
 	return DH_EXIT(hr, szProgId);
 }
 
@@ -118,10 +376,7 @@ HRESULT dhGetObjectEx(LPCOLESTR szPathName, LPCOLESTR szProgId, REFIID riid,
 		CLSID clsid;
 		IUnknown * pUnk = NULL;
 
-		if (L'{' == szProgId[0])
-			hr = CLSIDFromString((LPOLESTR) szProgId, &clsid);
-		else
-			hr = CLSIDFromProgID(szProgId, &clsid);
+		hr = ResolveClsid(szProgId, &clsid);
 
 		if (SUCCEEDED(hr)) hr = GetActiveObject(&clsid, NULL, &pUnk);
 		if (SUCCEEDED(hr)) hr = pUnk->lpVtbl->QueryInterface(pUnk, riid, ppv);
@@ -217,6 +472,38 @@ HRESULT dhGetValue(LPCWSTR szIdentifier, void * pResult, IDispatch * pDisp, LPCO
 	return DH_EXIT(hr, szMember);
 }
 
+HRESULT dhGetValues(IDispatch * pDisp, LPCOLESTR szFields, ...)
+{
+	HRESULT hr;
+	va_list marker;
+
+	DH_ENTER(L"GetValues");
+
+	va_start(marker, szFields);
+
+	hr = dhGetValuesV(NULL, 0, pDisp, szFields, &marker);
+
+	va_end(marker);
+
+	return DH_EXIT(hr, szFields);
+}
+
+HRESULT dhGetValuesEx(HRESULT * rghrFields, UINT cFields, IDispatch * pDisp, LPCOLESTR szFields, ...)
+{
+	HRESULT hr;
+	va_list marker;
+
+	DH_ENTER(L"GetValuesEx");
+
+	va_start(marker, szFields);
+
+	hr = dhGetValuesV(rghrFields, cFields, pDisp, szFields, &marker);
+
+	va_end(marker);
+
+	return DH_EXIT(hr, szFields);
+}
+
 HRESULT dhInvoke(int invokeType, VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember, ...)
 {
 	HRESULT hr;
@@ -239,20 +526,88 @@ BOOL dh_g_bIsUnicodeMode;
 
 HRESULT dhInvokeArray(int invokeType, VARIANT * pvResult, UINT cArgs,
                          IDispatch * pDisp, LPCOLESTR szMember, VARIANT * pArgs)
+{
+	DH_ENTER(L"InvokeArray");
+
+	return DH_EXIT(dhInvokeArrayEx(invokeType, pvResult, cArgs, pDisp, szMember, pArgs, 0, NULL), szMember);
+}
+
+HRESULT dhInvokeArrayEx(int invokeType, VARIANT * pvResult, UINT cArgs, IDispatch * pDisp,
+                        LPCOLESTR szMember, VARIANT * pArgs, UINT cNamedArgs, LPCOLESTR * pszArgNames)
 {
 	DISPPARAMS dp       = { 0 };
 	EXCEPINFO excep     = { 0 };
-	DISPID dispidNamed  = DISPID_PROPERTYPUT;
+	LPOLESTR rgszNames[DH_MAX_ARGS + 1];
+	DISPID rgDispIds[DH_MAX_ARGS + 1];
+	BOOL bPut = (invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF)) != 0;
 	DISPID dispID;
-	UINT uiArgErr;
+	UINT uiArgErr, iName;
 	HRESULT hr;
 
-	DH_ENTER(L"InvokeArray");
+	DH_ENTER(L"InvokeArrayEx");
 
 	if(!pDisp || !szMember || (cArgs != 0 && !pArgs)) return DH_EXIT(E_INVALIDARG, szMember);
 
-	hr = pDisp->lpVtbl->GetIDsOfNames(pDisp, &IID_NULL, (LPOLESTR *) &szMember, 1, LOCALE_USER_DEFAULT, &dispID);
+	if(cNamedArgs > DH_MAX_ARGS || (cNamedArgs != 0 &&
+	   (!pszArgNames || cNamedArgs + (bPut ? 1 : 0) > cArgs))) return DH_EXIT(E_INVALIDARG, szMember);
+
+	rgszNames[0] = (LPOLESTR) szMember;
+	for (iName = 0; iName < cNamedArgs; iName++) rgszNames[iName + 1] = (LPOLESTR) pszArgNames[iName];
+
+	hr = dhCacheGetIDsOfNames(pDisp, rgszNames, cNamedArgs + 1, rgDispIds);
+
+	if(FAILED(hr))
+	{
+		iName = 0;
+
+		if (hr == DISP_E_UNKNOWNNAME && cNamedArgs != 0 && rgDispIds[0] != DISPID_UNKNOWN)
+		{
+			for (iName = 1; iName < cNamedArgs && rgDispIds[iName] != DISPID_UNKNOWN; iName++);
+		}
+
+		return DH_EXITEX(hr, TRUE, rgszNames[iName], szMember, NULL, 0);
+	}
+
+	dispID = rgDispIds[0];
+
+	if (pvResult != NULL) VariantInit(pvResult);
+
+	dp.cArgs  = cArgs;
+	dp.rgvarg = pArgs;
+
+	if(bPut)
+	{
+		rgDispIds[0] = DISPID_PROPERTYPUT;
+		dp.cNamedArgs = cNamedArgs + 1;
+		dp.rgdispidNamedArgs = rgDispIds;
+	}
+	else if(cNamedArgs)
+	{
+		dp.cNamedArgs = cNamedArgs;
+		dp.rgdispidNamedArgs = &rgDispIds[1];
+	}
+
+	hr = dhInterceptInvoke(pDisp, szMember, dispID, invokeType, &dp, pvResult, &excep, &uiArgErr);
+
+	return DH_EXITEX(hr, TRUE, szMember, szMember, &excep, uiArgErr);
+}
+
+HRESULT dhInvokeAtom(int invokeType, VARIANT * pvResult, UINT cArgs, IDispatch * pDisp, const DH_ATOM * pAtom, VARIANT * pArgs)
+{
+	DISPPARAMS dp       = { 0 };
+	EXCEPINFO excep     = { 0 };
+	DISPID dispidNamed  = DISPID_PROPERTYPUT;
+	BOOL bPut = (invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF)) != 0;
+	LPCOLESTR szMember  = (pAtom ? pAtom->szName : NULL);
+	DISPID dispID;
+	UINT uiArgErr;
+	HRESULT hr;
+
+	DH_ENTER(L"InvokeAtom");
 
+	if(!pDisp || !szMember || (cArgs != 0 && !pArgs) || (bPut && cArgs == 0)) return DH_EXIT(E_INVALIDARG, szMember);
+
+	hr = dhCacheGetIDOfAtom(pDisp, pAtom, &dispID);
 	if(FAILED(hr)) return DH_EXITEX(hr, TRUE, szMember, szMember, NULL, 0);
 
 	if (pvResult != NULL) VariantInit(pvResult);
@@ -260,36 +615,48 @@ HRESULT dhInvokeArray(int invokeType, VARIANT * pvResult, UINT cArgs,
 	dp.cArgs  = cArgs;
 	dp.rgvarg = pArgs;
 
-	if(invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF))
+	if(bPut)
 	{
 		dp.cNamedArgs = 1;
 		dp.rgdispidNamedArgs = &dispidNamed;
 	}
 
-	hr = pDisp->lpVtbl->Invoke(pDisp, dispID, &IID_NULL, LOCALE_USER_DEFAULT, (WORD) invokeType, &dp, pvResult, &excep, &uiArgErr);
+	hr = dhInterceptInvoke(pDisp, szMember, dispID, invokeType, &dp, pvResult, &excep, &uiArgErr);
 
 	return DH_EXITEX(hr, TRUE, szMember, szMember, &excep, uiArgErr);
 }
 
 HRESULT dhCallMethodV(IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
 {
+	HRESULT hr;
+
 	DH_ENTER(L"CallMethodV");
 
-	return DH_EXIT(dhInvokeV(DISPATCH_METHOD, VT_EMPTY, NULL, pDisp, szMember, marker), szMember);
+	hr = dhInvokeV(DISPATCH_METHOD, VT_EMPTY, NULL, pDisp, szMember, marker);
+
+	return DH_EXIT(hr, szMember);
 }
 
 HRESULT dhPutValueV(IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
 {
+	HRESULT hr;
+
 	DH_ENTER(L"PutValueV");
 
-	return DH_EXIT(dhInvokeV(DISPATCH_PROPERTYPUT, VT_EMPTY, NULL, pDisp, szMember, marker), szMember);
+	hr = dhInvokeV(DISPATCH_PROPERTYPUT, VT_EMPTY, NULL, pDisp, szMember, marker);
+
+	return DH_EXIT(hr, szMember);
 }
 
 HRESULT dhPutRefV(IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
 {
+	HRESULT hr;
+
 	DH_ENTER(L"PutRefV");
 
-	return DH_EXIT(dhInvokeV(DISPATCH_PROPERTYPUTREF, VT_EMPTY, NULL, pDisp, szMember, marker), szMember);
+	hr = dhInvokeV(DISPATCH_PROPERTYPUTREF, VT_EMPTY, NULL, pDisp, szMember, marker);
+
+	return DH_EXIT(hr, szMember);
 }
 
 HRESULT dhGetValueV(LPCWSTR szIdentifier, void * pResult, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
@@ -331,7 +698,7 @@ HRESULT dhGetValueV(LPCWSTR szIdentifier, void * pResult, IDispatch * pDisp, LPC
 			return DH_EXIT(E_INVALIDARG, szMember);
 	}
 
-	hr = dhInvokeV(DISPATCH_PROPERTYGET|DISPATCH_METHOD, returnType, &vtResult, pDisp, szMember, marker);
+	hr = dhPropertyCacheGetV(returnType, &vtResult, pDisp, szMember, marker);
 	if (FAILED(hr)) return DH_EXIT(hr, szMember);
 
 	switch(*szIdentifier)
@@ -419,13 +786,112 @@ HRESULT dhGetValueV(LPCWSTR szIdentifier, void * pResult, IDispatch * pDisp, LPC
 	return DH_EXIT(hr, szMember);
 }
 
+HRESULT dhGetValuesV(HRESULT * rghrFields, UINT cFields, IDispatch * pDisp, LPCOLESTR szFields, va_list * marker)
+{
+	LPWSTR szMembers[DH_MAX_FIELDS];
+	LPWSTR szIdentifiers[DH_MAX_FIELDS];
+	WCHAR szPrefix[DH_MAX_MEMBER];
+	IDispatch * pObject = pDisp;
+	HRESULT hr, hrPrefix = NOERROR, hrRet = NOERROR;
+	UINT cParsed = 0, cchPrefix = 0, iField, cch;
+	LPWSTR szParams, szField, szColon;
+	BSTR bstrCopy;
+	va_list vaField;
+	void * pResult;
+
+	DH_ENTER(L"GetValuesV");
+
+	if (!pDisp || !szFields || !marker || (cFields != 0 && !rghrFields)) return DH_EXIT(E_INVALIDARG, szFields);
+
+	if (!(bstrCopy = SysAllocString(szFields))) return DH_EXIT(E_OUTOFMEMORY, szFields);
+
+	for (szParams = bstrCopy; *szParams; )
+	{
+		szField = szParams;
+		szColon = NULL;
+
+		for (; *szParams && *szParams != L';'; szParams++)
+		{
+			if (szParams[0] == L':' && szParams[1] == L'%') szColon = szParams;
+		}
+
+		if (*szParams) *szParams++ = L'\0';
+
+		if (*szField == L'\0') continue;
+
+		if (!szColon || cParsed == DH_MAX_FIELDS)
+		{
+			SysFreeString(bstrCopy);
+			return DH_EXIT(E_INVALIDARG, szFields);
+		}
+
+		*szColon = L'\0';
+		if (*szField == L'.') szField++;
+
+		szMembers[cParsed]     = szField;
+		szIdentifiers[cParsed] = szColon + 1;
+		cParsed++;
+	}
+
+	for (cch = 0; cParsed > 1 && cch < ARRAYSIZE(szPrefix) &&
+	              szMembers[0][cch] && szMembers[0][cch] != L'%'; cch++)
+	{
+		for (iField = 1; iField < cParsed && szMembers[iField][cch] == szMembers[0][cch]; iField++);
+
+		if (iField < cParsed) break;
+
+		if (szMembers[0][cch] == L'.') cchPrefix = cch + 1;
+	}
+
+	if (cchPrefix)
+	{
+		CopyMemory(szPrefix, szMembers[0], (cchPrefix - 1) * sizeof(WCHAR));
+		szPrefix[cchPrefix - 1] = L'\0';
+
+		hrPrefix = dhGetValueV(L"%o", &pObject, pDisp, szPrefix, marker);
+	}
+
+	for (iField = 0; iField < cParsed; iField++)
+	{
+		va_copy(vaField, *marker);
+
+		pResult = va_arg(*marker, void *);
+
+		hr = hrPrefix;
+		if (SUCCEEDED(hr)) hr = dhGetValueV(szIdentifiers[iField], pResult, pObject, szMembers[iField] + cchPrefix, marker);
+
+		if (FAILED(hr))
+		{
+			va_end(*marker);
+			va_copy(*marker, vaField);
+
+			pResult = va_arg(*marker, void *);
+			dhSkipArguments(szMembers[iField] + cchPrefix, marker);
+
+			hrRet = hr;
+		}
+
+		va_end(vaField);
+
+		if (iField < cFields) rghrFields[iField] = hr;
+	}
+
+	if (cchPrefix && SUCCEEDED(hrPrefix)) pObject->lpVtbl->Release(pObject);
+
+	SysFreeString(bstrCopy);
+
+	return DH_EXIT(hrRet, szFields);
+}
+
 /* ----- dh_invoke.c ----- */
 
 static HRESULT TraverseSubObjects(IDispatch ** ppDisp, LPWSTR * lpszMember, va_list * marker);
-static HRESULT CreateArgumentArray(LPWSTR szTemp, VARIANT * pArgs, BOOL * pbFreeList, UINT * pcArgs, va_list * marker);
+static HRESULT CreateArgumentArray(LPWSTR szTemp, VARIANT * pArgs, BOOL * pbFreeList, LPOLESTR * pszNames, UINT * pcArgs, UINT * pcNamed, va_list * marker);
 static HRESULT InternalInvokeV(int invokeType, VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPOLESTR szMember, va_list * marker);
 static HRESULT ExtractArgument(VARIANT * pvArg, const WCHAR * chIdentifierPtr, BOOL * pbFreeArg, va_list * marker);
 
+DH_SUB_OBJECT_HOOK dh_g_pfnSubObjectHook;
+
 HRESULT dhInvokeV(int invokeType, VARTYPE returnType, VARIANT * pvResult,
                      IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
 {
@@ -485,6 +951,8 @@ static HRESULT TraverseSubObjects(IDispatch ** ppDisp, LPWSTR * lpszMember, va_l
 
 		if (! V_DISPATCH(&vtObject) && SUCCEEDED(hr)) hr = E_NOINTERFACE;
 
+		if (SUCCEEDED(hr) && dh_g_pfnSubObjectHook) dh_g_pfnSubObjectHook(*ppDisp, V_DISPATCH(&vtObject));
+
 		(*ppDisp)->lpVtbl->Release(*ppDisp);
 
 		if (FAILED(hr)) break;
@@ -506,16 +974,27 @@ static HRESULT InternalInvokeV(int invokeType, VARTYPE returnType, VARIANT * pvR
 {
 	VARIANT vtArgs[DH_MAX_ARGS];
 	BOOL bFreeList[DH_MAX_ARGS];
+	LPOLESTR szNames[DH_MAX_ARGS];
+	BOOL bPut = (invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF)) != 0;
 	HRESULT hr;
-	UINT cArgs, iArg;
+	UINT cArgs, cNamed, iArg, iNamed;
 
 	DH_ENTER(L"InternalInvokeV");
 
-	hr = CreateArgumentArray(szMember, vtArgs, bFreeList, &cArgs, marker);
+	hr = CreateArgumentArray(szMember, vtArgs, bFreeList, szNames, &cArgs, &cNamed, marker);
 
 	if (SUCCEEDED(hr))
 	{
-		hr = dhInvokeArray(invokeType, pvResult, cArgs, pDisp, szMember, &vtArgs[DH_MAX_ARGS - cArgs]);
+		iNamed = DH_MAX_ARGS - cArgs + (bPut && cArgs != 0 ? 1 : 0);
+
+		for (iArg = DH_MAX_ARGS - cArgs;iArg < DH_MAX_ARGS;iArg++)
+		{
+			if ((szNames[iArg] != NULL) != (iArg >= iNamed && iArg < iNamed + cNamed)) hr = E_INVALIDARG;
+		}
+
+		if (SUCCEEDED(hr))
+			hr = dhInvokeArrayEx(invokeType, pvResult, cArgs, pDisp, szMember, &vtArgs[DH_MAX_ARGS - cArgs],
+			                     cNamed, (LPCOLESTR *) &szNames[iNamed]);
 
 		for (iArg = DH_MAX_ARGS - cArgs;iArg < DH_MAX_ARGS;iArg++)
 		{
@@ -525,7 +1004,7 @@ static HRESULT InternalInvokeV(int invokeType, VARTYPE returnType, VARIANT * pvR
 		if (SUCCEEDED(hr) && pvResult != NULL &&
 	            V_VT(pvResult) != returnType && returnType != VT_EMPTY)
 		{
-			hr = VariantChangeType(pvResult, pvResult, 16 , returnType);
+			hr = VariantChangeType(pvResult, pvResult, 16, returnType);
 			if (FAILED(hr)) VariantClear(pvResult);
 		}
 	}
@@ -534,14 +1013,18 @@ static HRESULT InternalInvokeV(int invokeType, VARTYPE returnType, VARIANT * pvR
 }
 
 static HRESULT CreateArgumentArray(LPWSTR szMember, VARIANT * pArgs, BOOL * pbFreeList,
-				   UINT * pcArgs, va_list * marker)
+				   LPOLESTR * pszNames, UINT * pcArgs, UINT * pcNamed, va_list * marker)
 {
 	HRESULT hr        = NOERROR;
 	INT iArg          = DH_MAX_ARGS;
 	BOOL bInArguments = FALSE;
+	LPWSTR szName     = NULL;
+	LPWSTR szNameEnd;
 
 	DH_ENTER(L"CreateArgumentArray");
 
+	*pcNamed = 0;
+
 	while (*szMember)
 	{
 		if (!bInArguments &&
@@ -551,6 +1034,22 @@ static HRESULT CreateArgumentArray(LPWSTR szMember, VARIANT * pArgs, BOOL * pbFr
 
 			*szMember = L'\0';
 		}
+		else if (bInArguments && *szMember == L':' && szMember[1] == L'=')
+		{
+			if (szName) { hr = E_INVALIDARG; break; }
+
+			for (szNameEnd = szMember; szNameEnd[-1] == L' '; szNameEnd--);
+
+			for (szName = szNameEnd; (szName[-1] >= L'a' && szName[-1] <= L'z') ||
+			                         (szName[-1] >= L'A' && szName[-1] <= L'Z') ||
+			                         (szName[-1] >= L'0' && szName[-1] <= L'9') ||
+			                          szName[-1] == L'_'; szName--);
+
+			if (szName == szNameEnd) { hr = E_INVALIDARG; break; }
+
+			*szNameEnd = L'\0';
+			szMember++;
+		}
 		else if  (*szMember == L'%')
 		{
 			if (!bInArguments)
@@ -559,25 +1058,31 @@ static HRESULT CreateArgumentArray(LPWSTR szMember, VARIANT * pArgs, BOOL * pbFr
 				*szMember = L'\0';
 			}
 
+			if (iArg == 0) { hr = E_INVALIDARG; break; }
+
 			iArg--;
 
-			if (iArg == -1) { hr = E_INVALIDARG; break; }
+			pszNames[iArg] = szName;
+			if (szName) (*pcNamed)++;
+			szName = NULL;
 
 			szMember++;
 
 			hr = ExtractArgument(&pArgs[iArg], szMember, &pbFreeList[iArg], marker);
 
-			if (FAILED(hr)) break;
+			if (FAILED(hr)) { iArg++; break; }
 		}
 
 		szMember++;
 	}
 
+	if (SUCCEEDED(hr) && szName) hr = E_INVALIDARG;
+
 	*pcArgs = DH_MAX_ARGS - iArg;
 
 	if (FAILED(hr))
 	{
-		for (++iArg;iArg < DH_MAX_ARGS; iArg++)
+		for (;iArg < DH_MAX_ARGS; iArg++)
 		{
 			if (pbFreeList[iArg]) VariantClear(&pArgs[iArg]);
 		}
@@ -591,6 +1096,7 @@ static HRESULT ExtractArgument(VARIANT * pvArg, const WCHAR * chIdentifierPtr, B
 	HRESULT hr = NOERROR;
 	WCHAR chIdentifier = *chIdentifierPtr;
 	BOOL isRef = FALSE;
+	BOOL isConst = FALSE;
 	INT  size = 0;
 
 	*pbFreeArg = FALSE;
@@ -611,6 +1117,8 @@ static HRESULT ExtractArgument(VARIANT * pvArg, const WCHAR * chIdentifierPtr, B
 			size++;
 		else if (chIdentifier == L'L')
 			size=2;	// long-long is always 64bits
+		else if (chIdentifier == L'k')
+			isConst = TRUE;
 		else break;
 
 		chIdentifier = *(++chIdentifierPtr);
@@ -752,187 +1260,3352 @@ static HRESULT ExtractArgument(VARIANT * pvArg, const WCHAR * chIdentifierPtr, B
 			}
 			break;
 
-		case L'b':
-			V_VT(pvArg)   = VT_BOOL;
-			V_BOOL(pvArg) = ( va_arg(*marker, BOOL) ? VARIANT_TRUE : VARIANT_FALSE );
-			break;
+		case L'b':
+			V_VT(pvArg)   = VT_BOOL;
+			V_BOOL(pvArg) = ( va_arg(*marker, BOOL) ? VARIANT_TRUE : VARIANT_FALSE );
+			break;
+
+		case L'v':
+			*pvArg  = *va_arg(*marker, VARIANT *);
+			break;
+
+		case L'm':
+			V_VT(pvArg)    = VT_ERROR;
+			V_ERROR(pvArg) = DISP_E_PARAMNOTFOUND;
+			break;
+
+		case L'B':
+			V_VT(pvArg)   = VT_BSTR;
+			V_BSTR(pvArg) = va_arg(*marker, BSTR);
+			break;
+
+		case L'S':
+		{
+			LPOLESTR szTemp = va_arg(*marker, LPOLESTR);
+
+			V_VT(pvArg)   = VT_BSTR;
+
+			if (isConst)
+			{
+				hr = dhCacheLiteral(szTemp, FALSE, &V_BSTR(pvArg), pbFreeArg);
+				break;
+			}
+
+			V_BSTR(pvArg) = SysAllocString(szTemp);
+
+			if (V_BSTR(pvArg) == NULL && szTemp != NULL) hr = E_OUTOFMEMORY;
+
+			*pbFreeArg = TRUE;
+			break;
+		}
+
+		case L's':
+			V_VT(pvArg) = VT_BSTR;
+
+			if (isConst)
+			{
+				hr = dhCacheLiteral(va_arg(*marker, LPSTR), TRUE, &V_BSTR(pvArg), pbFreeArg);
+				break;
+			}
+
+			hr = ConvertAnsiStrToBStr(va_arg(*marker, LPSTR), &V_BSTR(pvArg));
+			*pbFreeArg = TRUE;
+			break;
+
+		case L'o':
+			V_VT(pvArg)       = VT_DISPATCH;
+			V_DISPATCH(pvArg) = va_arg(*marker, IDispatch *);
+			break;
+
+		case L'O':
+			V_VT(pvArg)      = VT_UNKNOWN;
+			V_UNKNOWN(pvArg) = va_arg(*marker, IUnknown *);
+			break;
+
+		case L'D':
+			V_VT(pvArg)   = VT_DATE;
+			V_DATE(pvArg) = va_arg(*marker, DATE);
+			break;
+
+		case L't':
+			V_VT(pvArg) = VT_DATE;
+			hr = ConvertTimeTToVariantTime(va_arg(*marker, time_t), &V_DATE(pvArg));
+			break;
+
+		case L'W':
+			V_VT(pvArg) = VT_DATE;
+			hr = ConvertSystemTimeToVariantTime(va_arg(*marker, SYSTEMTIME *), &V_DATE(pvArg));
+			break;
+
+		case L'f':
+			V_VT(pvArg) = VT_DATE;
+			hr = ConvertFileTimeToVariantTime(va_arg(*marker, FILETIME *), &V_DATE(pvArg));
+			break;
+
+		case L'p':
+#ifndef _WIN64
+			V_VT(pvArg) = VT_I4;
+			V_I4(pvArg) = (LONG) va_arg(*marker, LPVOID);
+#else
+			V_VT(pvArg) = VT_I8;
+			V_I8(pvArg) = (LONGLONG) va_arg(*marker, LPVOID);
+#endif
+			break;
+
+		default:
+			hr = E_INVALIDARG;
+			DEBUG_NOTIFY_INVALID_IDENTIFIER(chIdentifier);
+			break;
+	}
+
+	return hr;
+}
+
+HRESULT dhSkipArguments(LPCOLESTR szMember, va_list * marker)
+{
+	VARIANT vtArg;
+	BOOL bFreeArg;
+	HRESULT hr = NOERROR;
+
+	while (*szMember && SUCCEEDED(hr))
+	{
+		if (*szMember++ == L'%')
+		{
+			hr = ExtractArgument(&vtArg, szMember, &bFreeArg, marker);
+			if (bFreeArg) VariantClear(&vtArg);
+		}
+	}
+
+	return hr;
+}
+
+HRESULT dhCaptureArguments(LPCOLESTR szMember, LPWSTR szCaptured, VARIANT * rgArgs, UINT cMaxArgs, UINT * pcArgs, va_list * marker)
+{
+	VARIANT vtArg;
+	BOOL bFreeArg;
+	HRESULT hr = NOERROR;
+
+	*pcArgs = 0;
+
+	while (*szMember && SUCCEEDED(hr))
+	{
+		if ((*szCaptured++ = *szMember++) != L'%') continue;
+
+		if (*pcArgs == cMaxArgs)
+		{
+			hr = E_INVALIDARG;
+			break;
+		}
+
+		hr = ExtractArgument(&vtArg, szMember, &bFreeArg, marker);
+		if (FAILED(hr)) break;
+
+		if (bFreeArg)
+		{
+			rgArgs[*pcArgs] = vtArg;
+		}
+		else
+		{
+			VariantInit(&rgArgs[*pcArgs]);
+			hr = VariantCopy(&rgArgs[*pcArgs], &vtArg);
+			if (FAILED(hr)) break;
+		}
+
+		(*pcArgs)++;
+
+		if (*szMember == L'&') szMember++;
+		while (*szMember == L'h' || *szMember == L'l' || *szMember == L'L' || *szMember == L'k') szMember++;
+		if (*szMember) szMember++;
+
+		*szCaptured++ = L'v';
+	}
+
+	*szCaptured = L'\0';
+
+	if (FAILED(hr))
+	{
+		while (*pcArgs) VariantClear(&rgArgs[--(*pcArgs)]);
+	}
+
+	return hr;
+}
+
+HRESULT dhInvokeCaptured(int invokeType, VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szCaptured, VARIANT * rgArgs)
+{
+	VARIANT * a = rgArgs;
+
+	return dhInvoke(invokeType, returnType, pvResult, pDisp, szCaptured,
+	                &a[0],  &a[1],  &a[2],  &a[3],  &a[4],  &a[5],  &a[6],  &a[7],
+	                &a[8],  &a[9],  &a[10], &a[11], &a[12], &a[13], &a[14], &a[15],
+	                &a[16], &a[17], &a[18], &a[19], &a[20], &a[21], &a[22], &a[23],
+	                &a[24], &a[25], &a[26], &a[27], &a[28], &a[29], &a[30], &a[31]);
+}
+
+/* ----- dh_cache.c ----- */
+
+#define DH_CACHE_BUCKETS 16
+
+typedef struct tagDH_CACHE_NAMES
+{
+	struct tagDH_CACHE_NAMES * pNext;
+	ULONG  ulHash;
+	UINT   cNames;
+	UINT   cchNames;
+	DISPID * rgDispId;
+	LPWSTR szNames;
+	LPCOLESTR szAtom;
+} DH_CACHE_NAMES;
+
+typedef struct tagDH_CACHE_OBJECT
+{
+	IDispatch * pDisp;
+	DWORD dwLastUse;
+	DH_CACHE_NAMES * rgBuckets[DH_CACHE_BUCKETS];
+	BOOL bTypeChecked;
+	BOOL bTypeKept;
+	ITypeInfo * pTypeInfo;
+	DH_TYPE_KEY typeKey;
+} DH_CACHE_OBJECT;
+
+typedef struct tagDH_THREAD_CACHE
+{
+	UINT  cObjects;
+	DWORD dwClock;
+	DH_CACHE_OBJECT rgObjects[1];
+} DH_THREAD_CACHE;
+
+#define DH_MAX_LITERALS 4096
+
+typedef struct tagDH_LITERAL
+{
+	LPCVOID pString;
+	BSTR bstr;
+} DH_LITERAL;
+
+typedef struct tagDH_LITERAL_TABLE
+{
+	UINT cEntries;
+	UINT cSlots;
+	DH_LITERAL * rgSlots;
+} DH_LITERAL_TABLE;
+
+static LONG  f_cCacheObjects = 0;
+static LONG  f_lngCacheTlsInitBegin = -1, f_lngCacheTlsInitEnd = -1;
+static DWORD f_TlsIdxCache, f_TlsIdxLiterals;
+
+#define GetThreadCache()          ((DH_THREAD_CACHE *) TlsGetValue(f_TlsIdxCache))
+#define SetThreadCache(pCache)    TlsSetValue(f_TlsIdxCache, pCache)
+#define GetThreadLiterals()       ((DH_LITERAL_TABLE *) TlsGetValue(f_TlsIdxLiterals))
+#define SetThreadLiterals(pTable) TlsSetValue(f_TlsIdxLiterals, pTable)
+#define CheckCacheTlsInitialized() if (f_lngCacheTlsInitEnd != 0) InitializeCacheTlsIndex();
+
+static void InitializeCacheTlsIndex(void)
+{
+	if (0 == InterlockedIncrement(&f_lngCacheTlsInitBegin))
+	{
+		f_TlsIdxCache        = TlsAlloc();
+		f_TlsIdxLiterals     = TlsAlloc();
+		f_lngCacheTlsInitEnd = 0;
+	}
+	else
+	{
+		while (f_lngCacheTlsInitEnd != 0) Sleep(5);
+	}
+}
+
+static WCHAR dhFoldChar(WCHAR ch)
+{
+	return (ch >= L'A' && ch <= L'Z') ? (WCHAR) (ch + (L'a' - L'A')) : ch;
+}
+
+ULONG dhHashName(ULONG ulHash, LPCOLESTR szName)
+{
+	if (ulHash == 0) ulHash = 2166136261UL;
+
+	while (*szName)
+	{
+		ulHash = (ulHash ^ dhFoldChar(*szName++)) * 16777619UL;
+	}
+
+	return ulHash * 16777619UL;
+}
+
+HRESULT dhInitAtom(PDH_ATOM pAtom, LPCOLESTR szName)
+{
+	if (!pAtom || !szName) return E_INVALIDARG;
+
+	pAtom->szName  = szName;
+	pAtom->cchName = (UINT) wcslen(szName);
+	pAtom->ulHash  = dhHashName(0, szName);
+
+	return NOERROR;
+}
+
+BOOL dhNamesMatch(LPCWSTR szCached, UINT cCachedNames, LPOLESTR * rgszNames, UINT cNames)
+{
+	LPCWSTR szName;
+	UINT iName;
+
+	if (cCachedNames != cNames) return FALSE;
+
+	for (iName = 0; iName < cNames; iName++)
+	{
+		szName = rgszNames[iName];
+
+		while (*szName && dhFoldChar(*szName) == dhFoldChar(*szCached))
+		{
+			szName++;
+			szCached++;
+		}
+
+		if (*szName || *szCached) return FALSE;
+
+		szCached++;
+	}
+
+	return TRUE;
+}
+
+static void FreeCachedObject(DH_CACHE_OBJECT * pObject)
+{
+	DH_CACHE_NAMES * pNames, * pNext;
+	UINT iBucket;
+
+	if (!pObject->pDisp) return;
+
+	for (iBucket = 0; iBucket < DH_CACHE_BUCKETS; iBucket++)
+	{
+		for (pNames = pObject->rgBuckets[iBucket]; pNames; pNames = pNext)
+		{
+			pNext = pNames->pNext;
+			HeapFree(GetProcessHeap(), 0, pNames);
+		}
+	}
+
+	if (pObject->pTypeInfo) pObject->pTypeInfo->lpVtbl->Release(pObject->pTypeInfo);
+
+	pObject->pDisp->lpVtbl->Release(pObject->pDisp);
+	ZeroMemory(pObject, sizeof(DH_CACHE_OBJECT));
+}
+
+static DH_CACHE_OBJECT * GetCachedObject(IDispatch * pDisp, BOOL bAdd)
+{
+	DH_THREAD_CACHE * pCache;
+	DH_CACHE_OBJECT * pObject, * pVictim = NULL;
+	UINT cObjects = (UINT) f_cCacheObjects;
+	UINT iObject;
+
+	if (cObjects == 0) return NULL;
+
+	CheckCacheTlsInitialized();
+	pCache = GetThreadCache();
+
+	if (pCache && pCache->cObjects != cObjects)
+	{
+		dhCleanupThreadCache();
+		pCache = NULL;
+	}
+
+	if (!pCache)
+	{
+		if (!bAdd) return NULL;
+
+		pCache = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
+		                   sizeof(DH_THREAD_CACHE) + (cObjects - 1) * sizeof(DH_CACHE_OBJECT));
+		if (!pCache) return NULL;
+
+		pCache->cObjects = cObjects;
+		SetThreadCache(pCache);
+	}
+
+	pCache->dwClock++;
+
+	for (iObject = 0; iObject < cObjects; iObject++)
+	{
+		pObject = &pCache->rgObjects[iObject];
+
+		if (pObject->pDisp == pDisp)
+		{
+			pObject->dwLastUse = pCache->dwClock;
+			return pObject;
+		}
+
+		if (!pVictim || pObject->dwLastUse < pVictim->dwLastUse) pVictim = pObject;
+	}
+
+	if (!bAdd) return NULL;
+
+	FreeCachedObject(pVictim);
+
+	pVictim->pDisp     = pDisp;
+	pVictim->dwLastUse = pCache->dwClock;
+	pDisp->lpVtbl->AddRef(pDisp);
+
+	return pVictim;
+}
+
+static void CheckObjectType(DH_CACHE_OBJECT * pObject)
+{
+	DH_THREAD_CACHE * pCache = GetThreadCache();
+	IDispatch * pDisp = pObject->pDisp;
+	UINT iObject;
+
+	pObject->bTypeChecked = TRUE;
+
+	if (FAILED(pDisp->lpVtbl->GetTypeInfo(pDisp, 0, LOCALE_USER_DEFAULT, &pObject->pTypeInfo)))
+	{
+		pObject->pTypeInfo = NULL;
+		return;
+	}
+
+	for (iObject = 0; iObject < pCache->cObjects; iObject++)
+	{
+		DH_CACHE_OBJECT * pOther = &pCache->rgObjects[iObject];
+
+		if (pOther != pObject && pOther->pTypeInfo == pObject->pTypeInfo)
+		{
+			pObject->bTypeKept = pOther->bTypeKept;
+			pObject->typeKey   = pOther->typeKey;
+			return;
+		}
+	}
+
+	pObject->bTypeKept = SUCCEEDED(dhSnapshotReadTypeKey(pObject->pTypeInfo, &pObject->typeKey));
+}
+
+static DH_CACHE_NAMES * FindCachedNames(DH_CACHE_OBJECT * pObject, ULONG ulHash, const DH_ATOM * pAtom, LPOLESTR * rgszNames, UINT cNames)
+{
+	DH_CACHE_NAMES * pNames;
+
+	for (pNames = pObject->rgBuckets[ulHash % DH_CACHE_BUCKETS]; pNames; pNames = pNames->pNext)
+	{
+		if (pNames->ulHash != ulHash) continue;
+
+		if (pAtom)
+		{
+			if (pNames->szAtom == pAtom->szName) break;
+			if (pNames->cchNames != pAtom->cchName + 1) continue;
+		}
+
+		if (dhNamesMatch(pNames->szNames, pNames->cNames, rgszNames, cNames))
+		{
+			if (pAtom) pNames->szAtom = pAtom->szName;
+			break;
+		}
+	}
+
+	return pNames;
+}
+
+static void AddCachedNames(DH_CACHE_OBJECT * pObject, ULONG ulHash, const DH_ATOM * pAtom, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DH_CACHE_NAMES * pNames;
+	UINT iName, cchNames = 0;
+	LPWSTR szDest;
+
+	for (iName = 0; iName < cNames; iName++)
+	{
+		cchNames += wcslen(rgszNames[iName]) + 1;
+	}
+
+	pNames = HeapAlloc(GetProcessHeap(), 0, sizeof(DH_CACHE_NAMES) +
+	                   cNames * sizeof(DISPID) + cchNames * sizeof(WCHAR));
+
+	if (!pNames) return;
+
+	pNames->ulHash   = ulHash;
+	pNames->cNames   = cNames;
+	pNames->cchNames = cchNames;
+	pNames->szAtom   = (pAtom ? pAtom->szName : NULL);
+	pNames->rgDispId = (DISPID *) (pNames + 1);
+	pNames->szNames  = (LPWSTR) (pNames->rgDispId + cNames);
+
+	CopyMemory(pNames->rgDispId, rgDispId, cNames * sizeof(DISPID));
+
+	for (iName = 0, szDest = pNames->szNames; iName < cNames; iName++)
+	{
+		LPCWSTR szSrc = rgszNames[iName];
+		while ((*szDest++ = *szSrc++));
+	}
+
+	pNames->pNext = pObject->rgBuckets[ulHash % DH_CACHE_BUCKETS];
+	pObject->rgBuckets[ulHash % DH_CACHE_BUCKETS] = pNames;
+}
+
+static HRESULT CacheGetIDsOfNames(IDispatch * pDisp, ULONG ulHash, const DH_ATOM * pAtom, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DH_CACHE_OBJECT * pObject;
+	DH_CACHE_NAMES * pNames;
+	BOOL bFromFile = FALSE;
+	HRESULT hr = NOERROR;
+
+	pObject = GetCachedObject(pDisp, FALSE);
+
+	if (pObject && (pNames = FindCachedNames(pObject, ulHash, pAtom, rgszNames, cNames)) != NULL)
+	{
+		CopyMemory(rgDispId, pNames->rgDispId, cNames * sizeof(DISPID));
+		return NOERROR;
+	}
+
+	if (dhSnapshotEnabled() && f_cCacheObjects && (pObject || (pObject = GetCachedObject(pDisp, TRUE))))
+	{
+		if (!pObject->bTypeChecked) CheckObjectType(pObject);
+
+		bFromFile = (pObject->bTypeKept && dhSnapshotLookup(&pObject->typeKey, ulHash, rgszNames, cNames, rgDispId));
+	}
+
+	if (!bFromFile)
+	{
+		hr = pDisp->lpVtbl->GetIDsOfNames(pDisp, &IID_NULL, rgszNames, cNames, LOCALE_USER_DEFAULT, rgDispId);
+
+		if (FAILED(hr) || f_cCacheObjects == 0) return hr;
+
+		if (!pObject && !(pObject = GetCachedObject(pDisp, TRUE))) return hr;
+
+		if (pObject->bTypeKept) dhSnapshotRecord(&pObject->typeKey, pObject->pTypeInfo, ulHash, rgszNames, cNames, rgDispId);
+	}
+
+	AddCachedNames(pObject, ulHash, pAtom, rgszNames, cNames, rgDispId);
+
+	return hr;
+}
+
+HRESULT dhCacheGetIDsOfNames(IDispatch * pDisp, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	ULONG ulHash = 0;
+	UINT iName;
+
+	if (f_cCacheObjects)
+	{
+		for (iName = 0; iName < cNames; iName++)
+		{
+			ulHash = dhHashName(ulHash, rgszNames[iName]);
+		}
+	}
+
+	return CacheGetIDsOfNames(pDisp, ulHash, NULL, rgszNames, cNames, rgDispId);
+}
+
+HRESULT dhCacheGetIDOfAtom(IDispatch * pDisp, const DH_ATOM * pAtom, DISPID * pDispId)
+{
+	LPOLESTR szName = (LPOLESTR) pAtom->szName;
+
+	return CacheGetIDsOfNames(pDisp, pAtom->ulHash, pAtom, &szName, 1, pDispId);
+}
+
+void dhCacheAddNames(IDispatch * pDisp, const DH_TYPE_KEY * pKey, ITypeInfo * pTypeInfo, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DH_CACHE_OBJECT * pObject;
+	ULONG ulHash = 0;
+	UINT iName;
+
+	if (f_cCacheObjects == 0 || !(pObject = GetCachedObject(pDisp, TRUE))) return;
+
+	if (pKey && !pObject->bTypeChecked)
+	{
+		pObject->bTypeChecked = TRUE;
+		pObject->bTypeKept    = TRUE;
+		pObject->typeKey      = *pKey;
+		pObject->pTypeInfo    = pTypeInfo;
+		pTypeInfo->lpVtbl->AddRef(pTypeInfo);
+	}
+
+	for (iName = 0; iName < cNames; iName++)
+	{
+		ulHash = dhHashName(ulHash, rgszNames[iName]);
+	}
+
+	if (!FindCachedNames(pObject, ulHash, NULL, rgszNames, cNames)) AddCachedNames(pObject, ulHash, NULL, rgszNames, cNames, rgDispId);
+}
+
+HRESULT dhSetDispIdCacheSize(UINT cObjects)
+{
+	if (cObjects > 4096) return E_INVALIDARG;
+
+	InterlockedExchange(&f_cCacheObjects, (LONG) cObjects);
+
+	return NOERROR;
+}
+
+HRESULT dhFlushDispIdCache(IDispatch * pDisp)
+{
+	DH_THREAD_CACHE * pCache;
+	UINT iObject;
+
+	CheckCacheTlsInitialized();
+	pCache = GetThreadCache();
+
+	if (!pCache) return NOERROR;
+
+	for (iObject = 0; iObject < pCache->cObjects; iObject++)
+	{
+		if (!pDisp || pCache->rgObjects[iObject].pDisp == pDisp)
+		{
+			FreeCachedObject(&pCache->rgObjects[iObject]);
+		}
+	}
+
+	return NOERROR;
+}
+
+static DH_LITERAL * FindLiteralSlot(DH_LITERAL_TABLE * pTable, LPCVOID pString)
+{
+	UINT iSlot = (UINT) (((ULONG_PTR) pString >> 1) * 2654435761UL) & (pTable->cSlots - 1);
+
+	while (pTable->rgSlots[iSlot].pString && pTable->rgSlots[iSlot].pString != pString)
+	{
+		iSlot = (iSlot + 1) & (pTable->cSlots - 1);
+	}
+
+	return &pTable->rgSlots[iSlot];
+}
+
+static BOOL GrowLiteralTable(DH_LITERAL_TABLE * pTable)
+{
+	DH_LITERAL * rgOld = pTable->rgSlots;
+	UINT cOld = pTable->cSlots, iSlot;
+	UINT cSlots = (cOld ? cOld * 2 : 64);
+
+	pTable->rgSlots = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, cSlots * sizeof(DH_LITERAL));
+
+	if (!pTable->rgSlots)
+	{
+		pTable->rgSlots = rgOld;
+		return FALSE;
+	}
+
+	pTable->cSlots = cSlots;
+
+	for (iSlot = 0; iSlot < cOld; iSlot++)
+	{
+		if (rgOld[iSlot].pString) *FindLiteralSlot(pTable, rgOld[iSlot].pString) = rgOld[iSlot];
+	}
+
+	if (rgOld) HeapFree(GetProcessHeap(), 0, rgOld);
+
+	return TRUE;
+}
+
+HRESULT dhCacheLiteral(LPCVOID pString, BOOL bAnsi, BSTR * pbstr, BOOL * pbFree)
+{
+	DH_LITERAL_TABLE * pTable;
+	DH_LITERAL * pSlot = NULL;
+	HRESULT hr = NOERROR;
+
+	*pbFree = FALSE;
+	*pbstr  = NULL;
+
+	if (!pString) return NOERROR;
+
+	CheckCacheTlsInitialized();
+	pTable = GetThreadLiterals();
+
+	if (!pTable && (pTable = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_LITERAL_TABLE))))
+	{
+		SetThreadLiterals(pTable);
+	}
+
+	if (pTable && pTable->cSlots)
+	{
+		pSlot = FindLiteralSlot(pTable, pString);
+
+		if (pSlot->pString)
+		{
+			*pbstr = pSlot->bstr;
+			return NOERROR;
+		}
+	}
+
+	if (bAnsi)
+	{
+		hr = ConvertAnsiStrToBStr((LPCSTR) pString, pbstr);
+	}
+	else if (!(*pbstr = SysAllocString((LPCOLESTR) pString)))
+	{
+		hr = E_OUTOFMEMORY;
+	}
+
+	if (FAILED(hr)) return hr;
+
+	if (pTable && pTable->cEntries < DH_MAX_LITERALS &&
+	    ((pTable->cEntries + 1) * 4 < pTable->cSlots * 3 || GrowLiteralTable(pTable)))
+	{
+		pSlot = FindLiteralSlot(pTable, pString);
+
+		pSlot->pString = pString;
+		pSlot->bstr    = *pbstr;
+		pTable->cEntries++;
+	}
+	else
+	{
+		*pbFree = TRUE;
+	}
+
+	return NOERROR;
+}
+
+void dhCleanupThreadLiterals(void)
+{
+	DH_LITERAL_TABLE * pTable;
+	UINT iSlot;
+
+	CheckCacheTlsInitialized();
+	pTable = GetThreadLiterals();
+
+	if (pTable)
+	{
+		for (iSlot = 0; iSlot < pTable->cSlots; iSlot++)
+		{
+			SysFreeString(pTable->rgSlots[iSlot].bstr);
+		}
+
+		if (pTable->rgSlots) HeapFree(GetProcessHeap(), 0, pTable->rgSlots);
+		HeapFree(GetProcessHeap(), 0, pTable);
+		SetThreadLiterals(NULL);
+	}
+}
+
+void dhCleanupThreadCache(void)
+{
+	DH_THREAD_CACHE * pCache;
+
+	CheckCacheTlsInitialized();
+	pCache = GetThreadCache();
+
+	if (pCache)
+	{
+		dhFlushDispIdCache(NULL);
+		HeapFree(GetProcessHeap(), 0, pCache);
+		SetThreadCache(NULL);
+	}
+}
+
+/* ----- dh_snapshot.c ----- */
+
+#define DH_SNAPSHOT_MAGIC        0x43444844
+#define DH_SNAPSHOT_VERSION      1
+#define DH_SNAPSHOT_DEFAULT_SIZE (1024 * 1024)
+#define DH_SNAPSHOT_MIN_SIZE     (64 * 1024)
+
+#define DH_SNAPSHOT_MAX_NAMES 64
+
+typedef struct tagDH_SNAPSHOT_HEADER
+{
+	DWORD dwMagic;
+	DWORD dwVersion;
+	DWORD cbFile;
+	volatile LONG cbUsed;
+} DH_SNAPSHOT_HEADER;
+
+typedef struct tagDH_SNAPSHOT_RECORD
+{
+	DWORD cbRecord;
+	DH_TYPE_KEY key;
+	ULONG ulHash;
+	UINT cNames;
+} DH_SNAPSHOT_RECORD;
+
+#define RecordDispIds(pRecord) ((DISPID *) ((pRecord) + 1))
+#define RecordNames(pRecord)   ((LPCWSTR) (RecordDispIds(pRecord) + (pRecord)->cNames))
+
+static LPWSTR f_szSnapshotFile = NULL;
+static DWORD f_cbSnapshotMax = DH_SNAPSHOT_DEFAULT_SIZE;
+static BOOL f_bSnapshotOpened = FALSE;
+
+static HANDLE f_hSnapshotFile = NULL;
+static HANDLE f_hSnapshotMapping = NULL;
+static HANDLE f_hSnapshotMutex = NULL;
+static DH_SNAPSHOT_HEADER * f_pSnapshot = NULL;
+
+static DWORD * f_rgSnapshotSlots = NULL;
+static UINT f_cSnapshotSlots = 0;
+static UINT f_cSnapshotEntries = 0;
+static DWORD f_cbSnapshotIndexed = 0;
+
+static DH_DISPID_FILE_STATISTICS f_SnapshotStatistics;
+
+static CRITICAL_SECTION f_csSnapshot;
+static LONG f_lngSnapshotInitBegin = -1, f_lngSnapshotInitEnd = -1;
+
+#define CheckSnapshotInitialized() if (f_lngSnapshotInitEnd != 0) InitializeSnapshot();
+
+static void InitializeSnapshot(void)
+{
+	if (0 == InterlockedIncrement(&f_lngSnapshotInitBegin))
+	{
+		InitializeCriticalSection(&f_csSnapshot);
+		f_lngSnapshotInitEnd = 0;
+	}
+	else
+	{
+		while (f_lngSnapshotInitEnd != 0) Sleep(5);
+	}
+}
+
+static ULONG HashRecordKey(const DH_TYPE_KEY * pKey, ULONG ulNamesHash)
+{
+	const BYTE * pb = (const BYTE *) pKey;
+	ULONG ulHash = ulNamesHash ^ 2166136261UL;
+	UINT ib;
+
+	for (ib = 0; ib < sizeof(DH_TYPE_KEY); ib++)
+	{
+		ulHash = (ulHash ^ pb[ib]) * 16777619UL;
+	}
+
+	return ulHash;
+}
+
+#define RecordAt(cbOffset) ((DH_SNAPSHOT_RECORD *) ((BYTE *) f_pSnapshot + (cbOffset)))
+
+static DWORD * FindSnapshotSlot(const DH_TYPE_KEY * pKey, ULONG ulHash, LPOLESTR * rgszNames, UINT cNames)
+{
+	DH_SNAPSHOT_RECORD * pRecord;
+	UINT iSlot = (UINT) HashRecordKey(pKey, ulHash) & (f_cSnapshotSlots - 1);
+
+	while (f_rgSnapshotSlots[iSlot])
+	{
+		pRecord = RecordAt(f_rgSnapshotSlots[iSlot]);
+
+		if (pRecord->ulHash == ulHash && pRecord->cNames == cNames &&
+		    memcmp(&pRecord->key, pKey, sizeof(DH_TYPE_KEY)) == 0 &&
+		    dhNamesMatch(RecordNames(pRecord), pRecord->cNames, rgszNames, cNames))
+		{
+			break;
+		}
+
+		iSlot = (iSlot + 1) & (f_cSnapshotSlots - 1);
+	}
+
+	return &f_rgSnapshotSlots[iSlot];
+}
+
+static BOOL IndexRecord(DWORD cbOffset, DWORD cbRecord)
+{
+	DH_SNAPSHOT_RECORD * pRecord = RecordAt(cbOffset);
+	LPOLESTR rgszNames[DH_SNAPSHOT_MAX_NAMES];
+	LPCWSTR szName;
+	DWORD * rgOld = f_rgSnapshotSlots, * pSlot;
+	UINT cOld = f_cSnapshotSlots, iSlot, iName;
+	DWORD cchLeft;
+
+	if (pRecord->cNames == 0 || pRecord->cNames > DH_SNAPSHOT_MAX_NAMES ||
+	    pRecord->cNames * sizeof(DISPID) > cbRecord - sizeof(DH_SNAPSHOT_RECORD))
+	{
+		return FALSE;
+	}
+
+	szName  = RecordNames(pRecord);
+	cchLeft = (cbRecord - sizeof(DH_SNAPSHOT_RECORD) - pRecord->cNames * sizeof(DISPID)) / sizeof(WCHAR);
+
+	for (iName = 0; iName < pRecord->cNames; iName++)
+	{
+		rgszNames[iName] = (LPOLESTR) szName;
+
+		while (cchLeft && *szName) { szName++; cchLeft--; }
+
+		if (cchLeft == 0) return FALSE;
+
+		szName++;
+		cchLeft--;
+	}
+
+	if ((f_cSnapshotEntries + 1) * 4 >= f_cSnapshotSlots * 3)
+	{
+		UINT cSlots = (cOld ? cOld * 2 : 256);
+
+		if (!(f_rgSnapshotSlots = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, cSlots * sizeof(DWORD))))
+		{
+			f_rgSnapshotSlots = rgOld;
+			return TRUE;
+		}
+
+		f_cSnapshotSlots = cSlots;
+
+		for (iSlot = 0; iSlot < cOld; iSlot++)
+		{
+			if (rgOld[iSlot])
+			{
+				DH_SNAPSHOT_RECORD * pOld = RecordAt(rgOld[iSlot]);
+				UINT iProbe = (UINT) HashRecordKey(&pOld->key, pOld->ulHash) & (cSlots - 1);
+
+				while (f_rgSnapshotSlots[iProbe]) iProbe = (iProbe + 1) & (cSlots - 1);
+				f_rgSnapshotSlots[iProbe] = rgOld[iSlot];
+			}
+		}
+
+		if (rgOld) HeapFree(GetProcessHeap(), 0, rgOld);
+	}
+
+	pSlot = FindSnapshotSlot(&pRecord->key, pRecord->ulHash, rgszNames, pRecord->cNames);
+
+	if (!*pSlot) f_cSnapshotEntries++;
+	*pSlot = cbOffset;
+
+	return TRUE;
+}
+
+static void IndexNewRecords(void)
+{
+	DWORD cbUsed = (DWORD) f_pSnapshot->cbUsed, cbRecord;
+
+	if (cbUsed > f_pSnapshot->cbFile) return;
+
+	while (f_cbSnapshotIndexed + sizeof(DH_SNAPSHOT_RECORD) <= cbUsed)
+	{
+		cbRecord = RecordAt(f_cbSnapshotIndexed)->cbRecord;
+
+		if (cbRecord < sizeof(DH_SNAPSHOT_RECORD) || cbRecord % sizeof(DWORD) || cbRecord > cbUsed - f_cbSnapshotIndexed ||
+		    !IndexRecord(f_cbSnapshotIndexed, cbRecord))
+		{
+			f_cbSnapshotIndexed = cbUsed;
+			break;
+		}
+
+		f_cbSnapshotIndexed += cbRecord;
+	}
+}
+
+static void CloseSnapshot(void)
+{
+	if (f_pSnapshot)        UnmapViewOfFile(f_pSnapshot);
+	if (f_hSnapshotMapping) CloseHandle(f_hSnapshotMapping);
+	if (f_hSnapshotFile)    CloseHandle(f_hSnapshotFile);
+	if (f_hSnapshotMutex)   CloseHandle(f_hSnapshotMutex);
+	if (f_rgSnapshotSlots)  HeapFree(GetProcessHeap(), 0, f_rgSnapshotSlots);
+
+	f_pSnapshot = NULL;
+	f_hSnapshotMapping = f_hSnapshotFile = f_hSnapshotMutex = NULL;
+	f_rgSnapshotSlots = NULL;
+	f_cSnapshotSlots = f_cSnapshotEntries = 0;
+	f_cbSnapshotIndexed = 0;
+}
+
+static BOOL OpenSnapshot(void)
+{
+	WCHAR szMutex[48] = L"Local\\DispHelperDispIdFile";
+	ULONG ulHash = dhHashName(0, f_szSnapshotFile);
+	LARGE_INTEGER liSize;
+	BOOL bCreate;
+	UINT iDigit;
+
+	f_bSnapshotOpened = TRUE;
+
+	for (iDigit = 0; iDigit < 8; iDigit++)
+	{
+		szMutex[26 + iDigit] = L"0123456789abcdef"[(ulHash >> (28 - iDigit * 4)) & 0xF];
+	}
+
+	if (!(f_hSnapshotMutex = CreateMutexW(NULL, FALSE, szMutex))) return FALSE;
+
+	f_hSnapshotFile = CreateFileW(f_szSnapshotFile, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+	                              NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (f_hSnapshotFile == INVALID_HANDLE_VALUE)
+	{
+		f_hSnapshotFile = NULL;
+		CloseSnapshot();
+		return FALSE;
+	}
+
+	WaitForSingleObject(f_hSnapshotMutex, INFINITE);
+
+	bCreate = (!GetFileSizeEx(f_hSnapshotFile, &liSize) || liSize.QuadPart < sizeof(DH_SNAPSHOT_HEADER));
+
+	if (bCreate)
+	{
+		liSize.QuadPart = f_cbSnapshotMax;
+
+		if (!SetFilePointerEx(f_hSnapshotFile, liSize, NULL, FILE_BEGIN) || !SetEndOfFile(f_hSnapshotFile))
+		{
+			liSize.QuadPart = 0;
+		}
+	}
+
+	if (liSize.QuadPart >= sizeof(DH_SNAPSHOT_HEADER) && liSize.QuadPart <= MAXLONG &&
+	    (f_hSnapshotMapping = CreateFileMappingW(f_hSnapshotFile, NULL, PAGE_READWRITE, 0, 0, NULL)) != NULL)
+	{
+		f_pSnapshot = MapViewOfFile(f_hSnapshotMapping, FILE_MAP_WRITE, 0, 0, 0);
+	}
+
+	if (f_pSnapshot && (bCreate || f_pSnapshot->dwMagic != DH_SNAPSHOT_MAGIC || f_pSnapshot->dwVersion != DH_SNAPSHOT_VERSION ||
+	                    f_pSnapshot->cbFile != (DWORD) liSize.QuadPart))
+	{
+		f_pSnapshot->dwMagic   = DH_SNAPSHOT_MAGIC;
+		f_pSnapshot->dwVersion = DH_SNAPSHOT_VERSION;
+		f_pSnapshot->cbFile    = (DWORD) liSize.QuadPart;
+		InterlockedExchange(&f_pSnapshot->cbUsed, sizeof(DH_SNAPSHOT_HEADER));
+	}
+
+	ReleaseMutex(f_hSnapshotMutex);
+
+	if (!f_pSnapshot)
+	{
+		CloseSnapshot();
+		return FALSE;
+	}
+
+	f_cbSnapshotIndexed = sizeof(DH_SNAPSHOT_HEADER);
+	IndexNewRecords();
+
+	return TRUE;
+}
+
+BOOL dhSnapshotEnabled(void)
+{
+	return (f_szSnapshotFile != NULL);
+}
+
+HRESULT dhSnapshotReadTypeKey(ITypeInfo * pTypeInfo, DH_TYPE_KEY * pKey)
+{
+	ITypeLib * pTypeLib = NULL;
+	TYPEATTR * pTypeAttr;
+	TLIBATTR * pLibAttr;
+	UINT iIndex;
+	HRESULT hr;
+
+	ZeroMemory(pKey, sizeof(DH_TYPE_KEY));
+
+	if (SUCCEEDED(hr = pTypeInfo->lpVtbl->GetTypeAttr(pTypeInfo, &pTypeAttr)))
+	{
+		pKey->guidType     = pTypeAttr->guid;
+		pKey->wMajorVerNum = pTypeAttr->wMajorVerNum;
+		pKey->wMinorVerNum = pTypeAttr->wMinorVerNum;
+		pTypeInfo->lpVtbl->ReleaseTypeAttr(pTypeInfo, pTypeAttr);
+
+		hr = pTypeInfo->lpVtbl->GetContainingTypeLib(pTypeInfo, &pTypeLib, &iIndex);
+	}
+
+	if (SUCCEEDED(hr) && SUCCEEDED(hr = pTypeLib->lpVtbl->GetLibAttr(pTypeLib, &pLibAttr)))
+	{
+		pKey->guidLib         = pLibAttr->guid;
+		pKey->wLibMajorVerNum = pLibAttr->wMajorVerNum;
+		pKey->wLibMinorVerNum = pLibAttr->wMinorVerNum;
+		pKey->lcid            = pLibAttr->lcid;
+		pTypeLib->lpVtbl->ReleaseTLibAttr(pTypeLib, pLibAttr);
+	}
+
+	if (pTypeLib) pTypeLib->lpVtbl->Release(pTypeLib);
+
+	if (SUCCEEDED(hr) && (IsEqualGUID(&pKey->guidLib, &GUID_NULL) || IsEqualGUID(&pKey->guidType, &GUID_NULL))) hr = E_FAIL;
+
+	return hr;
+}
+
+HRESULT dhSnapshotGetTypeKey(IDispatch * pDisp, DH_TYPE_KEY * pKey, ITypeInfo ** ppTypeInfo)
+{
+	ITypeInfo * pTypeInfo = NULL;
+	HRESULT hr;
+
+	*ppTypeInfo = NULL;
+	ZeroMemory(pKey, sizeof(DH_TYPE_KEY));
+
+	hr = pDisp->lpVtbl->GetTypeInfo(pDisp, 0, LOCALE_USER_DEFAULT, &pTypeInfo);
+
+	if (SUCCEEDED(hr)) hr = dhSnapshotReadTypeKey(pTypeInfo, pKey);
+
+	if (FAILED(hr))
+	{
+		if (pTypeInfo) pTypeInfo->lpVtbl->Release(pTypeInfo);
+		return hr;
+	}
+
+	*ppTypeInfo = pTypeInfo;
+
+	return NOERROR;
+}
+
+BOOL dhSnapshotLookup(const DH_TYPE_KEY * pKey, ULONG ulHash, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DWORD * pSlot;
+	BOOL bFound = FALSE;
+
+	if (!f_szSnapshotFile) return FALSE;
+
+	EnterCriticalSection(&f_csSnapshot);
+
+	if (f_bSnapshotOpened || OpenSnapshot())
+	{
+		if (f_pSnapshot) IndexNewRecords();
+
+		if (f_cSnapshotSlots && *(pSlot = FindSnapshotSlot(pKey, ulHash, rgszNames, cNames)))
+		{
+			CopyMemory(rgDispId, RecordDispIds(RecordAt(*pSlot)), cNames * sizeof(DISPID));
+			bFound = TRUE;
+		}
+	}
+
+	if (bFound)
+		f_SnapshotStatistics.cHits++;
+	else
+		f_SnapshotStatistics.cMisses++;
+
+	LeaveCriticalSection(&f_csSnapshot);
+
+	return bFound;
+}
+
+void dhSnapshotAppend(const DH_TYPE_KEY * pKey, ULONG ulHash, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DH_SNAPSHOT_RECORD * pRecord;
+	DWORD cbRecord, cbUsed;
+	UINT iName, cchNames = 0;
+	LPWSTR szDest;
+
+	if (!f_szSnapshotFile || cNames == 0 || cNames > DH_SNAPSHOT_MAX_NAMES) return;
+
+	for (iName = 0; iName < cNames; iName++)
+	{
+		cchNames += wcslen(rgszNames[iName]) + 1;
+	}
+
+	cbRecord = sizeof(DH_SNAPSHOT_RECORD) + cNames * sizeof(DISPID) + cchNames * sizeof(WCHAR);
+	cbRecord = (cbRecord + sizeof(DWORD) - 1) & ~(sizeof(DWORD) - 1);
+
+	EnterCriticalSection(&f_csSnapshot);
+
+	if (!f_bSnapshotOpened) OpenSnapshot();
+
+	if (f_pSnapshot && WaitForSingleObject(f_hSnapshotMutex, INFINITE) != WAIT_FAILED)
+	{
+		IndexNewRecords();
+
+		cbUsed = (DWORD) f_pSnapshot->cbUsed;
+
+		if (cbUsed <= f_pSnapshot->cbFile && cbRecord <= f_pSnapshot->cbFile - cbUsed &&
+		    !(f_cSnapshotSlots && *FindSnapshotSlot(pKey, ulHash, rgszNames, cNames)))
+		{
+			pRecord = RecordAt(cbUsed);
+
+			pRecord->cbRecord = cbRecord;
+			pRecord->key      = *pKey;
+			pRecord->ulHash   = ulHash;
+			pRecord->cNames   = cNames;
+			CopyMemory(RecordDispIds(pRecord), rgDispId, cNames * sizeof(DISPID));
+
+			for (iName = 0, szDest = (LPWSTR) RecordNames(pRecord); iName < cNames; iName++)
+			{
+				LPCWSTR szSrc = rgszNames[iName];
+				while ((*szDest++ = *szSrc++));
+			}
+
+			InterlockedExchange(&f_pSnapshot->cbUsed, (LONG) (cbUsed + cbRecord));
+
+			IndexNewRecords();
+			f_SnapshotStatistics.cAppended++;
+		}
+
+		ReleaseMutex(f_hSnapshotMutex);
+	}
+
+	LeaveCriticalSection(&f_csSnapshot);
+}
+
+void dhSnapshotRecord(const DH_TYPE_KEY * pKey, ITypeInfo * pTypeInfo, ULONG ulHash, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DISPID rgTypeDispId[DH_SNAPSHOT_MAX_NAMES];
+
+	if (!f_szSnapshotFile || !f_pSnapshot || cNames > DH_SNAPSHOT_MAX_NAMES) return;
+
+	if (FAILED(pTypeInfo->lpVtbl->GetIDsOfNames(pTypeInfo, rgszNames, cNames, rgTypeDispId)) ||
+	    memcmp(rgTypeDispId, rgDispId, cNames * sizeof(DISPID)) != 0)
+	{
+		InterlockedIncrement((LONG *) &f_SnapshotStatistics.cUnverified);
+		return;
+	}
+
+	dhSnapshotAppend(pKey, ulHash, rgszNames, cNames, rgDispId);
+}
+
+HRESULT dhSetDispIdCacheFile(LPCWSTR szFile, DWORD cbMaxSize)
+{
+	LPWSTR szCopy = NULL;
+	SIZE_T cb;
+
+	CheckSnapshotInitialized();
+
+	if (szFile)
+	{
+		cb = (wcslen(szFile) + 1) * sizeof(WCHAR);
+		if (!(szCopy = HeapAlloc(GetProcessHeap(), 0, cb))) return E_OUTOFMEMORY;
+		CopyMemory(szCopy, szFile, cb);
+	}
+
+	EnterCriticalSection(&f_csSnapshot);
+
+	CloseSnapshot();
+
+	if (f_szSnapshotFile) HeapFree(GetProcessHeap(), 0, f_szSnapshotFile);
+
+	f_szSnapshotFile  = szCopy;
+	f_cbSnapshotMax   = (cbMaxSize >= DH_SNAPSHOT_MIN_SIZE ? cbMaxSize : DH_SNAPSHOT_DEFAULT_SIZE);
+	f_bSnapshotOpened = FALSE;
+
+	LeaveCriticalSection(&f_csSnapshot);
+
+	return NOERROR;
+}
+
+HRESULT dhGetDispIdCacheFileStatistics(PDH_DISPID_FILE_STATISTICS pStatistics, BOOL bReset)
+{
+	if (!pStatistics) return E_INVALIDARG;
+
+	CheckSnapshotInitialized();
+
+	EnterCriticalSection(&f_csSnapshot);
+
+	*pStatistics = f_SnapshotStatistics;
+	pStatistics->cEntries = f_cSnapshotEntries;
+	pStatistics->cbUsed   = (f_pSnapshot ? (DWORD) f_pSnapshot->cbUsed : 0);
+
+	if (bReset)
+	{
+		f_SnapshotStatistics.cHits = f_SnapshotStatistics.cMisses = 0;
+		InterlockedExchange((LONG *) &f_SnapshotStatistics.cAppended, 0);
+		InterlockedExchange((LONG *) &f_SnapshotStatistics.cUnverified, 0);
+	}
+
+	LeaveCriticalSection(&f_csSnapshot);
+
+	return NOERROR;
+}
+
+/* ----- dh_prewarm.c ----- */
+
+#define DH_PREWARM_MAX_TYPES 32
+
+static HRESULT GetLocalTypeInfo(const DH_TYPE_KEY * pKey, ITypeInfo * pTypeInfo, ITypeLib ** ppTypeLib, ITypeInfo ** ppLocalInfo)
+{
+	UINT iIndex;
+	HRESULT hr;
+
+	*ppLocalInfo = NULL;
+
+	hr = LoadRegTypeLib(&pKey->guidLib, pKey->wLibMajorVerNum, pKey->wLibMinorVerNum, pKey->lcid, ppTypeLib);
+
+	if (FAILED(hr)) hr = pTypeInfo->lpVtbl->GetContainingTypeLib(pTypeInfo, ppTypeLib, &iIndex);
+
+	if (FAILED(hr))
+	{
+		*ppTypeLib = NULL;
+		return hr;
+	}
+
+	hr = (*ppTypeLib)->lpVtbl->GetTypeInfoOfGuid(*ppTypeLib, &pKey->guidType, ppLocalInfo);
+
+	if (FAILED(hr))
+	{
+		(*ppTypeLib)->lpVtbl->Release(*ppTypeLib);
+		*ppTypeLib = NULL;
+	}
+
+	return hr;
+}
+
+static BOOL GetDispatchTypeKey(ITypeInfo * pTypeInfo, const DH_TYPE_KEY * pLibKey, DH_TYPE_KEY * pKey, UINT * pcFuncs, UINT * pcVars)
+{
+	TYPEATTR * pTypeAttr;
+	BOOL bDispatch;
+
+	if (FAILED(pTypeInfo->lpVtbl->GetTypeAttr(pTypeInfo, &pTypeAttr))) return FALSE;
+
+	bDispatch = (pTypeAttr->typekind == TKIND_DISPATCH ||
+	             (pTypeAttr->typekind == TKIND_INTERFACE && (pTypeAttr->wTypeFlags & TYPEFLAG_FDUAL)));
+
+	*pKey = *pLibKey;
+	pKey->guidType     = pTypeAttr->guid;
+	pKey->wMajorVerNum = pTypeAttr->wMajorVerNum;
+	pKey->wMinorVerNum = pTypeAttr->wMinorVerNum;
+
+	if (pcFuncs) *pcFuncs = pTypeAttr->cFuncs;
+	if (pcVars)  *pcVars  = pTypeAttr->cVars;
+
+	pTypeInfo->lpVtbl->ReleaseTypeAttr(pTypeInfo, pTypeAttr);
+
+	return bDispatch;
+}
+
+static void PrewarmMember(IDispatch * pDisp, const DH_TYPE_KEY * pKey, ITypeInfo * pTypeInfo, LPOLESTR szName, DISPID dispID)
+{
+	if (pDisp) dhCacheAddNames(pDisp, pKey, pTypeInfo, &szName, 1, &dispID);
+
+	dhSnapshotAppend(pKey, dhHashName(0, szName), &szName, 1, &dispID);
+}
+
+HRESULT dhPrewarm(IDispatch * pDisp, LPCOLESTR szNames)
+{
+	DH_TYPE_KEY key, typeKey;
+	ITypeInfo * pTypeInfo = NULL, * pLocalInfo = NULL;
+	ITypeInfo * rgpFound[DH_PREWARM_MAX_TYPES];
+	MEMBERID rgMemIdFound[DH_PREWARM_MAX_TYPES];
+	ITypeLib * pTypeLib = NULL;
+	WCHAR szName[DH_MAX_MEMBER];
+	LPOLESTR pszName = szName;
+	LPCOLESTR szEnd;
+	USHORT cFound, iFound;
+	UINT cchName, cMissing = 0;
+	DISPID dispID;
+	BOOL bFound;
+
+	DH_ENTER(L"Prewarm");
+
+	if (!pDisp || !szNames) return DH_EXIT(E_INVALIDARG, szNames);
+
+	if (SUCCEEDED(dhSnapshotGetTypeKey(pDisp, &key, &pTypeInfo)))
+	{
+		GetLocalTypeInfo(&key, pTypeInfo, &pTypeLib, &pLocalInfo);
+	}
+
+	for (;;)
+	{
+		while (*szNames == L';' || *szNames == L' ') szNames++;
+
+		if (!*szNames) break;
+
+		for (szEnd = szNames; *szEnd && *szEnd != L';'; szEnd++);
+
+		for (cchName = (UINT) (szEnd - szNames); cchName && szNames[cchName - 1] == L' '; cchName--);
+
+		if (cchName >= ARRAYSIZE(szName))
+		{
+			cMissing++;
+			szNames = szEnd;
+			continue;
+		}
+
+		CopyMemory(szName, szNames, cchName * sizeof(WCHAR));
+		szName[cchName] = L'\0';
+		szNames = szEnd;
+
+		if (pLocalInfo && SUCCEEDED(pLocalInfo->lpVtbl->GetIDsOfNames(pLocalInfo, &pszName, 1, &dispID)))
+		{
+			PrewarmMember(pDisp, &key, pLocalInfo, pszName, dispID);
+			continue;
+		}
+
+		bFound = FALSE;
+
+		if (pTypeLib)
+		{
+			cFound = DH_PREWARM_MAX_TYPES;
+
+			if (SUCCEEDED(pTypeLib->lpVtbl->FindName(pTypeLib, pszName, 0, rgpFound, rgMemIdFound, &cFound)))
+			{
+				for (iFound = 0; iFound < cFound; iFound++)
+				{
+					if (GetDispatchTypeKey(rgpFound[iFound], &key, &typeKey, NULL, NULL))
+					{
+						PrewarmMember(NULL, &typeKey, NULL, pszName, rgMemIdFound[iFound]);
+						bFound = TRUE;
+					}
+
+					rgpFound[iFound]->lpVtbl->Release(rgpFound[iFound]);
+				}
+			}
+		}
+
+		if (!bFound && FAILED(dhCacheGetIDsOfNames(pDisp, &pszName, 1, &dispID))) cMissing++;
+	}
+
+	if (pLocalInfo) pLocalInfo->lpVtbl->Release(pLocalInfo);
+	if (pTypeLib)   pTypeLib->lpVtbl->Release(pTypeLib);
+	if (pTypeInfo)  pTypeInfo->lpVtbl->Release(pTypeInfo);
+
+	return DH_EXIT(cMissing ? S_FALSE : NOERROR, NULL);
+}
+
+HRESULT dhPrewarmTypeLib(IDispatch * pDisp)
+{
+	DH_TYPE_KEY key, typeKey;
+	ITypeInfo * pTypeInfo = NULL, * pLocalInfo = NULL, * pMemberInfo;
+	ITypeLib * pTypeLib = NULL;
+	FUNCDESC * pFuncDesc;
+	VARDESC * pVarDesc;
+	MEMBERID memid;
+	BSTR bstrName;
+	UINT cTypes, iType, cFuncs, cVars, iMember, cNames;
+	BOOL bOwnType;
+	HRESULT hr;
+
+	DH_ENTER(L"PrewarmTypeLib");
+
+	if (!pDisp) return DH_EXIT(E_INVALIDARG, NULL);
+
+	hr = dhSnapshotGetTypeKey(pDisp, &key, &pTypeInfo);
+
+	if (SUCCEEDED(hr)) hr = GetLocalTypeInfo(&key, pTypeInfo, &pTypeLib, &pLocalInfo);
+
+	if (FAILED(hr))
+	{
+		if (pTypeInfo) pTypeInfo->lpVtbl->Release(pTypeInfo);
+		return DH_EXIT(hr, NULL);
+	}
+
+	cTypes = pTypeLib->lpVtbl->GetTypeInfoCount(pTypeLib);
+
+	for (iType = 0; iType < cTypes; iType++)
+	{
+		if (FAILED(pTypeLib->lpVtbl->GetTypeInfo(pTypeLib, iType, &pMemberInfo))) continue;
+
+		if (GetDispatchTypeKey(pMemberInfo, &key, &typeKey, &cFuncs, &cVars))
+		{
+			bOwnType = IsEqualGUID(&typeKey.guidType, &key.guidType);
+
+			for (iMember = 0; iMember < cFuncs + cVars; iMember++)
+			{
+				if (iMember < cFuncs)
+				{
+					if (FAILED(pMemberInfo->lpVtbl->GetFuncDesc(pMemberInfo, iMember, &pFuncDesc))) continue;
+
+					memid = (pFuncDesc->wFuncFlags & FUNCFLAG_FRESTRICTED) ? MEMBERID_NIL : pFuncDesc->memid;
+					pMemberInfo->lpVtbl->ReleaseFuncDesc(pMemberInfo, pFuncDesc);
+				}
+				else
+				{
+					if (FAILED(pMemberInfo->lpVtbl->GetVarDesc(pMemberInfo, iMember - cFuncs, &pVarDesc))) continue;
+
+					memid = pVarDesc->memid;
+					pMemberInfo->lpVtbl->ReleaseVarDesc(pMemberInfo, pVarDesc);
+				}
+
+				if (memid == MEMBERID_NIL) continue;
+
+				if (SUCCEEDED(pMemberInfo->lpVtbl->GetNames(pMemberInfo, memid, &bstrName, 1, &cNames)) && cNames == 1)
+				{
+					PrewarmMember(bOwnType ? pDisp : NULL, &typeKey, pLocalInfo, bstrName, memid);
+					SysFreeString(bstrName);
+				}
+			}
+		}
+
+		pMemberInfo->lpVtbl->Release(pMemberInfo);
+	}
+
+	pLocalInfo->lpVtbl->Release(pLocalInfo);
+	pTypeLib->lpVtbl->Release(pTypeLib);
+	pTypeInfo->lpVtbl->Release(pTypeInfo);
+
+	return DH_EXIT(NOERROR, NULL);
+}
+
+/* ----- dh_flight.c ----- */
+
+typedef struct tagDH_FLIGHT_MEMBER
+{
+	struct tagDH_FLIGHT_MEMBER * volatile pNext;
+	volatile BOOL bEnabled;
+	WCHAR szMember[1];
+} DH_FLIGHT_MEMBER;
+
+typedef struct tagDH_FLIGHT
+{
+	struct tagDH_FLIGHT * pNext;
+	LONG cRefs;
+
+	IDispatch * pDisp;
+	LPCOLESTR szMember;
+	VARTYPE returnType;
+	UINT cArgs;
+	VARIANT rgArgs[DH_MAX_CAPTURED_ARGS];
+
+	DWORD dwLeaderThreadId;
+	HANDLE hDone;
+	HRESULT hr;
+	VARIANT vtResult;
+
+	BOOL bDispatchError;
+	UINT iArgError;
+	WCHAR szErrorMember[64];
+	EXCEPINFO excepInfo;
+} DH_FLIGHT;
+
+static DH_FLIGHT_MEMBER * volatile f_pFlightMembers = NULL;
+static DH_FLIGHT * f_pFlights = NULL;
+static LONG f_cFlightMembers = 0;
+static DH_SINGLEFLIGHT_STATISTICS f_FlightStatistics;
+
+static CRITICAL_SECTION f_csFlight;
+static LONG f_lngFlightInitBegin = -1, f_lngFlightInitEnd = -1;
+
+#define CheckFlightLockInitialized() if (f_lngFlightInitEnd != 0) InitializeFlightLock();
+
+static void InitializeFlightLock(void)
+{
+	if (0 == InterlockedIncrement(&f_lngFlightInitBegin))
+	{
+		InitializeCriticalSection(&f_csFlight);
+		f_lngFlightInitEnd = 0;
+	}
+	else
+	{
+		while (f_lngFlightInitEnd != 0) Sleep(5);
+	}
+}
+
+static DH_FLIGHT_MEMBER * FindFlightMember(LPCOLESTR szMember)
+{
+	DH_FLIGHT_MEMBER * pMember;
+
+	if (*szMember == L'.') szMember++;
+
+	for (pMember = f_pFlightMembers; pMember; pMember = pMember->pNext)
+	{
+		if (lstrcmpiW(pMember->szMember, szMember) == 0) break;
+	}
+
+	return pMember;
+}
+
+BOOL dhArgumentsMatch(VARIANT * rgArgs1, VARIANT * rgArgs2, UINT cArgs)
+{
+	UINT iArg;
+
+	for (iArg = 0; iArg < cArgs; iArg++)
+	{
+		VARIANT * pv1 = &rgArgs1[iArg], * pv2 = &rgArgs2[iArg];
+
+		if (V_VT(pv1) != V_VT(pv2) || (V_VT(pv1) & VT_BYREF)) return FALSE;
+
+		switch (V_VT(pv1))
+		{
+			case VT_EMPTY: case VT_NULL:
+				break;
+
+			case VT_DISPATCH: case VT_UNKNOWN:
+				if (V_UNKNOWN(pv1) != V_UNKNOWN(pv2)) return FALSE;
+				break;
+
+			case VT_ERROR:
+				if (V_ERROR(pv1) != V_ERROR(pv2)) return FALSE;
+				break;
+
+			default:
+				if (VarCmp(pv1, pv2, LOCALE_USER_DEFAULT, 0) != VARCMP_EQ) return FALSE;
+				break;
+		}
+	}
+
+	return TRUE;
+}
+
+static void ReleaseFlight(DH_FLIGHT * pFlight)
+{
+	UINT iArg;
+
+	if (InterlockedDecrement(&pFlight->cRefs) != 0) return;
+
+	for (iArg = 0; iArg < pFlight->cArgs; iArg++)
+	{
+		VariantClear(&pFlight->rgArgs[iArg]);
+	}
+
+	VariantClear(&pFlight->vtResult);
+	SysFreeString(pFlight->excepInfo.bstrDescription);
+	SysFreeString(pFlight->excepInfo.bstrSource);
+	SysFreeString(pFlight->excepInfo.bstrHelpFile);
+	CloseHandle(pFlight->hDone);
+	HeapFree(GetProcessHeap(), 0, pFlight);
+}
+
+static void SaveFlightException(DH_FLIGHT * pFlight, HRESULT hr)
+{
+#ifndef DISPHELPER_NO_EXCEPTIONS
+	PDH_EXCEPTION pException;
+
+	if (FAILED(dhGetLastException(&pException)) || !pException || pException->bOld || pException->hr != hr) return;
+
+	pFlight->bDispatchError = pException->bDispatchError;
+	pFlight->iArgError      = pException->iArgError;
+	CopyMemory(pFlight->szErrorMember, pException->szMember, sizeof(pFlight->szErrorMember));
+
+	if (hr == DISP_E_EXCEPTION)
+	{
+		pFlight->excepInfo.scode           = (SCODE) pException->swCode;
+		pFlight->excepInfo.dwHelpContext   = pException->dwHelpContext;
+		pFlight->excepInfo.bstrDescription = SysAllocString(pException->szDescription);
+		pFlight->excepInfo.bstrSource      = SysAllocString(pException->szSource);
+		pFlight->excepInfo.bstrHelpFile    = SysAllocString(pException->szHelpFile);
+	}
+#endif
+}
+
+static HRESULT ReportFlightException(DH_FLIGHT * pFlight)
+{
+	EXCEPINFO excepInfo;
+
+	DH_ENTER(L"SingleFlightGet");
+
+	ZeroMemory(&excepInfo, sizeof(excepInfo));
+	excepInfo.scode           = pFlight->excepInfo.scode;
+	excepInfo.dwHelpContext   = pFlight->excepInfo.dwHelpContext;
+	excepInfo.bstrDescription = SysAllocString(pFlight->excepInfo.bstrDescription);
+	excepInfo.bstrSource      = SysAllocString(pFlight->excepInfo.bstrSource);
+	excepInfo.bstrHelpFile    = SysAllocString(pFlight->excepInfo.bstrHelpFile);
+
+	return DH_EXITEX(pFlight->hr, pFlight->bDispatchError, (pFlight->szErrorMember[0] ? pFlight->szErrorMember : NULL),
+	                 NULL, &excepInfo, pFlight->iArgError);
+}
+
+static HRESULT LeadFlight(DH_FLIGHT * pFlight, LPCOLESTR szCaptured, VARIANT * pvResult)
+{
+	DH_FLIGHT ** ppFlight;
+	HRESULT hr;
+
+	hr = dhInvokeCaptured(DISPATCH_PROPERTYGET|DISPATCH_METHOD, pFlight->returnType, &pFlight->vtResult,
+	                      pFlight->pDisp, szCaptured, pFlight->rgArgs);
+
+	EnterCriticalSection(&f_csFlight);
+
+	for (ppFlight = &f_pFlights; *ppFlight; ppFlight = &(*ppFlight)->pNext)
+	{
+		if (*ppFlight == pFlight)
+		{
+			*ppFlight = pFlight->pNext;
+			break;
+		}
+	}
+
+	LeaveCriticalSection(&f_csFlight);
+
+	if (FAILED(hr)) SaveFlightException(pFlight, hr);
+
+	pFlight->hr = hr;
+	SetEvent(pFlight->hDone);
+
+	if (SUCCEEDED(hr))
+	{
+		VariantInit(pvResult);
+		hr = VariantCopy(pvResult, &pFlight->vtResult);
+	}
+
+	return hr;
+}
+
+static BOOL IsFlightMember(LPCOLESTR szMember)
+{
+	DH_FLIGHT_MEMBER * pMember;
+
+	if (f_cFlightMembers == 0) return FALSE;
+
+	pMember = FindFlightMember(szMember);
+
+	return pMember && pMember->bEnabled;
+}
+
+HRESULT dhSingleFlightGet(VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember,
+                          LPCOLESTR szCaptured, VARIANT * rgArgs, UINT cArgs)
+{
+	DH_FLIGHT * pFlight;
+	UINT iArg;
+	HRESULT hr;
+
+	if (!IsFlightMember(szMember))
+	{
+		hr = dhInvokeCaptured(DISPATCH_PROPERTYGET|DISPATCH_METHOD, returnType, pvResult, pDisp, szCaptured, rgArgs);
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+		return hr;
+	}
+
+	InterlockedIncrement((LONG *) &f_FlightStatistics.cCalls);
+
+	CheckFlightLockInitialized();
+
+	EnterCriticalSection(&f_csFlight);
+
+	for (pFlight = f_pFlights; pFlight; pFlight = pFlight->pNext)
+	{
+		if (pFlight->pDisp == pDisp && pFlight->returnType == returnType && pFlight->cArgs == cArgs &&
+		    wcscmp(pFlight->szMember, szMember) == 0 && dhArgumentsMatch(pFlight->rgArgs, rgArgs, cArgs))
+		{
+			break;
+		}
+	}
+
+	if (pFlight && pFlight->dwLeaderThreadId == GetCurrentThreadId())
+	{
+		LeaveCriticalSection(&f_csFlight);
+
+		InterlockedIncrement((LONG *) &f_FlightStatistics.cInvokes);
+
+		hr = dhInvokeCaptured(DISPATCH_PROPERTYGET|DISPATCH_METHOD, returnType, pvResult, pDisp, szCaptured, rgArgs);
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+		return hr;
+	}
+
+	if (pFlight)
+	{
+		DWORD dwIndex;
+
+		InterlockedIncrement(&pFlight->cRefs);
+
+		LeaveCriticalSection(&f_csFlight);
+
+		InterlockedIncrement((LONG *) &f_FlightStatistics.cCoalesced);
+
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+
+		CoWaitForMultipleHandles(0, INFINITE, 1, &pFlight->hDone, &dwIndex);
+
+		if (SUCCEEDED(hr = pFlight->hr))
+		{
+			VariantInit(pvResult);
+			hr = VariantCopy(pvResult, &pFlight->vtResult);
+		}
+		else
+		{
+			hr = ReportFlightException(pFlight);
+		}
+
+		ReleaseFlight(pFlight);
+
+		return hr;
+	}
+
+	pFlight = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_FLIGHT));
+
+	if (pFlight && !(pFlight->hDone = CreateEvent(NULL, TRUE, FALSE, NULL)))
+	{
+		HeapFree(GetProcessHeap(), 0, pFlight);
+		pFlight = NULL;
+	}
+
+	if (!pFlight)
+	{
+		LeaveCriticalSection(&f_csFlight);
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+		return E_OUTOFMEMORY;
+	}
+
+	pFlight->cRefs            = 1;
+	pFlight->dwLeaderThreadId = GetCurrentThreadId();
+	pFlight->pDisp            = pDisp;
+	pFlight->szMember         = szMember;
+	pFlight->returnType       = returnType;
+	pFlight->cArgs            = cArgs;
+
+	CopyMemory(pFlight->rgArgs, rgArgs, cArgs * sizeof(VARIANT));
+
+	pFlight->pNext = f_pFlights;
+	f_pFlights     = pFlight;
+
+	LeaveCriticalSection(&f_csFlight);
+
+	InterlockedIncrement((LONG *) &f_FlightStatistics.cInvokes);
+
+	hr = LeadFlight(pFlight, szCaptured, pvResult);
+
+	ReleaseFlight(pFlight);
+
+	return hr;
+}
+
+HRESULT dhSingleFlightGetV(VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
+{
+	WCHAR szCaptured[DH_MAX_MEMBER];
+	VARIANT rgArgs[DH_MAX_CAPTURED_ARGS];
+	UINT cArgs, iArg;
+	HRESULT hr;
+
+	if (f_cFlightMembers == 0 || !pDisp || !szMember || wcslen(szMember) >= DH_MAX_MEMBER || !IsFlightMember(szMember))
+	{
+		return dhInvokeV(DISPATCH_PROPERTYGET|DISPATCH_METHOD, returnType, pvResult, pDisp, szMember, marker);
+	}
+
+	hr = dhCaptureArguments(szMember, szCaptured, rgArgs, DH_MAX_CAPTURED_ARGS, &cArgs, marker);
+	if (FAILED(hr)) return hr;
+
+	for (iArg = cArgs; iArg < DH_MAX_CAPTURED_ARGS; iArg++) VariantInit(&rgArgs[iArg]);
+
+	return dhSingleFlightGet(returnType, pvResult, pDisp, szMember, szCaptured, rgArgs, cArgs);
+}
+
+HRESULT dhSetSingleFlight(LPCOLESTR szMember, BOOL bEnable)
+{
+	DH_FLIGHT_MEMBER * pMember;
+	HRESULT hr = NOERROR;
+
+	if (!szMember) return E_INVALIDARG;
+
+	if (*szMember == L'.') szMember++;
+
+	CheckFlightLockInitialized();
+
+	EnterCriticalSection(&f_csFlight);
+
+	pMember = FindFlightMember(szMember);
+
+	if (bEnable && !pMember)
+	{
+		pMember = HeapAlloc(GetProcessHeap(), 0, sizeof(DH_FLIGHT_MEMBER) + wcslen(szMember) * sizeof(WCHAR));
+
+		if (pMember)
+		{
+			wcscpy(pMember->szMember, szMember);
+			pMember->bEnabled = TRUE;
+			pMember->pNext    = f_pFlightMembers;
+
+			InterlockedExchangePointer((PVOID volatile *) &f_pFlightMembers, pMember);
+			InterlockedIncrement(&f_cFlightMembers);
+		}
+		else
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+	else if (pMember && !pMember->bEnabled != !bEnable)
+	{
+		pMember->bEnabled = (bEnable != FALSE);
+
+		if (bEnable)
+			InterlockedIncrement(&f_cFlightMembers);
+		else
+			InterlockedDecrement(&f_cFlightMembers);
+	}
+
+	LeaveCriticalSection(&f_csFlight);
+
+	return hr;
+}
+
+HRESULT dhGetSingleFlightStatistics(PDH_SINGLEFLIGHT_STATISTICS pStatistics, BOOL bReset)
+{
+	if (!pStatistics) return E_INVALIDARG;
+
+	if (bReset)
+	{
+		pStatistics->cCalls     = (ULONG) InterlockedExchange((LONG *) &f_FlightStatistics.cCalls, 0);
+		pStatistics->cInvokes   = (ULONG) InterlockedExchange((LONG *) &f_FlightStatistics.cInvokes, 0);
+		pStatistics->cCoalesced = (ULONG) InterlockedExchange((LONG *) &f_FlightStatistics.cCoalesced, 0);
+	}
+	else
+	{
+		*pStatistics = f_FlightStatistics;
+	}
+
+	return NOERROR;
+}
+
+/* ----- dh_propcache.c ----- */
+
+#define DH_PROPERTY_BUCKETS     64
+#define DH_MAX_PROPERTY_ENTRIES 512
+
+#define DH_PROPERTY_GENERATIONS 256
+
+typedef struct tagDH_PROPERTY_MEMBER
+{
+	struct tagDH_PROPERTY_MEMBER * pNext;
+	DWORD dwTimeToLive;
+	WCHAR szMember[1];
+} DH_PROPERTY_MEMBER;
+
+typedef struct tagDH_PROPERTY_ENTRY
+{
+	struct tagDH_PROPERTY_ENTRY * pNext;
+	IUnknown * pIdentity;
+	LONG lngGeneration;
+	LONG lngEpoch;
+	VARTYPE returnType;
+	DWORD dwStored;
+	DWORD dwTimeToLive;
+	UINT cArgs;
+	VARIANT * rgArgs;
+	LPWSTR szMember;
+	VARIANT vtValue;
+} DH_PROPERTY_ENTRY;
+
+typedef struct tagDH_PROPERTY_CACHE
+{
+	UINT cEntries;
+	DH_PROPERTY_ENTRY * rgBuckets[DH_PROPERTY_BUCKETS];
+} DH_PROPERTY_CACHE;
+
+static DH_PROPERTY_MEMBER * f_pPropertyMembers = NULL;
+static LONG f_cPropertyMembers = 0;
+static CRITICAL_SECTION f_csPropertyMembers;
+
+static volatile LONG f_rglngPropertyGenerations[DH_PROPERTY_GENERATIONS];
+static volatile LONG f_lngPropertyEpoch = 0;
+
+static LONG  f_lngPropertyInitBegin = -1, f_lngPropertyInitEnd = -1;
+static DWORD f_TlsIdxPropertyCache;
+
+#define GetThreadPropertyCache()       ((DH_PROPERTY_CACHE *) TlsGetValue(f_TlsIdxPropertyCache))
+#define SetThreadPropertyCache(pCache) TlsSetValue(f_TlsIdxPropertyCache, pCache)
+#define CheckPropertyCacheInitialized() if (f_lngPropertyInitEnd != 0) InitializePropertyCache();
+
+#define PropertyHash(pIdentity)       ((UINT) ((ULONG_PTR) (pIdentity) >> 4))
+#define PropertyBucket(pIdentity)     (PropertyHash(pIdentity) % DH_PROPERTY_BUCKETS)
+#define PropertyGeneration(pIdentity) (&f_rglngPropertyGenerations[PropertyHash(pIdentity) % DH_PROPERTY_GENERATIONS])
+
+static void InitializePropertyCache(void)
+{
+	if (0 == InterlockedIncrement(&f_lngPropertyInitBegin))
+	{
+		f_TlsIdxPropertyCache = TlsAlloc();
+		InitializeCriticalSection(&f_csPropertyMembers);
+		f_lngPropertyInitEnd = 0;
+	}
+	else
+	{
+		while (f_lngPropertyInitEnd != 0) Sleep(5);
+	}
+}
+
+static DH_PROPERTY_MEMBER ** FindPropertyMember(LPCOLESTR szMember)
+{
+	DH_PROPERTY_MEMBER ** ppMember;
+
+	if (*szMember == L'.') szMember++;
+
+	for (ppMember = &f_pPropertyMembers; *ppMember; ppMember = &(*ppMember)->pNext)
+	{
+		if (lstrcmpiW((*ppMember)->szMember, szMember) == 0) break;
+	}
+
+	return ppMember;
+}
+
+static void FreePropertyEntry(DH_PROPERTY_ENTRY * pEntry)
+{
+	UINT iArg;
+
+	for (iArg = 0; iArg < pEntry->cArgs; iArg++)
+	{
+		VariantClear(&pEntry->rgArgs[iArg]);
+	}
+
+	VariantClear(&pEntry->vtValue);
+	pEntry->pIdentity->lpVtbl->Release(pEntry->pIdentity);
+	HeapFree(GetProcessHeap(), 0, pEntry);
+}
+
+static BOOL IsStale(DH_PROPERTY_ENTRY * pEntry, DWORD dwNow)
+{
+	return (pEntry->dwTimeToLive != INFINITE && dwNow - pEntry->dwStored >= pEntry->dwTimeToLive) ||
+	       pEntry->lngGeneration != *PropertyGeneration(pEntry->pIdentity) || pEntry->lngEpoch != f_lngPropertyEpoch;
+}
+
+static void MakeRoom(DH_PROPERTY_CACHE * pCache, DWORD dwNow)
+{
+	DH_PROPERTY_ENTRY ** ppEntry, ** ppOldest = NULL, * pEntry;
+	UINT iBucket;
+
+	for (iBucket = 0; iBucket < DH_PROPERTY_BUCKETS; iBucket++)
+	{
+		for (ppEntry = &pCache->rgBuckets[iBucket]; (pEntry = *ppEntry) != NULL; )
+		{
+			if (IsStale(pEntry, dwNow))
+			{
+				*ppEntry = pEntry->pNext;
+				FreePropertyEntry(pEntry);
+				pCache->cEntries--;
+				continue;
+			}
+
+			if (!ppOldest || dwNow - pEntry->dwStored > dwNow - (*ppOldest)->dwStored) ppOldest = ppEntry;
+
+			ppEntry = &pEntry->pNext;
+		}
+	}
+
+	if (pCache->cEntries >= DH_MAX_PROPERTY_ENTRIES && ppOldest)
+	{
+		pEntry    = *ppOldest;
+		*ppOldest = pEntry->pNext;
+		FreePropertyEntry(pEntry);
+		pCache->cEntries--;
+	}
+}
+
+static DH_PROPERTY_ENTRY * CreatePropertyEntry(IUnknown * pIdentity, LPCOLESTR szMember, VARTYPE returnType,
+                                               VARIANT * rgArgs, UINT cArgs, DWORD dwTimeToLive)
+{
+	DH_PROPERTY_ENTRY * pEntry;
+	UINT iArg;
+
+	pEntry = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_PROPERTY_ENTRY) +
+	                   cArgs * sizeof(VARIANT) + (wcslen(szMember) + 1) * sizeof(WCHAR));
+
+	if (!pEntry) return NULL;
+
+	pEntry->rgArgs   = (VARIANT *) (pEntry + 1);
+	pEntry->szMember = (LPWSTR) (pEntry->rgArgs + cArgs);
+	wcscpy(pEntry->szMember, szMember);
+
+	for (iArg = 0; iArg < cArgs; iArg++)
+	{
+		if (FAILED(VariantCopy(&pEntry->rgArgs[iArg], &rgArgs[iArg])))
+		{
+			while (iArg) VariantClear(&pEntry->rgArgs[--iArg]);
+			HeapFree(GetProcessHeap(), 0, pEntry);
+			return NULL;
+		}
+	}
+
+	pEntry->pIdentity    = pIdentity;
+	pEntry->returnType   = returnType;
+	pEntry->cArgs        = cArgs;
+	pEntry->dwTimeToLive = dwTimeToLive;
+	pIdentity->lpVtbl->AddRef(pIdentity);
+
+	return pEntry;
+}
+
+static HRESULT GetPropertyTarget(IDispatch * pDisp, LPWSTR szCaptured, VARIANT * rgArgs, UINT * pcArgs,
+                                 IDispatch ** ppTarget, LPWSTR * pszName)
+{
+	LPWSTR szDot = (*szCaptured ? wcsrchr(szCaptured + 1, L'.') : NULL);
+	UINT cPathArgs = 0, iArg;
+	VARIANT vtTarget;
+	LPWSTR szPos;
+	HRESULT hr;
+
+	if (!szDot)
+	{
+		pDisp->lpVtbl->AddRef(pDisp);
+		*ppTarget = pDisp;
+		*pszName  = szCaptured;
+		return NOERROR;
+	}
+
+	for (szPos = szCaptured; szPos < szDot; szPos++)
+	{
+		if (*szPos == L'%') cPathArgs++;
+	}
+
+	*szDot = L'\0';
+	hr = dhInvokeCaptured(DISPATCH_PROPERTYGET|DISPATCH_METHOD, VT_DISPATCH, &vtTarget, pDisp, szCaptured, rgArgs);
+	*szDot = L'.';
+
+	for (iArg = 0; iArg < cPathArgs; iArg++) VariantClear(&rgArgs[iArg]);
+
+	MoveMemory(rgArgs, rgArgs + cPathArgs, (*pcArgs - cPathArgs) * sizeof(VARIANT));
+
+	for (iArg = *pcArgs - cPathArgs; iArg < *pcArgs; iArg++) VariantInit(&rgArgs[iArg]);
+
+	*pcArgs -= cPathArgs;
+
+	if (SUCCEEDED(hr) && !V_DISPATCH(&vtTarget)) hr = E_NOINTERFACE;
+	if (FAILED(hr)) return hr;
+
+	*ppTarget = V_DISPATCH(&vtTarget);
+	*pszName  = szDot;
+
+	return NOERROR;
+}
+
+HRESULT dhPropertyCacheGetV(VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
+{
+	WCHAR szCaptured[DH_MAX_MEMBER];
+	VARIANT rgArgs[DH_MAX_CAPTURED_ARGS];
+	DH_PROPERTY_MEMBER * pMember;
+	DH_PROPERTY_CACHE * pCache;
+	DH_PROPERTY_ENTRY ** ppEntry, * pEntry;
+	IDispatch * pTarget;
+	IUnknown * pIdentity;
+	LPWSTR szName;
+	DWORD dwTimeToLive = 0, dwNow;
+	LONG lngGeneration, lngEpoch;
+	UINT cArgs, iArg;
+	HRESULT hr;
+
+	if (f_cPropertyMembers == 0 || !pDisp || !szMember || wcslen(szMember) >= DH_MAX_MEMBER)
+	{
+		return dhSingleFlightGetV(returnType, pvResult, pDisp, szMember, marker);
+	}
+
+	CheckPropertyCacheInitialized();
+
+	EnterCriticalSection(&f_csPropertyMembers);
+	if ((pMember = *FindPropertyMember(szMember)) != NULL) dwTimeToLive = pMember->dwTimeToLive;
+	LeaveCriticalSection(&f_csPropertyMembers);
+
+	if (!dwTimeToLive) return dhSingleFlightGetV(returnType, pvResult, pDisp, szMember, marker);
+
+	hr = dhCaptureArguments(szMember, szCaptured, rgArgs, DH_MAX_CAPTURED_ARGS, &cArgs, marker);
+	if (FAILED(hr)) return hr;
+
+	for (iArg = cArgs; iArg < DH_MAX_CAPTURED_ARGS; iArg++) VariantInit(&rgArgs[iArg]);
+
+	for (iArg = 0; iArg < cArgs; iArg++)
+	{
+		if (V_VT(&rgArgs[iArg]) & VT_BYREF) return dhSingleFlightGet(returnType, pvResult, pDisp, szMember, szCaptured, rgArgs, cArgs);
+	}
+
+	if (FAILED(hr = GetPropertyTarget(pDisp, szCaptured, rgArgs, &cArgs, &pTarget, &szName)))
+	{
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+		return hr;
+	}
+
+	if (!(pCache = GetThreadPropertyCache()) && (pCache = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_PROPERTY_CACHE))))
+	{
+		SetThreadPropertyCache(pCache);
+	}
+
+	if (!pCache || FAILED(pTarget->lpVtbl->QueryInterface(pTarget, &IID_IUnknown, (void **) &pIdentity)))
+	{
+		hr = dhSingleFlightGet(returnType, pvResult, pTarget, szMember, szName, rgArgs, cArgs);
+		pTarget->lpVtbl->Release(pTarget);
+		return hr;
+	}
+
+	dwNow = GetTickCount();
+
+	for (ppEntry = &pCache->rgBuckets[PropertyBucket(pIdentity)]; (pEntry = *ppEntry) != NULL; ppEntry = &pEntry->pNext)
+	{
+		if (pEntry->pIdentity == pIdentity && pEntry->returnType == returnType && pEntry->cArgs == cArgs &&
+		    wcscmp(pEntry->szMember, szName) == 0 && dhArgumentsMatch(pEntry->rgArgs, rgArgs, cArgs))
+		{
+			break;
+		}
+	}
+
+	if (pEntry && !IsStale(pEntry, dwNow))
+	{
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+
+		pIdentity->lpVtbl->Release(pIdentity);
+		pTarget->lpVtbl->Release(pTarget);
+
+		VariantInit(pvResult);
+		return VariantCopy(pvResult, &pEntry->vtValue);
+	}
+
+	if (pEntry)
+	{
+		*ppEntry = pEntry->pNext;
+		FreePropertyEntry(pEntry);
+		pCache->cEntries--;
+	}
+
+	lngGeneration = *PropertyGeneration(pIdentity);
+	lngEpoch      = f_lngPropertyEpoch;
+
+	pEntry = CreatePropertyEntry(pIdentity, szName, returnType, rgArgs, cArgs, dwTimeToLive);
+
+	hr = dhSingleFlightGet(returnType, pvResult, pTarget, szMember, szName, rgArgs, cArgs);
+
+	pIdentity->lpVtbl->Release(pIdentity);
+	pTarget->lpVtbl->Release(pTarget);
+
+	if (!pEntry) return hr;
+
+	if (FAILED(hr) || FAILED(VariantCopy(&pEntry->vtValue, pvResult)))
+	{
+		FreePropertyEntry(pEntry);
+		return hr;
+	}
+
+	if (pCache->cEntries >= DH_MAX_PROPERTY_ENTRIES) MakeRoom(pCache, dwNow);
+
+	pEntry->lngGeneration = lngGeneration;
+	pEntry->lngEpoch      = lngEpoch;
+	pEntry->dwStored      = GetTickCount();
+	pEntry->pNext         = pCache->rgBuckets[PropertyBucket(pEntry->pIdentity)];
+	pCache->rgBuckets[PropertyBucket(pEntry->pIdentity)] = pEntry;
+	pCache->cEntries++;
+
+	return hr;
+}
+
+void dhPropertyCacheInvalidate(IDispatch * pDisp)
+{
+	IUnknown * pIdentity;
+
+	if (f_cPropertyMembers == 0) return;
+
+	if (FAILED(pDisp->lpVtbl->QueryInterface(pDisp, &IID_IUnknown, (void **) &pIdentity)))
+	{
+		InterlockedIncrement(&f_lngPropertyEpoch);
+		return;
+	}
+
+	InterlockedIncrement(PropertyGeneration(pIdentity));
+	pIdentity->lpVtbl->Release(pIdentity);
+}
+
+HRESULT dhSetPropertyCache(LPCOLESTR szMember, DWORD dwTimeToLive)
+{
+	DH_PROPERTY_MEMBER ** ppMember, * pMember;
+	HRESULT hr = NOERROR;
+
+	if (!szMember) return E_INVALIDARG;
+
+	if (*szMember == L'.') szMember++;
+
+	CheckPropertyCacheInitialized();
+
+	EnterCriticalSection(&f_csPropertyMembers);
+
+	ppMember = FindPropertyMember(szMember);
+
+	if (dwTimeToLive && *ppMember)
+	{
+		(*ppMember)->dwTimeToLive = dwTimeToLive;
+	}
+	else if (dwTimeToLive)
+	{
+		pMember = HeapAlloc(GetProcessHeap(), 0, sizeof(DH_PROPERTY_MEMBER) + wcslen(szMember) * sizeof(WCHAR));
+
+		if (pMember)
+		{
+			wcscpy(pMember->szMember, szMember);
+			pMember->dwTimeToLive = dwTimeToLive;
+			pMember->pNext = NULL;
+			*ppMember = pMember;
+			InterlockedIncrement(&f_cPropertyMembers);
+		}
+		else
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+	else if (*ppMember)
+	{
+		pMember   = *ppMember;
+		*ppMember = pMember->pNext;
+		HeapFree(GetProcessHeap(), 0, pMember);
+
+		InterlockedIncrement(&f_lngPropertyEpoch);
+		InterlockedDecrement(&f_cPropertyMembers);
+	}
+
+	LeaveCriticalSection(&f_csPropertyMembers);
+
+	return hr;
+}
+
+static void FreePropertyEntries(DH_PROPERTY_CACHE * pCache, IUnknown * pIdentity)
+{
+	DH_PROPERTY_ENTRY ** ppEntry, * pEntry;
+	UINT iBucket;
+
+	for (iBucket = 0; iBucket < DH_PROPERTY_BUCKETS && pCache->cEntries; iBucket++)
+	{
+		if (pIdentity && iBucket != PropertyBucket(pIdentity)) continue;
+
+		for (ppEntry = &pCache->rgBuckets[iBucket]; (pEntry = *ppEntry) != NULL; )
+		{
+			if (!pIdentity || pEntry->pIdentity == pIdentity)
+			{
+				*ppEntry = pEntry->pNext;
+				FreePropertyEntry(pEntry);
+				pCache->cEntries--;
+			}
+			else
+			{
+				ppEntry = &pEntry->pNext;
+			}
+		}
+	}
+}
+
+HRESULT dhFlushPropertyCache(IDispatch * pDisp)
+{
+	DH_PROPERTY_CACHE * pCache;
+	IUnknown * pIdentity = NULL;
+	HRESULT hr;
+
+	if (f_lngPropertyInitEnd != 0) return NOERROR;
+
+	if (pDisp)
+	{
+		if (FAILED(hr = pDisp->lpVtbl->QueryInterface(pDisp, &IID_IUnknown, (void **) &pIdentity))) return hr;
+
+		InterlockedIncrement(PropertyGeneration(pIdentity));
+	}
+	else
+	{
+		InterlockedIncrement(&f_lngPropertyEpoch);
+	}
+
+	if ((pCache = GetThreadPropertyCache()) != NULL) FreePropertyEntries(pCache, pIdentity);
+
+	if (pIdentity) pIdentity->lpVtbl->Release(pIdentity);
+
+	return NOERROR;
+}
+
+void dhCleanupThreadPropertyCache(void)
+{
+	DH_PROPERTY_CACHE * pCache;
+
+	CheckPropertyCacheInitialized();
+	pCache = GetThreadPropertyCache();
+
+	if (pCache)
+	{
+		FreePropertyEntries(pCache, NULL);
+		HeapFree(GetProcessHeap(), 0, pCache);
+		SetThreadPropertyCache(NULL);
+	}
+}
+
+/* ----- dh_intercept.c ----- */
+
+typedef struct tagDH_INTERCEPTOR
+{
+	DH_PRE_INVOKE pfnPreInvoke;
+	DH_POST_INVOKE pfnPostInvoke;
+	LPVOID pContext;
+	DWORD dwCookie;
+} DH_INTERCEPTOR;
+
+typedef struct tagDH_INTERCEPTOR_ARRAY
+{
+	struct tagDH_INTERCEPTOR_ARRAY * pNextRetired;
+	UINT cInterceptors;
+	DH_INTERCEPTOR rgInterceptors[1];
+} DH_INTERCEPTOR_ARRAY;
+
+#define DH_INTERCEPTOR_STRIPES 16
+
+typedef struct tagDH_READER_STRIPE
+{
+	volatile LONG cReaders;
+	BYTE rgbPadding[64 - sizeof(LONG)];
+} DH_READER_STRIPE;
+
+static DH_INTERCEPTOR_ARRAY * volatile f_pInterceptors = NULL;
+static DH_INTERCEPTOR_ARRAY * volatile f_pRetiredInterceptors = NULL;
+static DH_READER_STRIPE f_rgInterceptorReaders[DH_INTERCEPTOR_STRIPES];
+static LONG f_lngInterceptorWriter = 0;
+static DWORD f_dwNextInterceptorCookie = 0;
+
+#define ReaderStripe() (&f_rgInterceptorReaders[(GetCurrentThreadId() >> 2) % DH_INTERCEPTOR_STRIPES].cReaders)
+
+#define AcquireInterceptorWriter() while (InterlockedCompareExchange(&f_lngInterceptorWriter, 1, 0) != 0) Sleep(0)
+#define ReleaseInterceptorWriter() InterlockedExchange(&f_lngInterceptorWriter, 0)
+
+static void FreeRetiredInterceptors(void)
+{
+	DH_INTERCEPTOR_ARRAY * pOld, * pNext;
+	UINT iStripe;
+
+	for (iStripe = 0; iStripe < DH_INTERCEPTOR_STRIPES; iStripe++)
+	{
+		if (f_rgInterceptorReaders[iStripe].cReaders != 0) return;
+	}
+
+	for (pOld = f_pRetiredInterceptors; pOld; pOld = pNext)
+	{
+		pNext = pOld->pNextRetired;
+		HeapFree(GetProcessHeap(), 0, pOld);
+	}
+
+	f_pRetiredInterceptors = NULL;
+}
+
+static void LeaveInterceptors(volatile LONG * pcReaders)
+{
+	if (InterlockedDecrement(pcReaders) == 0 && f_pRetiredInterceptors &&
+	    InterlockedCompareExchange(&f_lngInterceptorWriter, 1, 0) == 0)
+	{
+		FreeRetiredInterceptors();
+		ReleaseInterceptorWriter();
+	}
+}
+
+static HRESULT InvokeIntercepted(IDispatch * pDisp, LPCOLESTR szMember, DISPID dispID, int invokeType,
+                                 DISPPARAMS * pDispParams, VARIANT * pvResult, EXCEPINFO * pExcepInfo, UINT * puArgErr)
+{
+	DH_INTERCEPTOR_ARRAY * pArray;
+	volatile LONG * pcReaders = ReaderStripe();
+	DH_INVOKE_CONTEXT call;
+	UINT cEntered = 0;
+	BOOL bShortCircuit = FALSE;
+	HRESULT hrPre;
+
+	InterlockedIncrement(pcReaders);
+
+	pArray = f_pInterceptors;
+
+	if (!pArray)
+	{
+		LeaveInterceptors(pcReaders);
+		return dhTimedInvoke(pDisp, dispID, invokeType, pDispParams, pvResult, pExcepInfo, puArgErr);
+	}
+
+	call.pDisp       = pDisp;
+	call.szMember    = szMember;
+	call.dispID      = dispID;
+	call.invokeType  = invokeType;
+	call.pDispParams = pDispParams;
+	call.pvResult    = pvResult;
+	call.pExcepInfo  = pExcepInfo;
+	call.puArgErr    = puArgErr;
+	call.hr          = NOERROR;
+
+	while (cEntered < pArray->cInterceptors)
+	{
+		DH_INTERCEPTOR * pInterceptor = &pArray->rgInterceptors[cEntered++];
+
+		if (!pInterceptor->pfnPreInvoke) continue;
+
+		hrPre = pInterceptor->pfnPreInvoke(&call, pInterceptor->pContext);
+
+		if (hrPre != S_OK)
+		{
+			if (hrPre != S_FALSE) call.hr = hrPre;
+			bShortCircuit = TRUE;
+			break;
+		}
+	}
+
+	if (!bShortCircuit)
+	{
+		call.hr = dhTimedInvoke(pDisp, dispID, invokeType, pDispParams, pvResult, pExcepInfo, puArgErr);
+	}
+
+	while (cEntered)
+	{
+		DH_INTERCEPTOR * pInterceptor = &pArray->rgInterceptors[--cEntered];
+
+		if (pInterceptor->pfnPostInvoke) pInterceptor->pfnPostInvoke(&call, pInterceptor->pContext);
+	}
+
+	LeaveInterceptors(pcReaders);
+
+	return call.hr;
+}
+
+HRESULT dhInterceptInvoke(IDispatch * pDisp, LPCOLESTR szMember, DISPID dispID, int invokeType,
+                          DISPPARAMS * pDispParams, VARIANT * pvResult, EXCEPINFO * pExcepInfo, UINT * puArgErr)
+{
+	HRESULT hr;
+
+	if (!f_pInterceptors)
+		hr = dhTimedInvoke(pDisp, dispID, invokeType, pDispParams, pvResult, pExcepInfo, puArgErr);
+	else
+		hr = InvokeIntercepted(pDisp, szMember, dispID, invokeType, pDispParams, pvResult, pExcepInfo, puArgErr);
+
+	if ((invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF)) || invokeType == DISPATCH_METHOD)
+	{
+		dhPropertyCacheInvalidate(pDisp);
+	}
+
+	return hr;
+}
+
+static void PublishInterceptors(DH_INTERCEPTOR_ARRAY * pArray)
+{
+	DH_INTERCEPTOR_ARRAY * pOld;
+
+	pOld = InterlockedExchangePointer((PVOID volatile *) &f_pInterceptors, pArray);
+
+	if (pOld)
+	{
+		pOld->pNextRetired     = f_pRetiredInterceptors;
+		f_pRetiredInterceptors = pOld;
+	}
+
+	FreeRetiredInterceptors();
+}
+
+static DH_INTERCEPTOR_ARRAY * CopyInterceptors(UINT cExtra)
+{
+	DH_INTERCEPTOR_ARRAY * pArray, * pCurrent = f_pInterceptors;
+	UINT cInterceptors = (pCurrent ? pCurrent->cInterceptors : 0);
+
+	pArray = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_INTERCEPTOR_ARRAY) +
+	                   (cInterceptors + cExtra) * sizeof(DH_INTERCEPTOR));
+
+	if (pArray && pCurrent)
+	{
+		CopyMemory(pArray->rgInterceptors, pCurrent->rgInterceptors, cInterceptors * sizeof(DH_INTERCEPTOR));
+		pArray->cInterceptors = cInterceptors;
+	}
+
+	return pArray;
+}
+
+HRESULT dhAddInterceptor(DH_PRE_INVOKE pfnPreInvoke, DH_POST_INVOKE pfnPostInvoke, LPVOID pContext, DWORD * pdwCookie)
+{
+	DH_INTERCEPTOR_ARRAY * pArray;
+	DH_INTERCEPTOR * pInterceptor;
+
+	if ((!pfnPreInvoke && !pfnPostInvoke) || !pdwCookie) return E_INVALIDARG;
+
+	AcquireInterceptorWriter();
+
+	if (!(pArray = CopyInterceptors(1)))
+	{
+		ReleaseInterceptorWriter();
+		return E_OUTOFMEMORY;
+	}
+
+	pInterceptor = &pArray->rgInterceptors[pArray->cInterceptors++];
+
+	pInterceptor->pfnPreInvoke  = pfnPreInvoke;
+	pInterceptor->pfnPostInvoke = pfnPostInvoke;
+	pInterceptor->pContext      = pContext;
+	pInterceptor->dwCookie      = *pdwCookie = ++f_dwNextInterceptorCookie;
+
+	PublishInterceptors(pArray);
+
+	ReleaseInterceptorWriter();
+
+	return NOERROR;
+}
+
+HRESULT dhRemoveInterceptor(DWORD dwCookie)
+{
+	DH_INTERCEPTOR_ARRAY * pArray;
+	UINT iSource, iDest = 0;
+
+	AcquireInterceptorWriter();
+
+	if (!(pArray = CopyInterceptors(0)))
+	{
+		ReleaseInterceptorWriter();
+		return (f_pInterceptors ? E_OUTOFMEMORY : E_INVALIDARG);
+	}
+
+	for (iSource = 0; iSource < pArray->cInterceptors; iSource++)
+	{
+		if (pArray->rgInterceptors[iSource].dwCookie != dwCookie)
+		{
+			pArray->rgInterceptors[iDest++] = pArray->rgInterceptors[iSource];
+		}
+	}
+
+	if (iDest == pArray->cInterceptors)
+	{
+		HeapFree(GetProcessHeap(), 0, pArray);
+		ReleaseInterceptorWriter();
+		return E_INVALIDARG;
+	}
+
+	pArray->cInterceptors = iDest;
+
+	if (iDest == 0)
+	{
+		HeapFree(GetProcessHeap(), 0, pArray);
+		pArray = NULL;
+	}
+
+	PublishInterceptors(pArray);
+
+	ReleaseInterceptorWriter();
+
+	return NOERROR;
+}
+
+
+/* ----- dh_enum.c ----- */
+
+HRESULT dhEnumBeginV(IEnumVARIANT ** ppEnum, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
+{
+	DISPPARAMS dp    = { 0 };
+	EXCEPINFO excep  = { 0 };
+	VARIANT vtResult;
+	IDispatch * pDispObj;
+	HRESULT hr;
+
+	DH_ENTER(L"EnumBeginV");
+
+	if (!ppEnum || !pDisp) return DH_EXIT(E_INVALIDARG, szMember);
+
+	if (szMember != NULL)
+	{
+		hr = dhGetValueV(L"%o", &pDispObj, pDisp, szMember, marker);
+		if (FAILED(hr)) return DH_EXIT(hr, szMember);
+	}
+	else
+	{
+		pDispObj = pDisp;
+	}
+
+	hr = pDispObj->lpVtbl->Invoke(pDispObj, DISPID_NEWENUM, &IID_NULL, LOCALE_USER_DEFAULT,
+				 DISPATCH_METHOD | DISPATCH_PROPERTYGET, &dp, &vtResult, &excep, NULL);
+
+	if (szMember != NULL) pDispObj->lpVtbl->Release(pDispObj);
+
+	if (FAILED(hr)) return DH_EXITEX(hr, TRUE, L"_NewEnum", szMember, &excep, 0);
+
+	if (V_VT(&vtResult) == VT_DISPATCH)
+		hr = V_DISPATCH(&vtResult)->lpVtbl->QueryInterface(V_DISPATCH(&vtResult), &IID_IEnumVARIANT, (void **) ppEnum);
+	else if (V_VT(&vtResult) == VT_UNKNOWN)
+		hr = V_UNKNOWN(&vtResult)->lpVtbl->QueryInterface(V_UNKNOWN(&vtResult), &IID_IEnumVARIANT, (void **) ppEnum);
+	else
+		hr = E_NOINTERFACE;
+
+	VariantClear(&vtResult);
+
+	return DH_EXIT(hr, szMember);
+}
+
+HRESULT dhEnumNextVariant(IEnumVARIANT * pEnum, VARIANT * pvResult)
+{
+	DH_ENTER(L"EnumNextVariant");
+
+	if (!pEnum || !pvResult) return DH_EXIT(E_INVALIDARG, L"Enumerator");
+
+	return DH_EXIT(pEnum->lpVtbl->Next(pEnum, 1, pvResult, NULL), L"Enumerator");
+}
+
+HRESULT dhEnumNextObject(IEnumVARIANT * pEnum, IDispatch ** ppDisp)
+{
+	VARIANT vtResult;
+	HRESULT hr;
+
+	DH_ENTER(L"EnumNextObject");
+
+	if (!pEnum || !ppDisp) return DH_EXIT(E_INVALIDARG, L"Enumerator");
+
+	hr = pEnum->lpVtbl->Next(pEnum, 1, &vtResult, NULL);
+
+	if (hr == S_OK)
+	{
+		if (V_VT(&vtResult) == VT_DISPATCH)
+		{
+			*ppDisp = V_DISPATCH(&vtResult);
+		}
+		else
+		{
+			hr = VariantChangeType(&vtResult, &vtResult, 0, VT_DISPATCH);
+			if (SUCCEEDED(hr)) *ppDisp = V_DISPATCH(&vtResult);
+			else VariantClear(&vtResult);
+		}
+	}
+
+	return DH_EXIT(hr, L"Enumerator");
+}
+
+HRESULT dhEnumBegin(IEnumVARIANT ** ppEnum, IDispatch * pDisp, LPCOLESTR szMember, ...)
+{
+	HRESULT hr;
+	va_list marker;
+
+	DH_ENTER(L"EnumBegin");
+
+	va_start(marker, szMember);
+
+	hr = dhEnumBeginV(ppEnum, pDisp, szMember, &marker);
+
+	va_end(marker);
+
+	return DH_EXIT(hr, szMember);
+}
+
+typedef struct tagDH_ENUM_SLICE
+{
+	IEnumVARIANTVtbl * lpVtbl;
+	LONG cRefs;
+	IEnumVARIANT * pInner;
+	IDispatch * pColl;
+	LONG iFirstIndex;
+	ULONG iStart;
+	ULONG cItems;
+	ULONG iNext;
+} DH_ENUM_SLICE;
+
+static IEnumVARIANTVtbl f_EnumSliceVtbl;
+
+static HRESULT CreateSlice(IEnumVARIANT ** ppEnum, IEnumVARIANT * pInner, IDispatch * pColl,
+                           LONG iFirstIndex, ULONG iStart, ULONG cItems, ULONG iNext)
+{
+	DH_ENUM_SLICE * pSlice = HeapAlloc(GetProcessHeap(), 0, sizeof(DH_ENUM_SLICE));
+
+	if (!pSlice) return E_OUTOFMEMORY;
+
+	pSlice->lpVtbl      = &f_EnumSliceVtbl;
+	pSlice->cRefs       = 1;
+	pSlice->pInner      = pInner;
+	pSlice->pColl       = pColl;
+	pSlice->iFirstIndex = iFirstIndex;
+	pSlice->iStart      = iStart;
+	pSlice->cItems      = cItems;
+	pSlice->iNext       = iNext;
+
+	if (pInner) pInner->lpVtbl->AddRef(pInner);
+	if (pColl) pColl->lpVtbl->AddRef(pColl);
+
+	*ppEnum = (IEnumVARIANT *) pSlice;
+
+	return NOERROR;
+}
+
+static HRESULT STDMETHODCALLTYPE Slice_QueryInterface(IEnumVARIANT * This, REFIID riid, void ** ppv)
+{
+	if (!IsEqualIID(riid, &IID_IUnknown) && !IsEqualIID(riid, &IID_IEnumVARIANT))
+	{
+		*ppv = NULL;
+		return E_NOINTERFACE;
+	}
+
+	*ppv = This;
+	This->lpVtbl->AddRef(This);
+
+	return S_OK;
+}
+
+static ULONG STDMETHODCALLTYPE Slice_AddRef(IEnumVARIANT * This)
+{
+	return InterlockedIncrement(&((DH_ENUM_SLICE *) This)->cRefs);
+}
+
+static ULONG STDMETHODCALLTYPE Slice_Release(IEnumVARIANT * This)
+{
+	DH_ENUM_SLICE * pSlice = (DH_ENUM_SLICE *) This;
+	LONG cRefs = InterlockedDecrement(&pSlice->cRefs);
+
+	if (cRefs == 0)
+	{
+		if (pSlice->pInner) pSlice->pInner->lpVtbl->Release(pSlice->pInner);
+		if (pSlice->pColl) pSlice->pColl->lpVtbl->Release(pSlice->pColl);
+		HeapFree(GetProcessHeap(), 0, pSlice);
+	}
+
+	return cRefs;
+}
+
+static HRESULT STDMETHODCALLTYPE Slice_Next(IEnumVARIANT * This, ULONG celt, VARIANT * rgVar, ULONG * pCeltFetched)
+{
+	DH_ENUM_SLICE * pSlice = (DH_ENUM_SLICE *) This;
+	ULONG cLeft = pSlice->cItems - pSlice->iNext, cFetched = 0;
+	ULONG cWanted = (celt < cLeft ? celt : cLeft);
+	HRESULT hr = NOERROR;
+
+	if (cWanted && pSlice->pInner)
+	{
+		hr = pSlice->pInner->lpVtbl->Next(pSlice->pInner, cWanted, rgVar, &cFetched);
+	}
+	else
+	{
+		for (; cFetched < cWanted; cFetched++)
+		{
+			LONG iIndex = pSlice->iFirstIndex + (LONG) (pSlice->iStart + pSlice->iNext + cFetched);
+
+			hr = dhGetValue(L"%v", &rgVar[cFetched], pSlice->pColl, L".Item(%d)", iIndex);
+			if (FAILED(hr)) break;
+		}
+	}
+
+	pSlice->iNext += cFetched;
+
+	if (pCeltFetched) *pCeltFetched = cFetched;
+
+	if (FAILED(hr) && cFetched == 0) return hr;
+
+	return (cFetched == celt ? S_OK : S_FALSE);
+}
+
+static HRESULT STDMETHODCALLTYPE Slice_Skip(IEnumVARIANT * This, ULONG celt)
+{
+	DH_ENUM_SLICE * pSlice = (DH_ENUM_SLICE *) This;
+	ULONG cLeft = pSlice->cItems - pSlice->iNext;
+	ULONG cSkip = (celt < cLeft ? celt : cLeft);
+	HRESULT hr = NOERROR;
+
+	if (cSkip && pSlice->pInner) hr = pSlice->pInner->lpVtbl->Skip(pSlice->pInner, cSkip);
+
+	if (FAILED(hr)) return hr;
+
+	pSlice->iNext += cSkip;
+
+	return (cSkip == celt && hr == S_OK ? S_OK : S_FALSE);
+}
+
+static HRESULT STDMETHODCALLTYPE Slice_Reset(IEnumVARIANT * This)
+{
+	DH_ENUM_SLICE * pSlice = (DH_ENUM_SLICE *) This;
+	HRESULT hr = NOERROR;
+
+	if (pSlice->pInner)
+	{
+		hr = pSlice->pInner->lpVtbl->Reset(pSlice->pInner);
+		if (SUCCEEDED(hr) && pSlice->iStart) hr = pSlice->pInner->lpVtbl->Skip(pSlice->pInner, pSlice->iStart);
+	}
+
+	if (SUCCEEDED(hr)) pSlice->iNext = 0;
+
+	return (FAILED(hr) ? hr : NOERROR);
+}
+
+static HRESULT STDMETHODCALLTYPE Slice_Clone(IEnumVARIANT * This, IEnumVARIANT ** ppEnum)
+{
+	DH_ENUM_SLICE * pSlice = (DH_ENUM_SLICE *) This;
+	IEnumVARIANT * pInner = NULL;
+	HRESULT hr;
+
+	if (!ppEnum) return E_POINTER;
+
+	*ppEnum = NULL;
+
+	if (pSlice->pInner)
+	{
+		hr = pSlice->pInner->lpVtbl->Clone(pSlice->pInner, &pInner);
+		if (FAILED(hr)) return hr;
+	}
+
+	hr = CreateSlice(ppEnum, pInner, pSlice->pColl, pSlice->iFirstIndex, pSlice->iStart, pSlice->cItems, pSlice->iNext);
+
+	if (pInner) pInner->lpVtbl->Release(pInner);
+
+	return hr;
+}
+
+static IEnumVARIANTVtbl f_EnumSliceVtbl =
+{
+	Slice_QueryInterface, Slice_AddRef, Slice_Release,
+	Slice_Next, Slice_Skip, Slice_Reset, Slice_Clone
+};
+
+HRESULT dhEnumSliceEnum(IEnumVARIANT ** ppEnum, IEnumVARIANT * pSource, ULONG iStart, ULONG cItems)
+{
+	IEnumVARIANT * pClone = NULL;
+	HRESULT hr;
+
+	DH_ENTER(L"EnumSliceEnum");
+
+	if (!ppEnum || !pSource) return DH_EXIT(E_INVALIDARG, L"Enumerator");
+
+	*ppEnum = NULL;
+
+	hr = pSource->lpVtbl->Clone(pSource, &pClone);
+
+	if (SUCCEEDED(hr)) hr = dhEnumSliceWrap(ppEnum, pClone, iStart, cItems);
+
+	if (pClone) pClone->lpVtbl->Release(pClone);
+
+	return DH_EXIT(hr, L"Enumerator");
+}
+
+HRESULT dhEnumSliceWrap(IEnumVARIANT ** ppEnum, IEnumVARIANT * pInner, ULONG iStart, ULONG cItems)
+{
+	HRESULT hr;
+
+	hr = pInner->lpVtbl->Reset(pInner);
+
+	if (SUCCEEDED(hr) && iStart) hr = pInner->lpVtbl->Skip(pInner, iStart);
+
+	if (FAILED(hr)) return hr;
+
+	return CreateSlice(ppEnum, pInner, NULL, 0, iStart, cItems, 0);
+}
+
+HRESULT dhEnumSlice(IEnumVARIANT ** ppEnum, IDispatch * pColl, ULONG iStart, ULONG cItems, int nMethod)
+{
+	IEnumVARIANT * pInner = NULL;
+	ULONG cCount = 0;
+	HRESULT hr;
+
+	DH_ENTER(L"EnumSlice");
+
+	if (!ppEnum || !pColl) return DH_EXIT(E_INVALIDARG, L"Slice");
+
+	*ppEnum = NULL;
+
+	if (nMethod == DH_SLICE_NEWENUM)
+	{
+		hr = dhEnumBegin(&pInner, pColl, NULL);
+
+		if (SUCCEEDED(hr)) hr = dhEnumSliceWrap(ppEnum, pInner, iStart, cItems);
+
+		if (pInner) pInner->lpVtbl->Release(pInner);
+
+		return DH_EXIT(hr, L"Slice");
+	}
+
+	if (nMethod != DH_SLICE_ITEM0 && nMethod != DH_SLICE_ITEM1) return DH_EXIT(E_INVALIDARG, L"Slice");
+
+	hr = dhGetValue(L"%u", &cCount, pColl, L".Count");
+	if (FAILED(hr)) return DH_EXIT(hr, L"Slice");
+
+	if (iStart > cCount) iStart = cCount;
+	if (cItems > cCount - iStart) cItems = cCount - iStart;
+
+	hr = CreateSlice(ppEnum, NULL, pColl, (nMethod == DH_SLICE_ITEM1 ? 1 : 0), iStart, cItems, 0);
+
+	return DH_EXIT(hr, L"Slice");
+}
+
+/* ----- dh_deadline.c ----- */
+
+#define DH_WATCHDOG_IDLE_MS 30000
+
+typedef struct tagDH_DEADLINE
+{
+	struct tagDH_DEADLINE * pNext;
+	DWORD dwThreadId;
+	DWORD dwTimeout;
+	DWORD dwDeadline;
+	BOOL bArmed;
+	BOOL bTimedOut;
+	BOOL bCancelEnabled;
+} DH_DEADLINE;
+
+static const ULONG f_rgCallHistogramBounds[DH_CALL_HISTOGRAM_BUCKETS - 1] = { 1000, 10000, 100000, 1000000 };
+
+static DH_CALL_STATISTICS f_CallStatistics;
+
+static DH_DEADLINE * f_pArmed = NULL;
+static HANDLE f_hWatchdog = NULL;
+static HANDLE f_hWatchdogWake = NULL;
+static DWORD f_dwWatchdogNext;
+
+static CRITICAL_SECTION f_csDeadline;
+static LONG f_lngDeadlineInitBegin = -1, f_lngDeadlineInitEnd = -1;
+static DWORD f_TlsIdxDeadline;
+
+#define GetDeadline()          ((DH_DEADLINE *) TlsGetValue(f_TlsIdxDeadline))
+#define SetDeadline(pDeadline) TlsSetValue(f_TlsIdxDeadline, pDeadline)
+#define CheckDeadlineInitialized() if (f_lngDeadlineInitEnd != 0) InitializeDeadlines();
+
+static void InitializeDeadlines(void)
+{
+	if (0 == InterlockedIncrement(&f_lngDeadlineInitBegin))
+	{
+		f_TlsIdxDeadline = TlsAlloc();
+		InitializeCriticalSection(&f_csDeadline);
+		f_lngDeadlineInitEnd = 0;
+	}
+	else
+	{
+		while (f_lngDeadlineInitEnd != 0) Sleep(5);
+	}
+}
+
+static DWORD WINAPI WatchdogThread(LPVOID lpParameter)
+{
+	DH_DEADLINE * pDeadline;
+	DWORD dwNow, dwWait;
+	LONG lRemaining;
+	BOOL bIdle = FALSE;
+	HRESULT hrInit = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	for (;;)
+	{
+		EnterCriticalSection(&f_csDeadline);
+
+		if (bIdle && !f_pArmed)
+		{
+			CloseHandle(f_hWatchdog);
+			f_hWatchdog = NULL;
+			LeaveCriticalSection(&f_csDeadline);
+			break;
+		}
+
+		dwNow  = GetTickCount();
+		dwWait = DH_WATCHDOG_IDLE_MS;
+
+		for (pDeadline = f_pArmed; pDeadline; pDeadline = pDeadline->pNext)
+		{
+			if (pDeadline->bTimedOut) continue;
+
+			lRemaining = (LONG) (pDeadline->dwDeadline - dwNow);
+
+			if (lRemaining <= 0)
+			{
+				pDeadline->bTimedOut = TRUE;
+				CoCancelCall(pDeadline->dwThreadId, 0);
+			}
+			else if ((DWORD) lRemaining < dwWait)
+			{
+				dwWait = (DWORD) lRemaining;
+			}
+		}
+
+		bIdle = (f_pArmed == NULL);
+		f_dwWatchdogNext = dwNow + dwWait;
+
+		LeaveCriticalSection(&f_csDeadline);
+
+		if (WaitForSingleObject(f_hWatchdogWake, dwWait) != WAIT_TIMEOUT) bIdle = FALSE;
+	}
+
+	if (SUCCEEDED(hrInit)) CoUninitialize();
+
+	return 0;
+}
+
+static BOOL ArmDeadline(DH_DEADLINE * pDeadline)
+{
+	BOOL bWake;
 
-		case L'v':
-			*pvArg  = *va_arg(*marker, VARIANT *);
-			break;
+	EnterCriticalSection(&f_csDeadline);
 
-		case L'm':
-			V_VT(pvArg)    = VT_ERROR;
-			V_ERROR(pvArg) = DISP_E_PARAMNOTFOUND;
-			break;
+	pDeadline->dwDeadline = GetTickCount() + pDeadline->dwTimeout;
+	pDeadline->bTimedOut  = FALSE;
 
-		case L'B':
-			V_VT(pvArg)   = VT_BSTR;
-			V_BSTR(pvArg) = va_arg(*marker, BSTR);
-			break;
+	if (!f_hWatchdogWake) f_hWatchdogWake = CreateEvent(NULL, FALSE, FALSE, NULL);
 
-		case L'S':
-		{
-			LPOLESTR szTemp = va_arg(*marker, LPOLESTR);
+	if (f_hWatchdogWake && !f_hWatchdog)
+	{
+		f_dwWatchdogNext = pDeadline->dwDeadline;
+		f_hWatchdog = CreateThread(NULL, 0, WatchdogThread, NULL, 0, NULL);
+	}
 
-			V_VT(pvArg)   = VT_BSTR;
-			V_BSTR(pvArg) = SysAllocString(szTemp);
+	if (f_hWatchdog)
+	{
+		pDeadline->pNext = f_pArmed;
+		f_pArmed = pDeadline;
+		pDeadline->bArmed = TRUE;
+	}
 
-			if (V_BSTR(pvArg) == NULL && szTemp != NULL) hr = E_OUTOFMEMORY;
+	bWake = (pDeadline->bArmed && (LONG) (pDeadline->dwDeadline - f_dwWatchdogNext) < 0);
 
-			*pbFreeArg = TRUE;
+	LeaveCriticalSection(&f_csDeadline);
+
+	if (bWake) SetEvent(f_hWatchdogWake);
+
+	return pDeadline->bArmed;
+}
+
+static BOOL DisarmDeadline(DH_DEADLINE * pDeadline)
+{
+	DH_DEADLINE ** ppLink;
+
+	EnterCriticalSection(&f_csDeadline);
+
+	for (ppLink = &f_pArmed; *ppLink; ppLink = &(*ppLink)->pNext)
+	{
+		if (*ppLink == pDeadline)
+		{
+			*ppLink = pDeadline->pNext;
 			break;
 		}
+	}
 
-		case L's':
-			V_VT(pvArg) = VT_BSTR;
-			hr = ConvertAnsiStrToBStr(va_arg(*marker, LPSTR), &V_BSTR(pvArg));
-			*pbFreeArg = TRUE;
-			break;
+	pDeadline->bArmed = FALSE;
 
-		case L'o':
-			V_VT(pvArg)       = VT_DISPATCH;
-			V_DISPATCH(pvArg) = va_arg(*marker, IDispatch *);
-			break;
+	LeaveCriticalSection(&f_csDeadline);
 
-		case L'O':
-			V_VT(pvArg)      = VT_UNKNOWN;
-			V_UNKNOWN(pvArg) = va_arg(*marker, IUnknown *);
-			break;
+	return pDeadline->bTimedOut;
+}
 
-		case L'D':
-			V_VT(pvArg)   = VT_DATE;
-			V_DATE(pvArg) = va_arg(*marker, DATE);
-			break;
+static void RecordCall(LARGE_INTEGER * pliStart, BOOL bTimedOut)
+{
+	LARGE_INTEGER liNow, liFrequency;
+	ULONG ulMicroseconds = 0, iBucket;
 
-		case L't':
-			V_VT(pvArg) = VT_DATE;
-			hr = ConvertTimeTToVariantTime(va_arg(*marker, time_t), &V_DATE(pvArg));
-			break;
+	InterlockedIncrement((LONG *) &f_CallStatistics.cCalls);
 
-		case L'W':
-			V_VT(pvArg) = VT_DATE;
-			hr = ConvertSystemTimeToVariantTime(va_arg(*marker, SYSTEMTIME *), &V_DATE(pvArg));
-			break;
+	if (bTimedOut)
+	{
+		InterlockedIncrement((LONG *) &f_CallStatistics.cTimeouts);
+		return;
+	}
 
-		case L'f':
-			V_VT(pvArg) = VT_DATE;
-			hr = ConvertFileTimeToVariantTime(va_arg(*marker, FILETIME *), &V_DATE(pvArg));
-			break;
+	if (QueryPerformanceFrequency(&liFrequency) && liFrequency.QuadPart)
+	{
+		QueryPerformanceCounter(&liNow);
+		ulMicroseconds = (ULONG) ((liNow.QuadPart - pliStart->QuadPart) * 1000000 / liFrequency.QuadPart);
+	}
 
-		case L'p':
-#ifndef _WIN64
-			V_VT(pvArg) = VT_I4;
-			V_I4(pvArg) = (LONG) va_arg(*marker, LPVOID);
-#else
-			V_VT(pvArg) = VT_I8;
-			V_I8(pvArg) = (LONGLONG) va_arg(*marker, LPVOID);
-#endif
-			break;
+	for (iBucket = 0; iBucket < DH_CALL_HISTOGRAM_BUCKETS - 1 && ulMicroseconds >= f_rgCallHistogramBounds[iBucket]; iBucket++);
 
-		default:
-			hr = E_INVALIDARG;
-			DEBUG_NOTIFY_INVALID_IDENTIFIER(chIdentifier);
-			break;
+	InterlockedIncrement((LONG *) &f_CallStatistics.rgHistogram[iBucket]);
+}
+
+HRESULT dhTimedInvoke(IDispatch * pDisp, DISPID dispID, int invokeType, DISPPARAMS * pDispParams,
+                      VARIANT * pvResult, EXCEPINFO * pExcepInfo, UINT * puArgErr)
+{
+	DH_DEADLINE * pDeadline = (f_lngDeadlineInitEnd == 0 ? GetDeadline() : NULL);
+	LARGE_INTEGER liStart;
+	BOOL bTimedOut;
+	HRESULT hr;
+
+	if (!pDeadline || pDeadline->dwTimeout == INFINITE || pDeadline->bArmed)
+	{
+		return pDisp->lpVtbl->Invoke(pDisp, dispID, &IID_NULL, LOCALE_USER_DEFAULT, (WORD) invokeType,
+		                             pDispParams, pvResult, pExcepInfo, puArgErr);
 	}
 
-	return hr;
+	if (!pDeadline->bCancelEnabled) pDeadline->bCancelEnabled = SUCCEEDED(CoEnableCallCancellation(NULL));
+
+	QueryPerformanceCounter(&liStart);
+
+	if (!pDeadline->bCancelEnabled || !ArmDeadline(pDeadline))
+	{
+		return pDisp->lpVtbl->Invoke(pDisp, dispID, &IID_NULL, LOCALE_USER_DEFAULT, (WORD) invokeType,
+		                             pDispParams, pvResult, pExcepInfo, puArgErr);
+	}
+
+	hr = pDisp->lpVtbl->Invoke(pDisp, dispID, &IID_NULL, LOCALE_USER_DEFAULT, (WORD) invokeType,
+	                           pDispParams, pvResult, pExcepInfo, puArgErr);
+
+	bTimedOut = DisarmDeadline(pDeadline) && FAILED(hr);
+
+	RecordCall(&liStart, bTimedOut);
+
+	return (bTimedOut ? DH_E_CALL_TIMEOUT : hr);
 }
 
-/* ----- dh_enum.c ----- */
+void dhCleanupThreadDeadline(void)
+{
+	DH_DEADLINE * pDeadline;
 
-HRESULT dhEnumBeginV(IEnumVARIANT ** ppEnum, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
+	if (f_lngDeadlineInitEnd != 0 || !(pDeadline = GetDeadline())) return;
+
+	if (pDeadline->bCancelEnabled) CoDisableCallCancellation(NULL);
+
+	HeapFree(GetProcessHeap(), 0, pDeadline);
+	SetDeadline(NULL);
+}
+
+DWORD dhSetCallTimeout(DWORD dwTimeout)
 {
-	DISPPARAMS dp    = { 0 };
-	EXCEPINFO excep  = { 0 };
-	VARIANT vtResult;
-	IDispatch * pDispObj;
-	HRESULT hr;
+	DH_DEADLINE * pDeadline;
+	DWORD dwPrevious;
 
-	DH_ENTER(L"EnumBeginV");
+	CheckDeadlineInitialized();
 
-	if (!ppEnum || !pDisp) return DH_EXIT(E_INVALIDARG, szMember);
+	if (!(pDeadline = GetDeadline()))
+	{
+		if (dwTimeout == INFINITE) return INFINITE;
 
-	if (szMember != NULL)
+		if (!(pDeadline = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_DEADLINE)))) return INFINITE;
+
+		pDeadline->dwThreadId = GetCurrentThreadId();
+		pDeadline->dwTimeout  = INFINITE;
+		SetDeadline(pDeadline);
+	}
+
+	dwPrevious = pDeadline->dwTimeout;
+	pDeadline->dwTimeout = dwTimeout;
+
+	return dwPrevious;
+}
+
+HRESULT dhGetCallStatistics(PDH_CALL_STATISTICS pStatistics, BOOL bReset)
+{
+	UINT iBucket;
+
+	if (!pStatistics) return E_INVALIDARG;
+
+	if (bReset)
 	{
-		hr = dhGetValueV(L"%o", &pDispObj, pDisp, szMember, marker);
-		if (FAILED(hr)) return DH_EXIT(hr, szMember);
+		pStatistics->cCalls    = (ULONG) InterlockedExchange((LONG *) &f_CallStatistics.cCalls, 0);
+		pStatistics->cTimeouts = (ULONG) InterlockedExchange((LONG *) &f_CallStatistics.cTimeouts, 0);
+
+		for (iBucket = 0; iBucket < DH_CALL_HISTOGRAM_BUCKETS; iBucket++)
+		{
+			pStatistics->rgHistogram[iBucket] = (ULONG) InterlockedExchange((LONG *) &f_CallStatistics.rgHistogram[iBucket], 0);
+		}
 	}
 	else
 	{
-		pDispObj = pDisp;
+		*pStatistics = f_CallStatistics;
 	}
 
-	hr = pDispObj->lpVtbl->Invoke(pDispObj, DISPID_NEWENUM, &IID_NULL, LOCALE_USER_DEFAULT,
-				 DISPATCH_METHOD | DISPATCH_PROPERTYGET, &dp, &vtResult, &excep, NULL);
+	return NOERROR;
+}
 
-	if (szMember != NULL) pDispObj->lpVtbl->Release(pDispObj);
+/* ----- dh_filter.c ----- */
 
-	if (FAILED(hr)) return DH_EXITEX(hr, TRUE, L"_NewEnum", szMember, &excep, 0);
+#define DH_FILTER_DEFAULT_DEADLINE  60000
+#define DH_FILTER_DEFAULT_MAX_DELAY 2000
 
-	if (V_VT(&vtResult) == VT_DISPATCH)
-		hr = V_DISPATCH(&vtResult)->lpVtbl->QueryInterface(V_DISPATCH(&vtResult), &IID_IEnumVARIANT, (void **) ppEnum);
-	else if (V_VT(&vtResult) == VT_UNKNOWN)
-		hr = V_UNKNOWN(&vtResult)->lpVtbl->QueryInterface(V_UNKNOWN(&vtResult), &IID_IEnumVARIANT, (void **) ppEnum);
+#define DH_FILTER_MIN_DELAY 100
+
+typedef struct tagDH_FILTER_THREAD
+{
+	IMessageFilter * pPrevious;
+	DWORD dwRetryTick;
+	UINT cAttempts;
+	ULONG ulSeed;
+} DH_FILTER_THREAD;
+
+static BOOL f_bFilterEnabled = FALSE;
+static DWORD f_dwFilterDeadline = DH_FILTER_DEFAULT_DEADLINE;
+static DWORD f_dwFilterMaxDelay = DH_FILTER_DEFAULT_MAX_DELAY;
+static DH_MESSAGE_FILTER_STATISTICS f_FilterStatistics;
+
+static LONG  f_lngFilterTlsInitBegin = -1, f_lngFilterTlsInitEnd = -1;
+static DWORD f_TlsIdxFilter;
+
+#define GetFilterThread()          ((DH_FILTER_THREAD *) TlsGetValue(f_TlsIdxFilter))
+#define SetFilterThread(pThread)   TlsSetValue(f_TlsIdxFilter, pThread)
+#define CheckFilterTlsInitialized() if (f_lngFilterTlsInitEnd != 0) InitializeFilterTlsIndex();
+
+static void InitializeFilterTlsIndex(void)
+{
+	if (0 == InterlockedIncrement(&f_lngFilterTlsInitBegin))
+	{
+		f_TlsIdxFilter        = TlsAlloc();
+		f_lngFilterTlsInitEnd = 0;
+	}
 	else
-		hr = E_NOINTERFACE;
+	{
+		while (f_lngFilterTlsInitEnd != 0) Sleep(5);
+	}
+}
 
-	VariantClear(&vtResult);
+static HRESULT STDMETHODCALLTYPE Filter_QueryInterface(IMessageFilter * This, REFIID riid, void ** ppv)
+{
+	if (!IsEqualIID(riid, &IID_IUnknown) && !IsEqualIID(riid, &IID_IMessageFilter))
+	{
+		*ppv = NULL;
+		return E_NOINTERFACE;
+	}
 
-	return DH_EXIT(hr, szMember);
+	*ppv = This;
+	return S_OK;
 }
 
-HRESULT dhEnumNextVariant(IEnumVARIANT * pEnum, VARIANT * pvResult)
+static ULONG STDMETHODCALLTYPE Filter_AddRef(IMessageFilter * This)
 {
-	DH_ENTER(L"EnumNextVariant");
+	return 2;
+}
 
-	if (!pEnum || !pvResult) return DH_EXIT(E_INVALIDARG, L"Enumerator");
+static ULONG STDMETHODCALLTYPE Filter_Release(IMessageFilter * This)
+{
+	return 1;
+}
 
-	return DH_EXIT(pEnum->lpVtbl->Next(pEnum, 1, pvResult, NULL), L"Enumerator");
+static DWORD STDMETHODCALLTYPE Filter_HandleInComingCall(IMessageFilter * This, DWORD dwCallType, HTASK htaskCaller,
+                                                         DWORD dwTickCount, LPINTERFACEINFO lpInterfaceInfo)
+{
+	DH_FILTER_THREAD * pThread = GetFilterThread();
+
+	if (pThread && pThread->pPrevious)
+	{
+		return pThread->pPrevious->lpVtbl->HandleInComingCall(pThread->pPrevious, dwCallType, htaskCaller,
+		                                                      dwTickCount, lpInterfaceInfo);
+	}
+
+	return SERVERCALL_ISHANDLED;
 }
 
-HRESULT dhEnumNextObject(IEnumVARIANT * pEnum, IDispatch ** ppDisp)
+static DWORD STDMETHODCALLTYPE Filter_MessagePending(IMessageFilter * This, HTASK htaskCallee,
+                                                     DWORD dwTickCount, DWORD dwPendingType)
 {
-	VARIANT vtResult;
-	HRESULT hr;
+	DH_FILTER_THREAD * pThread = GetFilterThread();
 
-	DH_ENTER(L"EnumNextObject");
+	if (pThread && pThread->pPrevious)
+	{
+		return pThread->pPrevious->lpVtbl->MessagePending(pThread->pPrevious, htaskCallee, dwTickCount, dwPendingType);
+	}
 
-	if (!pEnum || !ppDisp) return DH_EXIT(E_INVALIDARG, L"Enumerator");
+	return PENDINGMSG_WAITDEFPROCESS;
+}
 
-	hr = pEnum->lpVtbl->Next(pEnum, 1, &vtResult, NULL);
+static DWORD STDMETHODCALLTYPE Filter_RetryRejectedCall(IMessageFilter * This, HTASK htaskCallee,
+                                                        DWORD dwTickCount, DWORD dwRejectType)
+{
+	DH_FILTER_THREAD * pThread = GetFilterThread();
+	DWORD dwDeadline = f_dwFilterDeadline, dwDelay;
 
-	if (hr == S_OK)
+	if (!f_bFilterEnabled && pThread && pThread->pPrevious)
 	{
-		if (V_VT(&vtResult) == VT_DISPATCH)
-		{
-			*ppDisp = V_DISPATCH(&vtResult);
-		}
-		else
-		{
-			hr = VariantChangeType(&vtResult, &vtResult, 0, VT_DISPATCH);
-			if (SUCCEEDED(hr)) *ppDisp = V_DISPATCH(&vtResult);
-			else VariantClear(&vtResult);
-		}
+		return pThread->pPrevious->lpVtbl->RetryRejectedCall(pThread->pPrevious, htaskCallee, dwTickCount, dwRejectType);
 	}
 
-	return DH_EXIT(hr, L"Enumerator");
+	InterlockedIncrement((LONG *) &f_FilterStatistics.cRejections);
+
+	if (!f_bFilterEnabled || !pThread || dwRejectType != SERVERCALL_RETRYLATER || dwTickCount >= dwDeadline)
+	{
+		InterlockedIncrement((LONG *) &f_FilterStatistics.cCancelled);
+		return (DWORD) -1;
+	}
+
+	if (dwTickCount < pThread->dwRetryTick) pThread->cAttempts = 0;
+
+	dwDelay = (pThread->cAttempts < 16 ? DH_FILTER_MIN_DELAY << pThread->cAttempts : f_dwFilterMaxDelay);
+	if (dwDelay > f_dwFilterMaxDelay) dwDelay = f_dwFilterMaxDelay;
+
+	pThread->ulSeed = pThread->ulSeed * 1103515245 + 12345;
+	dwDelay = dwDelay / 2 + (DWORD) ((pThread->ulSeed >> 16) % (dwDelay / 2 + 1));
+
+	if (dwDelay > dwDeadline - dwTickCount) dwDelay = dwDeadline - dwTickCount;
+
+	if (dwDelay < DH_FILTER_MIN_DELAY)
+	{
+		InterlockedIncrement((LONG *) &f_FilterStatistics.cCancelled);
+		return (DWORD) -1;
+	}
+
+	pThread->cAttempts++;
+	pThread->dwRetryTick = dwTickCount + dwDelay / 2;
+
+	InterlockedIncrement((LONG *) &f_FilterStatistics.cRetries);
+	InterlockedExchangeAdd((LONG *) &f_FilterStatistics.ulDelayMs, (LONG) dwDelay);
+
+	return dwDelay;
 }
 
-HRESULT dhEnumBegin(IEnumVARIANT ** ppEnum, IDispatch * pDisp, LPCOLESTR szMember, ...)
+static IMessageFilterVtbl f_MessageFilterVtbl =
 {
-	HRESULT hr;
-	va_list marker;
+	Filter_QueryInterface, Filter_AddRef, Filter_Release,
+	Filter_HandleInComingCall, Filter_RetryRejectedCall, Filter_MessagePending
+};
 
-	DH_ENTER(L"EnumBegin");
+static IMessageFilter f_MessageFilter = { &f_MessageFilterVtbl };
 
-	va_start(marker, szMember);
+void dhRegisterThreadMessageFilter(void)
+{
+	DH_FILTER_THREAD * pThread;
 
-	hr = dhEnumBeginV(ppEnum, pDisp, szMember, &marker);
+	if (!f_bFilterEnabled) return;
 
-	va_end(marker);
+	CheckFilterTlsInitialized();
 
-	return DH_EXIT(hr, szMember);
+	if (GetFilterThread()) return;
+
+	if (!(pThread = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_FILTER_THREAD)))) return;
+
+	pThread->ulSeed = GetTickCount() ^ GetCurrentThreadId();
+
+	if (SUCCEEDED(CoRegisterMessageFilter(&f_MessageFilter, &pThread->pPrevious)))
+	{
+		SetFilterThread(pThread);
+	}
+	else
+	{
+		HeapFree(GetProcessHeap(), 0, pThread);
+	}
+}
+
+void dhCleanupThreadMessageFilter(void)
+{
+	DH_FILTER_THREAD * pThread;
+	IMessageFilter * pOurs = NULL;
+
+	if (f_lngFilterTlsInitEnd != 0 || !(pThread = GetFilterThread())) return;
+
+	CoRegisterMessageFilter(pThread->pPrevious, &pOurs);
+
+	if (pThread->pPrevious) pThread->pPrevious->lpVtbl->Release(pThread->pPrevious);
+
+	HeapFree(GetProcessHeap(), 0, pThread);
+	SetFilterThread(NULL);
+}
+
+HRESULT dhSetMessageFilter(BOOL bEnable, DWORD dwDeadline, DWORD dwMaxDelay)
+{
+	f_dwFilterDeadline = (dwDeadline ? dwDeadline : DH_FILTER_DEFAULT_DEADLINE);
+	f_dwFilterMaxDelay = (dwMaxDelay > DH_FILTER_MIN_DELAY ? dwMaxDelay : DH_FILTER_DEFAULT_MAX_DELAY);
+	f_bFilterEnabled   = bEnable;
+
+	if (bEnable)
+		dhRegisterThreadMessageFilter();
+	else
+		dhCleanupThreadMessageFilter();
+
+	return NOERROR;
+}
+
+HRESULT dhGetMessageFilterStatistics(PDH_MESSAGE_FILTER_STATISTICS pStatistics, BOOL bReset)
+{
+	if (!pStatistics) return E_INVALIDARG;
+
+	if (bReset)
+	{
+		pStatistics->cRejections = (ULONG) InterlockedExchange((LONG *) &f_FilterStatistics.cRejections, 0);
+		pStatistics->cRetries    = (ULONG) InterlockedExchange((LONG *) &f_FilterStatistics.cRetries, 0);
+		pStatistics->cCancelled  = (ULONG) InterlockedExchange((LONG *) &f_FilterStatistics.cCancelled, 0);
+		pStatistics->ulDelayMs   = (ULONG) InterlockedExchange((LONG *) &f_FilterStatistics.ulDelayMs, 0);
+	}
+	else
+	{
+		*pStatistics = f_FilterStatistics;
+	}
+
+	return NOERROR;
 }
 
 /* ----- convert.c ----- */
@@ -1280,6 +4953,10 @@ HRESULT dhFormatExceptionW(PDH_EXCEPTION pException, LPWSTR szBuffer, UINT cchBu
 					_snwprintf(pException->szDescription, DESCRIPTION_LENGTH, L"Object doesn't support this property or method: '%s'", pException->szMember);
 					break;
 
+				case DH_E_CALL_TIMEOUT:
+					_snwprintf(pException->szDescription, DESCRIPTION_LENGTH, L"The call to '%s' did not complete within its timeout", pException->szMember);
+					break;
+
 				case DISP_E_TYPEMISMATCH:
 					if (pException->szMember[0])
 					{
@@ -1423,11 +5100,15 @@ void dhCleanupThreadException(void)
 
 HRESULT dhInitializeImp(BOOL bInitializeCOM, BOOL bUnicode)
 {
+	HRESULT hr = NOERROR;
+
 	dh_g_bIsUnicodeMode = bUnicode;
 
-	if (bInitializeCOM) return CoInitialize(NULL);
+	if (bInitializeCOM) hr = CoInitialize(NULL);
 
-	return NOERROR;
+	if (SUCCEEDED(hr)) dhRegisterThreadMessageFilter();
+
+	return hr;
 }
 
 void dhUninitialize(BOOL bUninitializeCOM)
@@ -1435,6 +5116,12 @@ void dhUninitialize(BOOL bUninitializeCOM)
 #ifndef DISPHELPER_NO_EXCEPTIONS
 	dhCleanupThreadException();
 #endif
+	dhCleanupThreadCache();
+	dhCleanupThreadLiterals();
+	dhCleanupThreadPropertyCache();
+	dhCleanupThreadFactoryCache();
+	dhCleanupThreadMessageFilter();
+	dhCleanupThreadDeadline();
 	if (bUninitializeCOM) CoUninitialize();
 }
 
@@ -0,0 +1,640 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* The kinds of request processed by an executor */
+#define DH_ASYNC_INVOKE  0
+#define DH_ASYNC_CREATE  1
+#define DH_ASYNC_ATTACH  2
+#define DH_ASYNC_RELEASE 3
+#define DH_ASYNC_FREE    4
+
+/* Structure to store an asynchronous request and its completion */
+struct tagDH_ASYNC
+{
+	struct tagDH_ASYNC * pNext;
+	LONG cRefs;
+	int nKind;
+	struct tagDH_EXECUTOR * pExecutor;
+
+	/* Request */
+	int invokeType;
+	VARTYPE returnType;
+	IDispatch * pDisp;
+	LPWSTR szMember;
+	LPWSTR szMachine;
+	IStream * pStream;
+	UINT cArgs;
+	VARIANT rgArgs[DH_MAX_CAPTURED_ARGS];
+
+	/* Completion */
+	DH_ASYNC_CALLBACK pfnCallback;
+	LPVOID pContext;
+	HANDLE hEvent;
+	HRESULT hr;
+	VARIANT vtResult;
+};
+
+/* Structure to store an executor thread and its queue */
+struct tagDH_EXECUTOR
+{
+	HANDLE hThread;
+	DWORD dwThreadId;
+	HANDLE hWake;
+	CRITICAL_SECTION cs;
+	PDH_ASYNC pHead;
+	PDH_ASYNC pTail;
+	LONG cBatchDepth;
+	BOOL bStop;
+};
+
+
+
+/* **************************************************************************
+ * CreateRequest:
+ *   Allocates a request with one reference for the executor and, if
+ * bWaitable is TRUE, another for the caller.
+ *
+ ============================================================================ */
+static PDH_ASYNC CreateRequest(int nKind, BOOL bWaitable)
+{
+	PDH_ASYNC pAsync = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(struct tagDH_ASYNC));
+
+	if (!pAsync) return NULL;
+
+	pAsync->nKind = nKind;
+	pAsync->cRefs = (bWaitable ? 2 : 1);
+	VariantInit(&pAsync->vtResult);
+
+	if (bWaitable && !(pAsync->hEvent = CreateEvent(NULL, TRUE, FALSE, NULL)))
+	{
+		HeapFree(GetProcessHeap(), 0, pAsync);
+		return NULL;
+	}
+
+	return pAsync;
+}
+
+
+
+/* **************************************************************************
+ * SubmitRequest:
+ *   Adds a request to the end of the executor's queue. Unless bForceWake is
+ * TRUE, the executor is only woken if no batch is in progress.
+ *
+ ============================================================================ */
+static void SubmitRequest(PDH_EXECUTOR pExecutor, PDH_ASYNC pAsync, BOOL bForceWake)
+{
+	BOOL bWake;
+
+	pAsync->pExecutor = pExecutor;
+
+	EnterCriticalSection(&pExecutor->cs);
+
+	if (pExecutor->pTail)
+		pExecutor->pTail->pNext = pAsync;
+	else
+		pExecutor->pHead = pAsync;
+
+	pExecutor->pTail = pAsync;
+	bWake = (bForceWake || pExecutor->cBatchDepth == 0);
+
+	LeaveCriticalSection(&pExecutor->cs);
+
+	if (bWake) SetEvent(pExecutor->hWake);
+}
+
+
+
+/* **************************************************************************
+ * dhAsyncRelease:
+ *   This function releases a completion handle returned by dhInvokeAsync.
+ * The request still completes if it has not yet done so. A result holding
+ * objects that has not been retrieved with dhAsyncWait is freed on the
+ * executor thread, so the handle must be released before the executor is
+ * destroyed.
+ *
+ ============================================================================ */
+void dhAsyncRelease(PDH_ASYNC pAsync)
+{
+	UINT iArg;
+
+	if (!pAsync || InterlockedDecrement(&pAsync->cRefs) != 0) return;
+
+	/* Objects in the result belong to the executor's apartment */
+	if ((V_VT(&pAsync->vtResult) == VT_DISPATCH || V_VT(&pAsync->vtResult) == VT_UNKNOWN || (V_VT(&pAsync->vtResult) & VT_ARRAY)) &&
+	    pAsync->pExecutor && GetCurrentThreadId() != pAsync->pExecutor->dwThreadId)
+	{
+		pAsync->nKind       = DH_ASYNC_FREE;
+		pAsync->pNext       = NULL;
+		pAsync->pfnCallback = NULL;
+		pAsync->cRefs       = 1;
+		SubmitRequest(pAsync->pExecutor, pAsync, FALSE);
+		return;
+	}
+
+	for (iArg = 0; iArg < pAsync->cArgs; iArg++) VariantClear(&pAsync->rgArgs[iArg]);
+
+	VariantClear(&pAsync->vtResult);
+
+	if (pAsync->pStream) pAsync->pStream->lpVtbl->Release(pAsync->pStream);
+	if (pAsync->szMember)  HeapFree(GetProcessHeap(), 0, pAsync->szMember);
+	if (pAsync->szMachine) HeapFree(GetProcessHeap(), 0, pAsync->szMachine);
+	if (pAsync->hEvent) CloseHandle(pAsync->hEvent);
+
+	HeapFree(GetProcessHeap(), 0, pAsync);
+}
+
+
+
+/* **************************************************************************
+ * ExecuteRequest:
+ *   Carries out a request on the executor thread.
+ *
+ ============================================================================ */
+static HRESULT ExecuteRequest(PDH_ASYNC pAsync)
+{
+	IDispatch * pDisp = NULL;
+	HRESULT hr;
+
+	switch (pAsync->nKind)
+	{
+		case DH_ASYNC_INVOKE:
+			return dhInvokeCaptured(pAsync->invokeType, pAsync->returnType,
+			                        (pAsync->invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF)) ? NULL : &pAsync->vtResult,
+			                        pAsync->pDisp, pAsync->szMember, pAsync->rgArgs);
+
+		case DH_ASYNC_CREATE:
+			hr = dhCreateObject(pAsync->szMember, pAsync->szMachine, &pDisp);
+			break;
+
+		case DH_ASYNC_ATTACH:
+			hr = CoGetInterfaceAndReleaseStream(pAsync->pStream, &IID_IDispatch, (void **) &pDisp);
+			pAsync->pStream = NULL;
+			break;
+
+		case DH_ASYNC_RELEASE:
+			pAsync->pDisp->lpVtbl->Release(pAsync->pDisp);
+			return NOERROR;
+
+		case DH_ASYNC_FREE:
+			VariantClear(&pAsync->vtResult);
+			return NOERROR;
+
+		default:
+			return E_UNEXPECTED;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		V_VT(&pAsync->vtResult)       = VT_DISPATCH;
+		V_DISPATCH(&pAsync->vtResult) = pDisp;
+	}
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * ExecutorThread:
+ *   The executor thread owns a single threaded apartment. It takes the whole
+ * queue each time it is woken and completes the requests in order.
+ *
+ ============================================================================ */
+static DWORD WINAPI ExecutorThread(LPVOID lpParameter)
+{
+	PDH_EXECUTOR pExecutor = lpParameter;
+	PDH_ASYNC pBatch, pAsync;
+	DWORD dwIndex;
+	BOOL bStop = FALSE;
+	HRESULT hrInit;
+
+	hrInit = CoInitialize(NULL);
+
+	while (!bStop)
+	{
+		/* Keep dispatching messages while idle, as required in an STA */
+		CoWaitForMultipleHandles(0, INFINITE, 1, &pExecutor->hWake, &dwIndex);
+
+		EnterCriticalSection(&pExecutor->cs);
+		pBatch = pExecutor->pHead;
+		pExecutor->pHead = pExecutor->pTail = NULL;
+		bStop = pExecutor->bStop;
+		LeaveCriticalSection(&pExecutor->cs);
+
+		while (pBatch)
+		{
+			pAsync = pBatch;
+			pBatch = pBatch->pNext;
+
+			pAsync->hr = (SUCCEEDED(hrInit) ? ExecuteRequest(pAsync) : hrInit);
+
+			/* Objects passed as arguments belong to this apartment too */
+			while (pAsync->cArgs) VariantClear(&pAsync->rgArgs[--pAsync->cArgs]);
+
+			if (pAsync->pfnCallback) pAsync->pfnCallback(pAsync->hr, &pAsync->vtResult, pAsync->pContext);
+
+			/* Results must be released in this apartment if nobody is waiting for them */
+			if (!pAsync->hEvent) VariantClear(&pAsync->vtResult);
+			else SetEvent(pAsync->hEvent);
+
+			dhAsyncRelease(pAsync);
+		}
+	}
+
+	dhUninitialize(SUCCEEDED(hrInit));
+
+	return 0;
+}
+
+
+
+/* **************************************************************************
+ * dhCreateExecutor:
+ *   This function starts an executor thread in its own single threaded
+ * apartment. Objects created or attached through the executor live in this
+ * apartment and are called on the executor thread by dhInvokeAsync.
+ *
+ ============================================================================ */
+HRESULT dhCreateExecutor(PDH_EXECUTOR * ppExecutor)
+{
+	PDH_EXECUTOR pExecutor;
+
+	if (!ppExecutor) return E_INVALIDARG;
+
+	*ppExecutor = NULL;
+
+	pExecutor = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(struct tagDH_EXECUTOR));
+	if (!pExecutor) return E_OUTOFMEMORY;
+
+	InitializeCriticalSection(&pExecutor->cs);
+
+	if (!(pExecutor->hWake = CreateEvent(NULL, FALSE, FALSE, NULL)) ||
+	    !(pExecutor->hThread = CreateThread(NULL, 0, ExecutorThread, pExecutor, 0, &pExecutor->dwThreadId)))
+	{
+		HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+
+		if (pExecutor->hWake) CloseHandle(pExecutor->hWake);
+		DeleteCriticalSection(&pExecutor->cs);
+		HeapFree(GetProcessHeap(), 0, pExecutor);
+		return hr;
+	}
+
+	*ppExecutor = pExecutor;
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhDestroyExecutor:
+ *   This function completes the requests already queued, then stops the
+ * executor thread. Objects owned by the executor should be released with
+ * dhExecutorReleaseObject, and completion handles with dhAsyncRelease,
+ * beforehand.
+ *
+ ============================================================================ */
+void dhDestroyExecutor(PDH_EXECUTOR pExecutor)
+{
+	DWORD dwIndex;
+
+	if (!pExecutor) return;
+
+	EnterCriticalSection(&pExecutor->cs);
+	pExecutor->bStop       = TRUE;
+	pExecutor->cBatchDepth = 0;
+	LeaveCriticalSection(&pExecutor->cs);
+
+	SetEvent(pExecutor->hWake);
+	CoWaitForMultipleHandles(0, INFINITE, 1, &pExecutor->hThread, &dwIndex);
+
+	CloseHandle(pExecutor->hThread);
+	CloseHandle(pExecutor->hWake);
+	DeleteCriticalSection(&pExecutor->cs);
+	HeapFree(GetProcessHeap(), 0, pExecutor);
+}
+
+
+
+/* **************************************************************************
+ * dhExecutorBeginBatch/dhExecutorEndBatch:
+ *   Requests submitted between these calls are queued without waking the
+ * executor, which then completes them as a single batch. Batches may nest.
+ *
+ ============================================================================ */
+void dhExecutorBeginBatch(PDH_EXECUTOR pExecutor)
+{
+	EnterCriticalSection(&pExecutor->cs);
+	pExecutor->cBatchDepth++;
+	LeaveCriticalSection(&pExecutor->cs);
+}
+
+void dhExecutorEndBatch(PDH_EXECUTOR pExecutor)
+{
+	BOOL bWake;
+
+	EnterCriticalSection(&pExecutor->cs);
+	if (pExecutor->cBatchDepth > 0) pExecutor->cBatchDepth--;
+	bWake = (pExecutor->cBatchDepth == 0 && pExecutor->pHead != NULL);
+	LeaveCriticalSection(&pExecutor->cs);
+
+	if (bWake) SetEvent(pExecutor->hWake);
+}
+
+
+
+/* **************************************************************************
+ * SubmitAndWait:
+ *   Submits a request that returns an object and waits for it.
+ *
+ ============================================================================ */
+static HRESULT SubmitAndWait(PDH_EXECUTOR pExecutor, PDH_ASYNC pAsync, IDispatch ** ppDisp)
+{
+	VARIANT vtResult;
+	HRESULT hr;
+
+	/* The caller is waiting, so this request can not be held back by a batch */
+	SubmitRequest(pExecutor, pAsync, TRUE);
+
+	hr = dhAsyncWait(pAsync, INFINITE, &vtResult);
+
+	if (SUCCEEDED(hr)) *ppDisp = V_DISPATCH(&vtResult);
+
+	dhAsyncRelease(pAsync);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhExecutorCreateObject:
+ *   This function creates an object on the executor thread. The returned
+ * pointer belongs to the executor's apartment. It must only be used with
+ * dhInvokeAsync on this executor and released with dhExecutorReleaseObject.
+ *
+ ============================================================================ */
+HRESULT dhExecutorCreateObject(PDH_EXECUTOR pExecutor, LPCOLESTR szProgId, LPCWSTR szMachine, IDispatch ** ppDisp)
+{
+	PDH_ASYNC pAsync;
+	SIZE_T cb;
+
+	DH_ENTER(L"ExecutorCreateObject");
+
+	if (!pExecutor || !szProgId || !ppDisp) return DH_EXIT(E_INVALIDARG, szProgId);
+
+	*ppDisp = NULL;
+
+	if (!(pAsync = CreateRequest(DH_ASYNC_CREATE, TRUE))) return DH_EXIT(E_OUTOFMEMORY, szProgId);
+
+	cb = (wcslen(szProgId) + 1) * sizeof(WCHAR);
+	pAsync->szMember = HeapAlloc(GetProcessHeap(), 0, cb);
+	if (pAsync->szMember) CopyMemory(pAsync->szMember, szProgId, cb);
+
+	if (szMachine)
+	{
+		cb = (wcslen(szMachine) + 1) * sizeof(WCHAR);
+		pAsync->szMachine = HeapAlloc(GetProcessHeap(), 0, cb);
+		if (pAsync->szMachine) CopyMemory(pAsync->szMachine, szMachine, cb);
+	}
+
+	if (!pAsync->szMember || (szMachine && !pAsync->szMachine))
+	{
+		dhAsyncRelease(pAsync);
+		dhAsyncRelease(pAsync);
+		return DH_EXIT(E_OUTOFMEMORY, szProgId);
+	}
+
+	return DH_EXIT(SubmitAndWait(pExecutor, pAsync, ppDisp), szProgId);
+}
+
+
+
+/* **************************************************************************
+ * dhExecutorAttachObject:
+ *   This function marshals an object from the calling thread to the executor
+ * and returns the pointer to use with dhInvokeAsync on the executor.
+ *
+ ============================================================================ */
+HRESULT dhExecutorAttachObject(PDH_EXECUTOR pExecutor, IDispatch * pDisp, IDispatch ** ppExecutorDisp)
+{
+	PDH_ASYNC pAsync;
+	HRESULT hr;
+
+	DH_ENTER(L"ExecutorAttachObject");
+
+	if (!pExecutor || !pDisp || !ppExecutorDisp) return DH_EXIT(E_INVALIDARG, NULL);
+
+	*ppExecutorDisp = NULL;
+
+	if (!(pAsync = CreateRequest(DH_ASYNC_ATTACH, TRUE))) return DH_EXIT(E_OUTOFMEMORY, NULL);
+
+	hr = CoMarshalInterThreadInterfaceInStream(&IID_IDispatch, (IUnknown *) pDisp, &pAsync->pStream);
+
+	if (FAILED(hr))
+	{
+		dhAsyncRelease(pAsync);
+		dhAsyncRelease(pAsync);
+		return DH_EXIT(hr, NULL);
+	}
+
+	return DH_EXIT(SubmitAndWait(pExecutor, pAsync, ppExecutorDisp), NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhExecutorReleaseObject:
+ *   This function queues the release of an object owned by the executor.
+ *
+ ============================================================================ */
+HRESULT dhExecutorReleaseObject(PDH_EXECUTOR pExecutor, IDispatch * pDisp)
+{
+	PDH_ASYNC pAsync;
+
+	if (!pExecutor || !pDisp) return E_INVALIDARG;
+
+	if (!(pAsync = CreateRequest(DH_ASYNC_RELEASE, FALSE))) return E_OUTOFMEMORY;
+
+	pAsync->pDisp = pDisp;
+
+	SubmitRequest(pExecutor, pAsync, FALSE);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhInvokeAsyncV:
+ *   This function queues a call to the executor and returns immediately.
+ * The arguments are captured before returning, so strings and VARIANTs
+ * passed in may be freed straight away.
+ *
+ * Parameter Info:
+ *   pExecutor   - The executor which owns pDisp.
+ *   ppAsync     - If not NULL, receives a completion handle which must be
+ * released with dhAsyncRelease.
+ *   pfnCallback - If not NULL, called on the executor thread on completion.
+ *   pContext    - Passed to pfnCallback.
+ *   The remaining parameters are the same as for dhInvoke.
+ *
+ * Notes:
+ *   Requests on an executor complete in the order they were submitted.
+ * Objects passed as arguments and returned in the result belong to the
+ * executor's apartment. By reference arguments must stay valid until the
+ * request completes.
+ *
+ ============================================================================ */
+HRESULT dhInvokeAsyncV(PDH_EXECUTOR pExecutor, PDH_ASYNC * ppAsync, DH_ASYNC_CALLBACK pfnCallback, LPVOID pContext,
+                       int invokeType, VARTYPE returnType, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
+{
+	PDH_ASYNC pAsync;
+	HRESULT hr;
+
+	DH_ENTER(L"InvokeAsyncV");
+
+	if (ppAsync) *ppAsync = NULL;
+
+	if (!pExecutor || !pDisp || !szMember || !marker) return DH_EXIT(E_INVALIDARG, szMember);
+
+	if (!(pAsync = CreateRequest(DH_ASYNC_INVOKE, ppAsync != NULL))) return DH_EXIT(E_OUTOFMEMORY, szMember);
+
+	pAsync->invokeType  = invokeType;
+	pAsync->returnType  = returnType;
+	pAsync->pDisp       = pDisp;
+	pAsync->pfnCallback = pfnCallback;
+	pAsync->pContext    = pContext;
+
+	pAsync->szMember = HeapAlloc(GetProcessHeap(), 0, (wcslen(szMember) + 1) * sizeof(WCHAR));
+
+	if (!pAsync->szMember)
+		hr = E_OUTOFMEMORY;
+	else
+		hr = dhCaptureArguments(szMember, pAsync->szMember, pAsync->rgArgs, DH_MAX_CAPTURED_ARGS, &pAsync->cArgs, marker);
+
+	if (FAILED(hr))
+	{
+		if (ppAsync) dhAsyncRelease(pAsync);
+		dhAsyncRelease(pAsync);
+		return DH_EXIT(hr, szMember);
+	}
+
+	SubmitRequest(pExecutor, pAsync, FALSE);
+
+	if (ppAsync) *ppAsync = pAsync;
+
+	return DH_EXIT(NOERROR, szMember);
+}
+
+
+
+/* **************************************************************************
+ * dhInvokeAsync/dhInvokeAsyncCallback:
+ *   Variadic versions of dhInvokeAsyncV, completing through a handle or
+ * through a callback.
+ *
+ * Example(s):
+ *   dhInvokeAsync(pExecutor, &pAsync, DISPATCH_METHOD, VT_EMPTY, wdDocs, L".Add");
+ *   dhInvokeAsyncCallback(pExecutor, OnValue, pJob, DISPATCH_PROPERTYGET, VT_R8, xlApp, L".Range(%S).Value", L"A1");
+ *
+ ============================================================================ */
+HRESULT dhInvokeAsync(PDH_EXECUTOR pExecutor, PDH_ASYNC * ppAsync, int invokeType, VARTYPE returnType,
+                      IDispatch * pDisp, LPCOLESTR szMember, ...)
+{
+	HRESULT hr;
+	va_list marker;
+
+	va_start(marker, szMember);
+
+	hr = dhInvokeAsyncV(pExecutor, ppAsync, NULL, NULL, invokeType, returnType, pDisp, szMember, &marker);
+
+	va_end(marker);
+
+	return hr;
+}
+
+HRESULT dhInvokeAsyncCallback(PDH_EXECUTOR pExecutor, DH_ASYNC_CALLBACK pfnCallback, LPVOID pContext,
+                              int invokeType, VARTYPE returnType, IDispatch * pDisp, LPCOLESTR szMember, ...)
+{
+	HRESULT hr;
+	va_list marker;
+
+	va_start(marker, szMember);
+
+	hr = dhInvokeAsyncV(pExecutor, NULL, pfnCallback, pContext, invokeType, returnType, pDisp, szMember, &marker);
+
+	va_end(marker);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhAsyncWait:
+ *   This function waits for a request to complete and returns its HRESULT,
+ * or HRESULT_FROM_WIN32(WAIT_TIMEOUT) if it did not complete in time.
+ *   If pvResult is not NULL, it receives the result, which the caller must
+ * then free with VariantClear. The result can only be retrieved once.
+ *
+ ============================================================================ */
+HRESULT dhAsyncWait(PDH_ASYNC pAsync, DWORD dwTimeout, VARIANT * pvResult)
+{
+	DWORD dwIndex;
+	HRESULT hr;
+
+	if (!pAsync || !pAsync->hEvent) return E_INVALIDARG;
+
+	if (pvResult) VariantInit(pvResult);
+
+	/* Keep dispatching calls to this apartment, which the request may make */
+	hr = CoWaitForMultipleHandles(0, dwTimeout, 1, &pAsync->hEvent, &dwIndex);
+
+	if (hr == RPC_S_CALLPENDING) return HRESULT_FROM_WIN32(WAIT_TIMEOUT);
+	if (FAILED(hr)) return hr;
+
+	if (pvResult)
+	{
+		*pvResult = pAsync->vtResult;
+		VariantInit(&pAsync->vtResult);
+	}
+
+	return pAsync->hr;
+}
+
+
+
+/* **************************************************************************
+ * dhAsyncIsComplete:
+ *   This function returns TRUE if a request has completed.
+ *
+ ============================================================================ */
+BOOL dhAsyncIsComplete(PDH_ASYNC pAsync)
+{
+	return (pAsync && pAsync->hEvent && WaitForSingleObject(pAsync->hEvent, 0) == WAIT_OBJECT_0);
+}
@@ -0,0 +1,768 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+#include "convert.h"
+
+
+/* Number of hash buckets used for the names cached on each object */
+#define DH_CACHE_BUCKETS 16
+
+/* A set of names (member name followed by argument names) resolved
+ * together by a single call to IDispatch::GetIDsOfNames. cchNames includes
+ * the terminators. szAtom is the name of the last atom found to match the
+ * names, which is then compared by address. */
+typedef struct tagDH_CACHE_NAMES
+{
+	struct tagDH_CACHE_NAMES * pNext;
+	ULONG  ulHash;
+	UINT   cNames;
+	UINT   cchNames;
+	DISPID * rgDispId;
+	LPWSTR szNames;
+	LPCOLESTR szAtom;
+} DH_CACHE_NAMES;
+
+/* An object in the cache. We hold a reference on pDisp for as long as the
+ * object is cached so that its address can not be reused by another object.
+ * When a DISPID file is used, the object's type is looked up once, and
+ * bTypeKept is set if typeKey holds the key of its type in the file. */
+typedef struct tagDH_CACHE_OBJECT
+{
+	IDispatch * pDisp;
+	DWORD dwLastUse;
+	DH_CACHE_NAMES * rgBuckets[DH_CACHE_BUCKETS];
+	BOOL bTypeChecked;
+	BOOL bTypeKept;
+	ITypeInfo * pTypeInfo;
+	DH_TYPE_KEY typeKey;
+} DH_CACHE_OBJECT;
+
+/* The per-thread cache */
+typedef struct tagDH_THREAD_CACHE
+{
+	UINT  cObjects;
+	DWORD dwClock;
+	DH_CACHE_OBJECT rgObjects[1];
+} DH_THREAD_CACHE;
+
+/* Maximum number of constant strings cached on each thread. Past this the
+ * strings are allocated on each call, as if the 'k' modifier was not used. */
+#define DH_MAX_LITERALS 4096
+
+/* A BSTR for a constant string, keyed by the address of the string */
+typedef struct tagDH_LITERAL
+{
+	LPCVOID pString;
+	BSTR bstr;
+} DH_LITERAL;
+
+/* The per-thread table of constant strings (open addressing) */
+typedef struct tagDH_LITERAL_TABLE
+{
+	UINT cEntries;
+	UINT cSlots;
+	DH_LITERAL * rgSlots;
+} DH_LITERAL_TABLE;
+
+static LONG  f_cCacheObjects = 0;
+static LONG  f_lngCacheTlsInitBegin = -1, f_lngCacheTlsInitEnd = -1;
+static DWORD f_TlsIdxCache, f_TlsIdxLiterals;
+
+#define GetThreadCache()          ((DH_THREAD_CACHE *) TlsGetValue(f_TlsIdxCache))
+#define SetThreadCache(pCache)    TlsSetValue(f_TlsIdxCache, pCache)
+#define GetThreadLiterals()       ((DH_LITERAL_TABLE *) TlsGetValue(f_TlsIdxLiterals))
+#define SetThreadLiterals(pTable) TlsSetValue(f_TlsIdxLiterals, pTable)
+#define CheckCacheTlsInitialized() if (f_lngCacheTlsInitEnd != 0) InitializeCacheTlsIndex();
+
+
+
+/* **************************************************************************
+ * InitializeCacheTlsIndex:
+ *   Initializes the Tls indexes used to store each thread's caches if needed.
+ *
+ ============================================================================ */
+static void InitializeCacheTlsIndex(void)
+{
+	if (0 == InterlockedIncrement(&f_lngCacheTlsInitBegin))
+	{
+		f_TlsIdxCache        = TlsAlloc();
+		f_TlsIdxLiterals     = TlsAlloc();
+		f_lngCacheTlsInitEnd = 0;
+	}
+	else
+	{
+		/* Deal with extremely unlikely race condition */
+		while (f_lngCacheTlsInitEnd != 0) Sleep(5);
+	}
+}
+
+
+
+/* **************************************************************************
+ * dhFoldChar:
+ *   Case folds a character the same way for hashing and comparing names.
+ * Member names are compared case insensitively by IDispatch.
+ *
+ ============================================================================ */
+static WCHAR dhFoldChar(WCHAR ch)
+{
+	return (ch >= L'A' && ch <= L'Z') ? (WCHAR) (ch + (L'a' - L'A')) : ch;
+}
+
+
+
+/* **************************************************************************
+ * dhHashName:
+ *   Returns a case insensitive hash of a name. ulHash is the hash of any
+ * names preceding this one, or zero.
+ *
+ ============================================================================ */
+ULONG dhHashName(ULONG ulHash, LPCOLESTR szName)
+{
+	if (ulHash == 0) ulHash = 2166136261UL;
+
+	while (*szName)
+	{
+		ulHash = (ulHash ^ dhFoldChar(*szName++)) * 16777619UL;
+	}
+
+	/* Hash the terminator so that "ab","c" and "a","bc" differ */
+	return ulHash * 16777619UL;
+}
+
+
+
+/* **************************************************************************
+ * dhInitAtom:
+ *   Computes the length and hash of a member name at run time, for callers
+ * that can not use the _dh literals of the C++ API. The atom refers to
+ * szName, which must be a constant string as atoms are cached by address.
+ *
+ * Example(s):
+ *   static DH_ATOM atValue;
+ *   dhInitAtom(&atValue, L"Value");
+ *
+ ============================================================================ */
+HRESULT dhInitAtom(PDH_ATOM pAtom, LPCOLESTR szName)
+{
+	if (!pAtom || !szName) return E_INVALIDARG;
+
+	pAtom->szName  = szName;
+	pAtom->cchName = (UINT) wcslen(szName);
+	pAtom->ulHash  = dhHashName(0, szName);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhNamesMatch:
+ *   Checks if cached names, stored one after the other with their
+ * terminators, are the names in rgszNames.
+ *
+ ============================================================================ */
+BOOL dhNamesMatch(LPCWSTR szCached, UINT cCachedNames, LPOLESTR * rgszNames, UINT cNames)
+{
+	LPCWSTR szName;
+	UINT iName;
+
+	if (cCachedNames != cNames) return FALSE;
+
+	for (iName = 0; iName < cNames; iName++)
+	{
+		szName = rgszNames[iName];
+
+		while (*szName && dhFoldChar(*szName) == dhFoldChar(*szCached))
+		{
+			szName++;
+			szCached++;
+		}
+
+		if (*szName || *szCached) return FALSE;
+
+		szCached++; /* Skip terminator of cached name */
+	}
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * FreeCachedObject:
+ *   Frees the names cached on an object and releases it.
+ *
+ ============================================================================ */
+static void FreeCachedObject(DH_CACHE_OBJECT * pObject)
+{
+	DH_CACHE_NAMES * pNames, * pNext;
+	UINT iBucket;
+
+	if (!pObject->pDisp) return;
+
+	for (iBucket = 0; iBucket < DH_CACHE_BUCKETS; iBucket++)
+	{
+		for (pNames = pObject->rgBuckets[iBucket]; pNames; pNames = pNext)
+		{
+			pNext = pNames->pNext;
+			HeapFree(GetProcessHeap(), 0, pNames);
+		}
+	}
+
+	if (pObject->pTypeInfo) pObject->pTypeInfo->lpVtbl->Release(pObject->pTypeInfo);
+
+	pObject->pDisp->lpVtbl->Release(pObject->pDisp);
+	ZeroMemory(pObject, sizeof(DH_CACHE_OBJECT));
+}
+
+
+
+/* **************************************************************************
+ * GetCachedObject:
+ *   Finds the cache entry for pDisp on this thread. If bAdd is TRUE and the
+ * object is not yet cached, the least recently used entry is replaced.
+ *
+ ============================================================================ */
+static DH_CACHE_OBJECT * GetCachedObject(IDispatch * pDisp, BOOL bAdd)
+{
+	DH_THREAD_CACHE * pCache;
+	DH_CACHE_OBJECT * pObject, * pVictim = NULL;
+	UINT cObjects = (UINT) f_cCacheObjects;
+	UINT iObject;
+
+	if (cObjects == 0) return NULL;
+
+	CheckCacheTlsInitialized();
+	pCache = GetThreadCache();
+
+	if (pCache && pCache->cObjects != cObjects)
+	{
+		/* Cache size has been changed since this thread's cache was created */
+		dhCleanupThreadCache();
+		pCache = NULL;
+	}
+
+	if (!pCache)
+	{
+		if (!bAdd) return NULL;
+
+		pCache = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
+		                   sizeof(DH_THREAD_CACHE) + (cObjects - 1) * sizeof(DH_CACHE_OBJECT));
+		if (!pCache) return NULL;
+
+		pCache->cObjects = cObjects;
+		SetThreadCache(pCache);
+	}
+
+	pCache->dwClock++;
+
+	for (iObject = 0; iObject < cObjects; iObject++)
+	{
+		pObject = &pCache->rgObjects[iObject];
+
+		if (pObject->pDisp == pDisp)
+		{
+			pObject->dwLastUse = pCache->dwClock;
+			return pObject;
+		}
+
+		if (!pVictim || pObject->dwLastUse < pVictim->dwLastUse) pVictim = pObject;
+	}
+
+	if (!bAdd) return NULL;
+
+	FreeCachedObject(pVictim);
+
+	pVictim->pDisp     = pDisp;
+	pVictim->dwLastUse = pCache->dwClock;
+	pDisp->lpVtbl->AddRef(pDisp);
+
+	return pVictim;
+}
+
+
+
+/* **************************************************************************
+ * CheckObjectType:
+ *   Looks up the type of a cached object for the DISPID file. The key is
+ * read once per type on each thread: objects of a type share its type info,
+ * and a server's type info keeps the same proxy while a reference to it is
+ * held, so an object whose type info is held by another cached object takes
+ * that object's key.
+ *
+ ============================================================================ */
+static void CheckObjectType(DH_CACHE_OBJECT * pObject)
+{
+	DH_THREAD_CACHE * pCache = GetThreadCache();
+	IDispatch * pDisp = pObject->pDisp;
+	UINT iObject;
+
+	pObject->bTypeChecked = TRUE;
+
+	if (FAILED(pDisp->lpVtbl->GetTypeInfo(pDisp, 0, LOCALE_USER_DEFAULT, &pObject->pTypeInfo)))
+	{
+		pObject->pTypeInfo = NULL;
+		return;
+	}
+
+	for (iObject = 0; iObject < pCache->cObjects; iObject++)
+	{
+		DH_CACHE_OBJECT * pOther = &pCache->rgObjects[iObject];
+
+		if (pOther != pObject && pOther->pTypeInfo == pObject->pTypeInfo)
+		{
+			pObject->bTypeKept = pOther->bTypeKept;
+			pObject->typeKey   = pOther->typeKey;
+			return;
+		}
+	}
+
+	pObject->bTypeKept = SUCCEEDED(dhSnapshotReadTypeKey(pObject->pTypeInfo, &pObject->typeKey));
+}
+
+
+
+/* **************************************************************************
+ * FindCachedNames:
+ *   Finds a set of names cached on an object. When the name is an atom, a
+ * set already found with the same atom is matched by address and the names
+ * are only compared if their lengths are the same.
+ *
+ ============================================================================ */
+static DH_CACHE_NAMES * FindCachedNames(DH_CACHE_OBJECT * pObject, ULONG ulHash, const DH_ATOM * pAtom, LPOLESTR * rgszNames, UINT cNames)
+{
+	DH_CACHE_NAMES * pNames;
+
+	for (pNames = pObject->rgBuckets[ulHash % DH_CACHE_BUCKETS]; pNames; pNames = pNames->pNext)
+	{
+		if (pNames->ulHash != ulHash) continue;
+
+		if (pAtom)
+		{
+			if (pNames->szAtom == pAtom->szName) break;
+			if (pNames->cchNames != pAtom->cchName + 1) continue;
+		}
+
+		if (dhNamesMatch(pNames->szNames, pNames->cNames, rgszNames, cNames))
+		{
+			if (pAtom) pNames->szAtom = pAtom->szName;
+			break;
+		}
+	}
+
+	return pNames;
+}
+
+
+
+/* **************************************************************************
+ * AddCachedNames:
+ *   Caches a set of names, and the DISPIDs they resolved to, on an object.
+ *
+ ============================================================================ */
+static void AddCachedNames(DH_CACHE_OBJECT * pObject, ULONG ulHash, const DH_ATOM * pAtom, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DH_CACHE_NAMES * pNames;
+	UINT iName, cchNames = 0;
+	LPWSTR szDest;
+
+	for (iName = 0; iName < cNames; iName++)
+	{
+		cchNames += wcslen(rgszNames[iName]) + 1;
+	}
+
+	pNames = HeapAlloc(GetProcessHeap(), 0, sizeof(DH_CACHE_NAMES) +
+	                   cNames * sizeof(DISPID) + cchNames * sizeof(WCHAR));
+
+	if (!pNames) return;
+
+	pNames->ulHash   = ulHash;
+	pNames->cNames   = cNames;
+	pNames->cchNames = cchNames;
+	pNames->szAtom   = (pAtom ? pAtom->szName : NULL);
+	pNames->rgDispId = (DISPID *) (pNames + 1);
+	pNames->szNames  = (LPWSTR) (pNames->rgDispId + cNames);
+
+	CopyMemory(pNames->rgDispId, rgDispId, cNames * sizeof(DISPID));
+
+	for (iName = 0, szDest = pNames->szNames; iName < cNames; iName++)
+	{
+		LPCWSTR szSrc = rgszNames[iName];
+		while ((*szDest++ = *szSrc++));
+	}
+
+	pNames->pNext = pObject->rgBuckets[ulHash % DH_CACHE_BUCKETS];
+	pObject->rgBuckets[ulHash % DH_CACHE_BUCKETS] = pNames;
+}
+
+
+
+/* **************************************************************************
+ * CacheGetIDsOfNames:
+ *   Looks up names, whose hash has already been computed, in the calling
+ * thread's DISPID cache and only has the object resolve them if they are not
+ * found. Names resolved together are cached together.
+ *   When a DISPID file is used, names missing from the thread's cache are
+ * looked up in the file before the object is asked, and names the object
+ * resolves are added to it.
+ *
+ ============================================================================ */
+static HRESULT CacheGetIDsOfNames(IDispatch * pDisp, ULONG ulHash, const DH_ATOM * pAtom, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DH_CACHE_OBJECT * pObject;
+	DH_CACHE_NAMES * pNames;
+	BOOL bFromFile = FALSE;
+	HRESULT hr = NOERROR;
+
+	pObject = GetCachedObject(pDisp, FALSE);
+
+	if (pObject && (pNames = FindCachedNames(pObject, ulHash, pAtom, rgszNames, cNames)) != NULL)
+	{
+		CopyMemory(rgDispId, pNames->rgDispId, cNames * sizeof(DISPID));
+		return NOERROR;
+	}
+
+	if (dhSnapshotEnabled() && f_cCacheObjects && (pObject || (pObject = GetCachedObject(pDisp, TRUE))))
+	{
+		if (!pObject->bTypeChecked) CheckObjectType(pObject);
+
+		bFromFile = (pObject->bTypeKept && dhSnapshotLookup(&pObject->typeKey, ulHash, rgszNames, cNames, rgDispId));
+	}
+
+	if (!bFromFile)
+	{
+		hr = pDisp->lpVtbl->GetIDsOfNames(pDisp, &IID_NULL, rgszNames, cNames, LOCALE_USER_DEFAULT, rgDispId);
+
+		if (FAILED(hr) || f_cCacheObjects == 0) return hr;
+
+		if (!pObject && !(pObject = GetCachedObject(pDisp, TRUE))) return hr;
+
+		if (pObject->bTypeKept) dhSnapshotRecord(&pObject->typeKey, pObject->pTypeInfo, ulHash, rgszNames, cNames, rgDispId);
+	}
+
+	AddCachedNames(pObject, ulHash, pAtom, rgszNames, cNames, rgDispId);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhCacheGetIDsOfNames:
+ *   Internal replacement for IDispatch::GetIDsOfNames which uses the calling
+ * thread's DISPID cache. The names are only hashed if the cache is enabled.
+ *
+ ============================================================================ */
+HRESULT dhCacheGetIDsOfNames(IDispatch * pDisp, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	ULONG ulHash = 0;
+	UINT iName;
+
+	if (f_cCacheObjects)
+	{
+		for (iName = 0; iName < cNames; iName++)
+		{
+			ulHash = dhHashName(ulHash, rgszNames[iName]);
+		}
+	}
+
+	return CacheGetIDsOfNames(pDisp, ulHash, NULL, rgszNames, cNames, rgDispId);
+}
+
+
+
+/* **************************************************************************
+ * dhCacheGetIDOfAtom:
+ *   Resolves an atom with the calling thread's DISPID cache, using the hash
+ * computed when the atom was created.
+ *
+ ============================================================================ */
+HRESULT dhCacheGetIDOfAtom(IDispatch * pDisp, const DH_ATOM * pAtom, DISPID * pDispId)
+{
+	LPOLESTR szName = (LPOLESTR) pAtom->szName;
+
+	return CacheGetIDsOfNames(pDisp, pAtom->ulHash, pAtom, &szName, 1, pDispId);
+}
+
+
+
+/* **************************************************************************
+ * dhCacheAddNames:
+ *   Internal function used by dhPrewarm to cache names resolved from an
+ * object's type info on the calling thread. pKey and pTypeInfo, if given,
+ * save looking up the object's type again for the DISPID file.
+ *
+ ============================================================================ */
+void dhCacheAddNames(IDispatch * pDisp, const DH_TYPE_KEY * pKey, ITypeInfo * pTypeInfo, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DH_CACHE_OBJECT * pObject;
+	ULONG ulHash = 0;
+	UINT iName;
+
+	if (f_cCacheObjects == 0 || !(pObject = GetCachedObject(pDisp, TRUE))) return;
+
+	if (pKey && !pObject->bTypeChecked)
+	{
+		pObject->bTypeChecked = TRUE;
+		pObject->bTypeKept    = TRUE;
+		pObject->typeKey      = *pKey;
+		pObject->pTypeInfo    = pTypeInfo;
+		pTypeInfo->lpVtbl->AddRef(pTypeInfo);
+	}
+
+	for (iName = 0; iName < cNames; iName++)
+	{
+		ulHash = dhHashName(ulHash, rgszNames[iName]);
+	}
+
+	if (!FindCachedNames(pObject, ulHash, NULL, rgszNames, cNames)) AddCachedNames(pObject, ulHash, NULL, rgszNames, cNames, rgDispId);
+}
+
+
+
+/* **************************************************************************
+ * dhSetDispIdCacheSize:
+ *   Sets the number of objects for which each thread caches resolved DISPIDs.
+ * Zero, the default, disables the cache.
+ *
+ * Notes:
+ *   A cached object is kept alive (AddRef'd) until it is evicted, flushed with
+ * dhFlushDispIdCache or the thread calls dhUninitialize. This guarantees that
+ * a cached address always refers to the same object.
+ *
+ * Example(s):
+ *   dhSetDispIdCacheSize(32);
+ *
+ ============================================================================ */
+HRESULT dhSetDispIdCacheSize(UINT cObjects)
+{
+	if (cObjects > 4096) return E_INVALIDARG;
+
+	InterlockedExchange(&f_cCacheObjects, (LONG) cObjects);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhFlushDispIdCache:
+ *   Removes pDisp from the calling thread's DISPID cache and releases the
+ * cache's reference on it. If pDisp is NULL the whole cache is flushed.
+ *
+ ============================================================================ */
+HRESULT dhFlushDispIdCache(IDispatch * pDisp)
+{
+	DH_THREAD_CACHE * pCache;
+	UINT iObject;
+
+	CheckCacheTlsInitialized();
+	pCache = GetThreadCache();
+
+	if (!pCache) return NOERROR;
+
+	for (iObject = 0; iObject < pCache->cObjects; iObject++)
+	{
+		if (!pDisp || pCache->rgObjects[iObject].pDisp == pDisp)
+		{
+			FreeCachedObject(&pCache->rgObjects[iObject]);
+		}
+	}
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * FindLiteralSlot:
+ *   Returns the slot holding pString in a table, or the empty slot where it
+ * should be inserted.
+ *
+ ============================================================================ */
+static DH_LITERAL * FindLiteralSlot(DH_LITERAL_TABLE * pTable, LPCVOID pString)
+{
+	UINT iSlot = (UINT) (((ULONG_PTR) pString >> 1) * 2654435761UL) & (pTable->cSlots - 1);
+
+	while (pTable->rgSlots[iSlot].pString && pTable->rgSlots[iSlot].pString != pString)
+	{
+		iSlot = (iSlot + 1) & (pTable->cSlots - 1);
+	}
+
+	return &pTable->rgSlots[iSlot];
+}
+
+
+
+/* **************************************************************************
+ * GrowLiteralTable:
+ *   Doubles the number of slots in a table (or creates the slots).
+ *
+ ============================================================================ */
+static BOOL GrowLiteralTable(DH_LITERAL_TABLE * pTable)
+{
+	DH_LITERAL * rgOld = pTable->rgSlots;
+	UINT cOld = pTable->cSlots, iSlot;
+	UINT cSlots = (cOld ? cOld * 2 : 64);
+
+	pTable->rgSlots = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, cSlots * sizeof(DH_LITERAL));
+
+	if (!pTable->rgSlots)
+	{
+		pTable->rgSlots = rgOld;
+		return FALSE;
+	}
+
+	pTable->cSlots = cSlots;
+
+	for (iSlot = 0; iSlot < cOld; iSlot++)
+	{
+		if (rgOld[iSlot].pString) *FindLiteralSlot(pTable, rgOld[iSlot].pString) = rgOld[iSlot];
+	}
+
+	if (rgOld) HeapFree(GetProcessHeap(), 0, rgOld);
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * dhCacheLiteral:
+ *   Internal function used for the 'k' modifier (%kS, %ks and %kT). Returns
+ * the BSTR cached on this thread for a constant string, creating it on first
+ * use. The string is identified by its address, so it must not change for
+ * the life of the thread (i.e. it should be a string literal).
+ *
+ *   *pbFree is set to TRUE if the string could not be cached and the caller
+ * must free the returned BSTR.
+ *
+ ============================================================================ */
+HRESULT dhCacheLiteral(LPCVOID pString, BOOL bAnsi, BSTR * pbstr, BOOL * pbFree)
+{
+	DH_LITERAL_TABLE * pTable;
+	DH_LITERAL * pSlot = NULL;
+	HRESULT hr = NOERROR;
+
+	*pbFree = FALSE;
+	*pbstr  = NULL;
+
+	if (!pString) return NOERROR;
+
+	CheckCacheTlsInitialized();
+	pTable = GetThreadLiterals();
+
+	if (!pTable && (pTable = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_LITERAL_TABLE))))
+	{
+		SetThreadLiterals(pTable);
+	}
+
+	if (pTable && pTable->cSlots)
+	{
+		pSlot = FindLiteralSlot(pTable, pString);
+
+		if (pSlot->pString)
+		{
+			*pbstr = pSlot->bstr;
+			return NOERROR;
+		}
+	}
+
+	if (bAnsi)
+	{
+		hr = ConvertAnsiStrToBStr((LPCSTR) pString, pbstr);
+	}
+	else if (!(*pbstr = SysAllocString((LPCOLESTR) pString)))
+	{
+		hr = E_OUTOFMEMORY;
+	}
+
+	if (FAILED(hr)) return hr;
+
+	/* Keep the load factor under 3/4 */
+	if (pTable && pTable->cEntries < DH_MAX_LITERALS &&
+	    ((pTable->cEntries + 1) * 4 < pTable->cSlots * 3 || GrowLiteralTable(pTable)))
+	{
+		pSlot = FindLiteralSlot(pTable, pString);
+
+		pSlot->pString = pString;
+		pSlot->bstr    = *pbstr;
+		pTable->cEntries++;
+	}
+	else
+	{
+		*pbFree = TRUE;
+	}
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhCleanupThreadLiterals:
+ *   Internal function called by dhUninitialize to free the constant strings
+ * cached on this thread.
+ *
+ ============================================================================ */
+void dhCleanupThreadLiterals(void)
+{
+	DH_LITERAL_TABLE * pTable;
+	UINT iSlot;
+
+	CheckCacheTlsInitialized();
+	pTable = GetThreadLiterals();
+
+	if (pTable)
+	{
+		for (iSlot = 0; iSlot < pTable->cSlots; iSlot++)
+		{
+			SysFreeString(pTable->rgSlots[iSlot].bstr);
+		}
+
+		if (pTable->rgSlots) HeapFree(GetProcessHeap(), 0, pTable->rgSlots);
+		HeapFree(GetProcessHeap(), 0, pTable);
+		SetThreadLiterals(NULL);
+	}
+}
+
+
+
+/* **************************************************************************
+ * dhCleanupThreadCache:
+ *   Internal function called by dhUninitialize to free this thread's
+ * DISPID cache.
+ *
+ ============================================================================ */
+void dhCleanupThreadCache(void)
+{
+	DH_THREAD_CACHE * pCache;
+
+	CheckCacheTlsInitialized();
+	pCache = GetThreadCache();
+
+	if (pCache)
+	{
+		dhFlushDispIdCache(NULL);
+		HeapFree(GetProcessHeap(), 0, pCache);
+		SetThreadCache(NULL);
+	}
+}
@@ -0,0 +1,598 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+#include "convert.h"
+
+/* Number of items requested from the enumerator by each call to Next */
+#define DH_ENUM_BATCH 64
+
+/* Initial number of rows allocated for each column */
+#define DH_COLUMNS_INITIAL_ROWS 64
+
+/* Marks a string which has not been converted from a pool offset to a pointer */
+#define DH_POOL_NULL ((SIZE_T) -1)
+
+
+
+/* **************************************************************************
+ * FreeExcepInfo:
+ *   Frees the strings in an EXCEPINFO returned by IDispatch::Invoke when the
+ * error is not reported as an exception.
+ *
+ ============================================================================ */
+static void FreeExcepInfo(HRESULT hr, EXCEPINFO * pExcepInfo)
+{
+	if (hr == DISP_E_EXCEPTION)
+	{
+		SysFreeString(pExcepInfo->bstrDescription);
+		SysFreeString(pExcepInfo->bstrSource);
+		SysFreeString(pExcepInfo->bstrHelpFile);
+	}
+}
+
+
+
+/* **************************************************************************
+ * dhCreateColumns:
+ *   Parses a column list such as "Name:%S;Size:%Ld;Modified:%D" and creates
+ * empty column buffers for it. Column names can not contain sub objects or
+ * arguments.
+ *
+ ============================================================================ */
+HRESULT dhCreateColumns(LPCOLESTR szColumns, PDH_COLUMNS * ppColumns)
+{
+	PDH_COLUMNS pColumns;
+	DH_COLUMN * pColumn;
+	LPWSTR szParams, szField, szColon;
+	UINT cColumns = 0, iColumn, size;
+	BSTR bstrCopy;
+	WCHAR chIdentifier;
+
+	if (!szColumns || !ppColumns) return E_INVALIDARG;
+
+	*ppColumns = NULL;
+
+	for (szField = (LPWSTR) szColumns; *szField; szField++)
+	{
+		if (*szField == L':') cColumns++;
+	}
+
+	if (cColumns == 0) return E_INVALIDARG;
+
+	if (!(bstrCopy = SysAllocString(szColumns))) return E_OUTOFMEMORY;
+
+	pColumns = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_COLUMNS) + cColumns * sizeof(DH_COLUMN));
+
+	if (!pColumns)
+	{
+		SysFreeString(bstrCopy);
+		return E_OUTOFMEMORY;
+	}
+
+	pColumns->rgColumns = (DH_COLUMN *) (pColumns + 1);
+	pColumns->bstrSpec  = bstrCopy;
+
+	for (szParams = bstrCopy, iColumn = 0; *szParams; )
+	{
+		szField = szParams;
+
+		while (*szParams && *szParams != L';') szParams++;
+		if (*szParams) *szParams++ = L'\0';
+
+		while (*szField == L' ') szField++;
+		if (*szField == L'.') szField++;
+		if (*szField == L'\0') continue;
+
+		if (!(szColon = wcschr(szField, L':')) || szColon[1] != L'%' || szColon == szField ||
+		    wcscspn(szField, L".(%") < (size_t) (szColon - szField))
+		{
+			dhFreeColumns(pColumns);
+			return E_INVALIDARG;
+		}
+
+		*szColon = L'\0';
+		szColon += 2;
+
+		/* Length modifier, as with ExtractArgument */
+		for (size = 0; *szColon == L'l' || *szColon == L'L'; szColon++)
+		{
+			size = (*szColon == L'L' ? 2 : size + 1);
+		}
+
+		chIdentifier = *szColon;
+		if (chIdentifier == L'T') chIdentifier = (dh_g_bIsUnicodeMode ? L'S' : L's');
+
+		pColumn = &pColumns->rgColumns[iColumn++];
+		pColumn->szName       = szField;
+		pColumn->chIdentifier = chIdentifier;
+
+		switch (chIdentifier)
+		{
+			case L'd': pColumn->vt = (size == 2 ? VT_I8  : VT_I4);  pColumn->cbElement = (size == 2 ? sizeof(LONGLONG)  : sizeof(LONG));  break;
+			case L'u': pColumn->vt = (size == 2 ? VT_UI8 : VT_UI4); pColumn->cbElement = (size == 2 ? sizeof(ULONGLONG) : sizeof(ULONG)); break;
+			case L'e': pColumn->vt = VT_R8;    pColumn->cbElement = sizeof(DOUBLE);  break;
+			case L'b': pColumn->vt = VT_BOOL;  pColumn->cbElement = sizeof(BOOL);    break;
+			case L'D': pColumn->vt = VT_DATE;  pColumn->cbElement = sizeof(DATE);    break;
+			case L't': pColumn->vt = VT_DATE;  pColumn->cbElement = sizeof(time_t);  break;
+			case L'S': pColumn->vt = VT_BSTR;  pColumn->cbElement = sizeof(LPCWSTR); break;
+			case L's': pColumn->vt = VT_BSTR;  pColumn->cbElement = sizeof(LPCSTR);  break;
+			case L'v': pColumn->vt = VT_EMPTY; pColumn->cbElement = sizeof(VARIANT); break;
+			default:
+				DEBUG_NOTIFY_INVALID_IDENTIFIER(chIdentifier);
+				dhFreeColumns(pColumns);
+				return E_INVALIDARG;
+		}
+	}
+
+	pColumns->cColumns = iColumn;
+
+	*ppColumns = pColumns;
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * PoolAppend:
+ *   Appends cb bytes to the string pool and returns their offset.
+ *
+ ============================================================================ */
+static HRESULT PoolAppend(PDH_COLUMNS pColumns, SIZE_T cb, LPBYTE * ppDest, SIZE_T * pOffset)
+{
+	SIZE_T cbNeeded;
+	LPBYTE pbNew;
+
+	/* Keep every string aligned for WCHARs */
+	pColumns->cbPool = (pColumns->cbPool + sizeof(WCHAR) - 1) & ~(sizeof(WCHAR) - 1);
+
+	cbNeeded = pColumns->cbPool + cb;
+
+	if (cbNeeded > pColumns->cbPoolAllocated)
+	{
+		SIZE_T cbNew = (pColumns->cbPoolAllocated ? pColumns->cbPoolAllocated * 2 : 4096);
+		while (cbNew < cbNeeded) cbNew *= 2;
+
+		if (pColumns->pbPool)
+			pbNew = HeapReAlloc(GetProcessHeap(), 0, pColumns->pbPool, cbNew);
+		else
+			pbNew = HeapAlloc(GetProcessHeap(), 0, cbNew);
+
+		if (!pbNew) return E_OUTOFMEMORY;
+
+		pColumns->pbPool          = pbNew;
+		pColumns->cbPoolAllocated = cbNew;
+	}
+
+	*pOffset = pColumns->cbPool;
+	*ppDest  = pColumns->pbPool + pColumns->cbPool;
+	pColumns->cbPool = cbNeeded;
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhColumnsAddRow:
+ *   Makes room for a new row in every column. The new row starts out null.
+ *
+ ============================================================================ */
+HRESULT dhColumnsAddRow(PDH_COLUMNS pColumns, UINT * piRow)
+{
+	DH_COLUMN * pColumn;
+	UINT iColumn, cRowsNew;
+	LPVOID pvNew;
+
+	if (pColumns->cRows == pColumns->cRowsAllocated)
+	{
+		cRowsNew = (pColumns->cRowsAllocated ? pColumns->cRowsAllocated * 2 : DH_COLUMNS_INITIAL_ROWS);
+
+		for (iColumn = 0; iColumn < pColumns->cColumns; iColumn++)
+		{
+			pColumn = &pColumns->rgColumns[iColumn];
+
+			if (pColumn->pData)
+				pvNew = HeapReAlloc(GetProcessHeap(), 0, pColumn->pData, cRowsNew * pColumn->cbElement);
+			else
+				pvNew = HeapAlloc(GetProcessHeap(), 0, cRowsNew * pColumn->cbElement);
+
+			if (!pvNew) return E_OUTOFMEMORY;
+			pColumn->pData = pvNew;
+
+			if (pColumn->pbNull)
+				pvNew = HeapReAlloc(GetProcessHeap(), 0, pColumn->pbNull, cRowsNew);
+			else
+				pvNew = HeapAlloc(GetProcessHeap(), 0, cRowsNew);
+
+			if (!pvNew) return E_OUTOFMEMORY;
+			pColumn->pbNull = pvNew;
+		}
+
+		pColumns->cRowsAllocated = cRowsNew;
+	}
+
+	*piRow = pColumns->cRows++;
+
+	for (iColumn = 0; iColumn < pColumns->cColumns; iColumn++)
+	{
+		pColumn = &pColumns->rgColumns[iColumn];
+
+		pColumn->pbNull[*piRow] = TRUE;
+		ZeroMemory((LPBYTE) pColumn->pData + *piRow * pColumn->cbElement, pColumn->cbElement);
+
+		if (pColumn->vt == VT_BSTR) ((SIZE_T *) pColumn->pData)[*piRow] = DH_POOL_NULL;
+	}
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhColumnsSetValue:
+ *   Stores a value in a cell. The value is coerced to the type of the column
+ * and strings are copied to the string pool. Values that can not be
+ * coerced and null values leave the cell null.
+ *
+ ============================================================================ */
+HRESULT dhColumnsSetValue(PDH_COLUMNS pColumns, UINT iColumn, UINT iRow, VARIANT * pvValue)
+{
+	DH_COLUMN * pColumn = &pColumns->rgColumns[iColumn];
+	LPBYTE pCell = (LPBYTE) pColumn->pData + iRow * pColumn->cbElement;
+	VARIANT vtValue;
+	LPBYTE pbDest;
+	SIZE_T offset;
+	UINT cch;
+	INT cb;
+	HRESULT hr = NOERROR;
+
+	if (V_VT(pvValue) == VT_NULL || V_VT(pvValue) == VT_EMPTY) return NOERROR;
+
+	if (pColumn->vt == VT_EMPTY)
+	{
+		hr = VariantCopy((VARIANT *) pCell, pvValue);
+		if (SUCCEEDED(hr)) pColumn->pbNull[iRow] = FALSE;
+		return hr;
+	}
+
+	VariantInit(&vtValue);
+
+	if (V_VT(pvValue) != pColumn->vt)
+	{
+		hr = VariantChangeType(&vtValue, pvValue, 16 /* = VARIANT_LOCALBOOL */, pColumn->vt);
+		if (FAILED(hr)) return hr;
+		pvValue = &vtValue;
+	}
+
+	switch (pColumn->chIdentifier)
+	{
+		case L'd':
+		case L'u':
+			if (pColumn->vt == VT_I8 || pColumn->vt == VT_UI8)
+				*((LONGLONG *) pCell) = V_I8(pvValue);
+			else
+				*((LONG *) pCell) = V_I4(pvValue);
+			break;
+
+		case L'e':
+			*((DOUBLE *) pCell) = V_R8(pvValue);
+			break;
+
+		case L'b':
+			*((BOOL *) pCell) = (V_BOOL(pvValue) != VARIANT_FALSE);
+			break;
+
+		case L'D':
+			*((DATE *) pCell) = V_DATE(pvValue);
+			break;
+
+		case L't':
+			hr = ConvertVariantTimeToTimeT(V_DATE(pvValue), (time_t *) pCell);
+			break;
+
+		case L'S':
+			cch = SysStringLen(V_BSTR(pvValue));
+			hr = PoolAppend(pColumns, (cch + 1) * sizeof(WCHAR), &pbDest, &offset);
+			if (SUCCEEDED(hr))
+			{
+				CopyMemory(pbDest, V_BSTR(pvValue), cch * sizeof(WCHAR));
+				((LPWSTR) pbDest)[cch] = L'\0';
+				*((SIZE_T *) pCell) = offset;
+			}
+			break;
+
+		case L's':
+			cch = SysStringLen(V_BSTR(pvValue));
+			cb  = WideCharToMultiByte(CP_ACP, 0, V_BSTR(pvValue), cch, NULL, 0, NULL, NULL);
+			hr  = PoolAppend(pColumns, cb + 1, &pbDest, &offset);
+			if (SUCCEEDED(hr))
+			{
+				WideCharToMultiByte(CP_ACP, 0, V_BSTR(pvValue), cch, (LPSTR) pbDest, cb, NULL, NULL);
+				pbDest[cb] = '\0';
+				*((SIZE_T *) pCell) = offset;
+			}
+			break;
+	}
+
+	if (SUCCEEDED(hr)) pColumn->pbNull[iRow] = FALSE;
+
+	VariantClear(&vtValue);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhColumnsComplete:
+ *   Converts the pool offsets stored in string columns to pointers. This must
+ * be called once all the rows have been added, as adding to the pool may move it.
+ *
+ ============================================================================ */
+void dhColumnsComplete(PDH_COLUMNS pColumns)
+{
+	DH_COLUMN * pColumn;
+	SIZE_T * pOffsets;
+	UINT iColumn, iRow;
+
+	for (iColumn = 0; iColumn < pColumns->cColumns; iColumn++)
+	{
+		pColumn = &pColumns->rgColumns[iColumn];
+
+		if (pColumn->vt != VT_BSTR) continue;
+
+		pOffsets = (SIZE_T *) pColumn->pData;
+
+		for (iRow = 0; iRow < pColumns->cRows; iRow++)
+		{
+			((LPCVOID *) pOffsets)[iRow] = (pOffsets[iRow] == DH_POOL_NULL ? NULL :
+			                                (LPCVOID) (pColumns->pbPool + pOffsets[iRow]));
+		}
+	}
+}
+
+
+
+/* **************************************************************************
+ * dhColumnsReset:
+ *   Removes all the rows from the columns while keeping their buffers, so
+ * that they can be filled again without new allocations.
+ *
+ ============================================================================ */
+void dhColumnsReset(PDH_COLUMNS pColumns)
+{
+	DH_COLUMN * pColumn;
+	UINT iColumn, iRow;
+
+	for (iColumn = 0; iColumn < pColumns->cColumns; iColumn++)
+	{
+		pColumn = &pColumns->rgColumns[iColumn];
+
+		if (pColumn->vt == VT_EMPTY)
+		{
+			for (iRow = 0; iRow < pColumns->cRows; iRow++) VariantClear(&((VARIANT *) pColumn->pData)[iRow]);
+		}
+	}
+
+	pColumns->cRows  = 0;
+	pColumns->cbPool = 0;
+}
+
+
+
+/* **************************************************************************
+ * dhFreeColumns:
+ *   Frees the column buffers returned by dhEnumProject.
+ *
+ ============================================================================ */
+void dhFreeColumns(PDH_COLUMNS pColumns)
+{
+	DH_COLUMN * pColumn;
+	UINT iColumn, iRow;
+
+	if (!pColumns) return;
+
+	for (iColumn = 0; iColumn < pColumns->cColumns; iColumn++)
+	{
+		pColumn = &pColumns->rgColumns[iColumn];
+
+		if (pColumn->vt == VT_EMPTY && pColumn->pData)
+		{
+			for (iRow = 0; iRow < pColumns->cRows; iRow++) VariantClear(&((VARIANT *) pColumn->pData)[iRow]);
+		}
+
+		if (pColumn->pData)  HeapFree(GetProcessHeap(), 0, pColumn->pData);
+		if (pColumn->pbNull) HeapFree(GetProcessHeap(), 0, pColumn->pbNull);
+	}
+
+	if (pColumns->pbPool) HeapFree(GetProcessHeap(), 0, pColumns->pbPool);
+
+	SysFreeString(pColumns->bstrSpec);
+	HeapFree(GetProcessHeap(), 0, pColumns);
+}
+
+
+
+/* **************************************************************************
+ * ProjectItem:
+ *   Reads the columns of one item into row iRow. rgDispIds caches the DISPID
+ * of each column. They are resolved on the first item and again only if an
+ * item does not recognise them.
+ *
+ ============================================================================ */
+static void ProjectItem(PDH_COLUMNS pColumns, UINT iRow, IDispatch * pItem, DISPID * rgDispIds)
+{
+	DISPPARAMS dp = { 0 };
+	EXCEPINFO excep;
+	VARIANT vtResult;
+	UINT iColumn;
+	HRESULT hr;
+
+	for (iColumn = 0; iColumn < pColumns->cColumns; iColumn++)
+	{
+		LPOLESTR szName = (LPOLESTR) pColumns->rgColumns[iColumn].szName;
+		BOOL bResolved  = FALSE;
+
+		do
+		{
+			if (rgDispIds[iColumn] == DISPID_UNKNOWN || bResolved)
+			{
+				hr = pItem->lpVtbl->GetIDsOfNames(pItem, &IID_NULL, &szName, 1, LOCALE_USER_DEFAULT, &rgDispIds[iColumn]);
+				if (FAILED(hr)) { rgDispIds[iColumn] = DISPID_UNKNOWN; break; }
+				bResolved = TRUE;
+			}
+
+			ZeroMemory(&excep, sizeof(excep));
+			VariantInit(&vtResult);
+
+			hr = dhInterceptInvoke(pItem, szName, rgDispIds[iColumn], DISPATCH_PROPERTYGET | DISPATCH_METHOD,
+			                       &dp, &vtResult, &excep, NULL);
+
+			FreeExcepInfo(hr, &excep);
+
+			/* The cached DISPID may not be valid for a different kind of item */
+			if ((hr == DISP_E_MEMBERNOTFOUND || hr == DISP_E_UNKNOWNNAME) && !bResolved) bResolved = TRUE;
+			else break;
+		}
+		while (TRUE);
+
+		if (SUCCEEDED(hr))
+		{
+			dhColumnsSetValue(pColumns, iColumn, iRow, &vtResult);
+			VariantClear(&vtResult);
+		}
+	}
+}
+
+
+
+/* **************************************************************************
+ * dhEnumProject:
+ *   This function enumerates a collection and reads a list of properties from
+ * every item into typed column buffers. This avoids a dhGetValue call per
+ * property and item when processing large collections.
+ *
+ * Parameter Info:
+ *   pDisp     - The collection to enumerate.
+ *   szColumns - The properties to read, in the same format as dhGetValues.
+ * Supported identifiers are d/u/Ld/Lu/e/b/D/t/S/s/T/v.
+ *   ppColumns - Receives the columns, which must be freed with dhFreeColumns.
+ *   pcRows    - If this is not NULL, receives the number of rows.
+ *
+ * Notes:
+ *   The items are retrieved from the enumerator in batches and the DISPID of
+ * each property is only resolved once. Each column is an array of cRows values
+ * (LONG, ULONG, LONGLONG, ULONGLONG, DOUBLE, BOOL, DATE, time_t, LPCWSTR,
+ * LPCSTR or VARIANT) in its pData member. Strings are stored in a single pool
+ * owned by the columns. pbNull[iRow] is TRUE if the value could not be read or
+ * was null.
+ *
+ * Example(s):
+ *   dhEnumProject(colFiles, L"Name:%S;Size:%Ld;DateLastModified:%D", &pColumns, &cRows);
+ *   LPCWSTR * rgszNames = (LPCWSTR *) pColumns->rgColumns[0].pData;
+ *
+ ============================================================================ */
+HRESULT dhEnumProject(IDispatch * pDisp, LPCOLESTR szColumns, PDH_COLUMNS * ppColumns, UINT * pcRows)
+{
+	VARIANT rgvtItems[DH_ENUM_BATCH];
+	DISPID * rgDispIds = NULL;
+	IEnumVARIANT * pEnum = NULL;
+	PDH_COLUMNS pColumns = NULL;
+	ULONG cFetched, iItem;
+	UINT iColumn, iRow;
+	HRESULT hr, hrNext;
+
+	DH_ENTER(L"EnumProject");
+
+	if (!pDisp || !szColumns || !ppColumns) return DH_EXIT(E_INVALIDARG, szColumns);
+
+	*ppColumns = NULL;
+	if (pcRows) *pcRows = 0;
+
+	hr = dhCreateColumns(szColumns, &pColumns);
+
+	if (SUCCEEDED(hr))
+	{
+		rgDispIds = HeapAlloc(GetProcessHeap(), 0, pColumns->cColumns * sizeof(DISPID));
+		if (!rgDispIds) hr = E_OUTOFMEMORY;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		for (iColumn = 0; iColumn < pColumns->cColumns; iColumn++) rgDispIds[iColumn] = DISPID_UNKNOWN;
+
+		hr = dhEnumBegin(&pEnum, pDisp, NULL);
+	}
+
+	while (SUCCEEDED(hr))
+	{
+		cFetched = 0;
+
+		hrNext = pEnum->lpVtbl->Next(pEnum, DH_ENUM_BATCH, rgvtItems, &cFetched);
+
+		if (FAILED(hrNext))
+		{
+			hr = hrNext;
+			break;
+		}
+
+		if (cFetched == 0) break;
+
+		for (iItem = 0; iItem < cFetched; iItem++)
+		{
+			if (SUCCEEDED(hr)) hr = dhColumnsAddRow(pColumns, &iRow);
+
+			if (SUCCEEDED(hr) &&
+			    (V_VT(&rgvtItems[iItem]) == VT_DISPATCH ||
+			     SUCCEEDED(VariantChangeType(&rgvtItems[iItem], &rgvtItems[iItem], 0, VT_DISPATCH))) &&
+			    V_DISPATCH(&rgvtItems[iItem]) != NULL)
+			{
+				ProjectItem(pColumns, iRow, V_DISPATCH(&rgvtItems[iItem]), rgDispIds);
+			}
+
+			VariantClear(&rgvtItems[iItem]);
+		}
+
+		/* A short batch means the enumeration is complete */
+		if (hrNext == S_FALSE) break;
+	}
+
+	if (pEnum) pEnum->lpVtbl->Release(pEnum);
+	if (rgDispIds) HeapFree(GetProcessHeap(), 0, rgDispIds);
+
+	if (FAILED(hr))
+	{
+		dhFreeColumns(pColumns);
+		return DH_EXIT(hr, szColumns);
+	}
+
+	dhColumnsComplete(pColumns);
+
+	*ppColumns = pColumns;
+	if (pcRows) *pcRows = pColumns->cRows;
+
+	return DH_EXIT(NOERROR, szColumns);
+}
@@ -45,22 +45,70 @@ BOOL dh_g_bIsUnicodeMode;
  ============================================================================ */
 HRESULT dhInvokeArray(int invokeType, VARIANT * pvResult, UINT cArgs,
                          IDispatch * pDisp, LPCOLESTR szMember, VARIANT * pArgs)
+{
+	DH_ENTER(L"InvokeArray");
+
+	return DH_EXIT(dhInvokeArrayEx(invokeType, pvResult, cArgs, pDisp, szMember, pArgs, 0, NULL), szMember);
+}
+
+
+
+/* **************************************************************************
+ * dhInvokeArrayEx:
+ *   This function is the same as dhInvokeArray except that it can also pass
+ * named arguments. The member name and all the argument names are resolved
+ * with a single call to IDispatch::GetIDsOfNames.
+ *
+ * Parameter Info:
+ *   cNamedArgs  - The number of named arguments.
+ *   pszArgNames - The names of the named arguments. The named arguments come
+ * first in pArgs, so pszArgNames[0] names pArgs[0]. For DISPATCH_PROPERTYPUT
+ * pArgs[0] is always the property value and pszArgNames[0] names pArgs[1].
+ *
+ * Example(s):
+ *   LPCOLESTR szNames[] = { L"ReadOnly", L"FileName" };
+ *   dhInvokeArrayEx(DISPATCH_METHOD, &vtResult, 2, wdDocs, L"Open", &vtArgs, 2, szNames);
+ *
+ ============================================================================ */
+HRESULT dhInvokeArrayEx(int invokeType, VARIANT * pvResult, UINT cArgs, IDispatch * pDisp,
+                        LPCOLESTR szMember, VARIANT * pArgs, UINT cNamedArgs, LPCOLESTR * pszArgNames)
 {
 	DISPPARAMS dp       = { 0 };
 	EXCEPINFO excep     = { 0 };
-	DISPID dispidNamed  = DISPID_PROPERTYPUT;
+	LPOLESTR rgszNames[DH_MAX_ARGS + 1];
+	DISPID rgDispIds[DH_MAX_ARGS + 1];
+	BOOL bPut = (invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF)) != 0;
 	DISPID dispID;
-	UINT uiArgErr;
+	UINT uiArgErr, iName;
 	HRESULT hr;
 
-	DH_ENTER(L"InvokeArray");
+	DH_ENTER(L"InvokeArrayEx");
 
 	if(!pDisp || !szMember || (cArgs != 0 && !pArgs)) return DH_EXIT(E_INVALIDARG, szMember);
 
-	/* Get DISPID for name passed */
-	hr = pDisp->lpVtbl->GetIDsOfNames(pDisp, &IID_NULL, (LPOLESTR *) &szMember, 1, LOCALE_USER_DEFAULT, &dispID);
+	if(cNamedArgs > DH_MAX_ARGS || (cNamedArgs != 0 &&
+	   (!pszArgNames || cNamedArgs + (bPut ? 1 : 0) > cArgs))) return DH_EXIT(E_INVALIDARG, szMember);
 
-	if(FAILED(hr)) return DH_EXITEX(hr, TRUE, szMember, szMember, NULL, 0);
+	/* Get DISPIDs for the member name and any argument names passed */
+	rgszNames[0] = (LPOLESTR) szMember;
+	for (iName = 0; iName < cNamedArgs; iName++) rgszNames[iName + 1] = (LPOLESTR) pszArgNames[iName];
+
+	hr = dhCacheGetIDsOfNames(pDisp, rgszNames, cNamedArgs + 1, rgDispIds);
+
+	if(FAILED(hr))
+	{
+		iName = 0;
+
+		/* Report the argument name that could not be resolved, if any */
+		if (hr == DISP_E_UNKNOWNNAME && cNamedArgs != 0 && rgDispIds[0] != DISPID_UNKNOWN)
+		{
+			for (iName = 1; iName < cNamedArgs && rgDispIds[iName] != DISPID_UNKNOWN; iName++);
+		}
+
+		return DH_EXITEX(hr, TRUE, rgszNames[iName], szMember, NULL, 0);
+	}
+
+	dispID = rgDispIds[0];
 
 	if (pvResult != NULL) VariantInit(pvResult);
 
@@ -68,15 +116,72 @@ HRESULT dhInvokeArray(int invokeType, VARIANT * pvResult, UINT cArgs,
 	dp.cArgs  = cArgs;
 	dp.rgvarg = pArgs;
 
-	/* Handle special-case for property-puts */
-	if(invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF))
+	/* Handle special-case for property-puts. The property value is the
+	 * first named argument, followed by any other named arguments. */
+	if(bPut)
+	{
+		rgDispIds[0] = DISPID_PROPERTYPUT;
+		dp.cNamedArgs = cNamedArgs + 1;
+		dp.rgdispidNamedArgs = rgDispIds;
+	}
+	else if(cNamedArgs)
+	{
+		dp.cNamedArgs = cNamedArgs;
+		dp.rgdispidNamedArgs = &rgDispIds[1];
+	}
+
+	/* Make the call */
+	hr = dhInterceptInvoke(pDisp, szMember, dispID, invokeType, &dp, pvResult, &excep, &uiArgErr);
+
+	return DH_EXITEX(hr, TRUE, szMember, szMember, &excep, uiArgErr);
+}
+
+
+
+/* **************************************************************************
+ * dhInvokeAtom:
+ *   This function is the same as dhInvokeArray except that the member is an
+ * atom. The atom's hash is used to look up the DISPID cache without hashing
+ * or parsing the member name. Atoms are created with dhInitAtom or, in C++,
+ * with the _dh literal.
+ *
+ * Example(s):
+ *   static constexpr DH_ATOM atValue = L"Value"_dh;
+ *   dhInvokeAtom(DISPATCH_PROPERTYGET, &vtResult, 0, pCell, &atValue, NULL);
+ *
+ ============================================================================ */
+HRESULT dhInvokeAtom(int invokeType, VARIANT * pvResult, UINT cArgs, IDispatch * pDisp, const DH_ATOM * pAtom, VARIANT * pArgs)
+{
+	DISPPARAMS dp       = { 0 };
+	EXCEPINFO excep     = { 0 };
+	DISPID dispidNamed  = DISPID_PROPERTYPUT;
+	BOOL bPut = (invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF)) != 0;
+	LPCOLESTR szMember  = (pAtom ? pAtom->szName : NULL);
+	DISPID dispID;
+	UINT uiArgErr;
+	HRESULT hr;
+
+	DH_ENTER(L"InvokeAtom");
+
+	if(!pDisp || !szMember || (cArgs != 0 && !pArgs) || (bPut && cArgs == 0)) return DH_EXIT(E_INVALIDARG, szMember);
+
+	hr = dhCacheGetIDOfAtom(pDisp, pAtom, &dispID);
+	if(FAILED(hr)) return DH_EXITEX(hr, TRUE, szMember, szMember, NULL, 0);
+
+	if (pvResult != NULL) VariantInit(pvResult);
+
+	/* Build DISPPARAMS. The value of a property-put is its first argument. */
+	dp.cArgs  = cArgs;
+	dp.rgvarg = pArgs;
+
+	if(bPut)
 	{
 		dp.cNamedArgs = 1;
 		dp.rgdispidNamedArgs = &dispidNamed;
 	}
 
 	/* Make the call */
-	hr = pDisp->lpVtbl->Invoke(pDisp, dispID, &IID_NULL, LOCALE_USER_DEFAULT, (WORD) invokeType, &dp, pvResult, &excep, &uiArgErr);
+	hr = dhInterceptInvoke(pDisp, szMember, dispID, invokeType, &dp, pvResult, &excep, &uiArgErr);
 
 	return DH_EXITEX(hr, TRUE, szMember, szMember, &excep, uiArgErr);
 }
@@ -96,9 +201,13 @@ HRESULT dhInvokeArray(int invokeType, VARIANT * pvResult, UINT cArgs,
  ============================================================================ */
 HRESULT dhCallMethodV(IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
 {
+	HRESULT hr;
+
 	DH_ENTER(L"CallMethodV");
 
-	return DH_EXIT(dhInvokeV(DISPATCH_METHOD, VT_EMPTY, NULL, pDisp, szMember, marker), szMember);
+	hr = dhInvokeV(DISPATCH_METHOD, VT_EMPTY, NULL, pDisp, szMember, marker);
+
+	return DH_EXIT(hr, szMember);
 }
 
 
@@ -117,9 +226,13 @@ HRESULT dhCallMethodV(IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
  ============================================================================ */
 HRESULT dhPutValueV(IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
 {
+	HRESULT hr;
+
 	DH_ENTER(L"PutValueV");
 
-	return DH_EXIT(dhInvokeV(DISPATCH_PROPERTYPUT, VT_EMPTY, NULL, pDisp, szMember, marker), szMember);
+	hr = dhInvokeV(DISPATCH_PROPERTYPUT, VT_EMPTY, NULL, pDisp, szMember, marker);
+
+	return DH_EXIT(hr, szMember);
 }
 
 
@@ -134,9 +247,13 @@ HRESULT dhPutValueV(IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
  ============================================================================ */
 HRESULT dhPutRefV(IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
 {
+	HRESULT hr;
+
 	DH_ENTER(L"PutRefV");
 
-	return DH_EXIT(dhInvokeV(DISPATCH_PROPERTYPUTREF, VT_EMPTY, NULL, pDisp, szMember, marker), szMember);
+	hr = dhInvokeV(DISPATCH_PROPERTYPUTREF, VT_EMPTY, NULL, pDisp, szMember, marker);
+
+	return DH_EXIT(hr, szMember);
 }
 
 
@@ -198,7 +315,7 @@ HRESULT dhGetValueV(LPCWSTR szIdentifier, void * pResult, IDispatch * pDisp, LPC
 	}
 
 	/* Delegate to get the value in a variant(vtResult) */
-	hr = dhInvokeV(DISPATCH_PROPERTYGET|DISPATCH_METHOD, returnType, &vtResult, pDisp, szMember, marker);
+	hr = dhPropertyCacheGetV(returnType, &vtResult, pDisp, szMember, marker);
 	if (FAILED(hr)) return DH_EXIT(hr, szMember);
 
 	/* dhInvokeV will only succeed if it can return a variant of
@@ -290,3 +407,133 @@ HRESULT dhGetValueV(LPCWSTR szIdentifier, void * pResult, IDispatch * pDisp, LPC
 
 	return DH_EXIT(hr, szMember);
 }
+
+
+
+/* **************************************************************************
+ * dhGetValuesV:
+ *   This function retrieves several values from an object in one call. Each
+ * field in szFields is a member followed by a colon and the identifier of the
+ * type to return. Fields are seperated by semi-colons.
+ *
+ *   The object path shared by all the fields, if any, is traversed only once
+ * and the values are then retrieved back to back from the sub object. Used
+ * with the DISPID cache, repeated calls do not resolve the names again.
+ *
+ * Parameter Info:
+ *   rghrFields - If this is not NULL, receives the HRESULT of each field.
+ *   cFields    - The number of entries in rghrFields.
+ *   marker     - For each field, the address that receives the value followed by
+ * the arguments of the field's member, if any, as with dhGetValue.
+ *
+ * Return Value:
+ *   This function returns the hr of the last field to fail or NOERROR if all
+ * values were retrieved.
+ *
+ * Example(s):
+ *   dhGetValues(objQuickFix, L"CSName:%s;Description:%s;HotFixID:%s", &szCSName, &szDesc, &szHotFixID);
+ *   dhGetValues(xlApp, L"ActiveSheet.Name:%S;ActiveSheet.Cells(%d,%d).Value:%e", &szName, &dblValue, 1, 2);
+ *
+ ============================================================================ */
+HRESULT dhGetValuesV(HRESULT * rghrFields, UINT cFields, IDispatch * pDisp, LPCOLESTR szFields, va_list * marker)
+{
+	LPWSTR szMembers[DH_MAX_FIELDS];
+	LPWSTR szIdentifiers[DH_MAX_FIELDS];
+	WCHAR szPrefix[DH_MAX_MEMBER];
+	IDispatch * pObject = pDisp;
+	HRESULT hr, hrPrefix = NOERROR, hrRet = NOERROR;
+	UINT cParsed = 0, cchPrefix = 0, iField, cch;
+	LPWSTR szParams, szField, szColon;
+	BSTR bstrCopy;         /* Copy of input string that we can modify. */
+	va_list vaField;
+	void * pResult;
+
+	DH_ENTER(L"GetValuesV");
+
+	if (!pDisp || !szFields || !marker || (cFields != 0 && !rghrFields)) return DH_EXIT(E_INVALIDARG, szFields);
+
+	if (!(bstrCopy = SysAllocString(szFields))) return DH_EXIT(E_OUTOFMEMORY, szFields);
+
+	/* Split the fields at each semi-colon and each field at its last ":%" */
+	for (szParams = bstrCopy; *szParams; )
+	{
+		szField = szParams;
+		szColon = NULL;
+
+		for (; *szParams && *szParams != L';'; szParams++)
+		{
+			if (szParams[0] == L':' && szParams[1] == L'%') szColon = szParams;
+		}
+
+		if (*szParams) *szParams++ = L'\0';
+
+		if (*szField == L'\0') continue;
+
+		if (!szColon || cParsed == DH_MAX_FIELDS)
+		{
+			SysFreeString(bstrCopy);
+			return DH_EXIT(E_INVALIDARG, szFields);
+		}
+
+		*szColon = L'\0';
+		if (*szField == L'.') szField++;
+
+		szMembers[cParsed]     = szField;
+		szIdentifiers[cParsed] = szColon + 1;
+		cParsed++;
+	}
+
+	/* Find the object path shared by all the fields. eg. "ActiveSheet."
+	 * It can not contain arguments as they are passed for each field. */
+	for (cch = 0; cParsed > 1 && cch < ARRAYSIZE(szPrefix) &&
+	              szMembers[0][cch] && szMembers[0][cch] != L'%'; cch++)
+	{
+		for (iField = 1; iField < cParsed && szMembers[iField][cch] == szMembers[0][cch]; iField++);
+
+		if (iField < cParsed) break;
+
+		if (szMembers[0][cch] == L'.') cchPrefix = cch + 1;
+	}
+
+	if (cchPrefix)
+	{
+		/* Get the shared sub object once */
+		CopyMemory(szPrefix, szMembers[0], (cchPrefix - 1) * sizeof(WCHAR));
+		szPrefix[cchPrefix - 1] = L'\0';
+
+		hrPrefix = dhGetValueV(L"%o", &pObject, pDisp, szPrefix, marker);
+	}
+
+	for (iField = 0; iField < cParsed; iField++)
+	{
+		va_copy(vaField, *marker);
+
+		pResult = va_arg(*marker, void *);
+
+		hr = hrPrefix;
+		if (SUCCEEDED(hr)) hr = dhGetValueV(szIdentifiers[iField], pResult, pObject, szMembers[iField] + cchPrefix, marker);
+
+		if (FAILED(hr))
+		{
+			/* The arguments of a failed field may not all have been consumed.
+			 * Restart from the start of the field and skip them. */
+			va_end(*marker);
+			va_copy(*marker, vaField);
+
+			pResult = va_arg(*marker, void *);
+			dhSkipArguments(szMembers[iField] + cchPrefix, marker);
+
+			hrRet = hr;
+		}
+
+		va_end(vaField);
+
+		if (iField < cFields) rghrFields[iField] = hr;
+	}
+
+	if (cchPrefix && SUCCEEDED(hrPrefix)) pObject->lpVtbl->Release(pObject);
+
+	SysFreeString(bstrCopy);
+
+	return DH_EXIT(hrRet, szFields);
+}
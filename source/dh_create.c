@@ -20,6 +20,351 @@
 #include "disphelper.h"
 
 
+/* The per-thread cache of resolved ProgIDs and their class factories.
+ * Class factories belong to the apartment that obtained them, so each
+ * thread has its own cache. */
+typedef struct tagDH_FACTORY_ENTRY
+{
+	LPWSTR szProgId;
+	CLSID clsid;
+	DWORD dwClsContext;
+	IClassFactory * pCf;
+	DWORD dwCreated;
+	DWORD dwLastUse;
+} DH_FACTORY_ENTRY;
+
+typedef struct tagDH_FACTORY_CACHE
+{
+	UINT  cEntries;
+	DWORD dwClock;
+	DH_FACTORY_ENTRY rgEntries[1];
+} DH_FACTORY_CACHE;
+
+static LONG  f_cFactoryEntries = 0;
+static LONG  f_dwFactoryTimeToLive = 0;
+static LONG  f_lngFactoryTlsInitBegin = -1, f_lngFactoryTlsInitEnd = -1;
+static DWORD f_TlsIdxFactory;
+
+#define GetFactoryCache()          ((DH_FACTORY_CACHE *) TlsGetValue(f_TlsIdxFactory))
+#define SetFactoryCache(pCache)    TlsSetValue(f_TlsIdxFactory, pCache)
+#define CheckFactoryTlsInitialized() if (f_lngFactoryTlsInitEnd != 0) InitializeFactoryTlsIndex();
+
+/* The errors returned by a cached factory whose server has exited */
+#define IsServerGone(hr) ((hr) == RPC_E_DISCONNECTED || (hr) == CO_E_OBJNOTCONNECTED || \
+                          (hr) == HRESULT_FROM_WIN32(RPC_S_SERVER_UNAVAILABLE))
+
+
+
+/* **************************************************************************
+ * InitializeFactoryTlsIndex:
+ *   Initializes the Tls index used to store each thread's factory cache.
+ *
+ ============================================================================ */
+static void InitializeFactoryTlsIndex(void)
+{
+	if (0 == InterlockedIncrement(&f_lngFactoryTlsInitBegin))
+	{
+		f_TlsIdxFactory        = TlsAlloc();
+		f_lngFactoryTlsInitEnd = 0;
+	}
+	else
+	{
+		/* Deal with extremely unlikely race condition */
+		while (f_lngFactoryTlsInitEnd != 0) Sleep(5);
+	}
+}
+
+
+
+/* **************************************************************************
+ * FreeFactoryEntry:
+ *   Unlocks and releases a cached class factory and frees its entry.
+ *
+ ============================================================================ */
+static void FreeFactoryEntry(DH_FACTORY_ENTRY * pEntry)
+{
+	if (!pEntry->szProgId) return;
+
+	if (pEntry->pCf)
+	{
+		pEntry->pCf->lpVtbl->LockServer(pEntry->pCf, FALSE);
+		pEntry->pCf->lpVtbl->Release(pEntry->pCf);
+	}
+
+	HeapFree(GetProcessHeap(), 0, pEntry->szProgId);
+	ZeroMemory(pEntry, sizeof(DH_FACTORY_ENTRY));
+}
+
+
+
+/* **************************************************************************
+ * FindFactoryEntry:
+ *   Finds the cache entry for szProgId on this thread. A dwClsContext of zero
+ * matches any context. If ppVictim is not NULL and the ProgID is not cached,
+ * it receives the least recently used entry, which the caller may reuse.
+ *
+ ============================================================================ */
+static DH_FACTORY_ENTRY * FindFactoryEntry(LPCOLESTR szProgId, DWORD dwClsContext, DH_FACTORY_ENTRY ** ppVictim)
+{
+	DH_FACTORY_CACHE * pCache;
+	DH_FACTORY_ENTRY * pEntry, * pVictim = NULL;
+	UINT cEntries = (UINT) f_cFactoryEntries;
+	DWORD dwTimeToLive = (DWORD) f_dwFactoryTimeToLive;
+	UINT iEntry;
+
+	if (ppVictim) *ppVictim = NULL;
+
+	if (cEntries == 0)
+	{
+		/* Release the factories cached before the cache was disabled */
+		if (f_lngFactoryTlsInitEnd == 0 && GetFactoryCache()) dhCleanupThreadFactoryCache();
+		return NULL;
+	}
+
+	CheckFactoryTlsInitialized();
+	pCache = GetFactoryCache();
+
+	if (pCache && pCache->cEntries != cEntries)
+	{
+		/* Cache size has been changed since this thread's cache was created */
+		dhCleanupThreadFactoryCache();
+		pCache = NULL;
+	}
+
+	if (!pCache)
+	{
+		if (!ppVictim) return NULL;
+
+		pCache = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
+		                   sizeof(DH_FACTORY_CACHE) + (cEntries - 1) * sizeof(DH_FACTORY_ENTRY));
+		if (!pCache) return NULL;
+
+		pCache->cEntries = cEntries;
+		SetFactoryCache(pCache);
+	}
+
+	pCache->dwClock++;
+
+	for (iEntry = 0; iEntry < cEntries; iEntry++)
+	{
+		pEntry = &pCache->rgEntries[iEntry];
+
+		if (pEntry->szProgId && dwTimeToLive && GetTickCount() - pEntry->dwCreated >= dwTimeToLive)
+		{
+			FreeFactoryEntry(pEntry);
+		}
+
+		if (pEntry->szProgId && (dwClsContext == 0 || pEntry->dwClsContext == dwClsContext) &&
+		    lstrcmpiW(pEntry->szProgId, szProgId) == 0)
+		{
+			pEntry->dwLastUse = pCache->dwClock;
+			return pEntry;
+		}
+
+		if (!pVictim || pEntry->dwLastUse < pVictim->dwLastUse) pVictim = pEntry;
+	}
+
+	if (ppVictim)
+	{
+		FreeFactoryEntry(pVictim);
+		pVictim->dwLastUse = pCache->dwClock;
+		*ppVictim = pVictim;
+	}
+
+	return NULL;
+}
+
+
+
+/* **************************************************************************
+ * ResolveClsid:
+ *   Converts a ProgID or CLSID string to a CLSID, using a cached CLSID
+ * if there is one.
+ *
+ ============================================================================ */
+static HRESULT ResolveClsid(LPCOLESTR szProgId, CLSID * pClsid)
+{
+	DH_FACTORY_ENTRY * pEntry;
+
+	if (L'{' == szProgId[0]) return CLSIDFromString((LPOLESTR) szProgId, pClsid);
+
+	if ((pEntry = FindFactoryEntry(szProgId, 0, NULL)) != NULL)
+	{
+		*pClsid = pEntry->clsid;
+		return NOERROR;
+	}
+
+	return CLSIDFromProgID(szProgId, pClsid);
+}
+
+
+
+/* **************************************************************************
+ * IsLocalServerFactory:
+ *   Checks if a class factory is a proxy to another process, rather than
+ * an in-process object. Only proxies implement IClientSecurity.
+ *
+ ============================================================================ */
+static BOOL IsLocalServerFactory(IClassFactory * pCf)
+{
+	IClientSecurity * pSecurity;
+
+	if (FAILED(pCf->lpVtbl->QueryInterface(pCf, &IID_IClientSecurity, (void **) &pSecurity))) return FALSE;
+
+	pSecurity->lpVtbl->Release(pSecurity);
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * GetClassFactory:
+ *   Gets the class factory for szProgId. When the cache is enabled, the CLSID
+ * and, for local servers, the locked class factory are cached. *pbCached is
+ * set if a cached factory was returned.
+ *
+ ============================================================================ */
+static HRESULT GetClassFactory(LPCOLESTR szProgId, DWORD dwClsContext, COSERVERINFO * pServerInfo,
+                               IClassFactory ** ppCf, BOOL * pbCached)
+{
+	DH_FACTORY_ENTRY * pEntry, * pVictim;
+	CLSID clsid;
+	SIZE_T cb;
+	HRESULT hr;
+
+	*pbCached = FALSE;
+
+	if ((pEntry = FindFactoryEntry(szProgId, dwClsContext, &pVictim)) != NULL)
+	{
+		if (pEntry->pCf && !pServerInfo)
+		{
+			*ppCf = pEntry->pCf;
+			(*ppCf)->lpVtbl->AddRef(*ppCf);
+			*pbCached = TRUE;
+			return NOERROR;
+		}
+
+		return CoGetClassObject(&pEntry->clsid, dwClsContext, pServerInfo, &IID_IClassFactory, (void **) ppCf);
+	}
+
+	if (L'{' == szProgId[0])
+		hr = CLSIDFromString((LPOLESTR) szProgId, &clsid);
+	else
+		hr = CLSIDFromProgID(szProgId, &clsid);
+
+	if (SUCCEEDED(hr)) hr = CoGetClassObject(&clsid, dwClsContext, pServerInfo, &IID_IClassFactory, (void **) ppCf);
+
+	if (SUCCEEDED(hr) && pVictim)
+	{
+		cb = (wcslen(szProgId) + 1) * sizeof(WCHAR);
+
+		if ((pVictim->szProgId = HeapAlloc(GetProcessHeap(), 0, cb)) != NULL)
+		{
+			CopyMemory(pVictim->szProgId, szProgId, cb);
+			pVictim->clsid        = clsid;
+			pVictim->dwClsContext = dwClsContext;
+			pVictim->dwCreated    = GetTickCount();
+
+			/* Keep the server running while its factory is cached */
+			if (!pServerInfo && IsLocalServerFactory(*ppCf) && SUCCEEDED((*ppCf)->lpVtbl->LockServer(*ppCf, TRUE)))
+			{
+				pVictim->pCf = *ppCf;
+				pVictim->pCf->lpVtbl->AddRef(pVictim->pCf);
+			}
+		}
+	}
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhSetClassFactoryCache:
+ *   Sets the number of ProgIDs cached by each thread and how long, in
+ * milliseconds, a cached class factory is kept (0 for no limit). The cache
+ * is disabled by default and setting cEntries to zero disables it again.
+ *
+ * Notes:
+ *   A cached local server class factory is locked with
+ * IClassFactory::LockServer, which keeps its server running until the entry
+ * expires, is flushed with dhFlushClassFactoryCache or the thread calls
+ * dhUninitialize. For in-process servers only the CLSID is cached.
+ *   Factories belong to the thread that cached them, so disabling the cache
+ * releases the calling thread's factories at once and those of other threads
+ * the next time they create or get an object.
+ *
+ * Example(s):
+ *   dhSetClassFactoryCache(16, 5 * 60 * 1000);
+ *
+ ============================================================================ */
+HRESULT dhSetClassFactoryCache(UINT cEntries, DWORD dwTimeToLive)
+{
+	if (cEntries > 1024) return E_INVALIDARG;
+
+	InterlockedExchange(&f_dwFactoryTimeToLive, (LONG) dwTimeToLive);
+	InterlockedExchange(&f_cFactoryEntries, (LONG) cEntries);
+
+	if (cEntries == 0) dhCleanupThreadFactoryCache();
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhFlushClassFactoryCache:
+ *   Removes szProgId from the calling thread's class factory cache. If
+ * szProgId is NULL the whole cache is flushed.
+ *
+ ============================================================================ */
+HRESULT dhFlushClassFactoryCache(LPCOLESTR szProgId)
+{
+	DH_FACTORY_CACHE * pCache;
+	UINT iEntry;
+
+	CheckFactoryTlsInitialized();
+	pCache = GetFactoryCache();
+
+	if (!pCache) return NOERROR;
+
+	for (iEntry = 0; iEntry < pCache->cEntries; iEntry++)
+	{
+		if (pCache->rgEntries[iEntry].szProgId &&
+		    (!szProgId || lstrcmpiW(pCache->rgEntries[iEntry].szProgId, szProgId) == 0))
+		{
+			FreeFactoryEntry(&pCache->rgEntries[iEntry]);
+		}
+	}
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhCleanupThreadFactoryCache:
+ *   Internal function called by dhUninitialize to free this thread's
+ * class factory cache.
+ *
+ ============================================================================ */
+void dhCleanupThreadFactoryCache(void)
+{
+	DH_FACTORY_CACHE * pCache;
+
+	CheckFactoryTlsInitialized();
+	pCache = GetFactoryCache();
+
+	if (pCache)
+	{
+		dhFlushClassFactoryCache(NULL);
+		HeapFree(GetProcessHeap(), 0, pCache);
+		SetFactoryCache(NULL);
+	}
+}
+
+
+
 /* **************************************************************************
  * dhCreateObjectEx:
  *   This function is used to create a COM object based on a program id.
@@ -28,29 +373,41 @@
  *   We use CoGetClassObject/CreateInstance as it is supported on Windows 95
  * without DCOM while CoCreateInstanceEx is not. (The pServerInfo argument
  * to CoGetClassObject is reserved and must be NULL in this scenario).
+ *   If the class factory cache is enabled, a cached factory whose server has
+ * exited (the creation fails with RPC_E_DISCONNECTED, CO_E_OBJNOTCONNECTED
+ * or RPC_S_SERVER_UNAVAILABLE) is flushed and the object is created again
+ * with a new factory.
  *
  ============================================================================ */
 HRESULT dhCreateObjectEx(LPCOLESTR szProgId, REFIID riid, DWORD dwClsContext,
 			    COSERVERINFO * pServerInfo, void ** ppv)
 {
-	CLSID clsid;
 	HRESULT hr;
 	IClassFactory * pCf = NULL;
+	BOOL bCached;
 
 	DH_ENTER(L"CreateObjectEx");
 
 	if (!szProgId || !riid || !ppv) return DH_EXIT(E_INVALIDARG, szProgId);
 
-	if (L'{' == szProgId[0])
-		hr = CLSIDFromString((LPOLESTR) szProgId, &clsid);
-	else
-		hr = CLSIDFromProgID(szProgId, &clsid);
+	hr = GetClassFactory(szProgId, dwClsContext, pServerInfo, &pCf, &bCached);
 
-	if (SUCCEEDED(hr)) hr = CoGetClassObject(&clsid, dwClsContext, pServerInfo, &IID_IClassFactory, (void **) &pCf);
 	if (SUCCEEDED(hr)) hr = pCf->lpVtbl->CreateInstance(pCf, NULL, riid, ppv);
 
 	if (pCf) pCf->lpVtbl->Release(pCf);
 
+	if (bCached && IsServerGone(hr))
+	{
+		pCf = NULL;
+		dhFlushClassFactoryCache(szProgId);
+
+		hr = GetClassFactory(szProgId, dwClsContext, pServerInfo, &pCf, &bCached);
+
+		if (SUCCEEDED(hr)) hr = pCf->lpVtbl->CreateInstance(pCf, NULL, riid, ppv);
+
+		if (pCf) pCf->lpVtbl->Release(pCf);
+	}
+
 	return DH_EXIT(hr, szProgId);
 }
 
@@ -100,10 +457,7 @@ HRESULT dhGetObjectEx(LPCOLESTR szPathName, LPCOLESTR szProgId, REFIID riid,
 		CLSID clsid;
 		IUnknown * pUnk = NULL;
 
-		if (L'{' == szProgId[0])
-			hr = CLSIDFromString((LPOLESTR) szProgId, &clsid);
-		else
-			hr = CLSIDFromProgID(szProgId, &clsid);
+		hr = ResolveClsid(szProgId, &clsid);
 
 		if (SUCCEEDED(hr)) hr = GetActiveObject(&clsid, NULL, &pUnk);
 		if (SUCCEEDED(hr)) hr = pUnk->lpVtbl->QueryInterface(pUnk, riid, ppv);
@@ -149,7 +503,7 @@ HRESULT dhGetObject(LPCOLESTR szPathName, LPCOLESTR szProgId, IDispatch ** ppDis
 
 
 /* **************************************************************************
- * dhCallMethod / dhPutValue / dhPutRef / dhGetValue / dhInvoke
+ * dhCallMethod / dhPutValue / dhPutRef / dhGetValue / dhGetValues / dhInvoke
  *
  *   These functions are the accessor functions that initialise the va_list
  * and call their corresponding V versions.
@@ -236,6 +590,44 @@ HRESULT dhGetValue(LPCWSTR szIdentifier, void * pResult, IDispatch * pDisp, LPCO
 
 
 
+/* ======================================================================== */
+HRESULT dhGetValues(IDispatch * pDisp, LPCOLESTR szFields, ...)
+{
+	HRESULT hr;
+	va_list marker;
+
+	DH_ENTER(L"GetValues");
+
+	va_start(marker, szFields);
+
+	hr = dhGetValuesV(NULL, 0, pDisp, szFields, &marker);
+
+	va_end(marker);
+
+	return DH_EXIT(hr, szFields);
+}
+
+
+
+/* ======================================================================== */
+HRESULT dhGetValuesEx(HRESULT * rghrFields, UINT cFields, IDispatch * pDisp, LPCOLESTR szFields, ...)
+{
+	HRESULT hr;
+	va_list marker;
+
+	DH_ENTER(L"GetValuesEx");
+
+	va_start(marker, szFields);
+
+	hr = dhGetValuesV(rghrFields, cFields, pDisp, szFields, &marker);
+
+	va_end(marker);
+
+	return DH_EXIT(hr, szFields);
+}
+
+
+
 /* ======================================================================== */
 HRESULT dhInvoke(int invokeType, VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember, ...)
 {
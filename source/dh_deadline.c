@@ -0,0 +1,379 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* The watchdog thread exits after this long without a call to watch */
+#define DH_WATCHDOG_IDLE_MS 30000
+
+/* Structure to store a thread's call timeout and, while the thread is in a
+ * timed call, the call's deadline */
+typedef struct tagDH_DEADLINE
+{
+	struct tagDH_DEADLINE * pNext;
+	DWORD dwThreadId;
+	DWORD dwTimeout;
+	DWORD dwDeadline;
+	BOOL bArmed;
+	BOOL bTimedOut;
+	BOOL bCancelEnabled;
+} DH_DEADLINE;
+
+/* Upper bounds of the latency buckets, in microseconds */
+static const ULONG f_rgCallHistogramBounds[DH_CALL_HISTOGRAM_BUCKETS - 1] = { 1000, 10000, 100000, 1000000 };
+
+static DH_CALL_STATISTICS f_CallStatistics;
+
+static DH_DEADLINE * f_pArmed = NULL;
+static HANDLE f_hWatchdog = NULL;
+static HANDLE f_hWatchdogWake = NULL;
+static DWORD f_dwWatchdogNext;
+
+static CRITICAL_SECTION f_csDeadline;
+static LONG f_lngDeadlineInitBegin = -1, f_lngDeadlineInitEnd = -1;
+static DWORD f_TlsIdxDeadline;
+
+#define GetDeadline()          ((DH_DEADLINE *) TlsGetValue(f_TlsIdxDeadline))
+#define SetDeadline(pDeadline) TlsSetValue(f_TlsIdxDeadline, pDeadline)
+#define CheckDeadlineInitialized() if (f_lngDeadlineInitEnd != 0) InitializeDeadlines();
+
+
+
+/* **************************************************************************
+ * InitializeDeadlines:
+ *   Initializes the Tls index used to store each thread's call timeout and
+ * the critical section which protects the deadlines being watched.
+ *
+ ============================================================================ */
+static void InitializeDeadlines(void)
+{
+	if (0 == InterlockedIncrement(&f_lngDeadlineInitBegin))
+	{
+		f_TlsIdxDeadline = TlsAlloc();
+		InitializeCriticalSection(&f_csDeadline);
+		f_lngDeadlineInitEnd = 0;
+	}
+	else
+	{
+		/* Deal with extremely unlikely race condition */
+		while (f_lngDeadlineInitEnd != 0) Sleep(5);
+	}
+}
+
+
+
+/* **************************************************************************
+ * WatchdogThread:
+ *   Cancels the calls which pass their deadline. The thread is started by
+ * the first timed call and exits once no call has been watched for a while.
+ *
+ ============================================================================ */
+static DWORD WINAPI WatchdogThread(LPVOID lpParameter)
+{
+	DH_DEADLINE * pDeadline;
+	DWORD dwNow, dwWait;
+	LONG lRemaining;
+	BOOL bIdle = FALSE;
+	HRESULT hrInit = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	for (;;)
+	{
+		EnterCriticalSection(&f_csDeadline);
+
+		if (bIdle && !f_pArmed)
+		{
+			CloseHandle(f_hWatchdog);
+			f_hWatchdog = NULL;
+			LeaveCriticalSection(&f_csDeadline);
+			break;
+		}
+
+		dwNow  = GetTickCount();
+		dwWait = DH_WATCHDOG_IDLE_MS;
+
+		for (pDeadline = f_pArmed; pDeadline; pDeadline = pDeadline->pNext)
+		{
+			if (pDeadline->bTimedOut) continue;
+
+			lRemaining = (LONG) (pDeadline->dwDeadline - dwNow);
+
+			if (lRemaining <= 0)
+			{
+				/* The thread is still in its call, as it disarms under the lock */
+				pDeadline->bTimedOut = TRUE;
+				CoCancelCall(pDeadline->dwThreadId, 0);
+			}
+			else if ((DWORD) lRemaining < dwWait)
+			{
+				dwWait = (DWORD) lRemaining;
+			}
+		}
+
+		bIdle = (f_pArmed == NULL);
+		f_dwWatchdogNext = dwNow + dwWait;
+
+		LeaveCriticalSection(&f_csDeadline);
+
+		if (WaitForSingleObject(f_hWatchdogWake, dwWait) != WAIT_TIMEOUT) bIdle = FALSE;
+	}
+
+	if (SUCCEEDED(hrInit)) CoUninitialize();
+
+	return 0;
+}
+
+
+
+/* **************************************************************************
+ * ArmDeadline:
+ *   Starts watching a thread's call, starting the watchdog if needed. The
+ * watchdog is only woken if the call is due before its next check.
+ *
+ ============================================================================ */
+static BOOL ArmDeadline(DH_DEADLINE * pDeadline)
+{
+	BOOL bWake;
+
+	EnterCriticalSection(&f_csDeadline);
+
+	pDeadline->dwDeadline = GetTickCount() + pDeadline->dwTimeout;
+	pDeadline->bTimedOut  = FALSE;
+
+	if (!f_hWatchdogWake) f_hWatchdogWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	if (f_hWatchdogWake && !f_hWatchdog)
+	{
+		f_dwWatchdogNext = pDeadline->dwDeadline;
+		f_hWatchdog = CreateThread(NULL, 0, WatchdogThread, NULL, 0, NULL);
+	}
+
+	if (f_hWatchdog)
+	{
+		pDeadline->pNext = f_pArmed;
+		f_pArmed = pDeadline;
+		pDeadline->bArmed = TRUE;
+	}
+
+	bWake = (pDeadline->bArmed && (LONG) (pDeadline->dwDeadline - f_dwWatchdogNext) < 0);
+
+	LeaveCriticalSection(&f_csDeadline);
+
+	if (bWake) SetEvent(f_hWatchdogWake);
+
+	return pDeadline->bArmed;
+}
+
+
+
+/* **************************************************************************
+ * DisarmDeadline:
+ *   Stops watching a thread's call. Returns TRUE if the call was cancelled.
+ *
+ ============================================================================ */
+static BOOL DisarmDeadline(DH_DEADLINE * pDeadline)
+{
+	DH_DEADLINE ** ppLink;
+
+	EnterCriticalSection(&f_csDeadline);
+
+	for (ppLink = &f_pArmed; *ppLink; ppLink = &(*ppLink)->pNext)
+	{
+		if (*ppLink == pDeadline)
+		{
+			*ppLink = pDeadline->pNext;
+			break;
+		}
+	}
+
+	pDeadline->bArmed = FALSE;
+
+	LeaveCriticalSection(&f_csDeadline);
+
+	return pDeadline->bTimedOut;
+}
+
+
+
+/* **************************************************************************
+ * RecordCall:
+ *   Adds a timed call to the call statistics.
+ *
+ ============================================================================ */
+static void RecordCall(LARGE_INTEGER * pliStart, BOOL bTimedOut)
+{
+	LARGE_INTEGER liNow, liFrequency;
+	ULONG ulMicroseconds = 0, iBucket;
+
+	InterlockedIncrement((LONG *) &f_CallStatistics.cCalls);
+
+	if (bTimedOut)
+	{
+		InterlockedIncrement((LONG *) &f_CallStatistics.cTimeouts);
+		return;
+	}
+
+	if (QueryPerformanceFrequency(&liFrequency) && liFrequency.QuadPart)
+	{
+		QueryPerformanceCounter(&liNow);
+		ulMicroseconds = (ULONG) ((liNow.QuadPart - pliStart->QuadPart) * 1000000 / liFrequency.QuadPart);
+	}
+
+	for (iBucket = 0; iBucket < DH_CALL_HISTOGRAM_BUCKETS - 1 && ulMicroseconds >= f_rgCallHistogramBounds[iBucket]; iBucket++);
+
+	InterlockedIncrement((LONG *) &f_CallStatistics.rgHistogram[iBucket]);
+}
+
+
+
+/* **************************************************************************
+ * dhTimedInvoke:
+ *   Calls IDispatch::Invoke. If the thread has a call timeout, the call is
+ * watched and is cancelled if it does not complete in time, in which case
+ * DH_E_CALL_TIMEOUT is returned.
+ *
+ ============================================================================ */
+HRESULT dhTimedInvoke(IDispatch * pDisp, DISPID dispID, int invokeType, DISPPARAMS * pDispParams,
+                      VARIANT * pvResult, EXCEPINFO * pExcepInfo, UINT * puArgErr)
+{
+	DH_DEADLINE * pDeadline = (f_lngDeadlineInitEnd == 0 ? GetDeadline() : NULL);
+	LARGE_INTEGER liStart;
+	BOOL bTimedOut;
+	HRESULT hr;
+
+	/* Calls made by incoming calls during a timed call fall under its deadline */
+	if (!pDeadline || pDeadline->dwTimeout == INFINITE || pDeadline->bArmed)
+	{
+		return pDisp->lpVtbl->Invoke(pDisp, dispID, &IID_NULL, LOCALE_USER_DEFAULT, (WORD) invokeType,
+		                             pDispParams, pvResult, pExcepInfo, puArgErr);
+	}
+
+	if (!pDeadline->bCancelEnabled) pDeadline->bCancelEnabled = SUCCEEDED(CoEnableCallCancellation(NULL));
+
+	QueryPerformanceCounter(&liStart);
+
+	if (!pDeadline->bCancelEnabled || !ArmDeadline(pDeadline))
+	{
+		return pDisp->lpVtbl->Invoke(pDisp, dispID, &IID_NULL, LOCALE_USER_DEFAULT, (WORD) invokeType,
+		                             pDispParams, pvResult, pExcepInfo, puArgErr);
+	}
+
+	hr = pDisp->lpVtbl->Invoke(pDisp, dispID, &IID_NULL, LOCALE_USER_DEFAULT, (WORD) invokeType,
+	                           pDispParams, pvResult, pExcepInfo, puArgErr);
+
+	bTimedOut = DisarmDeadline(pDeadline) && FAILED(hr);
+
+	RecordCall(&liStart, bTimedOut);
+
+	return (bTimedOut ? DH_E_CALL_TIMEOUT : hr);
+}
+
+
+
+/* **************************************************************************
+ * dhCleanupThreadDeadline:
+ *   Frees the thread's call timeout. This is called by dhUninitialize.
+ *
+ ============================================================================ */
+void dhCleanupThreadDeadline(void)
+{
+	DH_DEADLINE * pDeadline;
+
+	if (f_lngDeadlineInitEnd != 0 || !(pDeadline = GetDeadline())) return;
+
+	if (pDeadline->bCancelEnabled) CoDisableCallCancellation(NULL);
+
+	HeapFree(GetProcessHeap(), 0, pDeadline);
+	SetDeadline(NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhSetCallTimeout:
+ *   This function sets how long each call made by the calling thread may
+ * take. A call still running after dwTimeout milliseconds is cancelled and
+ * fails with DH_E_CALL_TIMEOUT, which is recorded in the thread's exception
+ * like any other error.
+ *
+ * Parameter Info:
+ *   dwTimeout - The timeout in milliseconds, or INFINITE for none.
+ *
+ * Notes:
+ *   Returns the previous timeout so that it can be restored at the end of
+ * a scope, or around a single call.
+ *   Only calls made through a proxy, to another apartment or process, can
+ * be cancelled. The server still runs the cancelled call to its end.
+ *   Timed calls are counted in the call statistics.
+ *
+ ============================================================================ */
+DWORD dhSetCallTimeout(DWORD dwTimeout)
+{
+	DH_DEADLINE * pDeadline;
+	DWORD dwPrevious;
+
+	CheckDeadlineInitialized();
+
+	if (!(pDeadline = GetDeadline()))
+	{
+		if (dwTimeout == INFINITE) return INFINITE;
+
+		if (!(pDeadline = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_DEADLINE)))) return INFINITE;
+
+		pDeadline->dwThreadId = GetCurrentThreadId();
+		pDeadline->dwTimeout  = INFINITE;
+		SetDeadline(pDeadline);
+	}
+
+	dwPrevious = pDeadline->dwTimeout;
+	pDeadline->dwTimeout = dwTimeout;
+
+	return dwPrevious;
+}
+
+
+
+/* **************************************************************************
+ * dhGetCallStatistics:
+ *   This function gets the number of timed calls, how many of them timed
+ * out and the latency histogram of the others, optionally resetting them.
+ *
+ ============================================================================ */
+HRESULT dhGetCallStatistics(PDH_CALL_STATISTICS pStatistics, BOOL bReset)
+{
+	UINT iBucket;
+
+	if (!pStatistics) return E_INVALIDARG;
+
+	if (bReset)
+	{
+		pStatistics->cCalls    = (ULONG) InterlockedExchange((LONG *) &f_CallStatistics.cCalls, 0);
+		pStatistics->cTimeouts = (ULONG) InterlockedExchange((LONG *) &f_CallStatistics.cTimeouts, 0);
+
+		for (iBucket = 0; iBucket < DH_CALL_HISTOGRAM_BUCKETS; iBucket++)
+		{
+			pStatistics->rgHistogram[iBucket] = (ULONG) InterlockedExchange((LONG *) &f_CallStatistics.rgHistogram[iBucket], 0);
+		}
+	}
+	else
+	{
+		*pStatistics = f_CallStatistics;
+	}
+
+	return NOERROR;
+}
@@ -145,3 +145,295 @@ HRESULT dhEnumBegin(IEnumVARIANT ** ppEnum, IDispatch * pDisp, LPCOLESTR szMembe
 
 	return DH_EXIT(hr, szMember);
 }
+
+
+
+/* Structure to store an enumerator over a slice of a collection. The items
+ * come either from another enumerator or from the collection's Item(i). */
+typedef struct tagDH_ENUM_SLICE
+{
+	IEnumVARIANTVtbl * lpVtbl;
+	LONG cRefs;
+	IEnumVARIANT * pInner;
+	IDispatch * pColl;
+	LONG iFirstIndex;
+	ULONG iStart;
+	ULONG cItems;
+	ULONG iNext;
+} DH_ENUM_SLICE;
+
+static IEnumVARIANTVtbl f_EnumSliceVtbl;
+
+
+
+/* **************************************************************************
+ * CreateSlice:
+ *   Allocates a slice enumerator, which holds a reference to pInner or pColl.
+ *
+ ============================================================================ */
+static HRESULT CreateSlice(IEnumVARIANT ** ppEnum, IEnumVARIANT * pInner, IDispatch * pColl,
+                           LONG iFirstIndex, ULONG iStart, ULONG cItems, ULONG iNext)
+{
+	DH_ENUM_SLICE * pSlice = HeapAlloc(GetProcessHeap(), 0, sizeof(DH_ENUM_SLICE));
+
+	if (!pSlice) return E_OUTOFMEMORY;
+
+	pSlice->lpVtbl      = &f_EnumSliceVtbl;
+	pSlice->cRefs       = 1;
+	pSlice->pInner      = pInner;
+	pSlice->pColl       = pColl;
+	pSlice->iFirstIndex = iFirstIndex;
+	pSlice->iStart      = iStart;
+	pSlice->cItems      = cItems;
+	pSlice->iNext       = iNext;
+
+	if (pInner) pInner->lpVtbl->AddRef(pInner);
+	if (pColl) pColl->lpVtbl->AddRef(pColl);
+
+	*ppEnum = (IEnumVARIANT *) pSlice;
+
+	return NOERROR;
+}
+
+
+
+/* ===========================================================================
+ * IEnumVARIANT implementation of the slice enumerator.
+ * ======================================================================== */
+static HRESULT STDMETHODCALLTYPE Slice_QueryInterface(IEnumVARIANT * This, REFIID riid, void ** ppv)
+{
+	if (!IsEqualIID(riid, &IID_IUnknown) && !IsEqualIID(riid, &IID_IEnumVARIANT))
+	{
+		*ppv = NULL;
+		return E_NOINTERFACE;
+	}
+
+	*ppv = This;
+	This->lpVtbl->AddRef(This);
+
+	return S_OK;
+}
+
+static ULONG STDMETHODCALLTYPE Slice_AddRef(IEnumVARIANT * This)
+{
+	return InterlockedIncrement(&((DH_ENUM_SLICE *) This)->cRefs);
+}
+
+static ULONG STDMETHODCALLTYPE Slice_Release(IEnumVARIANT * This)
+{
+	DH_ENUM_SLICE * pSlice = (DH_ENUM_SLICE *) This;
+	LONG cRefs = InterlockedDecrement(&pSlice->cRefs);
+
+	if (cRefs == 0)
+	{
+		if (pSlice->pInner) pSlice->pInner->lpVtbl->Release(pSlice->pInner);
+		if (pSlice->pColl) pSlice->pColl->lpVtbl->Release(pSlice->pColl);
+		HeapFree(GetProcessHeap(), 0, pSlice);
+	}
+
+	return cRefs;
+}
+
+static HRESULT STDMETHODCALLTYPE Slice_Next(IEnumVARIANT * This, ULONG celt, VARIANT * rgVar, ULONG * pCeltFetched)
+{
+	DH_ENUM_SLICE * pSlice = (DH_ENUM_SLICE *) This;
+	ULONG cLeft = pSlice->cItems - pSlice->iNext, cFetched = 0;
+	ULONG cWanted = (celt < cLeft ? celt : cLeft);
+	HRESULT hr = NOERROR;
+
+	if (cWanted && pSlice->pInner)
+	{
+		hr = pSlice->pInner->lpVtbl->Next(pSlice->pInner, cWanted, rgVar, &cFetched);
+	}
+	else
+	{
+		for (; cFetched < cWanted; cFetched++)
+		{
+			LONG iIndex = pSlice->iFirstIndex + (LONG) (pSlice->iStart + pSlice->iNext + cFetched);
+
+			hr = dhGetValue(L"%v", &rgVar[cFetched], pSlice->pColl, L".Item(%d)", iIndex);
+			if (FAILED(hr)) break;
+		}
+	}
+
+	pSlice->iNext += cFetched;
+
+	if (pCeltFetched) *pCeltFetched = cFetched;
+
+	if (FAILED(hr) && cFetched == 0) return hr;
+
+	return (cFetched == celt ? S_OK : S_FALSE);
+}
+
+static HRESULT STDMETHODCALLTYPE Slice_Skip(IEnumVARIANT * This, ULONG celt)
+{
+	DH_ENUM_SLICE * pSlice = (DH_ENUM_SLICE *) This;
+	ULONG cLeft = pSlice->cItems - pSlice->iNext;
+	ULONG cSkip = (celt < cLeft ? celt : cLeft);
+	HRESULT hr = NOERROR;
+
+	if (cSkip && pSlice->pInner) hr = pSlice->pInner->lpVtbl->Skip(pSlice->pInner, cSkip);
+
+	if (FAILED(hr)) return hr;
+
+	pSlice->iNext += cSkip;
+
+	return (cSkip == celt && hr == S_OK ? S_OK : S_FALSE);
+}
+
+static HRESULT STDMETHODCALLTYPE Slice_Reset(IEnumVARIANT * This)
+{
+	DH_ENUM_SLICE * pSlice = (DH_ENUM_SLICE *) This;
+	HRESULT hr = NOERROR;
+
+	if (pSlice->pInner)
+	{
+		hr = pSlice->pInner->lpVtbl->Reset(pSlice->pInner);
+		if (SUCCEEDED(hr) && pSlice->iStart) hr = pSlice->pInner->lpVtbl->Skip(pSlice->pInner, pSlice->iStart);
+	}
+
+	if (SUCCEEDED(hr)) pSlice->iNext = 0;
+
+	return (FAILED(hr) ? hr : NOERROR);
+}
+
+static HRESULT STDMETHODCALLTYPE Slice_Clone(IEnumVARIANT * This, IEnumVARIANT ** ppEnum)
+{
+	DH_ENUM_SLICE * pSlice = (DH_ENUM_SLICE *) This;
+	IEnumVARIANT * pInner = NULL;
+	HRESULT hr;
+
+	if (!ppEnum) return E_POINTER;
+
+	*ppEnum = NULL;
+
+	if (pSlice->pInner)
+	{
+		hr = pSlice->pInner->lpVtbl->Clone(pSlice->pInner, &pInner);
+		if (FAILED(hr)) return hr;
+	}
+
+	hr = CreateSlice(ppEnum, pInner, pSlice->pColl, pSlice->iFirstIndex, pSlice->iStart, pSlice->cItems, pSlice->iNext);
+
+	if (pInner) pInner->lpVtbl->Release(pInner);
+
+	return hr;
+}
+
+static IEnumVARIANTVtbl f_EnumSliceVtbl =
+{
+	Slice_QueryInterface, Slice_AddRef, Slice_Release,
+	Slice_Next, Slice_Skip, Slice_Reset, Slice_Clone
+};
+
+
+
+/* **************************************************************************
+ * dhEnumSliceEnum:
+ *   This function returns an enumerator over cItems items of another
+ * enumerator, starting at the zero based iStart. The source enumerator is
+ * cloned, reset and skipped to iStart, so its own position is not changed.
+ *
+ ============================================================================ */
+HRESULT dhEnumSliceEnum(IEnumVARIANT ** ppEnum, IEnumVARIANT * pSource, ULONG iStart, ULONG cItems)
+{
+	IEnumVARIANT * pClone = NULL;
+	HRESULT hr;
+
+	DH_ENTER(L"EnumSliceEnum");
+
+	if (!ppEnum || !pSource) return DH_EXIT(E_INVALIDARG, L"Enumerator");
+
+	*ppEnum = NULL;
+
+	hr = pSource->lpVtbl->Clone(pSource, &pClone);
+
+	if (SUCCEEDED(hr)) hr = dhEnumSliceWrap(ppEnum, pClone, iStart, cItems);
+
+	if (pClone) pClone->lpVtbl->Release(pClone);
+
+	return DH_EXIT(hr, L"Enumerator");
+}
+
+
+
+/* **************************************************************************
+ * dhEnumSliceWrap:
+ *   Internal function which resets an enumerator, skips it to iStart and
+ * returns an enumerator over cItems of its items. The enumerator is used,
+ * not cloned.
+ *
+ ============================================================================ */
+HRESULT dhEnumSliceWrap(IEnumVARIANT ** ppEnum, IEnumVARIANT * pInner, ULONG iStart, ULONG cItems)
+{
+	HRESULT hr;
+
+	hr = pInner->lpVtbl->Reset(pInner);
+
+	/* Skip returns S_FALSE past the end, which leaves an empty slice */
+	if (SUCCEEDED(hr) && iStart) hr = pInner->lpVtbl->Skip(pInner, iStart);
+
+	if (FAILED(hr)) return hr;
+
+	return CreateSlice(ppEnum, pInner, NULL, 0, iStart, cItems, 0);
+}
+
+
+
+/* **************************************************************************
+ * dhEnumSlice:
+ *   This function returns an enumerator over cItems items of a collection,
+ * starting at the zero based iStart, which can be used like the enumerator
+ * returned by dhEnumBegin.
+ *
+ * Parameter Info:
+ *   ppEnum  - Receives the enumerator.
+ *   pColl   - The collection.
+ *   iStart  - The first item of the slice, counting from zero.
+ *   cItems  - The number of items in the slice. Fewer items are returned
+ * if the collection ends first.
+ *   nMethod - DH_SLICE_NEWENUM to skip through the collection's _NewEnum
+ * enumerator, or DH_SLICE_ITEM0/DH_SLICE_ITEM1 to call Item(i) with zero
+ * or one based indexes, for collections whose _NewEnum is slow.
+ *
+ * Example(s):
+ *   dhEnumSlice(&pEnum, wdParas, 1000, 100, DH_SLICE_ITEM1);
+ *   while (dhEnumNextObject(pEnum, &wdPara) == NOERROR)
+ *
+ ============================================================================ */
+HRESULT dhEnumSlice(IEnumVARIANT ** ppEnum, IDispatch * pColl, ULONG iStart, ULONG cItems, int nMethod)
+{
+	IEnumVARIANT * pInner = NULL;
+	ULONG cCount = 0;
+	HRESULT hr;
+
+	DH_ENTER(L"EnumSlice");
+
+	if (!ppEnum || !pColl) return DH_EXIT(E_INVALIDARG, L"Slice");
+
+	*ppEnum = NULL;
+
+	if (nMethod == DH_SLICE_NEWENUM)
+	{
+		hr = dhEnumBegin(&pInner, pColl, NULL);
+
+		if (SUCCEEDED(hr)) hr = dhEnumSliceWrap(ppEnum, pInner, iStart, cItems);
+
+		if (pInner) pInner->lpVtbl->Release(pInner);
+
+		return DH_EXIT(hr, L"Slice");
+	}
+
+	if (nMethod != DH_SLICE_ITEM0 && nMethod != DH_SLICE_ITEM1) return DH_EXIT(E_INVALIDARG, L"Slice");
+
+	/* Clip the slice to the collection, so that Next stops at the end */
+	hr = dhGetValue(L"%u", &cCount, pColl, L".Count");
+	if (FAILED(hr)) return DH_EXIT(hr, L"Slice");
+
+	if (iStart > cCount) iStart = cCount;
+	if (cItems > cCount - iStart) cItems = cCount - iStart;
+
+	hr = CreateSlice(ppEnum, NULL, pColl, (nMethod == DH_SLICE_ITEM1 ? 1 : 0), iStart, cItems, 0);
+
+	return DH_EXIT(hr, L"Slice");
+}
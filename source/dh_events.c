@@ -0,0 +1,886 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* Structure to store an event handled by a sink */
+typedef struct tagDH_EVENT_HANDLER
+{
+	DISPID dispID;
+	LPWSTR szEvent;
+} DH_EVENT_HANDLER;
+
+/* Structure to store an event waiting for the handler thread. Objects in
+ * rgArgs flagged in fMarshalled hold the stream they are marshalled in. */
+typedef struct tagDH_EVENT_ITEM
+{
+	SLIST_ENTRY entry; /* Must be first */
+	DISPID dispID;
+	LPCWSTR szEvent;
+	ULONG fMarshalled;
+	UINT cArgs;
+	VARIANT rgArgs[1];
+} DH_EVENT_ITEM;
+
+/* Structure to store an event sink and its connection */
+struct tagDH_EVENT_SINK
+{
+	SLIST_HEADER slEvents; /* Must be first, for alignment */
+	IDispatch dispSink;
+	LONG cRefs;
+	IID iidSource;
+	IConnectionPoint * pConnectionPoint;
+	DWORD dwCookie;
+
+	/* Events handled, sorted by DISPID */
+	DH_EVENT_HANDLER * rgHandlers;
+	UINT cHandlers;
+	BOOL bAllEvents;
+
+	DH_EVENT_CALLBACK pfnCallback;
+	LPVOID pContext;
+	DWORD dwFlags;
+
+	HANDLE hThread;
+	HANDLE hWake;
+	LONG bStop;
+
+	/* Counters */
+	LONG cReceived;
+	LONG cIgnored;
+	LONG cDropped;
+	LONG cDelivered;
+};
+
+#define SinkFromDispatch(pDisp) CONTAINING_RECORD(pDisp, struct tagDH_EVENT_SINK, dispSink)
+
+
+
+/* **************************************************************************
+ * FreeSink:
+ *   Frees a sink once the source and the caller have released it.
+ *
+ ============================================================================ */
+static void FreeSink(PDH_EVENT_SINK pSink)
+{
+	UINT iHandler;
+
+	for (iHandler = 0; iHandler < pSink->cHandlers; iHandler++)
+	{
+		HeapFree(GetProcessHeap(), 0, pSink->rgHandlers[iHandler].szEvent);
+	}
+
+	if (pSink->rgHandlers) HeapFree(GetProcessHeap(), 0, pSink->rgHandlers);
+	if (pSink->hWake) CloseHandle(pSink->hWake);
+
+	HeapFree(GetProcessHeap(), 0, pSink);
+}
+
+
+
+/* **************************************************************************
+ * FindHandler:
+ *   Finds the handler of an event in a sink's table.
+ *
+ ============================================================================ */
+static const DH_EVENT_HANDLER * FindHandler(PDH_EVENT_SINK pSink, DISPID dispID)
+{
+	UINT iLow = 0, iHigh = pSink->cHandlers, iMid;
+
+	while (iLow < iHigh)
+	{
+		iMid = (iLow + iHigh) / 2;
+
+		if (pSink->rgHandlers[iMid].dispID == dispID) return &pSink->rgHandlers[iMid];
+
+		if (pSink->rgHandlers[iMid].dispID < dispID) iLow = iMid + 1;
+		else iHigh = iMid;
+	}
+
+	return NULL;
+}
+
+
+
+/* **************************************************************************
+ * FreeEvent:
+ *   Frees a queued event and its arguments, including objects which were
+ * never unmarshalled.
+ *
+ ============================================================================ */
+static void FreeEvent(DH_EVENT_ITEM * pItem)
+{
+	UINT iArg;
+
+	for (iArg = 0; iArg < pItem->cArgs; iArg++)
+	{
+		if (pItem->fMarshalled & (1UL << iArg))
+		{
+			CoReleaseMarshalData((IStream *) V_UNKNOWN(&pItem->rgArgs[iArg]));
+			V_UNKNOWN(&pItem->rgArgs[iArg])->lpVtbl->Release(V_UNKNOWN(&pItem->rgArgs[iArg]));
+		}
+		else
+		{
+			VariantClear(&pItem->rgArgs[iArg]);
+		}
+	}
+
+	HeapFree(GetProcessHeap(), 0, pItem);
+}
+
+
+
+/* **************************************************************************
+ * QueueEvent:
+ *   Copies an event's arguments, in the order of its declaration, and
+ * queues it to the handler thread. ByRef arguments are copied by value and
+ * objects are marshalled to the handler thread.
+ *
+ ============================================================================ */
+static BOOL QueueEvent(PDH_EVENT_SINK pSink, const DH_EVENT_HANDLER * pHandler, DISPID dispID, DISPPARAMS * pDispParams)
+{
+	DH_EVENT_ITEM * pItem;
+	UINT iArg, cArgs = pDispParams->cArgs;
+	IStream * pStream;
+	VARIANT * pArg;
+
+	pItem = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_EVENT_ITEM) + (cArgs ? cArgs - 1 : 0) * sizeof(VARIANT));
+	if (!pItem) return FALSE;
+
+	pItem->dispID  = dispID;
+	pItem->szEvent = (pHandler ? pHandler->szEvent : NULL);
+	pItem->cArgs   = cArgs;
+
+	for (iArg = 0; iArg < cArgs; iArg++)
+	{
+		pArg = &pItem->rgArgs[iArg];
+
+		if (FAILED(VariantCopyInd(pArg, &pDispParams->rgvarg[cArgs - 1 - iArg]))) VariantInit(pArg);
+
+		if ((V_VT(pArg) == VT_DISPATCH || V_VT(pArg) == VT_UNKNOWN) && V_UNKNOWN(pArg))
+		{
+			if (SUCCEEDED(CoMarshalInterThreadInterfaceInStream(V_VT(pArg) == VT_DISPATCH ? &IID_IDispatch : &IID_IUnknown,
+			                                                   V_UNKNOWN(pArg), &pStream)))
+			{
+				V_UNKNOWN(pArg)->lpVtbl->Release(V_UNKNOWN(pArg));
+				V_UNKNOWN(pArg) = (IUnknown *) pStream;
+				pItem->fMarshalled |= (1UL << iArg);
+			}
+			else
+			{
+				VariantClear(pArg);
+			}
+		}
+	}
+
+	/* The handler thread is only woken when the queue was empty */
+	if (InterlockedPushEntrySList(&pSink->slEvents, &pItem->entry) == NULL) SetEvent(pSink->hWake);
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * DeliverEvent:
+ *   Unmarshals the objects of a queued event, calls the callback and frees
+ * the event.
+ *
+ ============================================================================ */
+static void DeliverEvent(PDH_EVENT_SINK pSink, DH_EVENT_ITEM * pItem)
+{
+	VARIANT * pArg;
+	UINT iArg;
+
+	for (iArg = 0; iArg < pItem->cArgs; iArg++)
+	{
+		if (!(pItem->fMarshalled & (1UL << iArg))) continue;
+
+		pArg = &pItem->rgArgs[iArg];
+
+		if (FAILED(CoGetInterfaceAndReleaseStream((IStream *) V_UNKNOWN(pArg),
+		                                          V_VT(pArg) == VT_DISPATCH ? &IID_IDispatch : &IID_IUnknown,
+		                                          (void **) &V_UNKNOWN(pArg))))
+		{
+			V_VT(pArg) = VT_EMPTY;
+		}
+	}
+
+	pItem->fMarshalled = 0;
+
+	pSink->pfnCallback(pItem->szEvent, pItem->dispID, pItem->cArgs, pItem->rgArgs, pSink->pContext);
+	InterlockedIncrement(&pSink->cDelivered);
+
+	FreeEvent(pItem);
+}
+
+
+
+/* **************************************************************************
+ * HandlerThread:
+ *   Delivers the events queued to a sink, oldest first, until the sink is
+ * stopped. The thread owns a single threaded apartment.
+ *
+ ============================================================================ */
+static DWORD WINAPI HandlerThread(LPVOID lpParameter)
+{
+	PDH_EVENT_SINK pSink = lpParameter;
+	PSLIST_ENTRY pEntry, pFifo, pNext;
+	DWORD dwIndex;
+	HRESULT hrInit;
+
+	hrInit = dhInitializeImp(TRUE, dh_g_bIsUnicodeMode);
+
+	for (;;)
+	{
+		if ((pEntry = InterlockedFlushSList(&pSink->slEvents)) != NULL)
+		{
+			/* The list comes newest first */
+			for (pFifo = NULL; pEntry; pEntry = pNext)
+			{
+				pNext = pEntry->Next;
+				pEntry->Next = pFifo;
+				pFifo = pEntry;
+			}
+
+			for (; pFifo; pFifo = pNext)
+			{
+				pNext = pFifo->Next;
+				DeliverEvent(pSink, (DH_EVENT_ITEM *) pFifo);
+			}
+
+			continue;
+		}
+
+		if (pSink->bStop) break;
+
+		/* Keep dispatching messages while idle, as required in an STA */
+		CoWaitForMultipleHandles(0, INFINITE, 1, &pSink->hWake, &dwIndex);
+	}
+
+	dhUninitialize(SUCCEEDED(hrInit));
+
+	return 0;
+}
+
+
+
+/* ============================================================================
+ * The sink: an IDispatch which answers for the source interface.
+ * ========================================================================= */
+static HRESULT STDMETHODCALLTYPE Sink_QueryInterface(IDispatch * This, REFIID riid, void ** ppv)
+{
+	PDH_EVENT_SINK pSink = SinkFromDispatch(This);
+
+	if (!IsEqualIID(riid, &IID_IUnknown) && !IsEqualIID(riid, &IID_IDispatch) && !IsEqualIID(riid, &pSink->iidSource))
+	{
+		*ppv = NULL;
+		return E_NOINTERFACE;
+	}
+
+	*ppv = This;
+	This->lpVtbl->AddRef(This);
+	return S_OK;
+}
+
+static ULONG STDMETHODCALLTYPE Sink_AddRef(IDispatch * This)
+{
+	return InterlockedIncrement(&SinkFromDispatch(This)->cRefs);
+}
+
+static ULONG STDMETHODCALLTYPE Sink_Release(IDispatch * This)
+{
+	PDH_EVENT_SINK pSink = SinkFromDispatch(This);
+	LONG cRefs = InterlockedDecrement(&pSink->cRefs);
+
+	if (cRefs == 0) FreeSink(pSink);
+
+	return cRefs;
+}
+
+static HRESULT STDMETHODCALLTYPE Sink_GetTypeInfoCount(IDispatch * This, UINT * pctinfo)
+{
+	*pctinfo = 0;
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE Sink_GetTypeInfo(IDispatch * This, UINT iTInfo, LCID lcid, ITypeInfo ** ppTInfo)
+{
+	*ppTInfo = NULL;
+	return E_NOTIMPL;
+}
+
+static HRESULT STDMETHODCALLTYPE Sink_GetIDsOfNames(IDispatch * This, REFIID riid, LPOLESTR * rgszNames,
+                                                    UINT cNames, LCID lcid, DISPID * rgDispId)
+{
+	return E_NOTIMPL;
+}
+
+static HRESULT STDMETHODCALLTYPE Sink_Invoke(IDispatch * This, DISPID dispIdMember, REFIID riid, LCID lcid,
+                                             WORD wFlags, DISPPARAMS * pDispParams, VARIANT * pVarResult,
+                                             EXCEPINFO * pExcepInfo, UINT * puArgErr)
+{
+	PDH_EVENT_SINK pSink = SinkFromDispatch(This);
+	const DH_EVENT_HANDLER * pHandler = FindHandler(pSink, dispIdMember);
+	VARIANT rgArgs[DH_MAX_ARGS];
+	UINT iArg, cArgs = pDispParams->cArgs;
+
+	InterlockedIncrement(&pSink->cReceived);
+
+	if (pSink->bStop || (!pHandler && !pSink->bAllEvents))
+	{
+		InterlockedIncrement(&pSink->cIgnored);
+		return S_OK;
+	}
+
+	/* Events are not failed back to the source, they are dropped */
+	if (cArgs > DH_MAX_ARGS)
+	{
+		InterlockedIncrement(&pSink->cDropped);
+		return S_OK;
+	}
+
+	if (pSink->dwFlags & DH_EVENT_INLINE)
+	{
+		/* Shallow copies, so that ByRef arguments can be set */
+		for (iArg = 0; iArg < cArgs; iArg++) rgArgs[iArg] = pDispParams->rgvarg[cArgs - 1 - iArg];
+
+		pSink->pfnCallback(pHandler ? pHandler->szEvent : NULL, dispIdMember, cArgs, rgArgs, pSink->pContext);
+		InterlockedIncrement(&pSink->cDelivered);
+	}
+	else if (!QueueEvent(pSink, pHandler, dispIdMember, pDispParams))
+	{
+		InterlockedIncrement(&pSink->cDropped);
+	}
+
+	return S_OK;
+}
+
+static IDispatchVtbl f_SinkVtbl =
+{
+	Sink_QueryInterface, Sink_AddRef, Sink_Release,
+	Sink_GetTypeInfoCount, Sink_GetTypeInfo, Sink_GetIDsOfNames, Sink_Invoke
+};
+
+
+
+/* **************************************************************************
+ * GetImplType:
+ *   Gets the type info of the interface of a coclass with the given
+ * IMPLTYPEFLAG_FDEFAULT and IMPLTYPEFLAG_FSOURCE flags.
+ *
+ ============================================================================ */
+static HRESULT GetImplType(ITypeInfo * pClassInfo, int nFlags, ITypeInfo ** ppTypeInfo)
+{
+	TYPEATTR * pTypeAttr;
+	HREFTYPE hRefType;
+	UINT iImplType, cImplTypes;
+	int nImplFlags;
+	HRESULT hr;
+
+	*ppTypeInfo = NULL;
+
+	hr = pClassInfo->lpVtbl->GetTypeAttr(pClassInfo, &pTypeAttr);
+	if (FAILED(hr)) return hr;
+
+	cImplTypes = pTypeAttr->cImplTypes;
+	pClassInfo->lpVtbl->ReleaseTypeAttr(pClassInfo, pTypeAttr);
+
+	for (iImplType = 0; iImplType < cImplTypes; iImplType++)
+	{
+		if (FAILED(pClassInfo->lpVtbl->GetImplTypeFlags(pClassInfo, iImplType, &nImplFlags)) ||
+		    (nImplFlags & (IMPLTYPEFLAG_FDEFAULT | IMPLTYPEFLAG_FSOURCE)) != nFlags) continue;
+
+		hr = pClassInfo->lpVtbl->GetRefTypeOfImplType(pClassInfo, iImplType, &hRefType);
+
+		if (SUCCEEDED(hr)) hr = pClassInfo->lpVtbl->GetRefTypeInfo(pClassInfo, hRefType, ppTypeInfo);
+
+		return hr;
+	}
+
+	return E_NOINTERFACE;
+}
+
+
+
+/* **************************************************************************
+ * GetTypeGuid:
+ *   Gets the GUID of a type.
+ *
+ ============================================================================ */
+static HRESULT GetTypeGuid(ITypeInfo * pTypeInfo, GUID * pGuid)
+{
+	TYPEATTR * pTypeAttr;
+	HRESULT hr;
+
+	hr = pTypeInfo->lpVtbl->GetTypeAttr(pTypeInfo, &pTypeAttr);
+	if (FAILED(hr)) return hr;
+
+	*pGuid = pTypeAttr->guid;
+	pTypeInfo->lpVtbl->ReleaseTypeAttr(pTypeInfo, pTypeAttr);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * FindClassInfo:
+ *   Finds the coclass of an object which does not provide its class info,
+ * as the coclass of the object's type library whose default interface is
+ * the type of the object.
+ *
+ ============================================================================ */
+static HRESULT FindClassInfo(ITypeInfo * pTypeInfo, ITypeInfo ** ppClassInfo)
+{
+	ITypeLib * pTypeLib;
+	ITypeInfo * pClassInfo, * pDefaultInfo;
+	GUID guidType, guidDefault;
+	TYPEKIND typeKind;
+	UINT iType, cTypes, iIndex;
+	HRESULT hr;
+
+	*ppClassInfo = NULL;
+
+	if (FAILED(hr = GetTypeGuid(pTypeInfo, &guidType))) return hr;
+
+	hr = pTypeInfo->lpVtbl->GetContainingTypeLib(pTypeInfo, &pTypeLib, &iIndex);
+	if (FAILED(hr)) return hr;
+
+	cTypes = pTypeLib->lpVtbl->GetTypeInfoCount(pTypeLib);
+
+	for (iType = 0; iType < cTypes && !*ppClassInfo; iType++)
+	{
+		if (FAILED(pTypeLib->lpVtbl->GetTypeInfoType(pTypeLib, iType, &typeKind)) || typeKind != TKIND_COCLASS ||
+		    FAILED(pTypeLib->lpVtbl->GetTypeInfo(pTypeLib, iType, &pClassInfo))) continue;
+
+		if (SUCCEEDED(GetImplType(pClassInfo, IMPLTYPEFLAG_FDEFAULT, &pDefaultInfo)))
+		{
+			if (SUCCEEDED(GetTypeGuid(pDefaultInfo, &guidDefault)) && IsEqualGUID(&guidDefault, &guidType))
+			{
+				*ppClassInfo = pClassInfo;
+				pClassInfo->lpVtbl->AddRef(pClassInfo);
+			}
+
+			pDefaultInfo->lpVtbl->Release(pDefaultInfo);
+		}
+
+		pClassInfo->lpVtbl->Release(pClassInfo);
+	}
+
+	pTypeLib->lpVtbl->Release(pTypeLib);
+
+	return (*ppClassInfo ? NOERROR : E_NOINTERFACE);
+}
+
+
+
+/* **************************************************************************
+ * GetSourceTypeInfo:
+ *   Gets the IID and, if it can, the type info of the source interface of
+ * an object. If piidSource is NULL, the default source interface of the
+ * object's coclass is used.
+ *
+ ============================================================================ */
+static HRESULT GetSourceTypeInfo(IDispatch * pDisp, const IID * piidSource, IID * piid, ITypeInfo ** ppSourceInfo)
+{
+	IProvideClassInfo * pProvideClassInfo;
+	ITypeInfo * pTypeInfo = NULL, * pClassInfo = NULL, * pLibInfo;
+	ITypeLib * pTypeLib;
+	UINT iIndex;
+	HRESULT hr = NOERROR;
+
+	*ppSourceInfo = NULL;
+
+	if (SUCCEEDED(pDisp->lpVtbl->QueryInterface(pDisp, &IID_IProvideClassInfo, (void **) &pProvideClassInfo)))
+	{
+		pProvideClassInfo->lpVtbl->GetClassInfo(pProvideClassInfo, &pClassInfo);
+		pProvideClassInfo->lpVtbl->Release(pProvideClassInfo);
+	}
+
+	if (!pClassInfo) pDisp->lpVtbl->GetTypeInfo(pDisp, 0, LOCALE_USER_DEFAULT, &pTypeInfo);
+
+	if (piidSource)
+	{
+		/* Without its type info, the source can be connected but its events can not be named */
+		*piid = *piidSource;
+		pLibInfo = (pClassInfo ? pClassInfo : pTypeInfo);
+
+		if (pLibInfo && SUCCEEDED(pLibInfo->lpVtbl->GetContainingTypeLib(pLibInfo, &pTypeLib, &iIndex)))
+		{
+			pTypeLib->lpVtbl->GetTypeInfoOfGuid(pTypeLib, piidSource, ppSourceInfo);
+			pTypeLib->lpVtbl->Release(pTypeLib);
+		}
+	}
+	else
+	{
+		if (!pClassInfo && pTypeInfo) FindClassInfo(pTypeInfo, &pClassInfo);
+
+		if (!pClassInfo)
+		{
+			hr = E_NOINTERFACE;
+		}
+		else if (SUCCEEDED(hr = GetImplType(pClassInfo, IMPLTYPEFLAG_FDEFAULT | IMPLTYPEFLAG_FSOURCE, ppSourceInfo)) &&
+		         FAILED(hr = GetTypeGuid(*ppSourceInfo, piid)))
+		{
+			(*ppSourceInfo)->lpVtbl->Release(*ppSourceInfo);
+			*ppSourceInfo = NULL;
+		}
+	}
+
+	if (pTypeInfo) pTypeInfo->lpVtbl->Release(pTypeInfo);
+	if (pClassInfo) pClassInfo->lpVtbl->Release(pClassInfo);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * AddHandler:
+ *   Adds an event to a sink's table, keeping the table sorted by DISPID.
+ *
+ ============================================================================ */
+static HRESULT AddHandler(PDH_EVENT_SINK pSink, DISPID dispID, LPCOLESTR szEvent, UINT cchEvent)
+{
+	UINT iHandler;
+	LPWSTR szCopy;
+
+	if (FindHandler(pSink, dispID)) return NOERROR;
+
+	if (!(szCopy = HeapAlloc(GetProcessHeap(), 0, (cchEvent + 1) * sizeof(WCHAR)))) return E_OUTOFMEMORY;
+
+	CopyMemory(szCopy, szEvent, cchEvent * sizeof(WCHAR));
+	szCopy[cchEvent] = L'\0';
+
+	for (iHandler = pSink->cHandlers; iHandler > 0 && pSink->rgHandlers[iHandler - 1].dispID > dispID; iHandler--)
+	{
+		pSink->rgHandlers[iHandler] = pSink->rgHandlers[iHandler - 1];
+	}
+
+	pSink->rgHandlers[iHandler].dispID  = dispID;
+	pSink->rgHandlers[iHandler].szEvent = szCopy;
+	pSink->cHandlers++;
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * BuildHandlerTable:
+ *   Resolves the events handled by a sink, seperated by semi-colons, with
+ * the type info of the source interface. If szEvents is NULL or "*", every
+ * event of the source interface is handled.
+ *
+ ============================================================================ */
+static HRESULT BuildHandlerTable(PDH_EVENT_SINK pSink, ITypeInfo * pSourceInfo, LPCOLESTR szEvents)
+{
+	WCHAR szName[DH_MAX_MEMBER];
+	LPOLESTR pszName = szName;
+	LPCOLESTR szEnd;
+	TYPEATTR * pTypeAttr;
+	FUNCDESC * pFuncDesc;
+	BSTR bstrName;
+	UINT iFunc, cFuncs, cchName, cMaxHandlers = 1;
+	DISPID dispID;
+	HRESULT hr = NOERROR;
+
+	pSink->bAllEvents = (!szEvents || wcscmp(szEvents, L"*") == 0);
+
+	if (pSink->bAllEvents)
+	{
+		/* Events are still delivered, without their names */
+		if (!pSourceInfo || FAILED(pSourceInfo->lpVtbl->GetTypeAttr(pSourceInfo, &pTypeAttr))) return NOERROR;
+
+		cMaxHandlers = cFuncs = pTypeAttr->cFuncs;
+		pSourceInfo->lpVtbl->ReleaseTypeAttr(pSourceInfo, pTypeAttr);
+	}
+	else
+	{
+		/* The names of the events can only be resolved from the type info */
+		if (!pSourceInfo) return E_NOINTERFACE;
+
+		for (szEnd = szEvents; *szEnd; szEnd++) if (*szEnd == L';') cMaxHandlers++;
+	}
+
+	pSink->rgHandlers = HeapAlloc(GetProcessHeap(), 0, (cMaxHandlers ? cMaxHandlers : 1) * sizeof(DH_EVENT_HANDLER));
+	if (!pSink->rgHandlers) return E_OUTOFMEMORY;
+
+	if (pSink->bAllEvents)
+	{
+		for (iFunc = 0; iFunc < cFuncs && SUCCEEDED(hr); iFunc++)
+		{
+			if (FAILED(pSourceInfo->lpVtbl->GetFuncDesc(pSourceInfo, iFunc, &pFuncDesc))) continue;
+
+			if (SUCCEEDED(pSourceInfo->lpVtbl->GetDocumentation(pSourceInfo, pFuncDesc->memid, &bstrName, NULL, NULL, NULL)))
+			{
+				hr = AddHandler(pSink, pFuncDesc->memid, bstrName, SysStringLen(bstrName));
+				SysFreeString(bstrName);
+			}
+
+			pSourceInfo->lpVtbl->ReleaseFuncDesc(pSourceInfo, pFuncDesc);
+		}
+
+		return hr;
+	}
+
+	for (;;)
+	{
+		while (*szEvents == L';' || *szEvents == L' ') szEvents++;
+
+		if (!*szEvents) break;
+
+		for (szEnd = szEvents; *szEnd && *szEnd != L';'; szEnd++);
+
+		for (cchName = (UINT) (szEnd - szEvents); cchName && szEvents[cchName - 1] == L' '; cchName--);
+
+		if (cchName >= ARRAYSIZE(szName)) return DISP_E_UNKNOWNNAME;
+
+		CopyMemory(szName, szEvents, cchName * sizeof(WCHAR));
+		szName[cchName] = L'\0';
+		szEvents = szEnd;
+
+		hr = pSourceInfo->lpVtbl->GetIDsOfNames(pSourceInfo, &pszName, 1, &dispID);
+
+		if (SUCCEEDED(hr)) hr = AddHandler(pSink, dispID, szName, cchName);
+
+		if (FAILED(hr)) return hr;
+	}
+
+	return (pSink->cHandlers ? NOERROR : E_INVALIDARG);
+}
+
+
+
+/* **************************************************************************
+ * StopSink:
+ *   Disconnects a sink from its source and, once the events already queued
+ * have been delivered, stops its handler thread.
+ *
+ ============================================================================ */
+static HRESULT StopSink(PDH_EVENT_SINK pSink)
+{
+	PSLIST_ENTRY pEntry, pNext;
+	DWORD dwIndex;
+	HRESULT hr = NOERROR;
+
+	if (pSink->pConnectionPoint)
+	{
+		hr = pSink->pConnectionPoint->lpVtbl->Unadvise(pSink->pConnectionPoint, pSink->dwCookie);
+		pSink->pConnectionPoint->lpVtbl->Release(pSink->pConnectionPoint);
+		pSink->pConnectionPoint = NULL;
+	}
+
+	InterlockedExchange(&pSink->bStop, TRUE);
+
+	if (pSink->hThread)
+	{
+		SetEvent(pSink->hWake);
+		CoWaitForMultipleHandles(0, INFINITE, 1, &pSink->hThread, &dwIndex);
+		CloseHandle(pSink->hThread);
+		pSink->hThread = NULL;
+	}
+
+	/* Free any event which arrived as the sink was stopped */
+	for (pEntry = InterlockedFlushSList(&pSink->slEvents); pEntry; pEntry = pNext)
+	{
+		pNext = pEntry->Next;
+		FreeEvent((DH_EVENT_ITEM *) pEntry);
+	}
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhAdviseEx:
+ *   This function connects a callback to the events of an object through
+ * its connection points. The sink maps the DISPID of each event it
+ * receives to its name with a table built when it is connected.
+ *
+ *   Events are received by the thread which calls dhAdviseEx, which must
+ * dispatch messages if it is in a single threaded apartment. Unless
+ * DH_EVENT_INLINE is given, they are then queued to a handler thread owned
+ * by the sink, which calls the callback, so that the source is not held up
+ * by the callback. The queue is lock-free.
+ *
+ * Parameter Info:
+ *   piidSource  - The source interface to connect to, or NULL for the
+ * default source interface of the object's coclass.
+ *   szEvents    - The events to handle, seperated by semi-colons, or NULL or
+ * "*" for all the events of the source interface. Naming events requires
+ * the type info of the source interface.
+ *   dwFlags     - DH_EVENT_INLINE to call the callback on the thread which
+ * receives the event, with the event's own arguments.
+ *
+ * Notes:
+ *   A queued event's arguments are copies: ByRef arguments, such as the
+ * Cancel argument of many events, can only be set with DH_EVENT_INLINE.
+ * Objects passed by events are marshalled to the handler thread.
+ *
+ * Example(s):
+ *   dhAdviseEx(wdApp, &DIID_ApplicationEvents4, L"DocumentBeforeClose", 0, OnEvent, NULL, &pSink);
+ *
+ ============================================================================ */
+HRESULT dhAdviseEx(IDispatch * pDisp, const IID * piidSource, LPCOLESTR szEvents, DWORD dwFlags,
+                   DH_EVENT_CALLBACK pfnCallback, LPVOID pContext, PDH_EVENT_SINK * ppSink)
+{
+	IConnectionPointContainer * pContainer = NULL;
+	ITypeInfo * pSourceInfo = NULL;
+	PDH_EVENT_SINK pSink;
+	HRESULT hr;
+
+	DH_ENTER(L"AdviseEx");
+
+	if (!pDisp || !pfnCallback || !ppSink) return DH_EXIT(E_INVALIDARG, szEvents);
+
+	*ppSink = NULL;
+
+	pSink = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(struct tagDH_EVENT_SINK));
+	if (!pSink) return DH_EXIT(E_OUTOFMEMORY, szEvents);
+
+	InitializeSListHead(&pSink->slEvents);
+	pSink->dispSink.lpVtbl = &f_SinkVtbl;
+	pSink->cRefs       = 1;
+	pSink->pfnCallback = pfnCallback;
+	pSink->pContext    = pContext;
+	pSink->dwFlags     = dwFlags;
+
+	hr = GetSourceTypeInfo(pDisp, piidSource, &pSink->iidSource, &pSourceInfo);
+
+	if (SUCCEEDED(hr)) hr = BuildHandlerTable(pSink, pSourceInfo, szEvents);
+
+	if (SUCCEEDED(hr) && !(dwFlags & DH_EVENT_INLINE))
+	{
+		if (!(pSink->hWake = CreateEvent(NULL, FALSE, FALSE, NULL)) ||
+		    !(pSink->hThread = CreateThread(NULL, 0, HandlerThread, pSink, 0, NULL)))
+		{
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		}
+	}
+
+	if (SUCCEEDED(hr)) hr = pDisp->lpVtbl->QueryInterface(pDisp, &IID_IConnectionPointContainer, (void **) &pContainer);
+
+	if (SUCCEEDED(hr)) hr = pContainer->lpVtbl->FindConnectionPoint(pContainer, &pSink->iidSource, &pSink->pConnectionPoint);
+
+	if (SUCCEEDED(hr)) hr = pSink->pConnectionPoint->lpVtbl->Advise(pSink->pConnectionPoint, (IUnknown *) &pSink->dispSink, &pSink->dwCookie);
+
+	if (FAILED(hr) && pSink->pConnectionPoint)
+	{
+		/* Not connected, so there is nothing to unadvise */
+		pSink->pConnectionPoint->lpVtbl->Release(pSink->pConnectionPoint);
+		pSink->pConnectionPoint = NULL;
+	}
+
+	if (pContainer) pContainer->lpVtbl->Release(pContainer);
+	if (pSourceInfo) pSourceInfo->lpVtbl->Release(pSourceInfo);
+
+	if (FAILED(hr))
+	{
+		StopSink(pSink);
+		Sink_Release(&pSink->dispSink);
+	}
+	else
+	{
+		*ppSink = pSink;
+	}
+
+	return DH_EXIT(hr, szEvents);
+}
+
+
+
+/* **************************************************************************
+ * dhAdvise:
+ *   This function connects a callback to events of the default source
+ * interface of an object, as dhAdviseEx does. The callback is called on
+ * the sink's handler thread.
+ *
+ * Example(s):
+ *   dhAdvise(wdApp, L"DocumentBeforeClose;DocumentOpen", OnEvent, NULL, &pSink);
+ *
+ ============================================================================ */
+HRESULT dhAdvise(IDispatch * pDisp, LPCOLESTR szEvents, DH_EVENT_CALLBACK pfnCallback, LPVOID pContext, PDH_EVENT_SINK * ppSink)
+{
+	DH_ENTER(L"Advise");
+
+	return DH_EXIT(dhAdviseEx(pDisp, NULL, szEvents, 0, pfnCallback, pContext, ppSink), szEvents);
+}
+
+
+
+/* **************************************************************************
+ * dhUnadvise:
+ *   Disconnects a sink from the events of its object. Events already queued
+ * are delivered before this function returns and the callback is not called
+ * afterwards. This should be called on the thread which called dhAdvise.
+ *
+ ============================================================================ */
+HRESULT dhUnadvise(PDH_EVENT_SINK pSink)
+{
+	HRESULT hr;
+
+	DH_ENTER(L"Unadvise");
+
+	if (!pSink) return DH_EXIT(E_INVALIDARG, NULL);
+
+	hr = StopSink(pSink);
+
+	/* The source may hold on to the sink for a while */
+	Sink_Release(&pSink->dispSink);
+
+	return DH_EXIT(hr, NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhGetEventStatistics:
+ *   Gets the counters of a sink: the events received, those ignored as they
+ * were not handled, those dropped and those delivered to the callback.
+ *
+ ============================================================================ */
+HRESULT dhGetEventStatistics(PDH_EVENT_SINK pSink, PDH_EVENT_STATISTICS pStatistics, BOOL bReset)
+{
+	if (!pSink || !pStatistics) return E_INVALIDARG;
+
+	if (bReset)
+	{
+		pStatistics->cReceived  = (ULONG) InterlockedExchange(&pSink->cReceived, 0);
+		pStatistics->cIgnored   = (ULONG) InterlockedExchange(&pSink->cIgnored, 0);
+		pStatistics->cDropped   = (ULONG) InterlockedExchange(&pSink->cDropped, 0);
+		pStatistics->cDelivered = (ULONG) InterlockedExchange(&pSink->cDelivered, 0);
+	}
+	else
+	{
+		pStatistics->cReceived  = (ULONG) pSink->cReceived;
+		pStatistics->cIgnored   = (ULONG) pSink->cIgnored;
+		pStatistics->cDropped   = (ULONG) pSink->cDropped;
+		pStatistics->cDelivered = (ULONG) pSink->cDelivered;
+	}
+
+	return NOERROR;
+}
@@ -277,6 +277,10 @@ HRESULT dhFormatExceptionW(PDH_EXCEPTION pException, LPWSTR szBuffer, UINT cchBu
 					_snwprintf(pException->szDescription, DESCRIPTION_LENGTH, L"Object doesn't support this property or method: '%s'", pException->szMember);
 					break;
 
+				case DH_E_CALL_TIMEOUT:
+					_snwprintf(pException->szDescription, DESCRIPTION_LENGTH, L"The call to '%s' did not complete within its timeout", pException->szMember);
+					break;
+
 				case DISP_E_TYPEMISMATCH:
 					if (pException->szMember[0])
 					{
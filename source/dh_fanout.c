@@ -0,0 +1,504 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* Structure to store a queued job */
+typedef struct tagDH_FANOUT_TASK
+{
+	SLIST_ENTRY entry; /* Must be first */
+	DH_FANOUT_JOB pfnJob;
+	LPVOID pContext;
+} DH_FANOUT_TASK;
+
+/* Structure to store a server instance, its thread and its queue */
+typedef struct tagDH_FANOUT_INSTANCE
+{
+	SLIST_HEADER slJobs; /* Must be first, for alignment */
+	PDH_FANOUT pFanOut;
+	HANDLE hThread;
+	HANDLE hWake;
+	HANDLE hStarted;
+	HRESULT hrStart;
+	LARGE_INTEGER liStarted;
+
+	/* Load, used to pick the least loaded instance */
+	LONG cQueued;
+	LONG bRunning;
+
+	/* Counters, only changed by the instance thread */
+	ULONG cCompleted;
+	ULONG cFailed;
+	ULONG cStolen;
+	ULONGLONG ullBusyUs;
+} DH_FANOUT_INSTANCE;
+
+/* Structure to store a fan-out executor */
+struct tagDH_FANOUT
+{
+	DH_FANOUT_INSTANCE * rgInstances;
+	UINT cInstances;
+	DH_FANOUT_FACTORY pfnFactory;
+	LPVOID pFactoryContext;
+	LONG cPending;
+	CRITICAL_SECTION csQuiet;
+	HANDLE hQuiet;
+	LONG bStop;
+};
+
+/* Context of the default factory used by dhCreateFanOut */
+typedef struct tagDH_FANOUT_PROGID
+{
+	LPCOLESTR szProgId;
+	LPCWSTR szMachine;
+} DH_FANOUT_PROGID;
+
+
+
+/* **************************************************************************
+ * ElapsedMicroseconds:
+ *   Returns the time since a performance counter value in microseconds.
+ *
+ ============================================================================ */
+static ULONGLONG ElapsedMicroseconds(LARGE_INTEGER * pliStart)
+{
+	LARGE_INTEGER liNow, liFrequency;
+
+	if (!QueryPerformanceFrequency(&liFrequency) || !liFrequency.QuadPart) return 0;
+
+	QueryPerformanceCounter(&liNow);
+
+	return (ULONGLONG) ((liNow.QuadPart - pliStart->QuadPart) * 1000000 / liFrequency.QuadPart);
+}
+
+
+
+/* **************************************************************************
+ * CreateServer:
+ *   The factory used by dhCreateFanOut.
+ *
+ ============================================================================ */
+static HRESULT CreateServer(IDispatch ** ppServer, LPVOID pContext)
+{
+	DH_FANOUT_PROGID * pProgId = pContext;
+
+	return dhCreateObject(pProgId->szProgId, pProgId->szMachine, ppServer);
+}
+
+
+
+/* **************************************************************************
+ * TakeTask:
+ *   Takes a job from an instance's own queue or, if it is empty, steals one
+ * from the instance with the longest queue.
+ *
+ ============================================================================ */
+static DH_FANOUT_TASK * TakeTask(DH_FANOUT_INSTANCE * pInstance)
+{
+	PDH_FANOUT pFanOut = pInstance->pFanOut;
+	DH_FANOUT_INSTANCE * pVictim;
+	PSLIST_ENTRY pEntry;
+	UINT iInstance, cAttempts;
+
+	if ((pEntry = InterlockedPopEntrySList(&pInstance->slJobs)) != NULL)
+	{
+		InterlockedDecrement(&pInstance->cQueued);
+		return (DH_FANOUT_TASK *) pEntry;
+	}
+
+	/* Counts are updated around the queue operations, so give up after a few tries */
+	for (cAttempts = 0; cAttempts < pFanOut->cInstances; cAttempts++)
+	{
+		pVictim = NULL;
+
+		for (iInstance = 0; iInstance < pFanOut->cInstances; iInstance++)
+		{
+			DH_FANOUT_INSTANCE * pOther = &pFanOut->rgInstances[iInstance];
+
+			if (pOther != pInstance && pOther->cQueued > 0 && (!pVictim || pOther->cQueued > pVictim->cQueued))
+			{
+				pVictim = pOther;
+			}
+		}
+
+		if (!pVictim) return NULL;
+
+		/* The queue may have been emptied since it was counted */
+		if ((pEntry = InterlockedPopEntrySList(&pVictim->slJobs)) != NULL)
+		{
+			InterlockedDecrement(&pVictim->cQueued);
+			pInstance->cStolen++;
+			return (DH_FANOUT_TASK *) pEntry;
+		}
+	}
+
+	return NULL;
+}
+
+
+
+/* **************************************************************************
+ * UpdateQuiet:
+ *   Sets hQuiet if no jobs are pending and resets it otherwise. This is called
+ * after cPending goes from zero to one or back, under a lock and reading the
+ * count again, so that a completion racing a submission can not leave the
+ * event set while jobs are still pending.
+ *
+ ============================================================================ */
+static void UpdateQuiet(PDH_FANOUT pFanOut)
+{
+	EnterCriticalSection(&pFanOut->csQuiet);
+
+	if (pFanOut->cPending == 0) SetEvent(pFanOut->hQuiet);
+	else ResetEvent(pFanOut->hQuiet);
+
+	LeaveCriticalSection(&pFanOut->csQuiet);
+}
+
+
+
+/* **************************************************************************
+ * RunTask:
+ *   Runs a job against an instance's server and records it.
+ *
+ ============================================================================ */
+static void RunTask(DH_FANOUT_INSTANCE * pInstance, DH_FANOUT_TASK * pTask, IDispatch * pServer)
+{
+	PDH_FANOUT pFanOut = pInstance->pFanOut;
+	LARGE_INTEGER liStart;
+	HRESULT hr;
+
+	QueryPerformanceCounter(&liStart);
+	InterlockedExchange(&pInstance->bRunning, TRUE);
+
+	hr = pTask->pfnJob(pServer, pTask->pContext);
+
+	InterlockedExchange(&pInstance->bRunning, FALSE);
+
+	pInstance->ullBusyUs += ElapsedMicroseconds(&liStart);
+
+	if (SUCCEEDED(hr)) pInstance->cCompleted++;
+	else pInstance->cFailed++;
+
+	HeapFree(GetProcessHeap(), 0, pTask);
+
+	if (InterlockedDecrement(&pFanOut->cPending) == 0) UpdateQuiet(pFanOut);
+}
+
+
+
+/* **************************************************************************
+ * InstanceThread:
+ *   Each instance thread owns a single threaded apartment and the server
+ * created in it, and runs jobs until the fan-out is destroyed.
+ *
+ ============================================================================ */
+static DWORD WINAPI InstanceThread(LPVOID lpParameter)
+{
+	DH_FANOUT_INSTANCE * pInstance = lpParameter;
+	PDH_FANOUT pFanOut = pInstance->pFanOut;
+	IDispatch * pServer = NULL;
+	DH_FANOUT_TASK * pTask;
+	DWORD dwIndex;
+	HRESULT hrInit, hr;
+
+	hr = hrInit = dhInitializeImp(TRUE, dh_g_bIsUnicodeMode);
+
+	if (SUCCEEDED(hr)) hr = pFanOut->pfnFactory(&pServer, pFanOut->pFactoryContext);
+
+	QueryPerformanceCounter(&pInstance->liStarted);
+	pInstance->hrStart = hr;
+	SetEvent(pInstance->hStarted);
+
+	while (SUCCEEDED(hr))
+	{
+		if ((pTask = TakeTask(pInstance)) != NULL)
+		{
+			RunTask(pInstance, pTask, pServer);
+			continue;
+		}
+
+		if (pFanOut->bStop) break;
+
+		/* Keep dispatching messages while idle, as required in an STA */
+		CoWaitForMultipleHandles(0, INFINITE, 1, &pInstance->hWake, &dwIndex);
+	}
+
+	if (pServer) pServer->lpVtbl->Release(pServer);
+
+	dhUninitialize(SUCCEEDED(hrInit));
+
+	return 0;
+}
+
+
+
+/* **************************************************************************
+ * dhCreateFanOutEx:
+ *   This function starts a number of server instances, each on its own
+ * single threaded apartment thread, and waits for them to be created.
+ *
+ * Parameter Info:
+ *   pfnFactory      - Called on each instance thread to create its server.
+ *   pFactoryContext - Passed to pfnFactory, which is only called before this
+ * function returns.
+ *   cInstances      - The number of instances, or zero for one per processor.
+ *   ppFanOut        - Receives the fan-out executor.
+ *
+ ============================================================================ */
+HRESULT dhCreateFanOutEx(DH_FANOUT_FACTORY pfnFactory, LPVOID pFactoryContext, UINT cInstances, PDH_FANOUT * ppFanOut)
+{
+	PDH_FANOUT pFanOut;
+	SYSTEM_INFO si;
+	UINT iInstance;
+	HRESULT hr = NOERROR;
+
+	DH_ENTER(L"CreateFanOutEx");
+
+	if (!pfnFactory || !ppFanOut) return DH_EXIT(E_INVALIDARG, NULL);
+
+	*ppFanOut = NULL;
+
+	if (cInstances == 0)
+	{
+		GetSystemInfo(&si);
+		cInstances = (si.dwNumberOfProcessors ? si.dwNumberOfProcessors : 1);
+	}
+
+	pFanOut = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(struct tagDH_FANOUT));
+	if (!pFanOut) return DH_EXIT(E_OUTOFMEMORY, NULL);
+
+	pFanOut->pfnFactory      = pfnFactory;
+	pFanOut->pFactoryContext = pFactoryContext;
+	InitializeCriticalSection(&pFanOut->csQuiet);
+
+	/* The heap returns blocks aligned as SLIST_HEADER requires */
+	pFanOut->rgInstances = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, cInstances * sizeof(DH_FANOUT_INSTANCE));
+
+	if (!pFanOut->rgInstances)
+		hr = E_OUTOFMEMORY;
+	else if (!(pFanOut->hQuiet = CreateEvent(NULL, TRUE, TRUE, NULL)))
+		hr = HRESULT_FROM_WIN32(GetLastError());
+
+	/* The servers are created concurrently */
+	for (iInstance = 0; SUCCEEDED(hr) && iInstance < cInstances; iInstance++)
+	{
+		DH_FANOUT_INSTANCE * pInstance = &pFanOut->rgInstances[iInstance];
+
+		InitializeSListHead(&pInstance->slJobs);
+		pInstance->pFanOut = pFanOut;
+
+		if (!(pInstance->hWake = CreateEvent(NULL, FALSE, FALSE, NULL)) ||
+		    !(pInstance->hStarted = CreateEvent(NULL, TRUE, FALSE, NULL)) ||
+		    !(pInstance->hThread = CreateThread(NULL, 0, InstanceThread, pInstance, 0, NULL)))
+		{
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		}
+
+		/* Only started instances are stopped by dhDestroyFanOut */
+		if (pInstance->hThread)
+		{
+			pFanOut->cInstances = iInstance + 1;
+		}
+		else
+		{
+			if (pInstance->hWake) CloseHandle(pInstance->hWake);
+			if (pInstance->hStarted) CloseHandle(pInstance->hStarted);
+		}
+	}
+
+	for (iInstance = 0; iInstance < pFanOut->cInstances; iInstance++)
+	{
+		WaitForSingleObject(pFanOut->rgInstances[iInstance].hStarted, INFINITE);
+
+		if (SUCCEEDED(hr)) hr = pFanOut->rgInstances[iInstance].hrStart;
+	}
+
+	if (FAILED(hr))
+	{
+		dhDestroyFanOut(pFanOut);
+		return DH_EXIT(hr, NULL);
+	}
+
+	*ppFanOut = pFanOut;
+
+	return DH_EXIT(NOERROR, NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhCreateFanOut:
+ *   This function starts a number of instances of an out of process server,
+ * such as Excel.Application, each on its own thread. The server must start
+ * a new process for each object created, as Excel and Word do.
+ *
+ ============================================================================ */
+HRESULT dhCreateFanOut(LPCOLESTR szProgId, LPCWSTR szMachine, UINT cInstances, PDH_FANOUT * ppFanOut)
+{
+	DH_FANOUT_PROGID progId;
+
+	if (!szProgId) return E_INVALIDARG;
+
+	/* The servers are created before dhCreateFanOutEx returns, so neither
+	 * the context nor the strings need to be copied. */
+	progId.szProgId  = szProgId;
+	progId.szMachine = szMachine;
+
+	return dhCreateFanOutEx(CreateServer, &progId, cInstances, ppFanOut);
+}
+
+
+
+/* **************************************************************************
+ * dhDestroyFanOut:
+ *   This function completes the jobs already queued, then releases the
+ * servers and stops the instance threads.
+ *
+ ============================================================================ */
+void dhDestroyFanOut(PDH_FANOUT pFanOut)
+{
+	UINT iInstance;
+
+	if (!pFanOut) return;
+
+	InterlockedExchange(&pFanOut->bStop, TRUE);
+
+	for (iInstance = 0; iInstance < pFanOut->cInstances; iInstance++) SetEvent(pFanOut->rgInstances[iInstance].hWake);
+
+	for (iInstance = 0; iInstance < pFanOut->cInstances; iInstance++)
+	{
+		DH_FANOUT_INSTANCE * pInstance = &pFanOut->rgInstances[iInstance];
+
+		WaitForSingleObject(pInstance->hThread, INFINITE);
+		CloseHandle(pInstance->hThread);
+		CloseHandle(pInstance->hWake);
+		CloseHandle(pInstance->hStarted);
+	}
+
+	if (pFanOut->hQuiet) CloseHandle(pFanOut->hQuiet);
+	DeleteCriticalSection(&pFanOut->csQuiet);
+	if (pFanOut->rgInstances) HeapFree(GetProcessHeap(), 0, pFanOut->rgInstances);
+
+	HeapFree(GetProcessHeap(), 0, pFanOut);
+}
+
+
+
+/* **************************************************************************
+ * dhFanOutSubmit:
+ *   This function queues a job to the least loaded instance. pfnJob is
+ * called on the instance's thread with its server. Jobs must be independent
+ * of each other: an idle instance steals jobs queued to busy ones, so jobs
+ * are not run in any particular order or on any particular instance.
+ *
+ ============================================================================ */
+HRESULT dhFanOutSubmit(PDH_FANOUT pFanOut, DH_FANOUT_JOB pfnJob, LPVOID pContext)
+{
+	DH_FANOUT_INSTANCE * pBest = NULL;
+	DH_FANOUT_TASK * pTask;
+	UINT iInstance;
+
+	if (!pFanOut || !pfnJob) return E_INVALIDARG;
+
+	pTask = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_FANOUT_TASK));
+	if (!pTask) return E_OUTOFMEMORY;
+
+	pTask->pfnJob   = pfnJob;
+	pTask->pContext = pContext;
+
+	for (iInstance = 0; iInstance < pFanOut->cInstances; iInstance++)
+	{
+		DH_FANOUT_INSTANCE * pInstance = &pFanOut->rgInstances[iInstance];
+
+		if (!pBest || pInstance->cQueued + pInstance->bRunning < pBest->cQueued + pBest->bRunning) pBest = pInstance;
+	}
+
+	/* Reset before the job can run, so its completion can not be missed */
+	if (InterlockedIncrement(&pFanOut->cPending) == 1) UpdateQuiet(pFanOut);
+
+	InterlockedIncrement(&pBest->cQueued);
+	InterlockedPushEntrySList(&pBest->slJobs, &pTask->entry);
+
+	SetEvent(pBest->hWake);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhFanOutWait:
+ *   This function waits until every job submitted has completed, or returns
+ * HRESULT_FROM_WIN32(WAIT_TIMEOUT). It must not be called from a job.
+ *
+ ============================================================================ */
+HRESULT dhFanOutWait(PDH_FANOUT pFanOut, DWORD dwTimeout)
+{
+	if (!pFanOut) return E_INVALIDARG;
+
+	if (WaitForSingleObject(pFanOut->hQuiet, dwTimeout) != WAIT_OBJECT_0) return HRESULT_FROM_WIN32(WAIT_TIMEOUT);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhFanOutGetInstanceCount:
+ *   This function returns the number of server instances.
+ *
+ ============================================================================ */
+UINT dhFanOutGetInstanceCount(PDH_FANOUT pFanOut)
+{
+	return (pFanOut ? pFanOut->cInstances : 0);
+}
+
+
+
+/* **************************************************************************
+ * dhFanOutGetStatistics:
+ *   This function gets a snapshot of an instance's counters. Its throughput
+ * is cCompleted over ullElapsedUs, and its utilization ullBusyUs over
+ * ullElapsedUs.
+ *
+ ============================================================================ */
+HRESULT dhFanOutGetStatistics(PDH_FANOUT pFanOut, UINT iInstance, PDH_FANOUT_STATISTICS pStatistics)
+{
+	DH_FANOUT_INSTANCE * pInstance;
+
+	if (!pFanOut || iInstance >= pFanOut->cInstances || !pStatistics) return E_INVALIDARG;
+
+	pInstance = &pFanOut->rgInstances[iInstance];
+
+	pStatistics->cQueued      = (UINT) pInstance->cQueued;
+	pStatistics->bRunning     = (pInstance->bRunning != FALSE);
+	pStatistics->cCompleted   = pInstance->cCompleted;
+	pStatistics->cFailed      = pInstance->cFailed;
+	pStatistics->cStolen      = pInstance->cStolen;
+	pStatistics->ullBusyUs    = pInstance->ullBusyUs;
+	pStatistics->ullElapsedUs = ElapsedMicroseconds(&pInstance->liStarted);
+
+	return NOERROR;
+}
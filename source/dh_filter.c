@@ -0,0 +1,312 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* Default deadline of a rejected call and longest delay between two attempts */
+#define DH_FILTER_DEFAULT_DEADLINE  60000
+#define DH_FILTER_DEFAULT_MAX_DELAY 2000
+
+/* First delay. RetryRejectedCall returns below 100 to retry at once. */
+#define DH_FILTER_MIN_DELAY 100
+
+/* Structure to store a thread's filter state */
+typedef struct tagDH_FILTER_THREAD
+{
+	IMessageFilter * pPrevious;
+	DWORD dwRetryTick;
+	UINT cAttempts;
+	ULONG ulSeed;
+} DH_FILTER_THREAD;
+
+static BOOL f_bFilterEnabled = FALSE;
+static DWORD f_dwFilterDeadline = DH_FILTER_DEFAULT_DEADLINE;
+static DWORD f_dwFilterMaxDelay = DH_FILTER_DEFAULT_MAX_DELAY;
+static DH_MESSAGE_FILTER_STATISTICS f_FilterStatistics;
+
+static LONG  f_lngFilterTlsInitBegin = -1, f_lngFilterTlsInitEnd = -1;
+static DWORD f_TlsIdxFilter;
+
+#define GetFilterThread()          ((DH_FILTER_THREAD *) TlsGetValue(f_TlsIdxFilter))
+#define SetFilterThread(pThread)   TlsSetValue(f_TlsIdxFilter, pThread)
+#define CheckFilterTlsInitialized() if (f_lngFilterTlsInitEnd != 0) InitializeFilterTlsIndex();
+
+
+
+/* **************************************************************************
+ * InitializeFilterTlsIndex:
+ *   Initializes the Tls index used to store each thread's filter state.
+ *
+ ============================================================================ */
+static void InitializeFilterTlsIndex(void)
+{
+	if (0 == InterlockedIncrement(&f_lngFilterTlsInitBegin))
+	{
+		f_TlsIdxFilter        = TlsAlloc();
+		f_lngFilterTlsInitEnd = 0;
+	}
+	else
+	{
+		/* Deal with extremely unlikely race condition */
+		while (f_lngFilterTlsInitEnd != 0) Sleep(5);
+	}
+}
+
+
+
+/* ===========================================================================
+ * The message filter. It is a single static object shared by all threads,
+ * its state is kept per thread.
+ * ======================================================================== */
+static HRESULT STDMETHODCALLTYPE Filter_QueryInterface(IMessageFilter * This, REFIID riid, void ** ppv)
+{
+	if (!IsEqualIID(riid, &IID_IUnknown) && !IsEqualIID(riid, &IID_IMessageFilter))
+	{
+		*ppv = NULL;
+		return E_NOINTERFACE;
+	}
+
+	*ppv = This;
+	return S_OK;
+}
+
+static ULONG STDMETHODCALLTYPE Filter_AddRef(IMessageFilter * This)
+{
+	return 2;
+}
+
+static ULONG STDMETHODCALLTYPE Filter_Release(IMessageFilter * This)
+{
+	return 1;
+}
+
+static DWORD STDMETHODCALLTYPE Filter_HandleInComingCall(IMessageFilter * This, DWORD dwCallType, HTASK htaskCaller,
+                                                         DWORD dwTickCount, LPINTERFACEINFO lpInterfaceInfo)
+{
+	DH_FILTER_THREAD * pThread = GetFilterThread();
+
+	if (pThread && pThread->pPrevious)
+	{
+		return pThread->pPrevious->lpVtbl->HandleInComingCall(pThread->pPrevious, dwCallType, htaskCaller,
+		                                                      dwTickCount, lpInterfaceInfo);
+	}
+
+	return SERVERCALL_ISHANDLED;
+}
+
+static DWORD STDMETHODCALLTYPE Filter_MessagePending(IMessageFilter * This, HTASK htaskCallee,
+                                                     DWORD dwTickCount, DWORD dwPendingType)
+{
+	DH_FILTER_THREAD * pThread = GetFilterThread();
+
+	if (pThread && pThread->pPrevious)
+	{
+		return pThread->pPrevious->lpVtbl->MessagePending(pThread->pPrevious, htaskCallee, dwTickCount, dwPendingType);
+	}
+
+	return PENDINGMSG_WAITDEFPROCESS;
+}
+
+
+
+/* **************************************************************************
+ * Filter_RetryRejectedCall:
+ *   Called when a server rejects a call, with the time elapsed since the
+ * call was first made. A call the server asked to retry later is retried
+ * after an exponential back-off with jitter, so that threads rejected at
+ * the same time do not retry together, until the deadline passes.
+ *   Returns the delay before the next attempt, or -1 to fail the call with
+ * RPC_E_CALL_REJECTED.
+ *
+ ============================================================================ */
+static DWORD STDMETHODCALLTYPE Filter_RetryRejectedCall(IMessageFilter * This, HTASK htaskCallee,
+                                                        DWORD dwTickCount, DWORD dwRejectType)
+{
+	DH_FILTER_THREAD * pThread = GetFilterThread();
+	DWORD dwDeadline = f_dwFilterDeadline, dwDelay;
+
+	if (!f_bFilterEnabled && pThread && pThread->pPrevious)
+	{
+		return pThread->pPrevious->lpVtbl->RetryRejectedCall(pThread->pPrevious, htaskCallee, dwTickCount, dwRejectType);
+	}
+
+	InterlockedIncrement((LONG *) &f_FilterStatistics.cRejections);
+
+	if (!f_bFilterEnabled || !pThread || dwRejectType != SERVERCALL_RETRYLATER || dwTickCount >= dwDeadline)
+	{
+		InterlockedIncrement((LONG *) &f_FilterStatistics.cCancelled);
+		return (DWORD) -1;
+	}
+
+	/* The elapsed time restarts with each call, so a call rejected before the
+	 * previous delay could have passed is a new call */
+	if (dwTickCount < pThread->dwRetryTick) pThread->cAttempts = 0;
+
+	dwDelay = (pThread->cAttempts < 16 ? DH_FILTER_MIN_DELAY << pThread->cAttempts : f_dwFilterMaxDelay);
+	if (dwDelay > f_dwFilterMaxDelay) dwDelay = f_dwFilterMaxDelay;
+
+	/* Keep between half and all of the delay */
+	pThread->ulSeed = pThread->ulSeed * 1103515245 + 12345;
+	dwDelay = dwDelay / 2 + (DWORD) ((pThread->ulSeed >> 16) % (dwDelay / 2 + 1));
+
+	if (dwDelay > dwDeadline - dwTickCount) dwDelay = dwDeadline - dwTickCount;
+
+	if (dwDelay < DH_FILTER_MIN_DELAY)
+	{
+		InterlockedIncrement((LONG *) &f_FilterStatistics.cCancelled);
+		return (DWORD) -1;
+	}
+
+	pThread->cAttempts++;
+	pThread->dwRetryTick = dwTickCount + dwDelay / 2;
+
+	InterlockedIncrement((LONG *) &f_FilterStatistics.cRetries);
+	InterlockedExchangeAdd((LONG *) &f_FilterStatistics.ulDelayMs, (LONG) dwDelay);
+
+	return dwDelay;
+}
+
+static IMessageFilterVtbl f_MessageFilterVtbl =
+{
+	Filter_QueryInterface, Filter_AddRef, Filter_Release,
+	Filter_HandleInComingCall, Filter_RetryRejectedCall, Filter_MessagePending
+};
+
+static IMessageFilter f_MessageFilter = { &f_MessageFilterVtbl };
+
+
+
+/* **************************************************************************
+ * dhRegisterThreadMessageFilter:
+ *   Registers the message filter on the calling thread if it is enabled.
+ * This is called by dhInitialize. Threads in the multithreaded apartment,
+ * which do not support message filters, are left as they are.
+ *
+ ============================================================================ */
+void dhRegisterThreadMessageFilter(void)
+{
+	DH_FILTER_THREAD * pThread;
+
+	if (!f_bFilterEnabled) return;
+
+	CheckFilterTlsInitialized();
+
+	if (GetFilterThread()) return;
+
+	if (!(pThread = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_FILTER_THREAD)))) return;
+
+	pThread->ulSeed = GetTickCount() ^ GetCurrentThreadId();
+
+	if (SUCCEEDED(CoRegisterMessageFilter(&f_MessageFilter, &pThread->pPrevious)))
+	{
+		SetFilterThread(pThread);
+	}
+	else
+	{
+		HeapFree(GetProcessHeap(), 0, pThread);
+	}
+}
+
+
+
+/* **************************************************************************
+ * dhCleanupThreadMessageFilter:
+ *   Restores the thread's previous message filter. This is called by
+ * dhUninitialize.
+ *
+ ============================================================================ */
+void dhCleanupThreadMessageFilter(void)
+{
+	DH_FILTER_THREAD * pThread;
+	IMessageFilter * pOurs = NULL;
+
+	if (f_lngFilterTlsInitEnd != 0 || !(pThread = GetFilterThread())) return;
+
+	CoRegisterMessageFilter(pThread->pPrevious, &pOurs);
+
+	if (pThread->pPrevious) pThread->pPrevious->lpVtbl->Release(pThread->pPrevious);
+
+	HeapFree(GetProcessHeap(), 0, pThread);
+	SetFilterThread(NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhSetMessageFilter:
+ *   This function enables or disables the message filter. While enabled,
+ * the filter is registered by each thread that calls dhInitialize, and by
+ * the calling thread at once. Calls which a busy server, such as an Office
+ * application, asks to retry later are then retried with an increasing delay
+ * instead of failing with RPC_E_CALL_REJECTED.
+ *
+ * Parameter Info:
+ *   bEnable    - TRUE to enable the filter, FALSE to disable it. A disabled
+ * filter lets rejected calls fail, as without a filter.
+ *   dwDeadline - How long, in milliseconds, a rejected call is retried
+ * before it fails, or zero for 60 seconds.
+ *   dwMaxDelay - The longest delay between two attempts, in milliseconds,
+ * or zero for 2 seconds. The first delay is 100ms.
+ *
+ * Notes:
+ *   Message filters are only supported by single threaded apartments.
+ *   Calls rejected with SERVERCALL_REJECTED, which the server will not
+ * accept later, fail at once.
+ *
+ ============================================================================ */
+HRESULT dhSetMessageFilter(BOOL bEnable, DWORD dwDeadline, DWORD dwMaxDelay)
+{
+	f_dwFilterDeadline = (dwDeadline ? dwDeadline : DH_FILTER_DEFAULT_DEADLINE);
+	f_dwFilterMaxDelay = (dwMaxDelay > DH_FILTER_MIN_DELAY ? dwMaxDelay : DH_FILTER_DEFAULT_MAX_DELAY);
+	f_bFilterEnabled   = bEnable;
+
+	if (bEnable)
+		dhRegisterThreadMessageFilter();
+	else
+		dhCleanupThreadMessageFilter();
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhGetMessageFilterStatistics:
+ *   This function gets the counters of the message filter, optionally
+ * resetting them.
+ *
+ ============================================================================ */
+HRESULT dhGetMessageFilterStatistics(PDH_MESSAGE_FILTER_STATISTICS pStatistics, BOOL bReset)
+{
+	if (!pStatistics) return E_INVALIDARG;
+
+	if (bReset)
+	{
+		pStatistics->cRejections = (ULONG) InterlockedExchange((LONG *) &f_FilterStatistics.cRejections, 0);
+		pStatistics->cRetries    = (ULONG) InterlockedExchange((LONG *) &f_FilterStatistics.cRetries, 0);
+		pStatistics->cCancelled  = (ULONG) InterlockedExchange((LONG *) &f_FilterStatistics.cCancelled, 0);
+		pStatistics->ulDelayMs   = (ULONG) InterlockedExchange((LONG *) &f_FilterStatistics.ulDelayMs, 0);
+	}
+	else
+	{
+		*pStatistics = f_FilterStatistics;
+	}
+
+	return NOERROR;
+}
@@ -0,0 +1,549 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+
+/* A member for which concurrent gets are coalesced. Members are never
+ * unlinked, so the list can be walked without the lock; a disabled member
+ * is kept and enabled again in place. */
+typedef struct tagDH_FLIGHT_MEMBER
+{
+	struct tagDH_FLIGHT_MEMBER * volatile pNext;
+	volatile BOOL bEnabled;
+	WCHAR szMember[1];
+} DH_FLIGHT_MEMBER;
+
+/* A get in progress. The thread that started it (the leader) invokes the
+ * member, other threads making the same get wait for its result. */
+typedef struct tagDH_FLIGHT
+{
+	struct tagDH_FLIGHT * pNext;
+	LONG cRefs;
+
+	IDispatch * pDisp;
+	LPCOLESTR szMember;
+	VARTYPE returnType;
+	UINT cArgs;
+	VARIANT rgArgs[DH_MAX_CAPTURED_ARGS];
+
+	DWORD dwLeaderThreadId;
+	HANDLE hDone;
+	HRESULT hr;
+	VARIANT vtResult;
+
+	/* The error recorded by the leader, reported to the waiters */
+	BOOL bDispatchError;
+	UINT iArgError;
+	WCHAR szErrorMember[64];
+	EXCEPINFO excepInfo;
+} DH_FLIGHT;
+
+static DH_FLIGHT_MEMBER * volatile f_pFlightMembers = NULL;
+static DH_FLIGHT * f_pFlights = NULL;
+static LONG f_cFlightMembers = 0;
+static DH_SINGLEFLIGHT_STATISTICS f_FlightStatistics;
+
+static CRITICAL_SECTION f_csFlight;
+static LONG f_lngFlightInitBegin = -1, f_lngFlightInitEnd = -1;
+
+#define CheckFlightLockInitialized() if (f_lngFlightInitEnd != 0) InitializeFlightLock();
+
+
+
+/* **************************************************************************
+ * InitializeFlightLock:
+ *   Initializes the critical section protecting the member list and the gets
+ * in progress if needed.
+ *
+ ============================================================================ */
+static void InitializeFlightLock(void)
+{
+	if (0 == InterlockedIncrement(&f_lngFlightInitBegin))
+	{
+		InitializeCriticalSection(&f_csFlight);
+		f_lngFlightInitEnd = 0;
+	}
+	else
+	{
+		/* Deal with extremely unlikely race condition */
+		while (f_lngFlightInitEnd != 0) Sleep(5);
+	}
+}
+
+
+
+/* **************************************************************************
+ * FindFlightMember:
+ *   Finds a member, enabled or not, in the list of members that have been
+ * passed to dhSetSingleFlight. Does not need the lock.
+ *
+ ============================================================================ */
+static DH_FLIGHT_MEMBER * FindFlightMember(LPCOLESTR szMember)
+{
+	DH_FLIGHT_MEMBER * pMember;
+
+	if (*szMember == L'.') szMember++;
+
+	for (pMember = f_pFlightMembers; pMember; pMember = pMember->pNext)
+	{
+		if (lstrcmpiW(pMember->szMember, szMember) == 0) break;
+	}
+
+	return pMember;
+}
+
+
+
+/* **************************************************************************
+ * dhArgumentsMatch:
+ *   Internal function which checks if two sets of captured arguments are
+ * identical. Objects are compared by address and other values with VarCmp.
+ *
+ ============================================================================ */
+BOOL dhArgumentsMatch(VARIANT * rgArgs1, VARIANT * rgArgs2, UINT cArgs)
+{
+	UINT iArg;
+
+	for (iArg = 0; iArg < cArgs; iArg++)
+	{
+		VARIANT * pv1 = &rgArgs1[iArg], * pv2 = &rgArgs2[iArg];
+
+		/* By reference arguments are written to by the call */
+		if (V_VT(pv1) != V_VT(pv2) || (V_VT(pv1) & VT_BYREF)) return FALSE;
+
+		switch (V_VT(pv1))
+		{
+			case VT_EMPTY: case VT_NULL:
+				break;
+
+			case VT_DISPATCH: case VT_UNKNOWN:
+				if (V_UNKNOWN(pv1) != V_UNKNOWN(pv2)) return FALSE;
+				break;
+
+			case VT_ERROR:
+				if (V_ERROR(pv1) != V_ERROR(pv2)) return FALSE;
+				break;
+
+			default:
+				if (VarCmp(pv1, pv2, LOCALE_USER_DEFAULT, 0) != VARCMP_EQ) return FALSE;
+				break;
+		}
+	}
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * ReleaseFlight:
+ *   Releases a reference on a get in progress and frees it with the last one.
+ *
+ ============================================================================ */
+static void ReleaseFlight(DH_FLIGHT * pFlight)
+{
+	UINT iArg;
+
+	if (InterlockedDecrement(&pFlight->cRefs) != 0) return;
+
+	for (iArg = 0; iArg < pFlight->cArgs; iArg++)
+	{
+		VariantClear(&pFlight->rgArgs[iArg]);
+	}
+
+	VariantClear(&pFlight->vtResult);
+	SysFreeString(pFlight->excepInfo.bstrDescription);
+	SysFreeString(pFlight->excepInfo.bstrSource);
+	SysFreeString(pFlight->excepInfo.bstrHelpFile);
+	CloseHandle(pFlight->hDone);
+	HeapFree(GetProcessHeap(), 0, pFlight);
+}
+
+
+
+/* **************************************************************************
+ * SaveFlightException:
+ *   Keeps a copy of the error the leader's get recorded on its thread, so
+ * that it can be reported to the waiters.
+ *
+ ============================================================================ */
+static void SaveFlightException(DH_FLIGHT * pFlight, HRESULT hr)
+{
+#ifndef DISPHELPER_NO_EXCEPTIONS
+	PDH_EXCEPTION pException;
+
+	if (FAILED(dhGetLastException(&pException)) || !pException || pException->bOld || pException->hr != hr) return;
+
+	pFlight->bDispatchError = pException->bDispatchError;
+	pFlight->iArgError      = pException->iArgError;
+	CopyMemory(pFlight->szErrorMember, pException->szMember, sizeof(pFlight->szErrorMember));
+
+	if (hr == DISP_E_EXCEPTION)
+	{
+		pFlight->excepInfo.scode           = (SCODE) pException->swCode;
+		pFlight->excepInfo.dwHelpContext   = pException->dwHelpContext;
+		pFlight->excepInfo.bstrDescription = SysAllocString(pException->szDescription);
+		pFlight->excepInfo.bstrSource      = SysAllocString(pException->szSource);
+		pFlight->excepInfo.bstrHelpFile    = SysAllocString(pException->szHelpFile);
+	}
+#endif
+}
+
+
+
+/* **************************************************************************
+ * ReportFlightException:
+ *   Records the error saved by the leader of a failed get on a waiting
+ * thread, as if the waiter had made the call itself.
+ *
+ ============================================================================ */
+static HRESULT ReportFlightException(DH_FLIGHT * pFlight)
+{
+	EXCEPINFO excepInfo;
+
+	DH_ENTER(L"SingleFlightGet");
+
+	/* dhExitEx takes ownership of the strings */
+	ZeroMemory(&excepInfo, sizeof(excepInfo));
+	excepInfo.scode           = pFlight->excepInfo.scode;
+	excepInfo.dwHelpContext   = pFlight->excepInfo.dwHelpContext;
+	excepInfo.bstrDescription = SysAllocString(pFlight->excepInfo.bstrDescription);
+	excepInfo.bstrSource      = SysAllocString(pFlight->excepInfo.bstrSource);
+	excepInfo.bstrHelpFile    = SysAllocString(pFlight->excepInfo.bstrHelpFile);
+
+	return DH_EXITEX(pFlight->hr, pFlight->bDispatchError, (pFlight->szErrorMember[0] ? pFlight->szErrorMember : NULL),
+	                 NULL, &excepInfo, pFlight->iArgError);
+}
+
+
+
+/* **************************************************************************
+ * LeadFlight:
+ *   Invokes the member for a get in progress, publishes the result to the
+ * threads waiting for it and returns a copy in pvResult.
+ *
+ ============================================================================ */
+static HRESULT LeadFlight(DH_FLIGHT * pFlight, LPCOLESTR szCaptured, VARIANT * pvResult)
+{
+	DH_FLIGHT ** ppFlight;
+	HRESULT hr;
+
+	hr = dhInvokeCaptured(DISPATCH_PROPERTYGET|DISPATCH_METHOD, pFlight->returnType, &pFlight->vtResult,
+	                      pFlight->pDisp, szCaptured, pFlight->rgArgs);
+
+	EnterCriticalSection(&f_csFlight);
+
+	for (ppFlight = &f_pFlights; *ppFlight; ppFlight = &(*ppFlight)->pNext)
+	{
+		if (*ppFlight == pFlight)
+		{
+			*ppFlight = pFlight->pNext;
+			break;
+		}
+	}
+
+	LeaveCriticalSection(&f_csFlight);
+
+	if (FAILED(hr)) SaveFlightException(pFlight, hr);
+
+	pFlight->hr = hr;
+	SetEvent(pFlight->hDone);
+
+	if (SUCCEEDED(hr))
+	{
+		VariantInit(pvResult);
+		hr = VariantCopy(pvResult, &pFlight->vtResult);
+	}
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * IsFlightMember:
+ *   Checks if gets of a member have been enabled with dhSetSingleFlight.
+ *
+ ============================================================================ */
+static BOOL IsFlightMember(LPCOLESTR szMember)
+{
+	DH_FLIGHT_MEMBER * pMember;
+
+	if (f_cFlightMembers == 0) return FALSE;
+
+	pMember = FindFlightMember(szMember);
+
+	return pMember && pMember->bEnabled;
+}
+
+
+
+/* **************************************************************************
+ * dhSingleFlightGet:
+ *   Internal function which gets a member whose arguments have been captured
+ * (see dhCaptureArguments). If the member has been enabled with
+ * dhSetSingleFlight and another thread is already making the same get (same
+ * object, member and arguments), this thread waits for that get to complete
+ * and receives a copy of its result instead of invoking the member again.
+ * A failed get's error is recorded on the waiting threads too.
+ *
+ *   The captured arguments are cleared before returning.
+ *
+ ============================================================================ */
+HRESULT dhSingleFlightGet(VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember,
+                          LPCOLESTR szCaptured, VARIANT * rgArgs, UINT cArgs)
+{
+	DH_FLIGHT * pFlight;
+	UINT iArg;
+	HRESULT hr;
+
+	if (!IsFlightMember(szMember))
+	{
+		hr = dhInvokeCaptured(DISPATCH_PROPERTYGET|DISPATCH_METHOD, returnType, pvResult, pDisp, szCaptured, rgArgs);
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+		return hr;
+	}
+
+	InterlockedIncrement((LONG *) &f_FlightStatistics.cCalls);
+
+	CheckFlightLockInitialized();
+
+	EnterCriticalSection(&f_csFlight);
+
+	for (pFlight = f_pFlights; pFlight; pFlight = pFlight->pNext)
+	{
+		if (pFlight->pDisp == pDisp && pFlight->returnType == returnType && pFlight->cArgs == cArgs &&
+		    wcscmp(pFlight->szMember, szMember) == 0 && dhArgumentsMatch(pFlight->rgArgs, rgArgs, cArgs))
+		{
+			break;
+		}
+	}
+
+	if (pFlight && pFlight->dwLeaderThreadId == GetCurrentThreadId())
+	{
+		/* The same get made while this thread leads it, e.g. from a message
+		 * dispatched while a single threaded apartment waits for the call.
+		 * Waiting would wait on ourself. */
+		LeaveCriticalSection(&f_csFlight);
+
+		InterlockedIncrement((LONG *) &f_FlightStatistics.cInvokes);
+
+		hr = dhInvokeCaptured(DISPATCH_PROPERTYGET|DISPATCH_METHOD, returnType, pvResult, pDisp, szCaptured, rgArgs);
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+		return hr;
+	}
+
+	if (pFlight)
+	{
+		DWORD dwIndex;
+
+		InterlockedIncrement(&pFlight->cRefs);
+
+		LeaveCriticalSection(&f_csFlight);
+
+		InterlockedIncrement((LONG *) &f_FlightStatistics.cCoalesced);
+
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+
+		CoWaitForMultipleHandles(0, INFINITE, 1, &pFlight->hDone, &dwIndex);
+
+		if (SUCCEEDED(hr = pFlight->hr))
+		{
+			VariantInit(pvResult);
+			hr = VariantCopy(pvResult, &pFlight->vtResult);
+		}
+		else
+		{
+			hr = ReportFlightException(pFlight);
+		}
+
+		ReleaseFlight(pFlight);
+
+		return hr;
+	}
+
+	/* This thread leads a new get */
+	pFlight = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_FLIGHT));
+
+	if (pFlight && !(pFlight->hDone = CreateEvent(NULL, TRUE, FALSE, NULL)))
+	{
+		HeapFree(GetProcessHeap(), 0, pFlight);
+		pFlight = NULL;
+	}
+
+	if (!pFlight)
+	{
+		LeaveCriticalSection(&f_csFlight);
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+		return E_OUTOFMEMORY;
+	}
+
+	/* The leader's reference. szMember lives on the leader's stack, which is
+	 * valid until the get is removed from the list. */
+	pFlight->cRefs            = 1;
+	pFlight->dwLeaderThreadId = GetCurrentThreadId();
+	pFlight->pDisp            = pDisp;
+	pFlight->szMember         = szMember;
+	pFlight->returnType       = returnType;
+	pFlight->cArgs            = cArgs;
+
+	CopyMemory(pFlight->rgArgs, rgArgs, cArgs * sizeof(VARIANT));
+
+	pFlight->pNext = f_pFlights;
+	f_pFlights     = pFlight;
+
+	LeaveCriticalSection(&f_csFlight);
+
+	InterlockedIncrement((LONG *) &f_FlightStatistics.cInvokes);
+
+	hr = LeadFlight(pFlight, szCaptured, pvResult);
+
+	ReleaseFlight(pFlight);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhSingleFlightGetV:
+ *   Internal function used by dhGetValueV to invoke a property get, which
+ * is coalesced with identical gets of other threads by dhSingleFlightGet if
+ * the member has been enabled with dhSetSingleFlight.
+ *
+ ============================================================================ */
+HRESULT dhSingleFlightGetV(VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
+{
+	WCHAR szCaptured[DH_MAX_MEMBER];
+	VARIANT rgArgs[DH_MAX_CAPTURED_ARGS];
+	UINT cArgs, iArg;
+	HRESULT hr;
+
+	if (f_cFlightMembers == 0 || !pDisp || !szMember || wcslen(szMember) >= DH_MAX_MEMBER || !IsFlightMember(szMember))
+	{
+		return dhInvokeV(DISPATCH_PROPERTYGET|DISPATCH_METHOD, returnType, pvResult, pDisp, szMember, marker);
+	}
+
+	hr = dhCaptureArguments(szMember, szCaptured, rgArgs, DH_MAX_CAPTURED_ARGS, &cArgs, marker);
+	if (FAILED(hr)) return hr;
+
+	for (iArg = cArgs; iArg < DH_MAX_CAPTURED_ARGS; iArg++) VariantInit(&rgArgs[iArg]);
+
+	return dhSingleFlightGet(returnType, pvResult, pDisp, szMember, szCaptured, rgArgs, cArgs);
+}
+
+
+
+/* **************************************************************************
+ * dhSetSingleFlight:
+ *   Enables or disables coalescing of concurrent gets of a member. While a
+ * get of an enabled member is in progress, other threads making the same get
+ * (same object, member and arguments) share its result instead of making
+ * another call.
+ *
+ * Parameter Info:
+ *   szMember - The member as passed to dhGetValue, e.g. L".Version" or
+ * L"ActiveWorkbook.Name". A leading '.' is ignored and the comparison is
+ * case insensitive.
+ *   bEnable  - TRUE to coalesce gets of the member, FALSE to stop.
+ *
+ * Notes:
+ *   Only threads using the same IDispatch pointer share a get, e.g. threads
+ * in the multithreaded apartment sharing a proxy. The result is copied for
+ * each thread, so objects returned by a coalesced get are shared. A get made
+ * by the thread already leading the same get is not coalesced.
+ *
+ ============================================================================ */
+HRESULT dhSetSingleFlight(LPCOLESTR szMember, BOOL bEnable)
+{
+	DH_FLIGHT_MEMBER * pMember;
+	HRESULT hr = NOERROR;
+
+	if (!szMember) return E_INVALIDARG;
+
+	if (*szMember == L'.') szMember++;
+
+	CheckFlightLockInitialized();
+
+	EnterCriticalSection(&f_csFlight);
+
+	pMember = FindFlightMember(szMember);
+
+	if (bEnable && !pMember)
+	{
+		pMember = HeapAlloc(GetProcessHeap(), 0, sizeof(DH_FLIGHT_MEMBER) + wcslen(szMember) * sizeof(WCHAR));
+
+		if (pMember)
+		{
+			wcscpy(pMember->szMember, szMember);
+			pMember->bEnabled = TRUE;
+			pMember->pNext    = f_pFlightMembers;
+
+			/* Publish the member once it is complete */
+			InterlockedExchangePointer((PVOID volatile *) &f_pFlightMembers, pMember);
+			InterlockedIncrement(&f_cFlightMembers);
+		}
+		else
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+	else if (pMember && !pMember->bEnabled != !bEnable)
+	{
+		pMember->bEnabled = (bEnable != FALSE);
+
+		if (bEnable)
+			InterlockedIncrement(&f_cFlightMembers);
+		else
+			InterlockedDecrement(&f_cFlightMembers);
+	}
+
+	LeaveCriticalSection(&f_csFlight);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhGetSingleFlightStatistics:
+ *   Retrieves the number of gets of enabled members (cCalls), how many of
+ * them invoked the member (cInvokes) and how many shared the result of
+ * another thread's get (cCoalesced). If bReset is TRUE the counters are
+ * reset to zero.
+ *
+ ============================================================================ */
+HRESULT dhGetSingleFlightStatistics(PDH_SINGLEFLIGHT_STATISTICS pStatistics, BOOL bReset)
+{
+	if (!pStatistics) return E_INVALIDARG;
+
+	if (bReset)
+	{
+		pStatistics->cCalls     = (ULONG) InterlockedExchange((LONG *) &f_FlightStatistics.cCalls, 0);
+		pStatistics->cInvokes   = (ULONG) InterlockedExchange((LONG *) &f_FlightStatistics.cInvokes, 0);
+		pStatistics->cCoalesced = (ULONG) InterlockedExchange((LONG *) &f_FlightStatistics.cCoalesced, 0);
+	}
+	else
+	{
+		*pStatistics = f_FlightStatistics;
+	}
+
+	return NOERROR;
+}
@@ -25,16 +25,21 @@
  *   dhInitialize should be called at the start of each thread. The global
  * unicode mode is set depending on whether UNICODE is defined or not.
  * This funcion optionally initializes COM. CoInitialize may be changed
- * to OleInitialize in a future version.
+ * to OleInitialize in a future version. The message filter is registered
+ * if it was enabled with dhSetMessageFilter.
  *
  ============================================================================ */
 HRESULT dhInitializeImp(BOOL bInitializeCOM, BOOL bUnicode)
 {
+	HRESULT hr = NOERROR;
+
 	dh_g_bIsUnicodeMode = bUnicode;
 
-	if (bInitializeCOM) return CoInitialize(NULL);
+	if (bInitializeCOM) hr = CoInitialize(NULL);
+
+	if (SUCCEEDED(hr)) dhRegisterThreadMessageFilter();
 
-	return NOERROR;
+	return hr;
 }
 
 
@@ -42,7 +47,9 @@ HRESULT dhInitializeImp(BOOL bInitializeCOM, BOOL bUnicode)
 /* **************************************************************************
  * dhUninitialize:
  *   This function should be called at the end of every thread. Frees
- * the thread's exception if it exists and uninitializes COM if requested. 
+ * the thread's exception, DISPID, constant string, property and class
+ * factory caches and call timeout if they exist, revokes the message
+ * filter and uninitializes COM if requested. 
  *
  ============================================================================ */
 void dhUninitialize(BOOL bUninitializeCOM)
@@ -50,5 +57,11 @@ void dhUninitialize(BOOL bUninitializeCOM)
 #ifndef DISPHELPER_NO_EXCEPTIONS
 	dhCleanupThreadException();
 #endif
+	dhCleanupThreadCache();
+	dhCleanupThreadLiterals();
+	dhCleanupThreadPropertyCache();
+	dhCleanupThreadFactoryCache();
+	dhCleanupThreadMessageFilter();
+	dhCleanupThreadDeadline();
 	if (bUninitializeCOM) CoUninitialize();
 }
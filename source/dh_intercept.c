@@ -0,0 +1,368 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+
+/* An installed interceptor */
+typedef struct tagDH_INTERCEPTOR
+{
+	DH_PRE_INVOKE pfnPreInvoke;
+	DH_POST_INVOKE pfnPostInvoke;
+	LPVOID pContext;
+	DWORD dwCookie;
+} DH_INTERCEPTOR;
+
+/* The installed interceptors. An array is never modified once published,
+ * changes install a copy (copy-on-write) and retire the old array. */
+typedef struct tagDH_INTERCEPTOR_ARRAY
+{
+	struct tagDH_INTERCEPTOR_ARRAY * pNextRetired;
+	UINT cInterceptors;
+	DH_INTERCEPTOR rgInterceptors[1];
+} DH_INTERCEPTOR_ARRAY;
+
+/* Invokes using an array are counted on one of several counters, chosen by
+ * thread and each on its own cache line, so that threads calling at the
+ * same time do not contend on a single counter. */
+#define DH_INTERCEPTOR_STRIPES 16
+
+typedef struct tagDH_READER_STRIPE
+{
+	volatile LONG cReaders;
+	BYTE rgbPadding[64 - sizeof(LONG)];
+} DH_READER_STRIPE;
+
+static DH_INTERCEPTOR_ARRAY * volatile f_pInterceptors = NULL;
+static DH_INTERCEPTOR_ARRAY * volatile f_pRetiredInterceptors = NULL;
+static DH_READER_STRIPE f_rgInterceptorReaders[DH_INTERCEPTOR_STRIPES];
+static LONG f_lngInterceptorWriter = 0;
+static DWORD f_dwNextInterceptorCookie = 0;
+
+/* Thread ids are multiples of four */
+#define ReaderStripe() (&f_rgInterceptorReaders[(GetCurrentThreadId() >> 2) % DH_INTERCEPTOR_STRIPES].cReaders)
+
+#define AcquireInterceptorWriter() while (InterlockedCompareExchange(&f_lngInterceptorWriter, 1, 0) != 0) Sleep(0)
+#define ReleaseInterceptorWriter() InterlockedExchange(&f_lngInterceptorWriter, 0)
+
+
+
+/* **************************************************************************
+ * FreeRetiredInterceptors:
+ *   Frees the retired arrays if no invoke is using any array. Must be called
+ * by the writer.
+ *
+ ============================================================================ */
+static void FreeRetiredInterceptors(void)
+{
+	DH_INTERCEPTOR_ARRAY * pOld, * pNext;
+	UINT iStripe;
+
+	/* Readers announce themselves before loading the array, and the arrays
+	 * were retired before this check. A reader of a retired array keeps its
+	 * counter above zero until it is done, so if each counter is seen at
+	 * zero, any reader still to come will load the current array. */
+	for (iStripe = 0; iStripe < DH_INTERCEPTOR_STRIPES; iStripe++)
+	{
+		if (f_rgInterceptorReaders[iStripe].cReaders != 0) return;
+	}
+
+	for (pOld = f_pRetiredInterceptors; pOld; pOld = pNext)
+	{
+		pNext = pOld->pNextRetired;
+		HeapFree(GetProcessHeap(), 0, pOld);
+	}
+
+	f_pRetiredInterceptors = NULL;
+}
+
+
+
+/* **************************************************************************
+ * LeaveInterceptors:
+ *   Ends an invoke's use of the installed array. The last reader to leave
+ * frees the arrays retired meanwhile. If another thread is changing the
+ * interceptors at that moment, they are left to the next reader to leave.
+ *
+ ============================================================================ */
+static void LeaveInterceptors(volatile LONG * pcReaders)
+{
+	if (InterlockedDecrement(pcReaders) == 0 && f_pRetiredInterceptors &&
+	    InterlockedCompareExchange(&f_lngInterceptorWriter, 1, 0) == 0)
+	{
+		FreeRetiredInterceptors();
+		ReleaseInterceptorWriter();
+	}
+}
+
+
+
+/* **************************************************************************
+ * InvokeIntercepted:
+ *   Invokes a member through the installed interceptors. Pre-invoke callbacks
+ * are called in the order the interceptors were added and post-invoke
+ * callbacks in the reverse order.
+ *
+ ============================================================================ */
+static HRESULT InvokeIntercepted(IDispatch * pDisp, LPCOLESTR szMember, DISPID dispID, int invokeType,
+                                 DISPPARAMS * pDispParams, VARIANT * pvResult, EXCEPINFO * pExcepInfo, UINT * puArgErr)
+{
+	DH_INTERCEPTOR_ARRAY * pArray;
+	volatile LONG * pcReaders = ReaderStripe();
+	DH_INVOKE_CONTEXT call;
+	UINT cEntered = 0;
+	BOOL bShortCircuit = FALSE;
+	HRESULT hrPre;
+
+	/* Announce this reader before loading the array, so that an array
+	 * retired after the load is not freed while we use it. */
+	InterlockedIncrement(pcReaders);
+
+	pArray = f_pInterceptors;
+
+	if (!pArray)
+	{
+		LeaveInterceptors(pcReaders);
+		return dhTimedInvoke(pDisp, dispID, invokeType, pDispParams, pvResult, pExcepInfo, puArgErr);
+	}
+
+	call.pDisp       = pDisp;
+	call.szMember    = szMember;
+	call.dispID      = dispID;
+	call.invokeType  = invokeType;
+	call.pDispParams = pDispParams;
+	call.pvResult    = pvResult;
+	call.pExcepInfo  = pExcepInfo;
+	call.puArgErr    = puArgErr;
+	call.hr          = NOERROR;
+
+	while (cEntered < pArray->cInterceptors)
+	{
+		DH_INTERCEPTOR * pInterceptor = &pArray->rgInterceptors[cEntered++];
+
+		if (!pInterceptor->pfnPreInvoke) continue;
+
+		hrPre = pInterceptor->pfnPreInvoke(&call, pInterceptor->pContext);
+
+		if (hrPre != S_OK)
+		{
+			/* S_FALSE returns the interceptor's result in call.hr and pvResult */
+			if (hrPre != S_FALSE) call.hr = hrPre;
+			bShortCircuit = TRUE;
+			break;
+		}
+	}
+
+	if (!bShortCircuit)
+	{
+		call.hr = dhTimedInvoke(pDisp, dispID, invokeType, pDispParams, pvResult, pExcepInfo, puArgErr);
+	}
+
+	while (cEntered)
+	{
+		DH_INTERCEPTOR * pInterceptor = &pArray->rgInterceptors[--cEntered];
+
+		if (pInterceptor->pfnPostInvoke) pInterceptor->pfnPostInvoke(&call, pInterceptor->pContext);
+	}
+
+	LeaveInterceptors(pcReaders);
+
+	return call.hr;
+}
+
+
+
+/* **************************************************************************
+ * dhInterceptInvoke:
+ *   Internal replacement for IDispatch::Invoke used by dhInvokeArrayEx and
+ * the other functions which invoke a resolved member. When no interceptor is
+ * installed this costs a single load and branch. Puts and method calls make
+ * the values cached for the object by the property cache stale.
+ *
+ ============================================================================ */
+HRESULT dhInterceptInvoke(IDispatch * pDisp, LPCOLESTR szMember, DISPID dispID, int invokeType,
+                          DISPPARAMS * pDispParams, VARIANT * pvResult, EXCEPINFO * pExcepInfo, UINT * puArgErr)
+{
+	HRESULT hr;
+
+	if (!f_pInterceptors)
+		hr = dhTimedInvoke(pDisp, dispID, invokeType, pDispParams, pvResult, pExcepInfo, puArgErr);
+	else
+		hr = InvokeIntercepted(pDisp, szMember, dispID, invokeType, pDispParams, pvResult, pExcepInfo, puArgErr);
+
+	if ((invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF)) || invokeType == DISPATCH_METHOD)
+	{
+		dhPropertyCacheInvalidate(pDisp);
+	}
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * PublishInterceptors:
+ *   Installs a new array of interceptors (NULL for none) and retires the old
+ * one. Retired arrays are freed now if no invoke is using any array, or else
+ * by the last invoke to leave. Must be called by the writer.
+ *
+ ============================================================================ */
+static void PublishInterceptors(DH_INTERCEPTOR_ARRAY * pArray)
+{
+	DH_INTERCEPTOR_ARRAY * pOld;
+
+	pOld = InterlockedExchangePointer((PVOID volatile *) &f_pInterceptors, pArray);
+
+	if (pOld)
+	{
+		pOld->pNextRetired     = f_pRetiredInterceptors;
+		f_pRetiredInterceptors = pOld;
+	}
+
+	FreeRetiredInterceptors();
+}
+
+
+
+/* **************************************************************************
+ * CopyInterceptors:
+ *   Allocates a copy of the installed interceptors with room for cExtra more.
+ *
+ ============================================================================ */
+static DH_INTERCEPTOR_ARRAY * CopyInterceptors(UINT cExtra)
+{
+	DH_INTERCEPTOR_ARRAY * pArray, * pCurrent = f_pInterceptors;
+	UINT cInterceptors = (pCurrent ? pCurrent->cInterceptors : 0);
+
+	pArray = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_INTERCEPTOR_ARRAY) +
+	                   (cInterceptors + cExtra) * sizeof(DH_INTERCEPTOR));
+
+	if (pArray && pCurrent)
+	{
+		CopyMemory(pArray->rgInterceptors, pCurrent->rgInterceptors, cInterceptors * sizeof(DH_INTERCEPTOR));
+		pArray->cInterceptors = cInterceptors;
+	}
+
+	return pArray;
+}
+
+
+
+/* **************************************************************************
+ * dhAddInterceptor:
+ *   This function installs an interceptor which is called around every
+ * invoke of a resolved member (dhInvokeArrayEx, and so dhInvoke, dhGetValue,
+ * dhPutValue...). Either callback may be NULL.
+ *
+ * Parameter Info:
+ *   pfnPreInvoke  - Called before the invoke. Return S_OK to continue,
+ * S_FALSE to skip the invoke and return pCall->hr (and *pCall->pvResult, set
+ * by the interceptor) or a failure code to fail the call with it. The
+ * interceptors added after this one are then skipped.
+ *   pfnPostInvoke - Called after the invoke, or the short circuit, with the
+ * result in pCall->hr and pCall->pvResult, which it may change.
+ *   pContext      - Passed to the callbacks.
+ *   pdwCookie     - Receives the cookie to pass to dhRemoveInterceptor.
+ *
+ * Notes:
+ *   Interceptors are called on the thread making the call and must be
+ * thread safe. Adding and removing interceptors is meant for start up and
+ * shut down and may spin while another thread changes them.
+ *
+ ============================================================================ */
+HRESULT dhAddInterceptor(DH_PRE_INVOKE pfnPreInvoke, DH_POST_INVOKE pfnPostInvoke, LPVOID pContext, DWORD * pdwCookie)
+{
+	DH_INTERCEPTOR_ARRAY * pArray;
+	DH_INTERCEPTOR * pInterceptor;
+
+	if ((!pfnPreInvoke && !pfnPostInvoke) || !pdwCookie) return E_INVALIDARG;
+
+	AcquireInterceptorWriter();
+
+	if (!(pArray = CopyInterceptors(1)))
+	{
+		ReleaseInterceptorWriter();
+		return E_OUTOFMEMORY;
+	}
+
+	pInterceptor = &pArray->rgInterceptors[pArray->cInterceptors++];
+
+	pInterceptor->pfnPreInvoke  = pfnPreInvoke;
+	pInterceptor->pfnPostInvoke = pfnPostInvoke;
+	pInterceptor->pContext      = pContext;
+	pInterceptor->dwCookie      = *pdwCookie = ++f_dwNextInterceptorCookie;
+
+	PublishInterceptors(pArray);
+
+	ReleaseInterceptorWriter();
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhRemoveInterceptor:
+ *   This function removes an interceptor installed by dhAddInterceptor.
+ * Invokes already in progress may still call it.
+ *
+ ============================================================================ */
+HRESULT dhRemoveInterceptor(DWORD dwCookie)
+{
+	DH_INTERCEPTOR_ARRAY * pArray;
+	UINT iSource, iDest = 0;
+
+	AcquireInterceptorWriter();
+
+	if (!(pArray = CopyInterceptors(0)))
+	{
+		ReleaseInterceptorWriter();
+		return (f_pInterceptors ? E_OUTOFMEMORY : E_INVALIDARG);
+	}
+
+	for (iSource = 0; iSource < pArray->cInterceptors; iSource++)
+	{
+		if (pArray->rgInterceptors[iSource].dwCookie != dwCookie)
+		{
+			pArray->rgInterceptors[iDest++] = pArray->rgInterceptors[iSource];
+		}
+	}
+
+	if (iDest == pArray->cInterceptors)
+	{
+		HeapFree(GetProcessHeap(), 0, pArray);
+		ReleaseInterceptorWriter();
+		return E_INVALIDARG;
+	}
+
+	pArray->cInterceptors = iDest;
+
+	if (iDest == 0)
+	{
+		/* Restore the fast path */
+		HeapFree(GetProcessHeap(), 0, pArray);
+		pArray = NULL;
+	}
+
+	PublishInterceptors(pArray);
+
+	ReleaseInterceptorWriter();
+
+	return NOERROR;
+}
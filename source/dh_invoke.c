@@ -21,10 +21,13 @@
 #include "convert.h"
 
 static HRESULT TraverseSubObjects(IDispatch ** ppDisp, LPWSTR * lpszMember, va_list * marker);
-static HRESULT CreateArgumentArray(LPWSTR szTemp, VARIANT * pArgs, BOOL * pbFreeList, UINT * pcArgs, va_list * marker);
+static HRESULT CreateArgumentArray(LPWSTR szTemp, VARIANT * pArgs, BOOL * pbFreeList, LPOLESTR * pszNames, UINT * pcArgs, UINT * pcNamed, va_list * marker);
 static HRESULT InternalInvokeV(int invokeType, VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPOLESTR szMember, va_list * marker);
 static HRESULT ExtractArgument(VARIANT * pvArg, const WCHAR * chIdentifierPtr, BOOL * pbFreeArg, va_list * marker);
 
+/* Called with each sub object and the object it was read from. Set by the remote host registry. */
+DH_SUB_OBJECT_HOOK dh_g_pfnSubObjectHook;
+
 
 /* **************************************************************************
  * dhInvokeV:
@@ -122,6 +125,8 @@ static HRESULT TraverseSubObjects(IDispatch ** ppDisp, LPWSTR * lpszMember, va_l
 
 		if (! V_DISPATCH(&vtObject) && SUCCEEDED(hr)) hr = E_NOINTERFACE;
 
+		if (SUCCEEDED(hr) && dh_g_pfnSubObjectHook) dh_g_pfnSubObjectHook(*ppDisp, V_DISPATCH(&vtObject));
+
 		/* Release old object in *ppDisp */
 		(*ppDisp)->lpVtbl->Release(*ppDisp);
 
@@ -150,7 +155,7 @@ static HRESULT TraverseSubObjects(IDispatch ** ppDisp, LPWSTR * lpszMember, va_l
 /* **************************************************************************
  * InternalInvokeV:
  *   This function is responsible for invoking a member with no parent objects.
- * Example input: 'Navigate(%S, %d)', 'Visible = %b', 'Cells(%d,%d)'
+ * Example input: 'Navigate(%S, %d)', 'Visible = %b', 'Cells(%d,%d)', 'Open(FileName:=%S)'
  *
  ============================================================================ */
 static HRESULT InternalInvokeV(int invokeType, VARTYPE returnType, VARIANT * pvResult,
@@ -161,18 +166,32 @@ static HRESULT InternalInvokeV(int invokeType, VARTYPE returnType, VARIANT * pvR
 
 	VARIANT vtArgs[DH_MAX_ARGS];           /* Argument array */
 	BOOL bFreeList[DH_MAX_ARGS];           /* List of which arguments need to be freed */
+	LPOLESTR szNames[DH_MAX_ARGS];         /* Names of named arguments, NULL for positional ones */
+	BOOL bPut = (invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF)) != 0;
 	HRESULT hr;
-	UINT cArgs, iArg;
+	UINT cArgs, cNamed, iArg, iNamed;
 
 	DH_ENTER(L"InternalInvokeV");
 
 	/* This function also terminates member name at start of arguments */
-	hr = CreateArgumentArray(szMember, vtArgs, bFreeList, &cArgs, marker);
+	hr = CreateArgumentArray(szMember, vtArgs, bFreeList, szNames, &cArgs, &cNamed, marker);
 
 	if (SUCCEEDED(hr))
 	{
+		/* Named arguments must follow the positional arguments, except for the
+		 * value of a property-put which is always last. As the arguments are
+		 * packed in reverse order the named arguments must start at iNamed. */
+		iNamed = DH_MAX_ARGS - cArgs + (bPut && cArgs != 0 ? 1 : 0);
+
+		for (iArg = DH_MAX_ARGS - cArgs;iArg < DH_MAX_ARGS;iArg++)
+		{
+			if ((szNames[iArg] != NULL) != (iArg >= iNamed && iArg < iNamed + cNamed)) hr = E_INVALIDARG;
+		}
+
 		/* Invoke member */
-		hr = dhInvokeArray(invokeType, pvResult, cArgs, pDisp, szMember, &vtArgs[DH_MAX_ARGS - cArgs]);
+		if (SUCCEEDED(hr))
+			hr = dhInvokeArrayEx(invokeType, pvResult, cArgs, pDisp, szMember, &vtArgs[DH_MAX_ARGS - cArgs],
+			                     cNamed, (LPCOLESTR *) &szNames[iNamed]);
 
 		/* Free the variants in the argument array as needed */
 		for (iArg = DH_MAX_ARGS - cArgs;iArg < DH_MAX_ARGS;iArg++)
@@ -203,10 +222,14 @@ static HRESULT InternalInvokeV(int invokeType, VARTYPE returnType, VARIANT * pvR
  *   eg. If szMember is "Navigate(%S, %d)" then pArgs will contain one BSTR
  * variant and one VT_I4 variant, *pcArgs will equal two and szMember will 
  * equal "Navigate" upon successful return.
+ *
+ *   An argument may be named with the VB style "Name:=%S" syntax. The name
+ * of each argument is returned in the corresponding entry of pszNames (NULL
+ * for positional arguments) and the number of named arguments in *pcNamed.
  * 
  ============================================================================ */
 static HRESULT CreateArgumentArray(LPWSTR szMember, VARIANT * pArgs, BOOL * pbFreeList,
-				   UINT * pcArgs, va_list * marker)
+				   LPOLESTR * pszNames, UINT * pcArgs, UINT * pcNamed, va_list * marker)
 {
 	/* NOTE: Assumes that the szMember string is modifiable. */
 	/* NOTE: Assumes arguments have been validated.          */
@@ -214,9 +237,13 @@ static HRESULT CreateArgumentArray(LPWSTR szMember, VARIANT * pArgs, BOOL * pbFr
 	HRESULT hr        = NOERROR;
 	INT iArg          = DH_MAX_ARGS;
 	BOOL bInArguments = FALSE;
+	LPWSTR szName     = NULL;
+	LPWSTR szNameEnd;
 
 	DH_ENTER(L"CreateArgumentArray");
 
+	*pcNamed = 0;
+
 	/* Note: As we have to pack the arguments in reverse order
 	 * iArg starts at DH_MAX_ARGS and we work backwards. */
 
@@ -230,6 +257,25 @@ static HRESULT CreateArgumentArray(LPWSTR szMember, VARIANT * pArgs, BOOL * pbFr
 			/* Terminate the member name string at start of arguments */
 			*szMember = L'\0';
 		}
+		else if (bInArguments && *szMember == L':' && szMember[1] == L'=')
+		{
+			/* ":=" follows the name of a named argument. Find the start
+			 * of the name by working backwards over any white space. */
+			if (szName) { hr = E_INVALIDARG; break; }
+
+			for (szNameEnd = szMember; szNameEnd[-1] == L' '; szNameEnd--);
+
+			for (szName = szNameEnd; (szName[-1] >= L'a' && szName[-1] <= L'z') ||
+			                         (szName[-1] >= L'A' && szName[-1] <= L'Z') ||
+			                         (szName[-1] >= L'0' && szName[-1] <= L'9') ||
+			                          szName[-1] == L'_'; szName--);
+
+			if (szName == szNameEnd) { hr = E_INVALIDARG; break; }
+
+			/* Terminate the name and move past the '=' */
+			*szNameEnd = L'\0';
+			szMember++;
+		}
 		else if  (*szMember == L'%') /* Prepends argument identifiers */
 		{ 
 			if (!bInArguments) /* % also signifies the start of arguments */
@@ -238,29 +284,38 @@ static HRESULT CreateArgumentArray(LPWSTR szMember, VARIANT * pArgs, BOOL * pbFr
 				*szMember = L'\0';
 			}
 
+			/* Check if we have ran out of argument slots */
+			if (iArg == 0) { hr = E_INVALIDARG; break; }
+
 			iArg--;
 
-			/* Check if we have ran out of argument slots */
-			if (iArg == -1) { hr = E_INVALIDARG; break; }
+			/* Record the name of the argument, if it has one */
+			pszNames[iArg] = szName;
+			if (szName) (*pcNamed)++;
+			szName = NULL;
 
 			szMember++; /* Move forward to actual identifier */
 
 			/* Extract argument based on identifier */
 			hr = ExtractArgument(&pArgs[iArg], szMember, &pbFreeList[iArg], marker);
 
-			if (FAILED(hr)) break;
+			/* The failed argument does not need to be freed */
+			if (FAILED(hr)) { iArg++; break; }
 		}
 
 		/* Move to next character in input string */
 		szMember++;
 	}
 
+	/* A name must be followed by an argument */
+	if (SUCCEEDED(hr) && szName) hr = E_INVALIDARG;
+
 	*pcArgs = DH_MAX_ARGS - iArg;  /* Return argument count */
 
 	if (FAILED(hr))
 	{
 		/* Free arguments that have already been allocated */
-		for (++iArg;iArg < DH_MAX_ARGS; iArg++)
+		for (;iArg < DH_MAX_ARGS; iArg++)
 		{
 			if (pbFreeList[iArg]) VariantClear(&pArgs[iArg]);
 		}
@@ -277,11 +332,12 @@ static HRESULT CreateArgumentArray(LPWSTR szMember, VARIANT * pArgs, BOOL * pbFr
  * identifier and pack it in a VARIANT.
  *
  ============================================================================ */
-static HRESULT ExtractArgument(VARIANT * pvArg, const WCHAR * chIdentifier, BOOL * pbFreeArg, va_list * marker)
+static HRESULT ExtractArgument(VARIANT * pvArg, const WCHAR * chIdentifierPtr, BOOL * pbFreeArg, va_list * marker)
 {
 	HRESULT hr = NOERROR;
 	WCHAR chIdentifier = *chIdentifierPtr;
 	BOOL isRef = FALSE;
+	BOOL isConst = FALSE;
 	INT  size = 0;
 
 	/* By default, the argument does not need to be freed */
@@ -303,6 +359,8 @@ static HRESULT ExtractArgument(VARIANT * pvArg, const WCHAR * chIdentifier, BOOL
 			size++;
 		else if (chIdentifier == L'L')
 			size=2;	// long-long is always 64bits
+		else if (chIdentifier == L'k')
+			isConst = TRUE;	/* constant string, see dhCacheLiteral */
 		else break;
 
 		chIdentifier = *(++chIdentifierPtr);
@@ -469,6 +527,13 @@ static HRESULT ExtractArgument(VARIANT * pvArg, const WCHAR * chIdentifier, BOOL
 			LPOLESTR szTemp = va_arg(*marker, LPOLESTR);
 
 			V_VT(pvArg)   = VT_BSTR;
+
+			if (isConst)
+			{
+				hr = dhCacheLiteral(szTemp, FALSE, &V_BSTR(pvArg), pbFreeArg);
+				break;
+			}
+
 			V_BSTR(pvArg) = SysAllocString(szTemp);
 
 			if (V_BSTR(pvArg) == NULL && szTemp != NULL) hr = E_OUTOFMEMORY;
@@ -479,6 +544,13 @@ static HRESULT ExtractArgument(VARIANT * pvArg, const WCHAR * chIdentifier, BOOL
 
 		case L's':   /* LPCSTR */
 			V_VT(pvArg) = VT_BSTR;
+
+			if (isConst)
+			{
+				hr = dhCacheLiteral(va_arg(*marker, LPSTR), TRUE, &V_BSTR(pvArg), pbFreeArg);
+				break;
+			}
+
 			hr = ConvertAnsiStrToBStr(va_arg(*marker, LPSTR), &V_BSTR(pvArg));
 			*pbFreeArg = TRUE;   /* We must free this argument */
 			break;
@@ -531,3 +603,114 @@ static HRESULT ExtractArgument(VARIANT * pvArg, const WCHAR * chIdentifier, BOOL
 
 	return hr;
 }
+
+
+
+/* **************************************************************************
+ * dhSkipArguments:
+ *   Consumes the arguments for the identifiers in szMember from the va_list
+ * without invoking anything. This is used to move past the arguments of a
+ * member that could not be invoked.
+ *
+ ============================================================================ */
+HRESULT dhSkipArguments(LPCOLESTR szMember, va_list * marker)
+{
+	VARIANT vtArg;
+	BOOL bFreeArg;
+	HRESULT hr = NOERROR;
+
+	while (*szMember && SUCCEEDED(hr))
+	{
+		if (*szMember++ == L'%')
+		{
+			hr = ExtractArgument(&vtArg, szMember, &bFreeArg, marker);
+			if (bFreeArg) VariantClear(&vtArg);
+		}
+	}
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhCaptureArguments:
+ *   Extracts the arguments for the identifiers in szMember into rgArgs so
+ * that the member can be invoked after the caller has returned. Arguments
+ * that are not owned by the VARIANT (BSTRs, VARIANTs, objects) are copied.
+ * szCaptured receives szMember with each identifier replaced by %v and must
+ * be at least as long as szMember.
+ *
+ ============================================================================ */
+HRESULT dhCaptureArguments(LPCOLESTR szMember, LPWSTR szCaptured, VARIANT * rgArgs, UINT cMaxArgs, UINT * pcArgs, va_list * marker)
+{
+	VARIANT vtArg;
+	BOOL bFreeArg;
+	HRESULT hr = NOERROR;
+
+	*pcArgs = 0;
+
+	while (*szMember && SUCCEEDED(hr))
+	{
+		if ((*szCaptured++ = *szMember++) != L'%') continue;
+
+		if (*pcArgs == cMaxArgs)
+		{
+			hr = E_INVALIDARG;
+			break;
+		}
+
+		hr = ExtractArgument(&vtArg, szMember, &bFreeArg, marker);
+		if (FAILED(hr)) break;
+
+		if (bFreeArg)
+		{
+			rgArgs[*pcArgs] = vtArg;
+		}
+		else
+		{
+			VariantInit(&rgArgs[*pcArgs]);
+			hr = VariantCopy(&rgArgs[*pcArgs], &vtArg);
+			if (FAILED(hr)) break;
+		}
+
+		(*pcArgs)++;
+
+		/* Skip the modifiers and the identifier */
+		if (*szMember == L'&') szMember++;
+		while (*szMember == L'h' || *szMember == L'l' || *szMember == L'L' || *szMember == L'k') szMember++;
+		if (*szMember) szMember++;
+
+		*szCaptured++ = L'v';
+	}
+
+	*szCaptured = L'\0';
+
+	if (FAILED(hr))
+	{
+		while (*pcArgs) VariantClear(&rgArgs[--(*pcArgs)]);
+	}
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhInvokeCaptured:
+ *   Internal function which invokes a member whose arguments have been
+ * captured by dhCaptureArguments. rgArgs must have DH_MAX_CAPTURED_ARGS
+ * elements, the unused ones set to VT_EMPTY.
+ *
+ ============================================================================ */
+HRESULT dhInvokeCaptured(int invokeType, VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szCaptured, VARIANT * rgArgs)
+{
+	VARIANT * a = rgArgs;
+
+	/* Every identifier was rewritten as %v, so unused arguments are ignored */
+	return dhInvoke(invokeType, returnType, pvResult, pDisp, szCaptured,
+	                &a[0],  &a[1],  &a[2],  &a[3],  &a[4],  &a[5],  &a[6],  &a[7],
+	                &a[8],  &a[9],  &a[10], &a[11], &a[12], &a[13], &a[14], &a[15],
+	                &a[16], &a[17], &a[18], &a[19], &a[20], &a[21], &a[22], &a[23],
+	                &a[24], &a[25], &a[26], &a[27], &a[28], &a[29], &a[30], &a[31]);
+}
@@ -0,0 +1,330 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* Number of items fetched from an enumerator at a time */
+#define DH_PARALLEL_BATCH 32
+
+/* Structure to store the state shared by the partitions of an enumeration */
+typedef struct tagDH_PARALLEL
+{
+	int nMethod;
+	DH_ENUM_CALLBACK pfnCallback;
+	LPVOID pContext;
+	LONG bCancel;
+	HRESULT hrFirstError;
+} DH_PARALLEL;
+
+/* Structure to store a partition: a range of the collection enumerated on
+ * its own thread, through its own marshalled enumerator or collection. */
+typedef struct tagDH_PARTITION
+{
+	DH_PARALLEL * pShared;
+	IStream * pStream;
+	ULONG iStart;
+	ULONG cItems;
+	HANDLE hThread;
+} DH_PARTITION;
+
+
+
+/* **************************************************************************
+ * RecordError:
+ *   Keeps the first error of an enumeration and cancels the other partitions.
+ *
+ ============================================================================ */
+static void RecordError(DH_PARALLEL * pShared, HRESULT hr)
+{
+	if (InterlockedExchange(&pShared->bCancel, TRUE) == FALSE) pShared->hrFirstError = hr;
+}
+
+
+
+/* **************************************************************************
+ * EnumeratePartition:
+ *   Enumerates a partition's range, calling the callback for each item.
+ *
+ ============================================================================ */
+static HRESULT EnumeratePartition(DH_PARTITION * pPartition, IEnumVARIANT * pEnum)
+{
+	DH_PARALLEL * pShared = pPartition->pShared;
+	VARIANT rgItems[DH_PARALLEL_BATCH];
+	ULONG iItem = pPartition->iStart, cFetched, i;
+	HRESULT hr = NOERROR, hrNext;
+
+	do
+	{
+		hrNext = pEnum->lpVtbl->Next(pEnum, DH_PARALLEL_BATCH, rgItems, &cFetched);
+		if (FAILED(hrNext)) return hrNext;
+
+		for (i = 0; i < cFetched; i++, iItem++)
+		{
+			if (SUCCEEDED(hr) && !pShared->bCancel)
+			{
+				if (V_VT(&rgItems[i]) != VT_DISPATCH) hr = VariantChangeType(&rgItems[i], &rgItems[i], 0, VT_DISPATCH);
+
+				if (SUCCEEDED(hr)) hr = pShared->pfnCallback(V_DISPATCH(&rgItems[i]), iItem, pShared->pContext);
+			}
+
+			VariantClear(&rgItems[i]);
+		}
+	}
+	while (hrNext == S_OK && SUCCEEDED(hr) && !pShared->bCancel);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * PartitionThread:
+ *   Partitions run in the multithreaded apartment, so a free threaded
+ * collection is called directly from every partition.
+ *
+ ============================================================================ */
+static DWORD WINAPI PartitionThread(LPVOID lpParameter)
+{
+	DH_PARTITION * pPartition = lpParameter;
+	DH_PARALLEL * pShared = pPartition->pShared;
+	IEnumVARIANT * pSource = NULL, * pEnum = NULL;
+	IDispatch * pColl = NULL;
+	HRESULT hrInit, hr;
+
+	hr = hrInit = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	if (SUCCEEDED(hr))
+	{
+		dhInitializeImp(FALSE, dh_g_bIsUnicodeMode);
+
+		if (pShared->nMethod == DH_SLICE_NEWENUM)
+		{
+			/* The stream holds this partition's own clone, which can be used as is */
+			hr = CoGetInterfaceAndReleaseStream(pPartition->pStream, &IID_IEnumVARIANT, (void **) &pSource);
+			if (SUCCEEDED(hr)) hr = dhEnumSliceWrap(&pEnum, pSource, pPartition->iStart, pPartition->cItems);
+		}
+		else
+		{
+			hr = CoGetInterfaceAndReleaseStream(pPartition->pStream, &IID_IDispatch, (void **) &pColl);
+			if (SUCCEEDED(hr)) hr = dhEnumSlice(&pEnum, pColl, pPartition->iStart, pPartition->cItems, pShared->nMethod);
+		}
+
+		pPartition->pStream = NULL;
+	}
+
+	if (SUCCEEDED(hr)) hr = EnumeratePartition(pPartition, pEnum);
+
+	if (FAILED(hr)) RecordError(pShared, hr);
+
+	if (pEnum) pEnum->lpVtbl->Release(pEnum);
+	if (pSource) pSource->lpVtbl->Release(pSource);
+	if (pColl) pColl->lpVtbl->Release(pColl);
+
+	if (SUCCEEDED(hrInit)) dhUninitialize(TRUE);
+
+	return 0;
+}
+
+
+
+/* **************************************************************************
+ * CountItems:
+ *   Gets the number of items in a collection from its Count property or,
+ * failing that, by walking a clone of its enumerator.
+ *
+ ============================================================================ */
+static HRESULT CountItems(IDispatch * pColl, IEnumVARIANT * pEnum, ULONG * pcItems)
+{
+	VARIANT rgItems[DH_PARALLEL_BATCH];
+	IEnumVARIANT * pClone = NULL;
+	ULONG cFetched, i;
+	HRESULT hr;
+
+	*pcItems = 0;
+
+	if (SUCCEEDED(dhGetValue(L"%u", pcItems, pColl, L".Count")) || !pEnum) return NOERROR;
+
+	hr = pEnum->lpVtbl->Clone(pEnum, &pClone);
+	if (FAILED(hr)) return hr;
+
+	do
+	{
+		hr = pClone->lpVtbl->Next(pClone, DH_PARALLEL_BATCH, rgItems, &cFetched);
+
+		for (i = 0; SUCCEEDED(hr) && i < cFetched; i++) VariantClear(&rgItems[i]);
+
+		if (SUCCEEDED(hr)) *pcItems += cFetched;
+	}
+	while (hr == S_OK);
+
+	pClone->lpVtbl->Release(pClone);
+
+	return (FAILED(hr) ? hr : NOERROR);
+}
+
+
+
+/* **************************************************************************
+ * dhEnumParallel:
+ *   This function splits a collection into ranges and enumerates each range
+ * on its own thread, calling pfnCallback for every item.
+ *
+ * Parameter Info:
+ *   pColl       - The collection.
+ *   nMethod     - How each range is reached, as for dhEnumSlice. With
+ * DH_SLICE_NEWENUM each thread gets its own marshalled clone of the
+ * collection's enumerator.
+ *   cPartitions - The number of ranges and threads, or zero for one per
+ * processor.
+ *   pfnCallback - Called for each item, with its zero based position, on the
+ * range's thread. It must be thread safe. Returning a failure code stops
+ * the enumeration.
+ *   pContext    - Passed to pfnCallback.
+ *
+ * Notes:
+ *   The threads are in the multithreaded apartment. A free threaded
+ * collection, such as a WMI result set obtained in the MTA, is then
+ * enumerated on all the threads at once; calls to a collection living in a
+ * single threaded apartment are serialized back to that apartment.
+ *   Returns the first error of any range, once every range has stopped.
+ *
+ ============================================================================ */
+HRESULT dhEnumParallel(IDispatch * pColl, int nMethod, UINT cPartitions, DH_ENUM_CALLBACK pfnCallback, LPVOID pContext)
+{
+	DH_PARALLEL shared;
+	DH_PARTITION * rgPartitions;
+	IEnumVARIANT * pEnum = NULL, * pClone;
+	SYSTEM_INFO si;
+	ULONG cItems = 0, cPerPartition, iStart = 0;
+	UINT iPartition, cStarted = 0;
+	DWORD dwIndex;
+	HRESULT hr;
+
+	DH_ENTER(L"EnumParallel");
+
+	if (!pColl || !pfnCallback) return DH_EXIT(E_INVALIDARG, L"EnumParallel");
+
+	if (nMethod != DH_SLICE_NEWENUM && nMethod != DH_SLICE_ITEM0 && nMethod != DH_SLICE_ITEM1)
+	{
+		return DH_EXIT(E_INVALIDARG, L"EnumParallel");
+	}
+
+	if (cPartitions == 0)
+	{
+		GetSystemInfo(&si);
+		cPartitions = (si.dwNumberOfProcessors ? si.dwNumberOfProcessors : 1);
+	}
+
+	if (nMethod == DH_SLICE_NEWENUM)
+	{
+		hr = dhEnumBegin(&pEnum, pColl, NULL);
+		if (FAILED(hr)) return DH_EXIT(hr, L"EnumParallel");
+	}
+
+	hr = CountItems(pColl, pEnum, &cItems);
+
+	if (FAILED(hr) || cItems == 0)
+	{
+		if (pEnum) pEnum->lpVtbl->Release(pEnum);
+		return DH_EXIT(hr, L"EnumParallel");
+	}
+
+	if (cPartitions > cItems) cPartitions = (UINT) cItems;
+
+	cPerPartition = (cItems + cPartitions - 1) / cPartitions;
+
+	rgPartitions = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, cPartitions * sizeof(DH_PARTITION));
+
+	if (!rgPartitions)
+	{
+		if (pEnum) pEnum->lpVtbl->Release(pEnum);
+		return DH_EXIT(E_OUTOFMEMORY, L"EnumParallel");
+	}
+
+	shared.nMethod      = nMethod;
+	shared.pfnCallback  = pfnCallback;
+	shared.pContext     = pContext;
+	shared.bCancel      = FALSE;
+	shared.hrFirstError = NOERROR;
+
+	for (iPartition = 0; SUCCEEDED(hr) && iPartition < cPartitions; iPartition++)
+	{
+		DH_PARTITION * pPartition = &rgPartitions[iPartition];
+
+		pPartition->pShared = &shared;
+		pPartition->iStart  = iStart;
+		pPartition->cItems  = (cItems - iStart < cPerPartition ? cItems - iStart : cPerPartition);
+		iStart += pPartition->cItems;
+
+		if (pEnum)
+		{
+			pClone = NULL;
+			hr = pEnum->lpVtbl->Clone(pEnum, &pClone);
+
+			if (SUCCEEDED(hr))
+			{
+				hr = CoMarshalInterThreadInterfaceInStream(&IID_IEnumVARIANT, (IUnknown *) pClone, &pPartition->pStream);
+				pClone->lpVtbl->Release(pClone);
+			}
+		}
+		else
+		{
+			hr = CoMarshalInterThreadInterfaceInStream(&IID_IDispatch, (IUnknown *) pColl, &pPartition->pStream);
+		}
+
+		if (SUCCEEDED(hr) && !(pPartition->hThread = CreateThread(NULL, 0, PartitionThread, pPartition, 0, NULL)))
+		{
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		}
+
+		if (FAILED(hr))
+		{
+			/* Stop the partitions already started. The marshalled pointer was
+			 * never unmarshalled, so its reference must be released too. */
+			if (pPartition->pStream)
+			{
+				CoReleaseMarshalData(pPartition->pStream);
+				pPartition->pStream->lpVtbl->Release(pPartition->pStream);
+			}
+			RecordError(&shared, hr);
+		}
+		else
+		{
+			cStarted++;
+		}
+	}
+
+	/* Keep dispatching messages, as partitions may call back into this apartment */
+	for (iPartition = 0; iPartition < cStarted; iPartition++)
+	{
+		CoWaitForMultipleHandles(0, INFINITE, 1, &rgPartitions[iPartition].hThread, &dwIndex);
+		CloseHandle(rgPartitions[iPartition].hThread);
+	}
+
+	HeapFree(GetProcessHeap(), 0, rgPartitions);
+
+	if (pEnum) pEnum->lpVtbl->Release(pEnum);
+
+	return DH_EXIT(shared.hrFirstError, L"EnumParallel");
+}
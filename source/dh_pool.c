@@ -0,0 +1,569 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* Upper bounds, in microseconds, of the checkout latency histogram buckets */
+static const ULONG f_rgHistogramBounds[DH_POOL_HISTOGRAM_BUCKETS - 1] = { 1000, 10000, 100000, 1000000 };
+
+/* Structure to store a pooled object. The object itself is held by the
+ * global interface table so that it can be checked out from any apartment. */
+typedef struct tagDH_POOL_ITEM
+{
+	struct tagDH_POOL_ITEM * pNext;
+	DWORD dwCookie;
+	IDispatch * pCheckedOut;
+	DWORD dwLastUsed;
+} DH_POOL_ITEM;
+
+/* Structure to store an object pool */
+struct tagDH_OBJECT_POOL
+{
+	CRITICAL_SECTION cs;
+	DH_POOL_OPTIONS options;
+	IGlobalInterfaceTable * pGIT;
+	HANDLE hReturned;
+
+	DH_POOL_ITEM * pIdle;
+	DH_POOL_ITEM * pInUse;
+	UINT cTotal;
+
+	DH_POOL_STATISTICS stats;
+};
+
+
+
+/* **************************************************************************
+ * CopyString:
+ *   Copies a string to the process heap.
+ *
+ ============================================================================ */
+static LPWSTR CopyString(LPCWSTR szSource)
+{
+	SIZE_T cb;
+	LPWSTR szCopy;
+
+	if (!szSource) return NULL;
+
+	cb = (wcslen(szSource) + 1) * sizeof(WCHAR);
+	if ((szCopy = HeapAlloc(GetProcessHeap(), 0, cb))) CopyMemory(szCopy, szSource, cb);
+
+	return szCopy;
+}
+
+
+
+/* **************************************************************************
+ * DefaultHealthCheck:
+ *   Checks that the server still answers with a cheap call.
+ *
+ ============================================================================ */
+static HRESULT DefaultHealthCheck(IDispatch * pDisp, LPVOID pContext)
+{
+	UINT cTypeInfo;
+
+	return pDisp->lpVtbl->GetTypeInfoCount(pDisp, &cTypeInfo);
+}
+
+
+
+/* **************************************************************************
+ * DiscardItem:
+ *   Removes an object from the global interface table, which releases it,
+ * and frees its item. The pool must not be locked.
+ *
+ ============================================================================ */
+static void DiscardItem(PDH_OBJECT_POOL pPool, DH_POOL_ITEM * pItem)
+{
+	pPool->pGIT->lpVtbl->RevokeInterfaceFromGlobal(pPool->pGIT, pItem->dwCookie);
+	HeapFree(GetProcessHeap(), 0, pItem);
+}
+
+
+
+/* **************************************************************************
+ * TakeExpiredItems:
+ *   Unlinks idle objects that have not been used for dwIdleTimeout, while
+ * keeping at least cMin objects. The pool must be locked.
+ *
+ ============================================================================ */
+static DH_POOL_ITEM * TakeExpiredItems(PDH_OBJECT_POOL pPool)
+{
+	DH_POOL_ITEM ** ppItem = &pPool->pIdle;
+	DH_POOL_ITEM * pExpired = NULL, * pItem;
+	DWORD dwNow = GetTickCount();
+
+	if (pPool->options.dwIdleTimeout == 0) return NULL;
+
+	/* Idle objects are kept most recently used first */
+	while (*ppItem && pPool->cTotal > pPool->options.cMin)
+	{
+		pItem = *ppItem;
+
+		if (dwNow - pItem->dwLastUsed >= pPool->options.dwIdleTimeout)
+		{
+			*ppItem = pItem->pNext;
+			pItem->pNext = pExpired;
+			pExpired = pItem;
+			pPool->cTotal--;
+			pPool->stats.cEvicted++;
+		}
+		else
+		{
+			ppItem = &pItem->pNext;
+		}
+	}
+
+	return pExpired;
+}
+
+
+
+/* **************************************************************************
+ * DiscardItems:
+ *   Discards a list of items returned by TakeExpiredItems.
+ *
+ ============================================================================ */
+static void DiscardItems(PDH_OBJECT_POOL pPool, DH_POOL_ITEM * pItem)
+{
+	DH_POOL_ITEM * pNext;
+
+	for (; pItem; pItem = pNext)
+	{
+		pNext = pItem->pNext;
+		DiscardItem(pPool, pItem);
+	}
+}
+
+
+
+/* **************************************************************************
+ * CreateItem:
+ *   Creates a new object on the calling thread and registers it in the
+ * global interface table. The caller must already have counted it in cTotal.
+ *
+ ============================================================================ */
+static HRESULT CreateItem(PDH_OBJECT_POOL pPool, DH_POOL_ITEM ** ppItem, IDispatch ** ppDisp)
+{
+	DH_POOL_ITEM * pItem;
+	IDispatch * pDisp = NULL;
+	HRESULT hr;
+
+	if (!(pItem = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_POOL_ITEM)))) return E_OUTOFMEMORY;
+
+	hr = dhCreateObject(pPool->options.szProgId, pPool->options.szMachine, &pDisp);
+
+	if (SUCCEEDED(hr))
+	{
+		hr = pPool->pGIT->lpVtbl->RegisterInterfaceInGlobal(pPool->pGIT, (IUnknown *) pDisp, &IID_IDispatch, &pItem->dwCookie);
+	}
+
+	if (FAILED(hr))
+	{
+		if (pDisp) pDisp->lpVtbl->Release(pDisp);
+		HeapFree(GetProcessHeap(), 0, pItem);
+		return hr;
+	}
+
+	pItem->dwLastUsed = GetTickCount();
+
+	EnterCriticalSection(&pPool->cs);
+	pPool->stats.cCreated++;
+	LeaveCriticalSection(&pPool->cs);
+
+	*ppItem = pItem;
+
+	if (ppDisp)
+		*ppDisp = pDisp;
+	else
+		pDisp->lpVtbl->Release(pDisp);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhCreateObjectPool:
+ *   This function creates a pool of objects of a single ProgID and starts
+ * cMin of them straight away.
+ *
+ * Parameter Info:
+ *   pOptions - The ProgID, optional machine, minimum and maximum number of
+ * objects, idle timeout in milliseconds (0 keeps idle objects forever) and
+ * the optional health check and reset callbacks.
+ *   ppPool   - Receives the pool, which must be freed with dhDestroyObjectPool.
+ *
+ ============================================================================ */
+HRESULT dhCreateObjectPool(PDH_POOL_OPTIONS pOptions, PDH_OBJECT_POOL * ppPool)
+{
+	PDH_OBJECT_POOL pPool;
+	DH_POOL_ITEM * pItem;
+	HRESULT hr;
+
+	DH_ENTER(L"CreateObjectPool");
+
+	if (!pOptions || !pOptions->szProgId || !ppPool || pOptions->cMax == 0 || pOptions->cMin > pOptions->cMax)
+	{
+		return DH_EXIT(E_INVALIDARG, pOptions ? pOptions->szProgId : NULL);
+	}
+
+	*ppPool = NULL;
+
+	if (!(pPool = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(struct tagDH_OBJECT_POOL))))
+	{
+		return DH_EXIT(E_OUTOFMEMORY, pOptions->szProgId);
+	}
+
+	InitializeCriticalSection(&pPool->cs);
+
+	pPool->options = *pOptions;
+	pPool->options.szProgId  = CopyString(pOptions->szProgId);
+	pPool->options.szMachine = CopyString(pOptions->szMachine);
+	if (!pPool->options.pfnHealthCheck) pPool->options.pfnHealthCheck = DefaultHealthCheck;
+
+	if (!pPool->options.szProgId || (pOptions->szMachine && !pPool->options.szMachine))
+		hr = E_OUTOFMEMORY;
+	else if (!(pPool->hReturned = CreateEvent(NULL, FALSE, FALSE, NULL)))
+		hr = HRESULT_FROM_WIN32(GetLastError());
+	else
+		hr = CoCreateInstance(&CLSID_StdGlobalInterfaceTable, NULL, CLSCTX_INPROC_SERVER,
+		                      &IID_IGlobalInterfaceTable, (void **) &pPool->pGIT);
+
+	/* Prestart the minimum number of objects */
+	while (SUCCEEDED(hr) && pPool->cTotal < pPool->options.cMin)
+	{
+		hr = CreateItem(pPool, &pItem, NULL);
+
+		if (SUCCEEDED(hr))
+		{
+			pItem->pNext = pPool->pIdle;
+			pPool->pIdle = pItem;
+			pPool->cTotal++;
+		}
+	}
+
+	if (FAILED(hr))
+	{
+		dhDestroyObjectPool(pPool);
+		return DH_EXIT(hr, pOptions->szProgId);
+	}
+
+	*ppPool = pPool;
+
+	return DH_EXIT(NOERROR, pOptions->szProgId);
+}
+
+
+
+/* **************************************************************************
+ * dhDestroyObjectPool:
+ *   This function releases the pool's objects and frees the pool. Objects
+ * still checked out stay alive until their callers release them.
+ *
+ ============================================================================ */
+void dhDestroyObjectPool(PDH_OBJECT_POOL pPool)
+{
+	DH_POOL_ITEM * pItem, * pNext;
+
+	if (!pPool) return;
+
+	if (pPool->pGIT)
+	{
+		DiscardItems(pPool, pPool->pIdle);
+
+		for (pItem = pPool->pInUse; pItem; pItem = pNext)
+		{
+			pNext = pItem->pNext;
+			DiscardItem(pPool, pItem);
+		}
+
+		pPool->pGIT->lpVtbl->Release(pPool->pGIT);
+	}
+
+	if (pPool->hReturned) CloseHandle(pPool->hReturned);
+
+	if (pPool->options.szProgId)  HeapFree(GetProcessHeap(), 0, (LPVOID) pPool->options.szProgId);
+	if (pPool->options.szMachine) HeapFree(GetProcessHeap(), 0, (LPVOID) pPool->options.szMachine);
+
+	DeleteCriticalSection(&pPool->cs);
+	HeapFree(GetProcessHeap(), 0, pPool);
+}
+
+
+
+/* **************************************************************************
+ * RecordCheckout:
+ *   Adds a checkout's latency to the pool statistics. The pool must be locked.
+ *
+ ============================================================================ */
+static void RecordCheckout(PDH_OBJECT_POOL pPool, LARGE_INTEGER * pliStart)
+{
+	LARGE_INTEGER liNow, liFrequency;
+	ULONG ulMicroseconds = 0, iBucket;
+
+	if (QueryPerformanceFrequency(&liFrequency) && liFrequency.QuadPart)
+	{
+		QueryPerformanceCounter(&liNow);
+		ulMicroseconds = (ULONG) ((liNow.QuadPart - pliStart->QuadPart) * 1000000 / liFrequency.QuadPart);
+	}
+
+	for (iBucket = 0; iBucket < DH_POOL_HISTOGRAM_BUCKETS - 1 && ulMicroseconds >= f_rgHistogramBounds[iBucket]; iBucket++);
+
+	pPool->stats.cCheckouts++;
+	pPool->stats.ullCheckoutTotalUs += ulMicroseconds;
+	if (ulMicroseconds > pPool->stats.ulCheckoutMaxUs) pPool->stats.ulCheckoutMaxUs = ulMicroseconds;
+	pPool->stats.rgCheckoutHistogram[iBucket]++;
+}
+
+
+
+/* **************************************************************************
+ * dhPoolCheckout:
+ *   This function takes an object from the pool for the calling thread.
+ * An idle object is health checked before it is handed out; if none is idle,
+ * a new one is created as long as the pool is below its maximum size.
+ * Otherwise the function waits up to dwTimeout milliseconds for an object
+ * to be returned.
+ *
+ * Parameter Info:
+ *   pPool     - The pool.
+ *   dwTimeout - How long to wait for an object, or INFINITE.
+ *   ppDisp    - Receives the object, which must be given back to the pool with
+ * dhPoolReturn rather than released.
+ *
+ ============================================================================ */
+HRESULT dhPoolCheckout(PDH_OBJECT_POOL pPool, DWORD dwTimeout, IDispatch ** ppDisp)
+{
+	DH_POOL_ITEM * pItem, * pExpired;
+	IDispatch * pDisp;
+	LARGE_INTEGER liStart;
+	DWORD dwStart = GetTickCount(), dwElapsed, dwIndex;
+	BOOL bCreate;
+	HRESULT hr;
+
+	DH_ENTER(L"PoolCheckout");
+
+	if (!pPool || !ppDisp) return DH_EXIT(E_INVALIDARG, NULL);
+
+	*ppDisp = NULL;
+
+	QueryPerformanceCounter(&liStart);
+
+	for (;;)
+	{
+		pDisp   = NULL;
+		bCreate = FALSE;
+
+		EnterCriticalSection(&pPool->cs);
+
+		pExpired = TakeExpiredItems(pPool);
+
+		if ((pItem = pPool->pIdle) != NULL)
+		{
+			pPool->pIdle = pItem->pNext;
+		}
+		else if (pPool->cTotal < pPool->options.cMax)
+		{
+			/* Reserve the slot before creating the object outside the lock */
+			pPool->cTotal++;
+			bCreate = TRUE;
+		}
+
+		LeaveCriticalSection(&pPool->cs);
+
+		DiscardItems(pPool, pExpired);
+
+		if (bCreate)
+		{
+			hr = CreateItem(pPool, &pItem, &pDisp);
+
+			if (FAILED(hr))
+			{
+				EnterCriticalSection(&pPool->cs);
+				pPool->cTotal--;
+				LeaveCriticalSection(&pPool->cs);
+				SetEvent(pPool->hReturned);
+				return DH_EXIT(hr, pPool->options.szProgId);
+			}
+		}
+		else if (pItem)
+		{
+			hr = pPool->pGIT->lpVtbl->GetInterfaceFromGlobal(pPool->pGIT, pItem->dwCookie, &IID_IDispatch, (void **) &pDisp);
+
+			if (SUCCEEDED(hr)) hr = pPool->options.pfnHealthCheck(pDisp, pPool->options.pContext);
+
+			if (FAILED(hr))
+			{
+				/* The server has died or hung up, replace it */
+				if (pDisp) pDisp->lpVtbl->Release(pDisp);
+				DiscardItem(pPool, pItem);
+
+				EnterCriticalSection(&pPool->cs);
+				pPool->cTotal--;
+				pPool->stats.cDiscarded++;
+				LeaveCriticalSection(&pPool->cs);
+				continue;
+			}
+		}
+		else
+		{
+			/* The pool is at its maximum size, wait for an object to be returned */
+			dwElapsed = GetTickCount() - dwStart;
+
+			if (dwTimeout != INFINITE && dwElapsed >= dwTimeout)
+			{
+				return DH_EXIT(HRESULT_FROM_WIN32(WAIT_TIMEOUT), pPool->options.szProgId);
+			}
+
+			EnterCriticalSection(&pPool->cs);
+			pPool->stats.cWaits++;
+			LeaveCriticalSection(&pPool->cs);
+
+			CoWaitForMultipleHandles(0, (dwTimeout == INFINITE ? INFINITE : dwTimeout - dwElapsed), 1, &pPool->hReturned, &dwIndex);
+			continue;
+		}
+
+		pItem->pCheckedOut = pDisp;
+
+		EnterCriticalSection(&pPool->cs);
+		pItem->pNext = pPool->pInUse;
+		pPool->pInUse = pItem;
+		RecordCheckout(pPool, &liStart);
+		LeaveCriticalSection(&pPool->cs);
+
+		*ppDisp = pDisp;
+
+		return DH_EXIT(NOERROR, pPool->options.szProgId);
+	}
+}
+
+
+
+/* **************************************************************************
+ * dhPoolReturn:
+ *   This function gives an object back to the pool. The reset callback is
+ * called first; if it fails, or bDiscard is TRUE, the object is discarded
+ * instead of being kept for the next checkout.
+ *
+ ============================================================================ */
+HRESULT dhPoolReturn(PDH_OBJECT_POOL pPool, IDispatch * pDisp, BOOL bDiscard)
+{
+	DH_POOL_ITEM ** ppItem, * pItem = NULL;
+	HRESULT hr = NOERROR;
+
+	if (!pPool || !pDisp) return E_INVALIDARG;
+
+	EnterCriticalSection(&pPool->cs);
+
+	for (ppItem = &pPool->pInUse; *ppItem; ppItem = &(*ppItem)->pNext)
+	{
+		if ((*ppItem)->pCheckedOut == pDisp)
+		{
+			pItem = *ppItem;
+			*ppItem = pItem->pNext;
+			break;
+		}
+	}
+
+	LeaveCriticalSection(&pPool->cs);
+
+	if (!pItem) return E_INVALIDARG;
+
+	if (!bDiscard && pPool->options.pfnReset) hr = pPool->options.pfnReset(pDisp, pPool->options.pContext);
+
+	pDisp->lpVtbl->Release(pDisp);
+	pItem->pCheckedOut = NULL;
+	pItem->dwLastUsed  = GetTickCount();
+
+	EnterCriticalSection(&pPool->cs);
+
+	if (bDiscard || FAILED(hr))
+	{
+		pPool->cTotal--;
+		pPool->stats.cDiscarded++;
+	}
+	else
+	{
+		pItem->pNext = pPool->pIdle;
+		pPool->pIdle = pItem;
+		pItem = NULL;
+	}
+
+	LeaveCriticalSection(&pPool->cs);
+
+	if (pItem) DiscardItem(pPool, pItem);
+
+	SetEvent(pPool->hReturned);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhPoolTrim:
+ *   This function evicts the objects that have been idle for longer than the
+ * idle timeout. This also happens on each checkout, so it only needs to be
+ * called to free idle objects while the pool is not in use.
+ *
+ ============================================================================ */
+void dhPoolTrim(PDH_OBJECT_POOL pPool)
+{
+	DH_POOL_ITEM * pExpired;
+
+	if (!pPool) return;
+
+	EnterCriticalSection(&pPool->cs);
+	pExpired = TakeExpiredItems(pPool);
+	LeaveCriticalSection(&pPool->cs);
+
+	DiscardItems(pPool, pExpired);
+}
+
+
+
+/* **************************************************************************
+ * dhPoolGetStatistics:
+ *   This function gets a snapshot of the pool's counters.
+ *
+ ============================================================================ */
+HRESULT dhPoolGetStatistics(PDH_OBJECT_POOL pPool, PDH_POOL_STATISTICS pStatistics)
+{
+	DH_POOL_ITEM * pItem;
+
+	if (!pPool || !pStatistics) return E_INVALIDARG;
+
+	EnterCriticalSection(&pPool->cs);
+
+	*pStatistics = pPool->stats;
+	pStatistics->cIdle = pStatistics->cInUse = 0;
+
+	for (pItem = pPool->pIdle;  pItem; pItem = pItem->pNext) pStatistics->cIdle++;
+	for (pItem = pPool->pInUse; pItem; pItem = pItem->pNext) pStatistics->cInUse++;
+
+	LeaveCriticalSection(&pPool->cs);
+
+	return NOERROR;
+}
@@ -0,0 +1,311 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* Most types of the library in which dhPrewarm finds a name */
+#define DH_PREWARM_MAX_TYPES 32
+
+
+
+/* **************************************************************************
+ * GetLocalTypeInfo:
+ *   Gets the type library and type info of an object's type. The library is
+ * loaded from the registry when possible, so that reading it costs no round
+ * trips to the server, and otherwise read through the object's type info.
+ *
+ ============================================================================ */
+static HRESULT GetLocalTypeInfo(const DH_TYPE_KEY * pKey, ITypeInfo * pTypeInfo, ITypeLib ** ppTypeLib, ITypeInfo ** ppLocalInfo)
+{
+	UINT iIndex;
+	HRESULT hr;
+
+	*ppLocalInfo = NULL;
+
+	hr = LoadRegTypeLib(&pKey->guidLib, pKey->wLibMajorVerNum, pKey->wLibMinorVerNum, pKey->lcid, ppTypeLib);
+
+	if (FAILED(hr)) hr = pTypeInfo->lpVtbl->GetContainingTypeLib(pTypeInfo, ppTypeLib, &iIndex);
+
+	if (FAILED(hr))
+	{
+		*ppTypeLib = NULL;
+		return hr;
+	}
+
+	hr = (*ppTypeLib)->lpVtbl->GetTypeInfoOfGuid(*ppTypeLib, &pKey->guidType, ppLocalInfo);
+
+	if (FAILED(hr))
+	{
+		(*ppTypeLib)->lpVtbl->Release(*ppTypeLib);
+		*ppTypeLib = NULL;
+	}
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * GetDispatchTypeKey:
+ *   Gets the key of a type of the library described by pLibKey, and its
+ * number of functions and variables. Returns FALSE for types which are not
+ * dispinterfaces or dual interfaces, whose names are not resolved through
+ * IDispatch.
+ *
+ ============================================================================ */
+static BOOL GetDispatchTypeKey(ITypeInfo * pTypeInfo, const DH_TYPE_KEY * pLibKey, DH_TYPE_KEY * pKey, UINT * pcFuncs, UINT * pcVars)
+{
+	TYPEATTR * pTypeAttr;
+	BOOL bDispatch;
+
+	if (FAILED(pTypeInfo->lpVtbl->GetTypeAttr(pTypeInfo, &pTypeAttr))) return FALSE;
+
+	bDispatch = (pTypeAttr->typekind == TKIND_DISPATCH ||
+	             (pTypeAttr->typekind == TKIND_INTERFACE && (pTypeAttr->wTypeFlags & TYPEFLAG_FDUAL)));
+
+	*pKey = *pLibKey;
+	pKey->guidType     = pTypeAttr->guid;
+	pKey->wMajorVerNum = pTypeAttr->wMajorVerNum;
+	pKey->wMinorVerNum = pTypeAttr->wMinorVerNum;
+
+	if (pcFuncs) *pcFuncs = pTypeAttr->cFuncs;
+	if (pcVars)  *pcVars  = pTypeAttr->cVars;
+
+	pTypeInfo->lpVtbl->ReleaseTypeAttr(pTypeInfo, pTypeAttr);
+
+	return bDispatch;
+}
+
+
+
+/* **************************************************************************
+ * PrewarmMember:
+ *   Adds the name of a member of a type to the DISPID file and, if pDisp
+ * is given, to the calling thread's cache for pDisp.
+ *
+ ============================================================================ */
+static void PrewarmMember(IDispatch * pDisp, const DH_TYPE_KEY * pKey, ITypeInfo * pTypeInfo, LPOLESTR szName, DISPID dispID)
+{
+	if (pDisp) dhCacheAddNames(pDisp, pKey, pTypeInfo, &szName, 1, &dispID);
+
+	dhSnapshotAppend(pKey, dhHashName(0, szName), &szName, 1, &dispID);
+}
+
+
+
+/* **************************************************************************
+ * dhPrewarm:
+ *   This function resolves a list of member names ahead of their first
+ * use. Names of the object's type are added to the calling thread's DISPID
+ * cache for the object, and to the DISPID file if one is used.
+ *
+ * Parameter Info:
+ *   pDisp   - An object of the server.
+ *   szNames - The names, separated by semicolons.
+ *
+ * Notes:
+ *   The names are resolved from the server's type library, loaded from the
+ * registry, rather than by the object: once its type is known, this costs
+ * no round trips to the server. A name which is not a member of the object's
+ * type is looked up on the other types of the library and added to the
+ * DISPID file for them, so that objects of those types, such as the Range
+ * objects of an Excel worksheet, find it there.
+ *   Objects without type info resolve each name with GetIDsOfNames.
+ *   Returns S_FALSE if some names could not be resolved.
+ *
+ * Example(s):
+ *   dhSetDispIdCacheSize(32);
+ *   dhPrewarm(xlApp, L"Workbooks;ActiveSheet;Range;Cells;Value;Interior;Font");
+ *
+ ============================================================================ */
+HRESULT dhPrewarm(IDispatch * pDisp, LPCOLESTR szNames)
+{
+	DH_TYPE_KEY key, typeKey;
+	ITypeInfo * pTypeInfo = NULL, * pLocalInfo = NULL;
+	ITypeInfo * rgpFound[DH_PREWARM_MAX_TYPES];
+	MEMBERID rgMemIdFound[DH_PREWARM_MAX_TYPES];
+	ITypeLib * pTypeLib = NULL;
+	WCHAR szName[DH_MAX_MEMBER];
+	LPOLESTR pszName = szName;
+	LPCOLESTR szEnd;
+	USHORT cFound, iFound;
+	UINT cchName, cMissing = 0;
+	DISPID dispID;
+	BOOL bFound;
+
+	DH_ENTER(L"Prewarm");
+
+	if (!pDisp || !szNames) return DH_EXIT(E_INVALIDARG, szNames);
+
+	if (SUCCEEDED(dhSnapshotGetTypeKey(pDisp, &key, &pTypeInfo)))
+	{
+		GetLocalTypeInfo(&key, pTypeInfo, &pTypeLib, &pLocalInfo);
+	}
+
+	for (;;)
+	{
+		while (*szNames == L';' || *szNames == L' ') szNames++;
+
+		if (!*szNames) break;
+
+		for (szEnd = szNames; *szEnd && *szEnd != L';'; szEnd++);
+
+		for (cchName = (UINT) (szEnd - szNames); cchName && szNames[cchName - 1] == L' '; cchName--);
+
+		if (cchName >= ARRAYSIZE(szName))
+		{
+			cMissing++;
+			szNames = szEnd;
+			continue;
+		}
+
+		CopyMemory(szName, szNames, cchName * sizeof(WCHAR));
+		szName[cchName] = L'\0';
+		szNames = szEnd;
+
+		if (pLocalInfo && SUCCEEDED(pLocalInfo->lpVtbl->GetIDsOfNames(pLocalInfo, &pszName, 1, &dispID)))
+		{
+			PrewarmMember(pDisp, &key, pLocalInfo, pszName, dispID);
+			continue;
+		}
+
+		bFound = FALSE;
+
+		if (pTypeLib)
+		{
+			/* Add the name for the other types of the library which have it */
+			cFound = DH_PREWARM_MAX_TYPES;
+
+			if (SUCCEEDED(pTypeLib->lpVtbl->FindName(pTypeLib, pszName, 0, rgpFound, rgMemIdFound, &cFound)))
+			{
+				for (iFound = 0; iFound < cFound; iFound++)
+				{
+					if (GetDispatchTypeKey(rgpFound[iFound], &key, &typeKey, NULL, NULL))
+					{
+						PrewarmMember(NULL, &typeKey, NULL, pszName, rgMemIdFound[iFound]);
+						bFound = TRUE;
+					}
+
+					rgpFound[iFound]->lpVtbl->Release(rgpFound[iFound]);
+				}
+			}
+		}
+
+		/* Otherwise the name may only be known by the object */
+		if (!bFound && FAILED(dhCacheGetIDsOfNames(pDisp, &pszName, 1, &dispID))) cMissing++;
+	}
+
+	if (pLocalInfo) pLocalInfo->lpVtbl->Release(pLocalInfo);
+	if (pTypeLib)   pTypeLib->lpVtbl->Release(pTypeLib);
+	if (pTypeInfo)  pTypeInfo->lpVtbl->Release(pTypeInfo);
+
+	return DH_EXIT(cMissing ? S_FALSE : NOERROR, NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhPrewarmTypeLib:
+ *   This function reads every member name of the server's type library
+ * once. The names of the object's type are added to the calling thread's
+ * DISPID cache for the object, and all the names to the DISPID file.
+ *
+ * Notes:
+ *   Without a DISPID file, only the names of the object's type are kept.
+ * With one, this can run on a background thread at start up, with its own
+ * copy of the object, so that the threads serving requests, and later
+ * processes, find every name in the file.
+ *   The type library is loaded from the registry when possible, so that
+ * reading it costs no round trips to the server.
+ *
+ ============================================================================ */
+HRESULT dhPrewarmTypeLib(IDispatch * pDisp)
+{
+	DH_TYPE_KEY key, typeKey;
+	ITypeInfo * pTypeInfo = NULL, * pLocalInfo = NULL, * pMemberInfo;
+	ITypeLib * pTypeLib = NULL;
+	FUNCDESC * pFuncDesc;
+	VARDESC * pVarDesc;
+	MEMBERID memid;
+	BSTR bstrName;
+	UINT cTypes, iType, cFuncs, cVars, iMember, cNames;
+	BOOL bOwnType;
+	HRESULT hr;
+
+	DH_ENTER(L"PrewarmTypeLib");
+
+	if (!pDisp) return DH_EXIT(E_INVALIDARG, NULL);
+
+	hr = dhSnapshotGetTypeKey(pDisp, &key, &pTypeInfo);
+
+	if (SUCCEEDED(hr)) hr = GetLocalTypeInfo(&key, pTypeInfo, &pTypeLib, &pLocalInfo);
+
+	if (FAILED(hr))
+	{
+		if (pTypeInfo) pTypeInfo->lpVtbl->Release(pTypeInfo);
+		return DH_EXIT(hr, NULL);
+	}
+
+	cTypes = pTypeLib->lpVtbl->GetTypeInfoCount(pTypeLib);
+
+	for (iType = 0; iType < cTypes; iType++)
+	{
+		if (FAILED(pTypeLib->lpVtbl->GetTypeInfo(pTypeLib, iType, &pMemberInfo))) continue;
+
+		if (GetDispatchTypeKey(pMemberInfo, &key, &typeKey, &cFuncs, &cVars))
+		{
+			bOwnType = IsEqualGUID(&typeKey.guidType, &key.guidType);
+
+			/* Functions, including property accessors, then properties of dispinterfaces */
+			for (iMember = 0; iMember < cFuncs + cVars; iMember++)
+			{
+				if (iMember < cFuncs)
+				{
+					if (FAILED(pMemberInfo->lpVtbl->GetFuncDesc(pMemberInfo, iMember, &pFuncDesc))) continue;
+
+					memid = (pFuncDesc->wFuncFlags & FUNCFLAG_FRESTRICTED) ? MEMBERID_NIL : pFuncDesc->memid;
+					pMemberInfo->lpVtbl->ReleaseFuncDesc(pMemberInfo, pFuncDesc);
+				}
+				else
+				{
+					if (FAILED(pMemberInfo->lpVtbl->GetVarDesc(pMemberInfo, iMember - cFuncs, &pVarDesc))) continue;
+
+					memid = pVarDesc->memid;
+					pMemberInfo->lpVtbl->ReleaseVarDesc(pMemberInfo, pVarDesc);
+				}
+
+				if (memid == MEMBERID_NIL) continue;
+
+				if (SUCCEEDED(pMemberInfo->lpVtbl->GetNames(pMemberInfo, memid, &bstrName, 1, &cNames)) && cNames == 1)
+				{
+					PrewarmMember(bOwnType ? pDisp : NULL, &typeKey, pLocalInfo, bstrName, memid);
+					SysFreeString(bstrName);
+				}
+			}
+		}
+
+		pMemberInfo->lpVtbl->Release(pMemberInfo);
+	}
+
+	pLocalInfo->lpVtbl->Release(pLocalInfo);
+	pTypeLib->lpVtbl->Release(pTypeLib);
+	pTypeInfo->lpVtbl->Release(pTypeInfo);
+
+	return DH_EXIT(NOERROR, NULL);
+}
@@ -0,0 +1,623 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+
+/* Number of hash buckets (by object) and maximum number of values cached on each thread */
+#define DH_PROPERTY_BUCKETS     64
+#define DH_MAX_PROPERTY_ENTRIES 512
+
+/* Number of change counters shared by all threads, to which objects are hashed */
+#define DH_PROPERTY_GENERATIONS 256
+
+/* A member whose values are cached and for how long */
+typedef struct tagDH_PROPERTY_MEMBER
+{
+	struct tagDH_PROPERTY_MEMBER * pNext;
+	DWORD dwTimeToLive;
+	WCHAR szMember[1];
+} DH_PROPERTY_MEMBER;
+
+/* A cached value, by the identity of the object the member is got from. We
+ * hold a reference on pIdentity for as long as the value is cached so that
+ * its address can not be reused by another object. The value is stale once
+ * the object's change counter or the epoch has moved on. */
+typedef struct tagDH_PROPERTY_ENTRY
+{
+	struct tagDH_PROPERTY_ENTRY * pNext;
+	IUnknown * pIdentity;
+	LONG lngGeneration;
+	LONG lngEpoch;
+	VARTYPE returnType;
+	DWORD dwStored;
+	DWORD dwTimeToLive;
+	UINT cArgs;
+	VARIANT * rgArgs;
+	LPWSTR szMember;
+	VARIANT vtValue;
+} DH_PROPERTY_ENTRY;
+
+/* The per-thread cache */
+typedef struct tagDH_PROPERTY_CACHE
+{
+	UINT cEntries;
+	DH_PROPERTY_ENTRY * rgBuckets[DH_PROPERTY_BUCKETS];
+} DH_PROPERTY_CACHE;
+
+static DH_PROPERTY_MEMBER * f_pPropertyMembers = NULL;
+static LONG f_cPropertyMembers = 0;
+static CRITICAL_SECTION f_csPropertyMembers;
+
+/* Raised by the puts and calls made on an object, and by flushes */
+static volatile LONG f_rglngPropertyGenerations[DH_PROPERTY_GENERATIONS];
+static volatile LONG f_lngPropertyEpoch = 0;
+
+static LONG  f_lngPropertyInitBegin = -1, f_lngPropertyInitEnd = -1;
+static DWORD f_TlsIdxPropertyCache;
+
+#define GetThreadPropertyCache()       ((DH_PROPERTY_CACHE *) TlsGetValue(f_TlsIdxPropertyCache))
+#define SetThreadPropertyCache(pCache) TlsSetValue(f_TlsIdxPropertyCache, pCache)
+#define CheckPropertyCacheInitialized() if (f_lngPropertyInitEnd != 0) InitializePropertyCache();
+
+#define PropertyHash(pIdentity)       ((UINT) ((ULONG_PTR) (pIdentity) >> 4))
+#define PropertyBucket(pIdentity)     (PropertyHash(pIdentity) % DH_PROPERTY_BUCKETS)
+#define PropertyGeneration(pIdentity) (&f_rglngPropertyGenerations[PropertyHash(pIdentity) % DH_PROPERTY_GENERATIONS])
+
+
+
+/* **************************************************************************
+ * InitializePropertyCache:
+ *   Initializes the Tls index used to store each thread's cache and the
+ * critical section protecting the list of cached members if needed.
+ *
+ ============================================================================ */
+static void InitializePropertyCache(void)
+{
+	if (0 == InterlockedIncrement(&f_lngPropertyInitBegin))
+	{
+		f_TlsIdxPropertyCache = TlsAlloc();
+		InitializeCriticalSection(&f_csPropertyMembers);
+		f_lngPropertyInitEnd = 0;
+	}
+	else
+	{
+		/* Deal with extremely unlikely race condition */
+		while (f_lngPropertyInitEnd != 0) Sleep(5);
+	}
+}
+
+
+
+/* **************************************************************************
+ * FindPropertyMember:
+ *   Finds a member in the list of cached members. Must be called with the
+ * lock held.
+ *
+ ============================================================================ */
+static DH_PROPERTY_MEMBER ** FindPropertyMember(LPCOLESTR szMember)
+{
+	DH_PROPERTY_MEMBER ** ppMember;
+
+	if (*szMember == L'.') szMember++;
+
+	for (ppMember = &f_pPropertyMembers; *ppMember; ppMember = &(*ppMember)->pNext)
+	{
+		if (lstrcmpiW((*ppMember)->szMember, szMember) == 0) break;
+	}
+
+	return ppMember;
+}
+
+
+
+/* **************************************************************************
+ * FreePropertyEntry:
+ *   Frees a cached value and releases its object.
+ *
+ ============================================================================ */
+static void FreePropertyEntry(DH_PROPERTY_ENTRY * pEntry)
+{
+	UINT iArg;
+
+	for (iArg = 0; iArg < pEntry->cArgs; iArg++)
+	{
+		VariantClear(&pEntry->rgArgs[iArg]);
+	}
+
+	VariantClear(&pEntry->vtValue);
+	pEntry->pIdentity->lpVtbl->Release(pEntry->pIdentity);
+	HeapFree(GetProcessHeap(), 0, pEntry);
+}
+
+
+
+/* **************************************************************************
+ * IsStale:
+ *   Checks if a cached value has outlived its time to live, or if its object
+ * may have changed since it was got.
+ *
+ ============================================================================ */
+static BOOL IsStale(DH_PROPERTY_ENTRY * pEntry, DWORD dwNow)
+{
+	return (pEntry->dwTimeToLive != INFINITE && dwNow - pEntry->dwStored >= pEntry->dwTimeToLive) ||
+	       pEntry->lngGeneration != *PropertyGeneration(pEntry->pIdentity) || pEntry->lngEpoch != f_lngPropertyEpoch;
+}
+
+
+
+/* **************************************************************************
+ * MakeRoom:
+ *   Frees the stale values of a full cache, or the oldest value if none
+ * are stale.
+ *
+ ============================================================================ */
+static void MakeRoom(DH_PROPERTY_CACHE * pCache, DWORD dwNow)
+{
+	DH_PROPERTY_ENTRY ** ppEntry, ** ppOldest = NULL, * pEntry;
+	UINT iBucket;
+
+	for (iBucket = 0; iBucket < DH_PROPERTY_BUCKETS; iBucket++)
+	{
+		for (ppEntry = &pCache->rgBuckets[iBucket]; (pEntry = *ppEntry) != NULL; )
+		{
+			if (IsStale(pEntry, dwNow))
+			{
+				*ppEntry = pEntry->pNext;
+				FreePropertyEntry(pEntry);
+				pCache->cEntries--;
+				continue;
+			}
+
+			if (!ppOldest || dwNow - pEntry->dwStored > dwNow - (*ppOldest)->dwStored) ppOldest = ppEntry;
+
+			ppEntry = &pEntry->pNext;
+		}
+	}
+
+	if (pCache->cEntries >= DH_MAX_PROPERTY_ENTRIES && ppOldest)
+	{
+		pEntry    = *ppOldest;
+		*ppOldest = pEntry->pNext;
+		FreePropertyEntry(pEntry);
+		pCache->cEntries--;
+	}
+}
+
+
+
+/* **************************************************************************
+ * CreatePropertyEntry:
+ *   Allocates a cache entry holding a copy of the captured arguments.
+ *
+ ============================================================================ */
+static DH_PROPERTY_ENTRY * CreatePropertyEntry(IUnknown * pIdentity, LPCOLESTR szMember, VARTYPE returnType,
+                                               VARIANT * rgArgs, UINT cArgs, DWORD dwTimeToLive)
+{
+	DH_PROPERTY_ENTRY * pEntry;
+	UINT iArg;
+
+	pEntry = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_PROPERTY_ENTRY) +
+	                   cArgs * sizeof(VARIANT) + (wcslen(szMember) + 1) * sizeof(WCHAR));
+
+	if (!pEntry) return NULL;
+
+	pEntry->rgArgs   = (VARIANT *) (pEntry + 1);
+	pEntry->szMember = (LPWSTR) (pEntry->rgArgs + cArgs);
+	wcscpy(pEntry->szMember, szMember);
+
+	for (iArg = 0; iArg < cArgs; iArg++)
+	{
+		if (FAILED(VariantCopy(&pEntry->rgArgs[iArg], &rgArgs[iArg])))
+		{
+			while (iArg) VariantClear(&pEntry->rgArgs[--iArg]);
+			HeapFree(GetProcessHeap(), 0, pEntry);
+			return NULL;
+		}
+	}
+
+	pEntry->pIdentity    = pIdentity;
+	pEntry->returnType   = returnType;
+	pEntry->cArgs        = cArgs;
+	pEntry->dwTimeToLive = dwTimeToLive;
+	pIdentity->lpVtbl->AddRef(pIdentity);
+
+	return pEntry;
+}
+
+
+
+/* **************************************************************************
+ * GetPropertyTarget:
+ *   Gets the object a captured member is finally got from, e.g. the active
+ * workbook for ".ActiveWorkbook.Name", and moves the member's own arguments
+ * to the start of rgArgs. *pszName receives the member's name, within
+ * szCaptured. On failure the remaining arguments must still be cleared.
+ *
+ ============================================================================ */
+static HRESULT GetPropertyTarget(IDispatch * pDisp, LPWSTR szCaptured, VARIANT * rgArgs, UINT * pcArgs,
+                                 IDispatch ** ppTarget, LPWSTR * pszName)
+{
+	LPWSTR szDot = (*szCaptured ? wcsrchr(szCaptured + 1, L'.') : NULL);
+	UINT cPathArgs = 0, iArg;
+	VARIANT vtTarget;
+	LPWSTR szPos;
+	HRESULT hr;
+
+	if (!szDot)
+	{
+		pDisp->lpVtbl->AddRef(pDisp);
+		*ppTarget = pDisp;
+		*pszName  = szCaptured;
+		return NOERROR;
+	}
+
+	for (szPos = szCaptured; szPos < szDot; szPos++)
+	{
+		if (*szPos == L'%') cPathArgs++;
+	}
+
+	*szDot = L'\0';
+	hr = dhInvokeCaptured(DISPATCH_PROPERTYGET|DISPATCH_METHOD, VT_DISPATCH, &vtTarget, pDisp, szCaptured, rgArgs);
+	*szDot = L'.';
+
+	for (iArg = 0; iArg < cPathArgs; iArg++) VariantClear(&rgArgs[iArg]);
+
+	MoveMemory(rgArgs, rgArgs + cPathArgs, (*pcArgs - cPathArgs) * sizeof(VARIANT));
+
+	for (iArg = *pcArgs - cPathArgs; iArg < *pcArgs; iArg++) VariantInit(&rgArgs[iArg]);
+
+	*pcArgs -= cPathArgs;
+
+	if (SUCCEEDED(hr) && !V_DISPATCH(&vtTarget)) hr = E_NOINTERFACE;
+	if (FAILED(hr)) return hr;
+
+	*ppTarget = V_DISPATCH(&vtTarget);
+	*pszName  = szDot;
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhPropertyCacheGetV:
+ *   Internal function used by dhGetValueV to invoke a property get. If the
+ * member has been enabled with dhSetPropertyCache, the objects on its path
+ * are got and a copy of a value cached by this thread for the final object,
+ * member and arguments is returned. On a miss the member is got (through
+ * dhSingleFlightGet) and its value cached.
+ *
+ ============================================================================ */
+HRESULT dhPropertyCacheGetV(VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
+{
+	WCHAR szCaptured[DH_MAX_MEMBER];
+	VARIANT rgArgs[DH_MAX_CAPTURED_ARGS];
+	DH_PROPERTY_MEMBER * pMember;
+	DH_PROPERTY_CACHE * pCache;
+	DH_PROPERTY_ENTRY ** ppEntry, * pEntry;
+	IDispatch * pTarget;
+	IUnknown * pIdentity;
+	LPWSTR szName;
+	DWORD dwTimeToLive = 0, dwNow;
+	LONG lngGeneration, lngEpoch;
+	UINT cArgs, iArg;
+	HRESULT hr;
+
+	if (f_cPropertyMembers == 0 || !pDisp || !szMember || wcslen(szMember) >= DH_MAX_MEMBER)
+	{
+		return dhSingleFlightGetV(returnType, pvResult, pDisp, szMember, marker);
+	}
+
+	CheckPropertyCacheInitialized();
+
+	EnterCriticalSection(&f_csPropertyMembers);
+	if ((pMember = *FindPropertyMember(szMember)) != NULL) dwTimeToLive = pMember->dwTimeToLive;
+	LeaveCriticalSection(&f_csPropertyMembers);
+
+	if (!dwTimeToLive) return dhSingleFlightGetV(returnType, pvResult, pDisp, szMember, marker);
+
+	hr = dhCaptureArguments(szMember, szCaptured, rgArgs, DH_MAX_CAPTURED_ARGS, &cArgs, marker);
+	if (FAILED(hr)) return hr;
+
+	for (iArg = cArgs; iArg < DH_MAX_CAPTURED_ARGS; iArg++) VariantInit(&rgArgs[iArg]);
+
+	/* By reference arguments are written to by the call, so are never cached */
+	for (iArg = 0; iArg < cArgs; iArg++)
+	{
+		if (V_VT(&rgArgs[iArg]) & VT_BYREF) return dhSingleFlightGet(returnType, pvResult, pDisp, szMember, szCaptured, rgArgs, cArgs);
+	}
+
+	if (FAILED(hr = GetPropertyTarget(pDisp, szCaptured, rgArgs, &cArgs, &pTarget, &szName)))
+	{
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+		return hr;
+	}
+
+	if (!(pCache = GetThreadPropertyCache()) && (pCache = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_PROPERTY_CACHE))))
+	{
+		SetThreadPropertyCache(pCache);
+	}
+
+	if (!pCache || FAILED(pTarget->lpVtbl->QueryInterface(pTarget, &IID_IUnknown, (void **) &pIdentity)))
+	{
+		hr = dhSingleFlightGet(returnType, pvResult, pTarget, szMember, szName, rgArgs, cArgs);
+		pTarget->lpVtbl->Release(pTarget);
+		return hr;
+	}
+
+	dwNow = GetTickCount();
+
+	for (ppEntry = &pCache->rgBuckets[PropertyBucket(pIdentity)]; (pEntry = *ppEntry) != NULL; ppEntry = &pEntry->pNext)
+	{
+		if (pEntry->pIdentity == pIdentity && pEntry->returnType == returnType && pEntry->cArgs == cArgs &&
+		    wcscmp(pEntry->szMember, szName) == 0 && dhArgumentsMatch(pEntry->rgArgs, rgArgs, cArgs))
+		{
+			break;
+		}
+	}
+
+	if (pEntry && !IsStale(pEntry, dwNow))
+	{
+		for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+
+		pIdentity->lpVtbl->Release(pIdentity);
+		pTarget->lpVtbl->Release(pTarget);
+
+		VariantInit(pvResult);
+		return VariantCopy(pvResult, &pEntry->vtValue);
+	}
+
+	if (pEntry)
+	{
+		*ppEntry = pEntry->pNext;
+		FreePropertyEntry(pEntry);
+		pCache->cEntries--;
+	}
+
+	/* Read the counters before the get, so that a change made during it
+	 * leaves the value stale */
+	lngGeneration = *PropertyGeneration(pIdentity);
+	lngEpoch      = f_lngPropertyEpoch;
+
+	/* dhSingleFlightGet clears the captured arguments, so copy them first */
+	pEntry = CreatePropertyEntry(pIdentity, szName, returnType, rgArgs, cArgs, dwTimeToLive);
+
+	hr = dhSingleFlightGet(returnType, pvResult, pTarget, szMember, szName, rgArgs, cArgs);
+
+	pIdentity->lpVtbl->Release(pIdentity);
+	pTarget->lpVtbl->Release(pTarget);
+
+	if (!pEntry) return hr;
+
+	if (FAILED(hr) || FAILED(VariantCopy(&pEntry->vtValue, pvResult)))
+	{
+		FreePropertyEntry(pEntry);
+		return hr;
+	}
+
+	if (pCache->cEntries >= DH_MAX_PROPERTY_ENTRIES) MakeRoom(pCache, dwNow);
+
+	pEntry->lngGeneration = lngGeneration;
+	pEntry->lngEpoch      = lngEpoch;
+	pEntry->dwStored      = GetTickCount();
+	pEntry->pNext         = pCache->rgBuckets[PropertyBucket(pEntry->pIdentity)];
+	pCache->rgBuckets[PropertyBucket(pEntry->pIdentity)] = pEntry;
+	pCache->cEntries++;
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhPropertyCacheInvalidate:
+ *   Internal function called by dhInterceptInvoke after a put or a method
+ * call. The values cached for the object by every thread become stale.
+ *
+ ============================================================================ */
+void dhPropertyCacheInvalidate(IDispatch * pDisp)
+{
+	IUnknown * pIdentity;
+
+	if (f_cPropertyMembers == 0) return;
+
+	if (FAILED(pDisp->lpVtbl->QueryInterface(pDisp, &IID_IUnknown, (void **) &pIdentity)))
+	{
+		InterlockedIncrement(&f_lngPropertyEpoch);
+		return;
+	}
+
+	InterlockedIncrement(PropertyGeneration(pIdentity));
+	pIdentity->lpVtbl->Release(pIdentity);
+}
+
+
+
+/* **************************************************************************
+ * dhSetPropertyCache:
+ *   Enables caching of the values returned by gets of a member, such as a
+ * property which does not change during a job. Each thread caches values by
+ * object, member and arguments for dwTimeToLive milliseconds (INFINITE for
+ * no expiry). A dwTimeToLive of zero stops caching the member.
+ *
+ * Parameter Info:
+ *   szMember - The member as passed to dhGetValue, e.g. L".Path" or
+ * L".Fields(%S).Type". A leading '.' is ignored and the comparison is case
+ * insensitive.
+ *
+ * Notes:
+ *   Values are cached by the identity of the object the member is finally
+ * got from, so the objects on the path, such as ActiveWorkbook in
+ * L".ActiveWorkbook.Name", are still got each time. The values cached for
+ * an object by every thread become stale when a put or a method call is
+ * made on it through DispHelper. Call dhFlushPropertyCache after any other
+ * change, such as one made through another apartment's proxy.
+ *
+ *   An object is kept alive (AddRef'd) while values are cached for it.
+ *
+ * Example(s):
+ *   dhSetPropertyCache(L".Version", INFINITE);
+ *   dhSetPropertyCache(L".Fields(%S).Type", 60000);
+ *
+ ============================================================================ */
+HRESULT dhSetPropertyCache(LPCOLESTR szMember, DWORD dwTimeToLive)
+{
+	DH_PROPERTY_MEMBER ** ppMember, * pMember;
+	HRESULT hr = NOERROR;
+
+	if (!szMember) return E_INVALIDARG;
+
+	if (*szMember == L'.') szMember++;
+
+	CheckPropertyCacheInitialized();
+
+	EnterCriticalSection(&f_csPropertyMembers);
+
+	ppMember = FindPropertyMember(szMember);
+
+	if (dwTimeToLive && *ppMember)
+	{
+		(*ppMember)->dwTimeToLive = dwTimeToLive;
+	}
+	else if (dwTimeToLive)
+	{
+		pMember = HeapAlloc(GetProcessHeap(), 0, sizeof(DH_PROPERTY_MEMBER) + wcslen(szMember) * sizeof(WCHAR));
+
+		if (pMember)
+		{
+			wcscpy(pMember->szMember, szMember);
+			pMember->dwTimeToLive = dwTimeToLive;
+			pMember->pNext = NULL;
+			*ppMember = pMember;
+			InterlockedIncrement(&f_cPropertyMembers);
+		}
+		else
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+	else if (*ppMember)
+	{
+		pMember   = *ppMember;
+		*ppMember = pMember->pNext;
+		HeapFree(GetProcessHeap(), 0, pMember);
+
+		/* Changes are not counted while no member is cached, so values
+		 * cached until now can not be trusted if it is enabled again */
+		InterlockedIncrement(&f_lngPropertyEpoch);
+		InterlockedDecrement(&f_cPropertyMembers);
+	}
+
+	LeaveCriticalSection(&f_csPropertyMembers);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * FreePropertyEntries:
+ *   Frees the values cached by the calling thread for an object, or all of
+ * them if pIdentity is NULL.
+ *
+ ============================================================================ */
+static void FreePropertyEntries(DH_PROPERTY_CACHE * pCache, IUnknown * pIdentity)
+{
+	DH_PROPERTY_ENTRY ** ppEntry, * pEntry;
+	UINT iBucket;
+
+	for (iBucket = 0; iBucket < DH_PROPERTY_BUCKETS && pCache->cEntries; iBucket++)
+	{
+		if (pIdentity && iBucket != PropertyBucket(pIdentity)) continue;
+
+		for (ppEntry = &pCache->rgBuckets[iBucket]; (pEntry = *ppEntry) != NULL; )
+		{
+			if (!pIdentity || pEntry->pIdentity == pIdentity)
+			{
+				*ppEntry = pEntry->pNext;
+				FreePropertyEntry(pEntry);
+				pCache->cEntries--;
+			}
+			else
+			{
+				ppEntry = &pEntry->pNext;
+			}
+		}
+	}
+}
+
+
+
+/* **************************************************************************
+ * dhFlushPropertyCache:
+ *   Makes the values cached by every thread for pDisp stale, and frees those
+ * of the calling thread, releasing the cache's reference on the object. If
+ * pDisp is NULL every cached value is flushed.
+ *
+ ============================================================================ */
+HRESULT dhFlushPropertyCache(IDispatch * pDisp)
+{
+	DH_PROPERTY_CACHE * pCache;
+	IUnknown * pIdentity = NULL;
+	HRESULT hr;
+
+	/* Nothing can be cached before the first call to dhSetPropertyCache */
+	if (f_lngPropertyInitEnd != 0) return NOERROR;
+
+	if (pDisp)
+	{
+		if (FAILED(hr = pDisp->lpVtbl->QueryInterface(pDisp, &IID_IUnknown, (void **) &pIdentity))) return hr;
+
+		InterlockedIncrement(PropertyGeneration(pIdentity));
+	}
+	else
+	{
+		InterlockedIncrement(&f_lngPropertyEpoch);
+	}
+
+	if ((pCache = GetThreadPropertyCache()) != NULL) FreePropertyEntries(pCache, pIdentity);
+
+	if (pIdentity) pIdentity->lpVtbl->Release(pIdentity);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhCleanupThreadPropertyCache:
+ *   Internal function called by dhUninitialize to free this thread's
+ * property cache.
+ *
+ ============================================================================ */
+void dhCleanupThreadPropertyCache(void)
+{
+	DH_PROPERTY_CACHE * pCache;
+
+	CheckPropertyCacheInitialized();
+	pCache = GetThreadPropertyCache();
+
+	if (pCache)
+	{
+		FreePropertyEntries(pCache, NULL);
+		HeapFree(GetProcessHeap(), 0, pCache);
+		SetThreadPropertyCache(NULL);
+	}
+}
@@ -0,0 +1,770 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+#include <stdlib.h>
+
+/* Number of cells buffered when none is specified */
+#define DH_DEFAULT_WRITER_CELLS 4096
+
+/* Excel 2007 and later */
+#define DH_MAX_EXCEL_COLUMN 16384
+
+/* A pending cell */
+typedef struct tagDH_PENDING_CELL
+{
+	LONG iRow;
+	LONG iCol;
+	VARIANT vtValue;
+} DH_PENDING_CELL;
+
+/* A run of pending cells in consecutive columns of a row */
+typedef struct tagDH_CELL_RUN
+{
+	LONG iRow;
+	LONG iCol;
+	UINT cCols;
+	UINT iFirstCell;
+	UINT iBlock;
+} DH_CELL_RUN;
+
+/* A rectangle of pending cells written with a single Range.Value put */
+typedef struct tagDH_CELL_BLOCK
+{
+	LONG iRow;
+	LONG iCol;
+	UINT cRows;
+	UINT cCols;
+	UINT iFirstCell;
+	SAFEARRAY * psa;
+	VARIANT * pData;
+} DH_CELL_BLOCK;
+
+/* Structure to store a write-behind buffer for a worksheet */
+struct tagDH_RANGE_WRITER
+{
+	IDispatch * pSheet;
+	UINT cMaxCells;
+	UINT cCells;
+	DH_PENDING_CELL * rgCells;
+
+	/* Open addressing table of indexes into rgCells (plus one) */
+	UINT cSlots;
+	UINT * rgSlots;
+};
+
+
+
+/* **************************************************************************
+ * HashCell:
+ *   Returns the first slot of a cell in the writer's table.
+ *
+ ============================================================================ */
+static UINT HashCell(PDH_RANGE_WRITER pWriter, LONG iRow, LONG iCol)
+{
+	return (UINT) (((ULONG) iRow * 16411UL + (ULONG) iCol) * 2654435761UL) & (pWriter->cSlots - 1);
+}
+
+
+
+/* **************************************************************************
+ * FindCellSlot:
+ *   Returns the slot of a pending cell, or the empty slot where it should be
+ * inserted.
+ *
+ ============================================================================ */
+static UINT * FindCellSlot(PDH_RANGE_WRITER pWriter, LONG iRow, LONG iCol)
+{
+	UINT iSlot = HashCell(pWriter, iRow, iCol);
+	DH_PENDING_CELL * pCell;
+
+	while (pWriter->rgSlots[iSlot])
+	{
+		pCell = &pWriter->rgCells[pWriter->rgSlots[iSlot] - 1];
+
+		if (pCell->iRow == iRow && pCell->iCol == iCol) break;
+
+		iSlot = (iSlot + 1) & (pWriter->cSlots - 1);
+	}
+
+	return &pWriter->rgSlots[iSlot];
+}
+
+
+
+/* **************************************************************************
+ * CompareCells:
+ *   qsort callback ordering cells by row then column.
+ *
+ ============================================================================ */
+static int __cdecl CompareCells(const void * p1, const void * p2)
+{
+	const DH_PENDING_CELL * pCell1 = (const DH_PENDING_CELL *) p1;
+	const DH_PENDING_CELL * pCell2 = (const DH_PENDING_CELL *) p2;
+
+	if (pCell1->iRow != pCell2->iRow) return (pCell1->iRow < pCell2->iRow ? -1 : 1);
+	if (pCell1->iCol != pCell2->iCol) return (pCell1->iCol < pCell2->iCol ? -1 : 1);
+
+	return 0;
+}
+
+
+
+/* **************************************************************************
+ * FormatAddress:
+ *   Formats an A1 style address of a cell or, if cRows and cCols are not
+ * both 1, a rectangle of cells. e.g. "B3" or "B3:D10".
+ *
+ ============================================================================ */
+static void FormatAddress(LPWSTR szAddress, LONG iRow, LONG iCol, UINT cRows, UINT cCols)
+{
+	WCHAR szPart[16];
+	LPWSTR szTemp;
+	LONG iTemp;
+
+	for (;;)
+	{
+		/* Build the part backwards: row digits then column letters */
+		szTemp = szPart + ARRAYSIZE(szPart) - 1;
+		*szTemp = L'\0';
+
+		for (iTemp = iRow; iTemp > 0; iTemp /= 10)
+		{
+			*--szTemp = (WCHAR) (L'0' + iTemp % 10);
+		}
+
+		for (iTemp = iCol; iTemp > 0; iTemp = (iTemp - 1) / 26)
+		{
+			*--szTemp = (WCHAR) (L'A' + (iTemp - 1) % 26);
+		}
+
+		while (*szTemp) *szAddress++ = *szTemp++;
+
+		if (cRows == 1 && cCols == 1) break;
+
+		*szAddress++ = L':';
+
+		iRow += cRows - 1;
+		iCol += cCols - 1;
+		cRows = cCols = 1;
+	}
+
+	*szAddress = L'\0';
+}
+
+
+
+/* **************************************************************************
+ * ParseAddress:
+ *   Parses an A1 style address of a single cell (such as "B3" or "$B$3").
+ * Returns FALSE for anything else, e.g. "B3:D10" or a named range.
+ *
+ ============================================================================ */
+static BOOL ParseAddress(LPCWSTR szAddress, LONG * piRow, LONG * piCol)
+{
+	LONG iCol = 0, iRow = 0;
+
+	if (!szAddress) return FALSE;
+
+	if (*szAddress == L'$') szAddress++;
+
+	for (; (*szAddress >= L'A' && *szAddress <= L'Z') || (*szAddress >= L'a' && *szAddress <= L'z'); szAddress++)
+	{
+		iCol = iCol * 26 + ((*szAddress | 0x20) - L'a' + 1);
+		if (iCol > DH_MAX_EXCEL_COLUMN) return FALSE;
+	}
+
+	if (*szAddress == L'$') szAddress++;
+
+	for (; *szAddress >= L'0' && *szAddress <= L'9'; szAddress++)
+	{
+		iRow = iRow * 10 + (*szAddress - L'0');
+		if (iRow > 0x00FFFFFF) return FALSE;
+	}
+
+	if (*szAddress || iCol == 0 || iRow == 0) return FALSE;
+
+	*piRow = iRow;
+	*piCol = iCol;
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * SkipWord:
+ *   If sz starts with szWord (case insensitively), moves sz past it and
+ * returns TRUE.
+ *
+ ============================================================================ */
+static BOOL SkipWord(LPCWSTR * psz, LPCWSTR szWord)
+{
+	LPCWSTR sz = *psz;
+
+	for (; *szWord; sz++, szWord++)
+	{
+		if (*sz != *szWord && (*sz | 0x20) != (*szWord | 0x20)) return FALSE;
+	}
+
+	*psz = sz;
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * SkipIdentifier:
+ *   Moves sz past an identifier passed by value, such as %d or %Ld.
+ *
+ ============================================================================ */
+static BOOL SkipIdentifier(LPCWSTR * psz)
+{
+	LPCWSTR sz = *psz;
+
+	if (*sz++ != L'%') return FALSE;
+
+	while (*sz == L'h' || *sz == L'l' || *sz == L'L' || *sz == L'k') sz++;
+
+	if (!((*sz >= L'a' && *sz <= L'z') || (*sz >= L'A' && *sz <= L'Z'))) return FALSE;
+
+	*psz = sz + 1;
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * IsCellPut:
+ *   Checks if a member is a put to a single cell which can be buffered:
+ * "Cells(%d, %d) = %v" or "Range(%S).Value = %v" (".Value" is optional).
+ *
+ ============================================================================ */
+static BOOL IsCellPut(LPCOLESTR szMember, BOOL * pbRange)
+{
+	UINT cArgs = 0;
+
+	if (*szMember == L'.') szMember++;
+
+	if (SkipWord(&szMember, L"Cells("))      *pbRange = FALSE;
+	else if (SkipWord(&szMember, L"Range(")) *pbRange = TRUE;
+	else return FALSE;
+
+	for (;;)
+	{
+		while (*szMember == L' ') szMember++;
+
+		if (!SkipIdentifier(&szMember)) return FALSE;
+		cArgs++;
+
+		while (*szMember == L' ') szMember++;
+
+		if (*szMember == L')') break;
+		if (*szMember++ != L',') return FALSE;
+	}
+
+	szMember++;
+	SkipWord(&szMember, L".Value");
+
+	while (*szMember == L' ') szMember++;
+	if (*szMember++ != L'=') return FALSE;
+	while (*szMember == L' ') szMember++;
+
+	if (!SkipIdentifier(&szMember)) return FALSE;
+
+	while (*szMember == L' ') szMember++;
+
+	return (*szMember == L'\0' && cArgs == (*pbRange ? 1u : 2u));
+}
+
+
+
+/* **************************************************************************
+ * dhCreateRangeWriter:
+ *   This function creates a write-behind buffer for a worksheet. Cell puts
+ * made through the writer are buffered, merged into rectangular blocks and
+ * written with one Range.Value put per block when the writer is flushed,
+ * closed or full.
+ *
+ * Parameter Info:
+ *   pSheet    - The Excel worksheet.
+ *   cMaxCells - The number of cells buffered before the writer is flushed
+ * automatically, or zero for the default (4096).
+ *   ppWriter  - Receives the writer, which must be closed with
+ * dhRangeWriterClose.
+ *
+ ============================================================================ */
+HRESULT dhCreateRangeWriter(IDispatch * pSheet, UINT cMaxCells, PDH_RANGE_WRITER * ppWriter)
+{
+	PDH_RANGE_WRITER pWriter;
+
+	DH_ENTER(L"CreateRangeWriter");
+
+	if (!pSheet || !ppWriter) return DH_EXIT(E_INVALIDARG, NULL);
+
+	*ppWriter = NULL;
+
+	if (cMaxCells == 0) cMaxCells = DH_DEFAULT_WRITER_CELLS;
+	if (cMaxCells > 0x00100000) return DH_EXIT(E_INVALIDARG, NULL);
+
+	if (!(pWriter = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(struct tagDH_RANGE_WRITER))))
+	{
+		return DH_EXIT(E_OUTOFMEMORY, NULL);
+	}
+
+	/* Keep the load factor of the table under 1/2 */
+	for (pWriter->cSlots = 16; pWriter->cSlots < cMaxCells * 2; pWriter->cSlots *= 2);
+
+	pWriter->rgCells = HeapAlloc(GetProcessHeap(), 0, cMaxCells * sizeof(DH_PENDING_CELL));
+	pWriter->rgSlots = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, pWriter->cSlots * sizeof(UINT));
+
+	if (!pWriter->rgCells || !pWriter->rgSlots)
+	{
+		if (pWriter->rgCells) HeapFree(GetProcessHeap(), 0, pWriter->rgCells);
+		if (pWriter->rgSlots) HeapFree(GetProcessHeap(), 0, pWriter->rgSlots);
+		HeapFree(GetProcessHeap(), 0, pWriter);
+		return DH_EXIT(E_OUTOFMEMORY, NULL);
+	}
+
+	pWriter->pSheet    = pSheet;
+	pWriter->cMaxCells = cMaxCells;
+	pSheet->lpVtbl->AddRef(pSheet);
+
+	*ppWriter = pWriter;
+
+	return DH_EXIT(NOERROR, NULL);
+}
+
+
+
+/* **************************************************************************
+ * BuildRuns:
+ *   Splits the sorted pending cells into runs of consecutive columns and
+ * merges runs with the same columns in consecutive rows into blocks.
+ * Returns the number of blocks.
+ *
+ ============================================================================ */
+static UINT BuildRuns(PDH_RANGE_WRITER pWriter, DH_CELL_RUN * rgRuns, UINT * pcRuns, DH_CELL_BLOCK * rgBlocks, UINT * rgPrevRow)
+{
+	UINT cRuns = 0, cBlocks = 0, cPrevRow = 0, iPrev = 0, iCell, iRun, iRowStart = 0;
+	DH_CELL_RUN * pRun;
+	DH_CELL_BLOCK * pBlock;
+
+	for (iCell = 0; iCell < pWriter->cCells; iCell++)
+	{
+		DH_PENDING_CELL * pCell = &pWriter->rgCells[iCell];
+
+		if (cRuns && rgRuns[cRuns - 1].iRow == pCell->iRow &&
+		    rgRuns[cRuns - 1].iCol + (LONG) rgRuns[cRuns - 1].cCols == pCell->iCol)
+		{
+			rgRuns[cRuns - 1].cCols++;
+			continue;
+		}
+
+		pRun = &rgRuns[cRuns++];
+		pRun->iRow       = pCell->iRow;
+		pRun->iCol       = pCell->iCol;
+		pRun->cCols      = 1;
+		pRun->iFirstCell = iCell;
+	}
+
+	for (iRun = 0; iRun < cRuns; iRun++)
+	{
+		pRun = &rgRuns[iRun];
+
+		if (iRun > 0 && pRun->iRow != rgRuns[iRun - 1].iRow)
+		{
+			/* Remember the blocks that the previous row's runs belong to.
+			 * They are in column order, like the runs of this row. */
+			LONG iPrevRow = rgRuns[iRun - 1].iRow;
+
+			cPrevRow = 0;
+			iPrev    = 0;
+
+			if (iPrevRow == pRun->iRow - 1)
+			{
+				for (; iRowStart < iRun; iRowStart++) rgPrevRow[cPrevRow++] = rgRuns[iRowStart].iBlock;
+			}
+
+			iRowStart = iRun;
+		}
+
+		/* Find a block of the previous row with the same columns */
+		while (iPrev < cPrevRow && rgBlocks[rgPrevRow[iPrev]].iCol < pRun->iCol) iPrev++;
+
+		if (iPrev < cPrevRow && rgBlocks[rgPrevRow[iPrev]].iCol == pRun->iCol &&
+		    rgBlocks[rgPrevRow[iPrev]].cCols == pRun->cCols)
+		{
+			pRun->iBlock = rgPrevRow[iPrev];
+			rgBlocks[pRun->iBlock].cRows++;
+			continue;
+		}
+
+		pRun->iBlock = cBlocks;
+
+		pBlock = &rgBlocks[cBlocks++];
+		pBlock->iRow  = pRun->iRow;
+		pBlock->iCol  = pRun->iCol;
+		pBlock->cRows = 1;
+		pBlock->cCols = pRun->cCols;
+		pBlock->iFirstCell = pRun->iFirstCell;
+		pBlock->psa   = NULL;
+		pBlock->pData = NULL;
+	}
+
+	*pcRuns = cRuns;
+
+	return cBlocks;
+}
+
+
+
+/* **************************************************************************
+ * dhRangeWriterFlush:
+ *   This function writes the pending cells of a writer. Each rectangular
+ * block of cells is written with a single Range.Value put of a SAFEARRAY.
+ *
+ * Notes:
+ *   All the pending cells are discarded, even if a put fails. The other
+ * blocks are still written and the first failure is returned.
+ *
+ ============================================================================ */
+HRESULT dhRangeWriterFlush(PDH_RANGE_WRITER pWriter)
+{
+	DH_CELL_RUN * rgRuns = NULL;
+	DH_CELL_BLOCK * rgBlocks = NULL;
+	UINT * rgPrevRow = NULL;
+	UINT cRuns = 0, cBlocks = 0, iRun, iBlock, iCol, iCell;
+	WCHAR szAddress[40];
+	HRESULT hr = NOERROR, hrPut;
+	BOOL bReady;
+
+	DH_ENTER(L"RangeWriterFlush");
+
+	if (!pWriter) return DH_EXIT(E_INVALIDARG, NULL);
+
+	if (pWriter->cCells == 0) return DH_EXIT(NOERROR, NULL);
+
+	qsort(pWriter->rgCells, pWriter->cCells, sizeof(DH_PENDING_CELL), CompareCells);
+
+	rgRuns    = HeapAlloc(GetProcessHeap(), 0, pWriter->cCells * sizeof(DH_CELL_RUN));
+	rgBlocks  = HeapAlloc(GetProcessHeap(), 0, pWriter->cCells * sizeof(DH_CELL_BLOCK));
+	rgPrevRow = HeapAlloc(GetProcessHeap(), 0, pWriter->cCells * sizeof(UINT));
+
+	if (!rgRuns || !rgBlocks || !rgPrevRow)
+	{
+		hr = E_OUTOFMEMORY;
+	}
+	else
+	{
+		cBlocks = BuildRuns(pWriter, rgRuns, &cRuns, rgBlocks, rgPrevRow);
+	}
+
+	/* Create an array for each block of more than one cell */
+	for (iBlock = 0; iBlock < cBlocks && SUCCEEDED(hr); iBlock++)
+	{
+		DH_CELL_BLOCK * pBlock = &rgBlocks[iBlock];
+		SAFEARRAYBOUND rgBounds[2];
+
+		if (pBlock->cRows == 1 && pBlock->cCols == 1) continue;
+
+		rgBounds[0].lLbound   = 1;
+		rgBounds[0].cElements = pBlock->cRows;
+		rgBounds[1].lLbound   = 1;
+		rgBounds[1].cElements = pBlock->cCols;
+
+		if (!(pBlock->psa = SafeArrayCreate(VT_VARIANT, 2, rgBounds)))
+		{
+			hr = E_OUTOFMEMORY;
+		}
+		else if (FAILED(hr = SafeArrayAccessData(pBlock->psa, (void **) &pBlock->pData)))
+		{
+			SafeArrayDestroy(pBlock->psa);
+			pBlock->psa = NULL;
+		}
+	}
+
+	/* Move the values into the arrays. The first dimension (rows) varies fastest. */
+	for (iRun = 0; iRun < cRuns && SUCCEEDED(hr); iRun++)
+	{
+		DH_CELL_RUN * pRun = &rgRuns[iRun];
+		DH_CELL_BLOCK * pBlock = &rgBlocks[pRun->iBlock];
+
+		if (!pBlock->pData) continue;
+
+		for (iCol = 0; iCol < pRun->cCols; iCol++)
+		{
+			VARIANT * pvCell = &pWriter->rgCells[pRun->iFirstCell + iCol].vtValue;
+
+			pBlock->pData[(pRun->iRow - pBlock->iRow) + iCol * pBlock->cRows] = *pvCell;
+			VariantInit(pvCell);
+		}
+	}
+
+	bReady = SUCCEEDED(hr);
+
+	for (iBlock = 0; iBlock < cBlocks; iBlock++)
+	{
+		DH_CELL_BLOCK * pBlock = &rgBlocks[iBlock];
+		VARIANT vtArray;
+
+		if (bReady)
+		{
+			FormatAddress(szAddress, pBlock->iRow, pBlock->iCol, pBlock->cRows, pBlock->cCols);
+
+			if (pBlock->psa)
+			{
+				SafeArrayUnaccessData(pBlock->psa);
+
+				V_VT(&vtArray)    = VT_ARRAY | VT_VARIANT;
+				V_ARRAY(&vtArray) = pBlock->psa;
+
+				hrPut = dhPutValue(pWriter->pSheet, L".Range(%S).Value = %v", szAddress, &vtArray);
+			}
+			else
+			{
+				hrPut = dhPutValue(pWriter->pSheet, L".Range(%S).Value = %v", szAddress,
+				                   &pWriter->rgCells[pBlock->iFirstCell].vtValue);
+			}
+
+			if (FAILED(hrPut) && SUCCEEDED(hr)) hr = hrPut;
+		}
+		else if (pBlock->psa)
+		{
+			SafeArrayUnaccessData(pBlock->psa);
+		}
+
+		if (pBlock->psa) SafeArrayDestroy(pBlock->psa);
+	}
+
+	/* Discard the pending cells */
+	for (iCell = 0; iCell < pWriter->cCells; iCell++)
+	{
+		VariantClear(&pWriter->rgCells[iCell].vtValue);
+	}
+
+	pWriter->cCells = 0;
+	ZeroMemory(pWriter->rgSlots, pWriter->cSlots * sizeof(UINT));
+
+	if (rgRuns)    HeapFree(GetProcessHeap(), 0, rgRuns);
+	if (rgBlocks)  HeapFree(GetProcessHeap(), 0, rgBlocks);
+	if (rgPrevRow) HeapFree(GetProcessHeap(), 0, rgPrevRow);
+
+	return DH_EXIT(hr, NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhRangeWriterPut:
+ *   This function buffers a value for a cell, replacing any value already
+ * pending for the cell. The writer is flushed first if it is full.
+ *
+ ============================================================================ */
+HRESULT dhRangeWriterPut(PDH_RANGE_WRITER pWriter, LONG iRow, LONG iCol, VARIANT * pvValue)
+{
+	DH_PENDING_CELL * pCell;
+	UINT * piSlot;
+	HRESULT hr = NOERROR;
+
+	DH_ENTER(L"RangeWriterPut");
+
+	if (!pWriter || !pvValue || iRow < 1 || iCol < 1 || iCol > DH_MAX_EXCEL_COLUMN) return DH_EXIT(E_INVALIDARG, NULL);
+
+	piSlot = FindCellSlot(pWriter, iRow, iCol);
+
+	if (*piSlot)
+	{
+		pCell = &pWriter->rgCells[*piSlot - 1];
+		return DH_EXIT(VariantCopy(&pCell->vtValue, pvValue), NULL);
+	}
+
+	if (pWriter->cCells == pWriter->cMaxCells)
+	{
+		hr = dhRangeWriterFlush(pWriter);
+		piSlot = FindCellSlot(pWriter, iRow, iCol);
+	}
+
+	pCell = &pWriter->rgCells[pWriter->cCells];
+	pCell->iRow = iRow;
+	pCell->iCol = iCol;
+	VariantInit(&pCell->vtValue);
+
+	if (SUCCEEDED(hr)) hr = VariantCopy(&pCell->vtValue, pvValue);
+
+	if (SUCCEEDED(hr)) *piSlot = ++pWriter->cCells;
+
+	return DH_EXIT(hr, NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhRangeWriterPutValueV:
+ *   This function takes a put in the format of dhPutValue. Puts to a single
+ * cell, "Cells(%d, %d) = %v" or "Range(%S).Value = %v" (with any identifiers
+ * passed by value), are buffered. Any other put is made on the worksheet
+ * immediately, after flushing the writer so that puts stay in order.
+ *
+ * Example(s):
+ *   dhRangeWriterPutValue(pWriter, L".Cells(%d, %d) = %e", iRow, iCol, 3.14);
+ *   dhRangeWriterPutValue(pWriter, L".Range(%S).Value = %d", L"A2", 184);
+ *
+ ============================================================================ */
+HRESULT dhRangeWriterPutValueV(PDH_RANGE_WRITER pWriter, LPCOLESTR szMember, va_list * marker)
+{
+	WCHAR szCaptured[DH_MAX_MEMBER];
+	VARIANT rgArgs[3], vtRow, vtCol;
+	LONG iRow = 0, iCol = 0;
+	UINT cArgs, iArg;
+	BOOL bRange;
+	HRESULT hr;
+
+	DH_ENTER(L"RangeWriterPutValueV");
+
+	if (!pWriter || !szMember || !marker) return DH_EXIT(E_INVALIDARG, szMember);
+
+	if (wcslen(szMember) >= DH_MAX_MEMBER || !IsCellPut(szMember, &bRange))
+	{
+		hr = dhRangeWriterFlush(pWriter);
+		if (SUCCEEDED(hr)) hr = dhPutValueV(pWriter->pSheet, szMember, marker);
+
+		return DH_EXIT(hr, szMember);
+	}
+
+	hr = dhCaptureArguments(szMember, szCaptured, rgArgs, 3, &cArgs, marker);
+	if (FAILED(hr)) return DH_EXIT(hr, szMember);
+
+	if (bRange)
+	{
+		VariantInit(&vtRow);
+		hr = VariantChangeType(&vtRow, &rgArgs[0], 0, VT_BSTR);
+
+		if (SUCCEEDED(hr) && !ParseAddress(V_BSTR(&vtRow), &iRow, &iCol))
+		{
+			/* Not a single cell, e.g. "A1:B2" */
+			hr = dhRangeWriterFlush(pWriter);
+			if (SUCCEEDED(hr)) hr = dhPutValue(pWriter->pSheet, L".Range(%v).Value = %v", &rgArgs[0], &rgArgs[1]);
+
+			iRow = 0;
+		}
+
+		VariantClear(&vtRow);
+	}
+	else
+	{
+		VariantInit(&vtRow);
+		VariantInit(&vtCol);
+
+		hr = VariantChangeType(&vtRow, &rgArgs[0], 0, VT_I4);
+		if (SUCCEEDED(hr)) hr = VariantChangeType(&vtCol, &rgArgs[1], 0, VT_I4);
+
+		if (SUCCEEDED(hr))
+		{
+			iRow = V_I4(&vtRow);
+			iCol = V_I4(&vtCol);
+		}
+	}
+
+	if (SUCCEEDED(hr) && iRow) hr = dhRangeWriterPut(pWriter, iRow, iCol, &rgArgs[cArgs - 1]);
+
+	for (iArg = 0; iArg < cArgs; iArg++) VariantClear(&rgArgs[iArg]);
+
+	return DH_EXIT(hr, szMember);
+}
+
+
+
+/* ========================================================================== */
+HRESULT dhRangeWriterPutValue(PDH_RANGE_WRITER pWriter, LPCOLESTR szMember, ...)
+{
+	HRESULT hr;
+	va_list marker;
+
+	DH_ENTER(L"RangeWriterPutValue");
+
+	va_start(marker, szMember);
+
+	hr = dhRangeWriterPutValueV(pWriter, szMember, &marker);
+
+	va_end(marker);
+
+	return DH_EXIT(hr, szMember);
+}
+
+
+
+/* **************************************************************************
+ * dhRangeWriterGet:
+ *   This function reads the value of a cell. A value pending in the writer
+ * is returned without reading the worksheet.
+ *
+ ============================================================================ */
+HRESULT dhRangeWriterGet(PDH_RANGE_WRITER pWriter, LONG iRow, LONG iCol, VARIANT * pvResult)
+{
+	UINT * piSlot;
+
+	DH_ENTER(L"RangeWriterGet");
+
+	if (!pWriter || !pvResult || iRow < 1 || iCol < 1) return DH_EXIT(E_INVALIDARG, NULL);
+
+	VariantInit(pvResult);
+
+	piSlot = FindCellSlot(pWriter, iRow, iCol);
+
+	if (*piSlot)
+	{
+		return DH_EXIT(VariantCopy(pvResult, &pWriter->rgCells[*piSlot - 1].vtValue), NULL);
+	}
+
+	return DH_EXIT(dhInvoke(DISPATCH_PROPERTYGET, VT_EMPTY, pvResult, pWriter->pSheet, L".Cells(%d, %d).Value", iRow, iCol), NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhRangeWriterClose:
+ *   This function flushes and frees a writer. The result of the flush is
+ * returned.
+ *
+ ============================================================================ */
+HRESULT dhRangeWriterClose(PDH_RANGE_WRITER pWriter)
+{
+	HRESULT hr;
+
+	DH_ENTER(L"RangeWriterClose");
+
+	if (!pWriter) return DH_EXIT(NOERROR, NULL);
+
+	hr = dhRangeWriterFlush(pWriter);
+
+	pWriter->pSheet->lpVtbl->Release(pWriter->pSheet);
+	HeapFree(GetProcessHeap(), 0, pWriter->rgCells);
+	HeapFree(GetProcessHeap(), 0, pWriter->rgSlots);
+	HeapFree(GetProcessHeap(), 0, pWriter);
+
+	return DH_EXIT(hr, NULL);
+}
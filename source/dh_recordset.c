@@ -0,0 +1,424 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* Number of rows requested by each call to GetRows if not specified */
+#define DH_DEFAULT_PAGE_SIZE 1000
+
+/* Structure to store the state of a recordset reader */
+struct tagDH_RECORDSET_READER
+{
+	IDispatch * pRecordset;
+	VARIANT vtFields;
+	UINT cPageSize;
+
+	PDH_COLUMNS rgPages[2];
+	UINT iPage;
+	UINT iRow;
+	BOOL bStarted;
+	BOOL bLastPage;
+	HRESULT hrFailed;
+
+	/* Prefetch worker. It always fills rgPages[!iPage]. */
+	HANDLE hThread;
+	HANDLE hRequest;
+	HANDLE hReady;
+	IStream * pStream;
+	BOOL bPending;
+	volatile LONG bStop;
+	HRESULT hrNext;
+	BOOL bNextLastPage;
+};
+
+
+
+/* **************************************************************************
+ * FetchPage:
+ *   Reads the next page of rows from the recordset into pColumns with a
+ * single call to GetRows. *pbLastPage is set if no rows remain.
+ *
+ ============================================================================ */
+static HRESULT FetchPage(IDispatch * pRecordset, PDH_RECORDSET_READER pReader, PDH_COLUMNS pColumns, BOOL * pbLastPage)
+{
+	VARIANT vtRows;
+	VARIANT * pData;
+	LONG lLower1, lUpper1, lLower2, lUpper2;
+	UINT cFields, cRows, iField, iRow, iNewRow;
+	BOOL bEOF;
+	HRESULT hr;
+
+	dhColumnsReset(pColumns);
+	*pbLastPage = TRUE;
+
+	hr = dhGetValue(L"%b", &bEOF, pRecordset, L".EOF");
+
+	if (FAILED(hr) || bEOF) return hr;
+
+	VariantInit(&vtRows);
+
+	hr = dhGetValue(L"%v", &vtRows, pRecordset, L".GetRows(%d, %m, %v)", pReader->cPageSize, &pReader->vtFields);
+
+	if (FAILED(hr)) return hr;
+
+	/* GetRows returns an array indexed by field then row */
+	if (V_VT(&vtRows) != (VT_ARRAY | VT_VARIANT) || SafeArrayGetDim(V_ARRAY(&vtRows)) != 2)
+	{
+		VariantClear(&vtRows);
+		return E_UNEXPECTED;
+	}
+
+	SafeArrayGetLBound(V_ARRAY(&vtRows), 1, &lLower1);
+	SafeArrayGetUBound(V_ARRAY(&vtRows), 1, &lUpper1);
+	SafeArrayGetLBound(V_ARRAY(&vtRows), 2, &lLower2);
+	SafeArrayGetUBound(V_ARRAY(&vtRows), 2, &lUpper2);
+
+	cFields = (UINT) (lUpper1 - lLower1 + 1);
+	cRows   = (UINT) (lUpper2 - lLower2 + 1);
+
+	if (cFields != pColumns->cColumns)
+	{
+		VariantClear(&vtRows);
+		return E_UNEXPECTED;
+	}
+
+	if (SUCCEEDED(hr = SafeArrayAccessData(V_ARRAY(&vtRows), (void **) &pData)))
+	{
+		/* The first dimension varies fastest */
+		for (iRow = 0; iRow < cRows && SUCCEEDED(hr); iRow++)
+		{
+			hr = dhColumnsAddRow(pColumns, &iNewRow);
+
+			for (iField = 0; iField < cFields && SUCCEEDED(hr); iField++)
+			{
+				dhColumnsSetValue(pColumns, iField, iNewRow, &pData[iField + iRow * cFields]);
+			}
+		}
+
+		SafeArrayUnaccessData(V_ARRAY(&vtRows));
+	}
+
+	VariantClear(&vtRows);
+
+	dhColumnsComplete(pColumns);
+
+	*pbLastPage = (cRows < pReader->cPageSize);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * RecordsetWorkerThread:
+ *   Prefetches the next page each time the reader signals hRequest.
+ *
+ ============================================================================ */
+static DWORD WINAPI RecordsetWorkerThread(LPVOID lpParameter)
+{
+	PDH_RECORDSET_READER pReader = lpParameter;
+	IDispatch * pRecordset = NULL;
+	HRESULT hrInit, hrUnmarshal;
+
+	hrInit = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	hrUnmarshal = CoGetInterfaceAndReleaseStream(pReader->pStream, &IID_IDispatch, (void **) &pRecordset);
+	pReader->pStream = NULL;
+
+	while (WaitForSingleObject(pReader->hRequest, INFINITE) == WAIT_OBJECT_0 && !pReader->bStop)
+	{
+		if (SUCCEEDED(hrUnmarshal))
+			pReader->hrNext = FetchPage(pRecordset, pReader, pReader->rgPages[!pReader->iPage], &pReader->bNextLastPage);
+		else
+			pReader->hrNext = hrUnmarshal;
+
+		SetEvent(pReader->hReady);
+	}
+
+	SAFE_RELEASE(pRecordset);
+
+	dhUninitialize(SUCCEEDED(hrInit));
+
+	return 0;
+}
+
+
+
+/* **************************************************************************
+ * WaitForWorker:
+ *   Waits for the worker while still dispatching calls to this apartment, as
+ * the worker may be calling the recordset through a proxy to this thread.
+ *
+ ============================================================================ */
+static HRESULT WaitForWorker(HANDLE hEvent)
+{
+	DWORD dwIndex;
+
+	return CoWaitForMultipleHandles(0, INFINITE, 1, &hEvent, &dwIndex);
+}
+
+
+
+/* **************************************************************************
+ * CreateFieldList:
+ *   Creates the array of field names passed to GetRows.
+ *
+ ============================================================================ */
+static HRESULT CreateFieldList(PDH_COLUMNS pColumns, VARIANT * pvFields)
+{
+	SAFEARRAY * psa;
+	VARIANT vtName;
+	LONG iColumn;
+	HRESULT hr = NOERROR;
+
+	if (!(psa = SafeArrayCreateVector(VT_VARIANT, 0, pColumns->cColumns))) return E_OUTOFMEMORY;
+
+	for (iColumn = 0; iColumn < (LONG) pColumns->cColumns && SUCCEEDED(hr); iColumn++)
+	{
+		V_VT(&vtName)   = VT_BSTR;
+		V_BSTR(&vtName) = (BSTR) pColumns->rgColumns[iColumn].szName;
+
+		/* SafeArrayPutElement copies the string */
+		hr = SafeArrayPutElement(psa, &iColumn, &vtName);
+	}
+
+	if (FAILED(hr))
+	{
+		SafeArrayDestroy(psa);
+		return hr;
+	}
+
+	V_VT(pvFields)    = VT_ARRAY | VT_VARIANT;
+	V_ARRAY(pvFields) = psa;
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhRecordsetOpen:
+ *   This function creates a reader which streams the rows of an ADO recordset
+ * a page at a time. Each page is read with a single call to GetRows rather
+ * than several calls per row.
+ *
+ * Parameter Info:
+ *   pRecordset - An open ADO recordset. Reading starts at the current record.
+ *   szColumns  - The fields to read, in the same format as dhEnumProject.
+ *   cPageSize  - The number of rows requested by each call to GetRows.
+ * Zero selects the default of 1000.
+ *   bPrefetch  - If TRUE, the next page is read on a worker thread while
+ * the current page is processed.
+ *   ppReader   - Receives the reader, which must be freed with dhRecordsetClose.
+ *
+ * Notes:
+ *   The prefetch worker calls the recordset from the multi-threaded apartment.
+ * It only overlaps with the caller if the recordset can be called from there
+ * without a proxy to the caller's thread (for example, ADO registered as free
+ * threaded or a caller in the MTA). Otherwise the page is read while the
+ * caller waits for it.
+ *
+ ============================================================================ */
+HRESULT dhRecordsetOpen(IDispatch * pRecordset, LPCOLESTR szColumns, UINT cPageSize, BOOL bPrefetch, PDH_RECORDSET_READER * ppReader)
+{
+	PDH_RECORDSET_READER pReader;
+	HRESULT hr;
+
+	DH_ENTER(L"RecordsetOpen");
+
+	if (!pRecordset || !szColumns || !ppReader) return DH_EXIT(E_INVALIDARG, szColumns);
+
+	*ppReader = NULL;
+
+	pReader = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(struct tagDH_RECORDSET_READER));
+	if (!pReader) return DH_EXIT(E_OUTOFMEMORY, szColumns);
+
+	pReader->pRecordset = pRecordset;
+	pRecordset->lpVtbl->AddRef(pRecordset);
+
+	pReader->cPageSize = (cPageSize ? cPageSize : DH_DEFAULT_PAGE_SIZE);
+
+	hr = dhCreateColumns(szColumns, &pReader->rgPages[0]);
+
+	if (SUCCEEDED(hr)) hr = dhCreateColumns(szColumns, &pReader->rgPages[1]);
+
+	if (SUCCEEDED(hr)) hr = CreateFieldList(pReader->rgPages[0], &pReader->vtFields);
+
+	if (SUCCEEDED(hr) && bPrefetch)
+	{
+		pReader->hRequest = CreateEvent(NULL, FALSE, FALSE, NULL);
+		pReader->hReady   = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+		if (!pReader->hRequest || !pReader->hReady) hr = HRESULT_FROM_WIN32(GetLastError());
+
+		if (SUCCEEDED(hr)) hr = CoMarshalInterThreadInterfaceInStream(&IID_IDispatch, (IUnknown *) pRecordset, &pReader->pStream);
+
+		if (SUCCEEDED(hr))
+		{
+			pReader->hThread = CreateThread(NULL, 0, RecordsetWorkerThread, pReader, 0, NULL);
+
+			if (pReader->hThread)
+			{
+				/* Start reading the first page straight away */
+				pReader->bPending = TRUE;
+				SetEvent(pReader->hRequest);
+			}
+			else
+			{
+				hr = HRESULT_FROM_WIN32(GetLastError());
+				CoReleaseMarshalData(pReader->pStream);
+				pReader->pStream->lpVtbl->Release(pReader->pStream);
+				pReader->pStream = NULL;
+			}
+		}
+	}
+
+	if (FAILED(hr))
+	{
+		dhRecordsetClose(pReader);
+		return DH_EXIT(hr, szColumns);
+	}
+
+	*ppReader = pReader;
+
+	return DH_EXIT(NOERROR, szColumns);
+}
+
+
+
+/* **************************************************************************
+ * dhRecordsetRead:
+ *   This function moves the reader to the next row. It returns NOERROR if
+ * there is a row, S_FALSE at the end of the recordset or a failure code.
+ *
+ * Parameter Info:
+ *   pReader   - The reader returned by dhRecordsetOpen.
+ *   ppColumns - Receives the columns of the current page.
+ *   piRow     - Receives the index of the current row in the columns.
+ *
+ * Notes:
+ *   The columns and their strings are only valid until the next call to
+ * dhRecordsetRead or dhRecordsetClose.
+ *   Once the prefetch worker fails to read a page, each later call returns
+ * the same failure.
+ *
+ ============================================================================ */
+HRESULT dhRecordsetRead(PDH_RECORDSET_READER pReader, PDH_COLUMNS * ppColumns, UINT * piRow)
+{
+	HRESULT hr;
+
+	DH_ENTER(L"RecordsetRead");
+
+	if (!pReader || !ppColumns || !piRow) return DH_EXIT(E_INVALIDARG, NULL);
+
+	if (pReader->bStarted && pReader->iRow + 1 < pReader->rgPages[pReader->iPage]->cRows)
+	{
+		pReader->iRow++;
+	}
+	else
+	{
+		if (pReader->bLastPage) return DH_EXIT(S_FALSE, NULL);
+
+		/* No page is requested after a failed one, so do not wait again */
+		if (FAILED(pReader->hrFailed)) return DH_EXIT(pReader->hrFailed, NULL);
+
+		if (pReader->hThread)
+		{
+			hr = WaitForWorker(pReader->hReady);
+			pReader->bPending = FALSE;
+
+			if (SUCCEEDED(hr)) hr = pReader->hrNext;
+
+			if (FAILED(hr))
+			{
+				pReader->hrFailed = hr;
+				return DH_EXIT(hr, NULL);
+			}
+
+			pReader->iPage     = !pReader->iPage;
+			pReader->bLastPage = pReader->bNextLastPage;
+
+			if (!pReader->bLastPage)
+			{
+				pReader->bPending = TRUE;
+				SetEvent(pReader->hRequest);
+			}
+		}
+		else
+		{
+			hr = FetchPage(pReader->pRecordset, pReader, pReader->rgPages[pReader->iPage], &pReader->bLastPage);
+			if (FAILED(hr)) return DH_EXIT(hr, NULL);
+		}
+
+		pReader->iRow     = 0;
+		pReader->bStarted = TRUE;
+
+		if (pReader->rgPages[pReader->iPage]->cRows == 0)
+		{
+			pReader->bLastPage = TRUE;
+			return DH_EXIT(S_FALSE, NULL);
+		}
+	}
+
+	*ppColumns = pReader->rgPages[pReader->iPage];
+	*piRow     = pReader->iRow;
+
+	return DH_EXIT(NOERROR, NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhRecordsetClose:
+ *   This function stops the prefetch worker and frees a reader.
+ *
+ ============================================================================ */
+void dhRecordsetClose(PDH_RECORDSET_READER pReader)
+{
+	if (!pReader) return;
+
+	if (pReader->hThread)
+	{
+		/* Let an outstanding fetch complete before stopping the worker */
+		if (pReader->bPending) WaitForWorker(pReader->hReady);
+
+		InterlockedExchange((LONG *) &pReader->bStop, TRUE);
+		SetEvent(pReader->hRequest);
+
+		WaitForWorker(pReader->hThread);
+		CloseHandle(pReader->hThread);
+	}
+
+	if (pReader->hRequest) CloseHandle(pReader->hRequest);
+	if (pReader->hReady)   CloseHandle(pReader->hReady);
+
+	VariantClear(&pReader->vtFields);
+
+	dhFreeColumns(pReader->rgPages[0]);
+	dhFreeColumns(pReader->rgPages[1]);
+
+	SAFE_RELEASE(pReader->pRecordset);
+
+	HeapFree(GetProcessHeap(), 0, pReader);
+}
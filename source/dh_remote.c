@@ -0,0 +1,881 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define _WIN32_DCOM
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* How long a host is passed over after a creation on it failed */
+#define DH_REMOTE_RETRY_MS 30000
+
+/* Added to the latency of every host when comparing them, so that the load
+ * decides between hosts of similar latency */
+#define DH_REMOTE_LATENCY_BIAS_US 1000
+
+/* Structure to store a class factory of a host. The factory is kept in the
+ * global interface table so that any apartment can use it. */
+typedef struct tagDH_REMOTE_FACTORY
+{
+	struct tagDH_REMOTE_FACTORY * pNext;
+	LPWSTR szProgId;
+	CLSID clsid;
+	DWORD dwCookie;  /* Zero when only the CLSID is cached */
+} DH_REMOTE_FACTORY;
+
+/* Structure to store a host: its activation context, built once, and its load */
+typedef struct tagDH_REMOTE_HOST
+{
+	struct tagDH_REMOTE_HOST * pNext;
+	LONG cRefs;
+	LPWSTR szMachine;
+	DWORD dwClsContext;
+	UINT nWeight;
+	BOOL bBlanket;
+	COSERVERINFO serverInfo;
+	COAUTHINFO authInfo;
+	SEC_WINNT_AUTH_IDENTITY_W identity;
+	DH_REMOTE_FACTORY * pFactories;
+	UINT cActive;
+	ULONG cCreated;
+	ULONG cFailed;
+	ULONG cFactoryHits;
+	ULONG ulLatencyUs;
+	BOOL bMeasured;
+	BOOL bDown;
+	DWORD dwDownSince;
+	SIZE_T cbAlloc;
+} DH_REMOTE_HOST;
+
+/* Structure to record an object created on a host, until dhReleaseRemoteObject */
+typedef struct tagDH_REMOTE_OBJECT
+{
+	struct tagDH_REMOTE_OBJECT * pNext;
+	IDispatch * pDisp;
+	DH_REMOTE_HOST * pHost;
+} DH_REMOTE_OBJECT;
+
+static DH_REMOTE_HOST * f_pHosts;
+static DH_REMOTE_OBJECT * f_pObjects;
+static IGlobalInterfaceTable * f_pGIT;  /* Kept for the life of the process */
+static UINT f_cBlanketHosts;
+
+static CRITICAL_SECTION f_csRemote;
+static LONG f_lngRemoteInitBegin = -1, f_lngRemoteInitEnd = -1;
+
+#define CheckRemoteLockInitialized() if (f_lngRemoteInitEnd != 0) InitializeRemoteLock();
+
+
+
+/* **************************************************************************
+ * InitializeRemoteLock:
+ *   Initializes the critical section which protects the host registry.
+ *
+ ============================================================================ */
+static void InitializeRemoteLock(void)
+{
+	if (0 == InterlockedIncrement(&f_lngRemoteInitBegin))
+	{
+		InitializeCriticalSection(&f_csRemote);
+		f_lngRemoteInitEnd = 0;
+	}
+	else
+	{
+		/* Deal with extremely unlikely race condition */
+		while (f_lngRemoteInitEnd != 0) Sleep(5);
+	}
+}
+
+
+
+/* **************************************************************************
+ * GetMicroseconds:
+ *   Returns the performance counter in microseconds.
+ *
+ ============================================================================ */
+static ULONGLONG GetMicroseconds(void)
+{
+	LARGE_INTEGER liCount, liFrequency;
+
+	if (!QueryPerformanceFrequency(&liFrequency) || !QueryPerformanceCounter(&liCount)) return GetTickCount() * (ULONGLONG) 1000;
+
+	return (ULONGLONG) liCount.QuadPart * 1000000 / (ULONGLONG) liFrequency.QuadPart;
+}
+
+
+
+/* **************************************************************************
+ * CopyString:
+ *   Copies a string into the memory allocated with a host and advances the
+ * destination. Returns NULL for a NULL string.
+ *
+ ============================================================================ */
+static LPWSTR CopyString(LPWSTR * pszDest, LPCWSTR szSource, ULONG * pcch)
+{
+	LPWSTR szCopy = *pszDest;
+
+	*pcch = 0;
+
+	if (!szSource) return NULL;
+
+	*pcch = (ULONG) wcslen(szSource);
+	CopyMemory(szCopy, szSource, (*pcch + 1) * sizeof(WCHAR));
+	*pszDest += *pcch + 1;
+
+	return szCopy;
+}
+
+
+
+/* **************************************************************************
+ * FreeFactories:
+ *   Revokes a list of class factories from the global interface table and
+ * frees it. Must be called outside the lock, as revoking releases a proxy.
+ *
+ ============================================================================ */
+static void FreeFactories(DH_REMOTE_FACTORY * pFactory, IGlobalInterfaceTable * pGIT)
+{
+	DH_REMOTE_FACTORY * pNext;
+
+	for (; pFactory; pFactory = pNext)
+	{
+		pNext = pFactory->pNext;
+
+		if (pFactory->dwCookie && pGIT) pGIT->lpVtbl->RevokeInterfaceFromGlobal(pGIT, pFactory->dwCookie);
+
+		HeapFree(GetProcessHeap(), 0, pFactory->szProgId);
+		HeapFree(GetProcessHeap(), 0, pFactory);
+	}
+}
+
+
+
+/* **************************************************************************
+ * ReleaseHost:
+ *   Releases a reference on a host. A removed host is freed with its last
+ * reference, with any factory cached by a creation which was in progress
+ * when it was removed. The credentials are wiped before the memory is freed.
+ *
+ ============================================================================ */
+static void ReleaseHost(DH_REMOTE_HOST * pHost)
+{
+	if (InterlockedDecrement(&pHost->cRefs) == 0)
+	{
+		FreeFactories(pHost->pFactories, f_pGIT);
+		ZeroMemory(pHost, pHost->cbAlloc);
+		HeapFree(GetProcessHeap(), 0, pHost);
+	}
+}
+
+
+
+/* **************************************************************************
+ * SetBlanket:
+ *   Sets a host's security blanket on a proxy and on its IUnknown, which
+ * carries its reference counting calls. Objects which are not proxies, such
+ * as in-process objects, are left as they are.
+ *
+ ============================================================================ */
+static HRESULT SetBlanket(DH_REMOTE_HOST * pHost, IUnknown * pProxy)
+{
+	IUnknown * pUnk = NULL;
+	HRESULT hr;
+
+	if (!pHost->bBlanket) return NOERROR;
+
+	hr = CoSetProxyBlanket(pProxy, pHost->authInfo.dwAuthnSvc, pHost->authInfo.dwAuthzSvc, NULL,
+	                       pHost->authInfo.dwAuthnLevel, pHost->authInfo.dwImpersonationLevel,
+	                       &pHost->identity, EOAC_NONE);
+
+	if (SUCCEEDED(hr) && SUCCEEDED(pProxy->lpVtbl->QueryInterface(pProxy, &IID_IUnknown, (void **) &pUnk)))
+	{
+		CoSetProxyBlanket(pUnk, pHost->authInfo.dwAuthnSvc, pHost->authInfo.dwAuthzSvc, NULL,
+		                  pHost->authInfo.dwAuthnLevel, pHost->authInfo.dwImpersonationLevel,
+		                  &pHost->identity, EOAC_NONE);
+
+		pUnk->lpVtbl->Release(pUnk);
+	}
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * FindHost:
+ *   Finds a host by name. Must be called with the lock held.
+ *
+ ============================================================================ */
+static DH_REMOTE_HOST * FindHost(LPCWSTR szMachine)
+{
+	DH_REMOTE_HOST * pHost;
+
+	for (pHost = f_pHosts; pHost; pHost = pHost->pNext)
+	{
+		if (lstrcmpiW(pHost->szMachine, szMachine) == 0) return pHost;
+	}
+
+	return NULL;
+}
+
+
+
+/* **************************************************************************
+ * PickHost:
+ *   Picks the host for a creation: the named host or, with szMachine NULL,
+ * the available host with the lowest load weighted by its latency. Hosts
+ * are passed over for a while after a failure unless all of them failed.
+ *   The picked host is referenced and its load incremented.
+ *
+ ============================================================================ */
+static DH_REMOTE_HOST * PickHost(LPCWSTR szMachine)
+{
+	DH_REMOTE_HOST * pHost, * pBest = NULL;
+	ULONGLONG ullScore, ullBest = 0;
+	BOOL bAvailable, bBestAvailable = FALSE;
+	DWORD dwNow = GetTickCount();
+
+	EnterCriticalSection(&f_csRemote);
+
+	if (szMachine)
+	{
+		pBest = FindHost(szMachine);
+	}
+	else
+	{
+		for (pHost = f_pHosts; pHost; pHost = pHost->pNext)
+		{
+			bAvailable = (!pHost->bDown || dwNow - pHost->dwDownSince >= DH_REMOTE_RETRY_MS);
+
+			ullScore = (ULONGLONG) (pHost->cActive + 1) * (pHost->ulLatencyUs + DH_REMOTE_LATENCY_BIAS_US) * 1000 / pHost->nWeight;
+
+			if (!pBest || (bAvailable && !bBestAvailable) ||
+			    (bAvailable == bBestAvailable && ullScore < ullBest))
+			{
+				pBest          = pHost;
+				ullBest        = ullScore;
+				bBestAvailable = bAvailable;
+			}
+		}
+	}
+
+	if (pBest)
+	{
+		pBest->cActive++;
+		InterlockedIncrement(&pBest->cRefs);
+	}
+
+	LeaveCriticalSection(&f_csRemote);
+
+	return pBest;
+}
+
+
+
+/* **************************************************************************
+ * GetHostFactory:
+ *   Gets a host's class factory for a ProgID from the host's cache or, the
+ * first time or with bUseCache FALSE, from the host with the host's
+ * activation context, and sets the host's blanket on it.
+ *
+ ============================================================================ */
+static HRESULT GetHostFactory(DH_REMOTE_HOST * pHost, LPCOLESTR szProgId, BOOL bUseCache, IClassFactory ** ppCf, BOOL * pbCached)
+{
+	DH_REMOTE_FACTORY * pFactory, ** ppLink, * pNew = NULL, * pStale = NULL;
+	IGlobalInterfaceTable * pGIT;
+	CLSID clsid;
+	DWORD dwCookie = 0;
+	BOOL bHaveClsid = FALSE;
+	SIZE_T cb;
+	HRESULT hr = NOERROR;
+
+	*ppCf = NULL;
+	*pbCached = FALSE;
+
+	EnterCriticalSection(&f_csRemote);
+
+	if ((pGIT = f_pGIT) != NULL) pGIT->lpVtbl->AddRef(pGIT);
+
+	for (pFactory = pHost->pFactories; pFactory; pFactory = pFactory->pNext)
+	{
+		if (lstrcmpiW(pFactory->szProgId, szProgId) == 0)
+		{
+			clsid      = pFactory->clsid;
+			dwCookie   = (bUseCache ? pFactory->dwCookie : 0);
+			bHaveClsid = TRUE;
+			break;
+		}
+	}
+
+	LeaveCriticalSection(&f_csRemote);
+
+	if (dwCookie && pGIT)
+	{
+		hr = pGIT->lpVtbl->GetInterfaceFromGlobal(pGIT, dwCookie, &IID_IClassFactory, (void **) ppCf);
+
+		if (SUCCEEDED(hr))
+		{
+			/* A proxy unmarshalled in another apartment has the default blanket */
+			SetBlanket(pHost, (IUnknown *) *ppCf);
+			*pbCached = TRUE;
+			pGIT->lpVtbl->Release(pGIT);
+			return NOERROR;
+		}
+
+		/* The cached factory is gone, forget it but keep the CLSID */
+		EnterCriticalSection(&f_csRemote);
+
+		for (pFactory = pHost->pFactories; pFactory; pFactory = pFactory->pNext)
+		{
+			if (pFactory->dwCookie == dwCookie)
+			{
+				pFactory->dwCookie = 0;
+				break;
+			}
+		}
+
+		LeaveCriticalSection(&f_csRemote);
+
+		if (pFactory) pGIT->lpVtbl->RevokeInterfaceFromGlobal(pGIT, dwCookie);
+	}
+
+	if (!bHaveClsid)
+	{
+		if (L'{' == szProgId[0])
+			hr = CLSIDFromString((LPOLESTR) szProgId, &clsid);
+		else
+			hr = CLSIDFromProgID(szProgId, &clsid);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = CoGetClassObject(&clsid, pHost->dwClsContext,
+		                      (pHost->dwClsContext & CLSCTX_REMOTE_SERVER) ? &pHost->serverInfo : NULL,
+		                      &IID_IClassFactory, (void **) ppCf);
+	}
+
+	if (SUCCEEDED(hr)) SetBlanket(pHost, (IUnknown *) *ppCf);
+
+	/* Cache the factory, or at least the CLSID, for the next creation */
+	if (SUCCEEDED(hr) && (pNew = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_REMOTE_FACTORY))) != NULL)
+	{
+		cb = (wcslen(szProgId) + 1) * sizeof(WCHAR);
+
+		if ((pNew->szProgId = HeapAlloc(GetProcessHeap(), 0, cb)) != NULL)
+		{
+			CopyMemory(pNew->szProgId, szProgId, cb);
+			pNew->clsid = clsid;
+
+			if (pGIT) pGIT->lpVtbl->RegisterInterfaceInGlobal(pGIT, (IUnknown *) *ppCf, &IID_IClassFactory, &pNew->dwCookie);
+
+			EnterCriticalSection(&f_csRemote);
+
+			for (ppLink = &pHost->pFactories; *ppLink; ppLink = &(*ppLink)->pNext)
+			{
+				if (lstrcmpiW((*ppLink)->szProgId, szProgId) == 0)
+				{
+					/* Replace the previous entry */
+					pStale = *ppLink;
+					*ppLink = pStale->pNext;
+					pStale->pNext = NULL;
+					break;
+				}
+			}
+
+			pNew->pNext = pHost->pFactories;
+			pHost->pFactories = pNew;
+
+			LeaveCriticalSection(&f_csRemote);
+
+			FreeFactories(pStale, pGIT);
+		}
+		else
+		{
+			HeapFree(GetProcessHeap(), 0, pNew);
+		}
+	}
+
+	if (pGIT) pGIT->lpVtbl->Release(pGIT);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * CreateOnHost:
+ *   Creates an object on a host and records the creation's latency.
+ *
+ ============================================================================ */
+static HRESULT CreateOnHost(DH_REMOTE_HOST * pHost, LPCOLESTR szProgId, IDispatch ** ppDisp)
+{
+	IClassFactory * pCf = NULL;
+	ULONGLONG ullStart = GetMicroseconds();
+	ULONG ulLatencyUs;
+	BOOL bCached;
+	HRESULT hr;
+
+	hr = GetHostFactory(pHost, szProgId, TRUE, &pCf, &bCached);
+
+	if (SUCCEEDED(hr)) hr = pCf->lpVtbl->CreateInstance(pCf, NULL, &IID_IDispatch, (void **) ppDisp);
+
+	if (pCf) pCf->lpVtbl->Release(pCf);
+
+	if (FAILED(hr) && bCached)
+	{
+		/* The server may have restarted, get a new factory once */
+		pCf = NULL;
+		hr = GetHostFactory(pHost, szProgId, FALSE, &pCf, &bCached);
+
+		if (SUCCEEDED(hr)) hr = pCf->lpVtbl->CreateInstance(pCf, NULL, &IID_IDispatch, (void **) ppDisp);
+
+		if (pCf) pCf->lpVtbl->Release(pCf);
+	}
+
+	if (SUCCEEDED(hr)) SetBlanket(pHost, (IUnknown *) *ppDisp);
+
+	ulLatencyUs = (ULONG) (GetMicroseconds() - ullStart);
+
+	EnterCriticalSection(&f_csRemote);
+
+	if (SUCCEEDED(hr))
+	{
+		pHost->cCreated++;
+		if (bCached) pHost->cFactoryHits++;
+		pHost->bDown = FALSE;
+
+		/* Smooth the latency over the last creations */
+		pHost->ulLatencyUs = (pHost->bMeasured ? (ULONG) (((ULONGLONG) pHost->ulLatencyUs * 7 + ulLatencyUs) / 8) : ulLatencyUs);
+		pHost->bMeasured = TRUE;
+	}
+	else
+	{
+		pHost->cFailed++;
+		pHost->bDown = TRUE;
+		pHost->dwDownSince = GetTickCount();
+	}
+
+	LeaveCriticalSection(&f_csRemote);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * SubObjectHook:
+ *   Installed as dh_g_pfnSubObjectHook while a host has credentials, so
+ * that the objects reached through a member string keep their parent's
+ * blanket.
+ *
+ ============================================================================ */
+static void SubObjectHook(IDispatch * pParent, IDispatch * pSubObject)
+{
+	dhCopyRemoteBlanket(pParent, pSubObject);
+}
+
+
+
+/* **************************************************************************
+ * dhAddRemoteHost:
+ *   This function adds a host to the remote host registry. Its activation
+ * context and security blanket are built once and reused by every object
+ * created on it with dhCreateRemoteObject.
+ *
+ * Parameter Info:
+ *   pOptions - The host's options:
+ *     szMachine    - The host's name.
+ *     szUser       - The user name of alternate credentials or NULL to use
+ * the caller's identity. szPassword and szDomain complete the credentials.
+ *     dwAuthnLevel - The RPC_C_AUTHN_LEVEL_* used with the credentials or
+ * zero for RPC_C_AUTHN_LEVEL_CONNECT.
+ *     dwImpLevel   - The RPC_C_IMP_LEVEL_* used with the credentials or
+ * zero for RPC_C_IMP_LEVEL_IMPERSONATE.
+ *     dwClsContext - Zero for CLSCTX_REMOTE_SERVER. Without
+ * CLSCTX_REMOTE_SERVER, szMachine is only a label and objects are created
+ * on this computer, so that local servers can stand in for remote hosts.
+ *     nWeight      - The host's relative capacity or zero for one.
+ *
+ ============================================================================ */
+HRESULT dhAddRemoteHost(PDH_REMOTE_HOST_OPTIONS pOptions)
+{
+	DH_REMOTE_HOST * pHost;
+	IGlobalInterfaceTable * pGIT = NULL;
+	LPWSTR szNext;
+	ULONG cch;
+	SIZE_T cb;
+	HRESULT hr = NOERROR;
+
+	DH_ENTER(L"AddRemoteHost");
+
+	if (!pOptions || !pOptions->szMachine) return DH_EXIT(E_INVALIDARG, L"AddRemoteHost");
+
+	cb = sizeof(DH_REMOTE_HOST) + (wcslen(pOptions->szMachine) + 1) * sizeof(WCHAR);
+	if (pOptions->szUser)     cb += (wcslen(pOptions->szUser) + 1) * sizeof(WCHAR);
+	if (pOptions->szPassword) cb += (wcslen(pOptions->szPassword) + 1) * sizeof(WCHAR);
+	if (pOptions->szDomain)   cb += (wcslen(pOptions->szDomain) + 1) * sizeof(WCHAR);
+
+	pHost = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, cb);
+	if (!pHost) return DH_EXIT(E_OUTOFMEMORY, L"AddRemoteHost");
+
+	pHost->cbAlloc      = cb;
+	pHost->cRefs        = 1;
+	pHost->dwClsContext = (pOptions->dwClsContext ? pOptions->dwClsContext : CLSCTX_REMOTE_SERVER);
+	pHost->nWeight      = (pOptions->nWeight ? pOptions->nWeight : 1);
+
+	szNext = (LPWSTR) (pHost + 1);
+	pHost->szMachine = CopyString(&szNext, pOptions->szMachine, &cch);
+	pHost->serverInfo.pwszName = pHost->szMachine;
+
+	if (pOptions->szUser)
+	{
+		pHost->identity.Flags    = SEC_WINNT_AUTH_IDENTITY_UNICODE;
+		pHost->identity.User     = (unsigned short *) CopyString(&szNext, pOptions->szUser, &pHost->identity.UserLength);
+		pHost->identity.Password = (unsigned short *) CopyString(&szNext, pOptions->szPassword, &pHost->identity.PasswordLength);
+		pHost->identity.Domain   = (unsigned short *) CopyString(&szNext, pOptions->szDomain, &pHost->identity.DomainLength);
+
+		pHost->authInfo.dwAuthnSvc           = RPC_C_AUTHN_WINNT;
+		pHost->authInfo.dwAuthzSvc           = RPC_C_AUTHZ_NONE;
+		pHost->authInfo.dwAuthnLevel         = (pOptions->dwAuthnLevel ? pOptions->dwAuthnLevel : RPC_C_AUTHN_LEVEL_CONNECT);
+		pHost->authInfo.dwImpersonationLevel = (pOptions->dwImpLevel ? pOptions->dwImpLevel : RPC_C_IMP_LEVEL_IMPERSONATE);
+		pHost->authInfo.dwCapabilities       = EOAC_NONE;
+
+		/* Older MinGW headers declare this member as AUTH_IDENTITY instead of COAUTHIDENTITY */
+		pHost->authInfo.pAuthIdentityData = (void *) &pHost->identity;
+
+		pHost->serverInfo.pAuthInfo = &pHost->authInfo;
+		pHost->bBlanket = TRUE;
+	}
+
+	CheckRemoteLockInitialized();
+
+	/* The global interface table is free threaded, so one pointer serves every apartment */
+	EnterCriticalSection(&f_csRemote);
+	if (!f_pGIT)
+	{
+		LeaveCriticalSection(&f_csRemote);
+
+		hr = CoCreateInstance(&CLSID_StdGlobalInterfaceTable, NULL, CLSCTX_INPROC_SERVER,
+		                      &IID_IGlobalInterfaceTable, (void **) &pGIT);
+
+		EnterCriticalSection(&f_csRemote);
+
+		if (SUCCEEDED(hr) && !f_pGIT)
+		{
+			f_pGIT = pGIT;
+			pGIT = NULL;
+		}
+	}
+
+	if (SUCCEEDED(hr) && FindHost(pHost->szMachine)) hr = HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+
+	if (SUCCEEDED(hr))
+	{
+		pHost->pNext = f_pHosts;
+		f_pHosts = pHost;
+
+		if (pHost->bBlanket && f_cBlanketHosts++ == 0) dh_g_pfnSubObjectHook = SubObjectHook;
+	}
+
+	LeaveCriticalSection(&f_csRemote);
+
+	if (pGIT) pGIT->lpVtbl->Release(pGIT);
+
+	if (FAILED(hr)) ReleaseHost(pHost);
+
+	return DH_EXIT(hr, L"AddRemoteHost");
+}
+
+
+
+/* **************************************************************************
+ * dhRemoveRemoteHost:
+ *   This function removes a host, or all hosts with szMachine NULL, and
+ * releases the class factories cached for it.
+ *
+ * Notes:
+ *   The objects created on a host use its credentials. They, and the sub
+ * objects obtained from them, must be released before the host is removed.
+ *
+ ============================================================================ */
+HRESULT dhRemoveRemoteHost(LPCWSTR szMachine)
+{
+	DH_REMOTE_HOST * pRemoved = NULL, ** ppLink, * pHost;
+	DH_REMOTE_FACTORY * pFactories;
+	IGlobalInterfaceTable * pGIT = NULL;
+
+	DH_ENTER(L"RemoveRemoteHost");
+
+	CheckRemoteLockInitialized();
+
+	EnterCriticalSection(&f_csRemote);
+
+	for (ppLink = &f_pHosts; *ppLink; )
+	{
+		pHost = *ppLink;
+
+		if (!szMachine || lstrcmpiW(pHost->szMachine, szMachine) == 0)
+		{
+			*ppLink = pHost->pNext;
+			pHost->pNext = pRemoved;
+			pRemoved = pHost;
+
+			if (pHost->bBlanket && --f_cBlanketHosts == 0) dh_g_pfnSubObjectHook = NULL;
+		}
+		else
+		{
+			ppLink = &pHost->pNext;
+		}
+	}
+
+	if ((pGIT = f_pGIT) != NULL) pGIT->lpVtbl->AddRef(pGIT);
+
+	LeaveCriticalSection(&f_csRemote);
+
+	if (szMachine && !pRemoved)
+	{
+		if (pGIT) pGIT->lpVtbl->Release(pGIT);
+		return DH_EXIT(HRESULT_FROM_WIN32(ERROR_NOT_FOUND), L"RemoveRemoteHost");
+	}
+
+	while ((pHost = pRemoved) != NULL)
+	{
+		pRemoved = pHost->pNext;
+
+		EnterCriticalSection(&f_csRemote);
+		pFactories = pHost->pFactories;
+		pHost->pFactories = NULL;
+		LeaveCriticalSection(&f_csRemote);
+
+		FreeFactories(pFactories, pGIT);
+		ReleaseHost(pHost);
+	}
+
+	if (pGIT) pGIT->lpVtbl->Release(pGIT);
+
+	return DH_EXIT(NOERROR, L"RemoveRemoteHost");
+}
+
+
+
+/* **************************************************************************
+ * dhCreateRemoteObject:
+ *   This function creates an object on a registered host.
+ *
+ * Parameter Info:
+ *   szProgId  - The ProgID or the CLSID string of the object to create.
+ *   szMachine - The host or NULL to let the registry pick the host with the
+ * lowest load, weighted by its creation latency.
+ *   ppDisp    - Receives the object, with the host's security blanket set.
+ *
+ * Notes:
+ *   A host's load counts its creations in progress and the objects created
+ * on it which have not been released with dhReleaseRemoteObject.
+ *   When the registry picks the host and a creation fails, the host is
+ * passed over for 30 seconds and the creation is retried on another host.
+ *
+ ============================================================================ */
+HRESULT dhCreateRemoteObject(LPCOLESTR szProgId, LPCWSTR szMachine, IDispatch ** ppDisp)
+{
+	DH_REMOTE_HOST * pHost;
+	DH_REMOTE_OBJECT * pObject;
+	UINT cAttempts = 0, cHosts = 1;
+	HRESULT hr = HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+
+	DH_ENTER(L"CreateRemoteObject");
+
+	if (!szProgId || !ppDisp) return DH_EXIT(E_INVALIDARG, szProgId);
+
+	*ppDisp = NULL;
+
+	CheckRemoteLockInitialized();
+
+	if (!szMachine)
+	{
+		EnterCriticalSection(&f_csRemote);
+		for (cHosts = 0, pHost = f_pHosts; pHost; pHost = pHost->pNext) cHosts++;
+		LeaveCriticalSection(&f_csRemote);
+	}
+
+	while (FAILED(hr) && cAttempts++ < cHosts && (pHost = PickHost(szMachine)) != NULL)
+	{
+		hr = CreateOnHost(pHost, szProgId, ppDisp);
+
+		pObject = NULL;
+
+		if (SUCCEEDED(hr) && !(pObject = HeapAlloc(GetProcessHeap(), 0, sizeof(DH_REMOTE_OBJECT))))
+		{
+			(*ppDisp)->lpVtbl->Release(*ppDisp);
+			*ppDisp = NULL;
+			hr = E_OUTOFMEMORY;
+		}
+
+		EnterCriticalSection(&f_csRemote);
+
+		if (pObject)
+		{
+			/* The object keeps the host's load and reference until dhReleaseRemoteObject */
+			pObject->pDisp  = *ppDisp;
+			pObject->pHost  = pHost;
+			pObject->pNext  = f_pObjects;
+			f_pObjects      = pObject;
+		}
+		else
+		{
+			pHost->cActive--;
+		}
+
+		LeaveCriticalSection(&f_csRemote);
+
+		if (!pObject) ReleaseHost(pHost);
+	}
+
+	return DH_EXIT(hr, szProgId);
+}
+
+
+
+/* **************************************************************************
+ * dhReleaseRemoteObject:
+ *   This function releases an object created by dhCreateRemoteObject and
+ * removes it from its host's load.
+ *
+ ============================================================================ */
+HRESULT dhReleaseRemoteObject(IDispatch * pDisp)
+{
+	DH_REMOTE_OBJECT * pObject = NULL, ** ppLink;
+	DH_REMOTE_HOST * pHost = NULL;
+
+	DH_ENTER(L"ReleaseRemoteObject");
+
+	if (!pDisp) return DH_EXIT(E_INVALIDARG, L"ReleaseRemoteObject");
+
+	CheckRemoteLockInitialized();
+
+	EnterCriticalSection(&f_csRemote);
+
+	for (ppLink = &f_pObjects; *ppLink; ppLink = &(*ppLink)->pNext)
+	{
+		if ((*ppLink)->pDisp == pDisp)
+		{
+			pObject = *ppLink;
+			*ppLink = pObject->pNext;
+			pHost = pObject->pHost;
+			pHost->cActive--;
+			break;
+		}
+	}
+
+	LeaveCriticalSection(&f_csRemote);
+
+	pDisp->lpVtbl->Release(pDisp);
+
+	if (pObject)
+	{
+		ReleaseHost(pHost);
+		HeapFree(GetProcessHeap(), 0, pObject);
+	}
+
+	return DH_EXIT(NOERROR, L"ReleaseRemoteObject");
+}
+
+
+
+/* **************************************************************************
+ * dhCopyRemoteBlanket:
+ *   This function sets the security blanket of the host an object was
+ * created on to another object obtained from it. Sub objects reached in a
+ * member string, such as L".Workbooks.Open(%s)", get it automatically; this
+ * function is needed for objects returned with %o or in a VARIANT.
+ *
+ * Notes:
+ *   Returns S_FALSE, and leaves pTo as it is, when pFrom does not use the
+ * credentials of a registered host.
+ *
+ ============================================================================ */
+HRESULT dhCopyRemoteBlanket(IDispatch * pFrom, IDispatch * pTo)
+{
+	DH_REMOTE_HOST * pHost = NULL;
+	void * pAuthInfo = NULL;
+	HRESULT hr;
+
+	if (!pFrom || !pTo) return E_INVALIDARG;
+
+	/* The identity set on a proxy identifies its host */
+	hr = CoQueryProxyBlanket((IUnknown *) pFrom, NULL, NULL, NULL, NULL, NULL, &pAuthInfo, NULL);
+	if (FAILED(hr) || !pAuthInfo) return S_FALSE;
+
+	CheckRemoteLockInitialized();
+
+	EnterCriticalSection(&f_csRemote);
+
+	for (pHost = f_pHosts; pHost; pHost = pHost->pNext)
+	{
+		if (pAuthInfo == (void *) &pHost->identity)
+		{
+			InterlockedIncrement(&pHost->cRefs);
+			break;
+		}
+	}
+
+	LeaveCriticalSection(&f_csRemote);
+
+	if (!pHost) return S_FALSE;
+
+	hr = SetBlanket(pHost, (IUnknown *) pTo);
+
+	ReleaseHost(pHost);
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhGetRemoteHostStatistics:
+ *   This function gets the load, latency and counters of a host.
+ *
+ ============================================================================ */
+HRESULT dhGetRemoteHostStatistics(LPCWSTR szMachine, PDH_REMOTE_HOST_STATISTICS pStatistics)
+{
+	DH_REMOTE_HOST * pHost;
+
+	if (!szMachine || !pStatistics) return E_INVALIDARG;
+
+	CheckRemoteLockInitialized();
+
+	EnterCriticalSection(&f_csRemote);
+
+	if ((pHost = FindHost(szMachine)) != NULL)
+	{
+		pStatistics->cActive      = pHost->cActive;
+		pStatistics->cCreated     = pHost->cCreated;
+		pStatistics->cFailed      = pHost->cFailed;
+		pStatistics->cFactoryHits = pHost->cFactoryHits;
+		pStatistics->ulLatencyUs  = pHost->ulLatencyUs;
+		pStatistics->bAvailable   = (!pHost->bDown || GetTickCount() - pHost->dwDownSince >= DH_REMOTE_RETRY_MS);
+	}
+
+	LeaveCriticalSection(&f_csRemote);
+
+	return (pHost ? NOERROR : HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+}
@@ -0,0 +1,781 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* Default time a call waits before it is raised by one priority class */
+#define DH_SCHEDULER_DEFAULT_AGING 1000
+
+/* Number of server objects a thread keeps before the objects nobody else
+ * holds are dropped */
+#define DH_SCHEDULER_MIN_SWEEP 64
+
+/* Upper bounds, in microseconds, of the call latency histogram buckets */
+static const ULONG f_rgSchedulerHistogramBounds[DH_SCHEDULER_HISTOGRAM_BUCKETS - 1] = { 1000, 10000, 100000, 1000000 };
+
+/* Structure to store a thread attached to a scheduler. While the thread
+ * waits for its turn it is linked in the queue of its priority class.
+ * rgSlots holds the thread's objects of the server (open addressing), by
+ * identity and with a reference on each so that an address is not reused
+ * while the object is known. */
+typedef struct tagDH_SCHEDULER_THREAD
+{
+	struct tagDH_SCHEDULER_THREAD * pNext;
+	PDH_SCHEDULER pScheduler;
+	int nPriority;
+	HANDLE hTurn;
+	UINT cDepth;
+	DWORD dwQueued;
+	LARGE_INTEGER liQueued;
+	ULONG ulWaitUs;
+
+	UINT cObjects;
+	UINT cSlots;
+	UINT cSweepAt;
+	IUnknown ** rgSlots;
+} DH_SCHEDULER_THREAD;
+
+/* Structure to store the waiting calls of a priority class, oldest first */
+typedef struct tagDH_SCHEDULER_QUEUE
+{
+	DH_SCHEDULER_THREAD * pHead;
+	DH_SCHEDULER_THREAD * pTail;
+} DH_SCHEDULER_QUEUE;
+
+/* Structure to store a scheduler */
+struct tagDH_SCHEDULER
+{
+	CRITICAL_SECTION cs;
+	LONG cRefs;
+	DH_SCHEDULER_OPTIONS options;
+
+	UINT cRunning;
+	int nLastPriority;
+	UINT cInRow;
+	DH_SCHEDULER_QUEUE rgQueues[DH_PRIORITY_CLASSES];
+
+	DH_SCHEDULER_STATISTICS rgStats[DH_PRIORITY_CLASSES];
+};
+
+/* The interceptor is installed while any scheduler exists */
+static CRITICAL_SECTION f_csSchedulers;
+static UINT f_cSchedulers = 0;
+static DWORD f_dwSchedulerInterceptor = 0;
+
+static LONG  f_lngSchedulerInitBegin = -1, f_lngSchedulerInitEnd = -1;
+static DWORD f_TlsIdxScheduler;
+
+#define GetSchedulerThread()          ((DH_SCHEDULER_THREAD *) TlsGetValue(f_TlsIdxScheduler))
+#define SetSchedulerThread(pThread)   TlsSetValue(f_TlsIdxScheduler, pThread)
+#define CheckSchedulerInitialized()   if (f_lngSchedulerInitEnd != 0) InitializeSchedulers();
+
+
+
+/* **************************************************************************
+ * InitializeSchedulers:
+ *   Initializes the Tls index used to store each thread's scheduler and
+ * the critical section which protects the interceptor.
+ *
+ ============================================================================ */
+static void InitializeSchedulers(void)
+{
+	if (0 == InterlockedIncrement(&f_lngSchedulerInitBegin))
+	{
+		f_TlsIdxScheduler = TlsAlloc();
+		InitializeCriticalSection(&f_csSchedulers);
+		f_lngSchedulerInitEnd = 0;
+	}
+	else
+	{
+		/* Deal with extremely unlikely race condition */
+		while (f_lngSchedulerInitEnd != 0) Sleep(5);
+	}
+}
+
+
+
+/* **************************************************************************
+ * ElapsedMicroseconds:
+ *   Returns the time elapsed since a performance counter value.
+ *
+ ============================================================================ */
+static ULONG ElapsedMicroseconds(LARGE_INTEGER * pliStart)
+{
+	LARGE_INTEGER liNow, liFrequency;
+
+	if (!QueryPerformanceFrequency(&liFrequency) || !liFrequency.QuadPart) return 0;
+
+	QueryPerformanceCounter(&liNow);
+
+	return (ULONG) ((liNow.QuadPart - pliStart->QuadPart) * 1000000 / liFrequency.QuadPart);
+}
+
+
+
+/* **************************************************************************
+ * FindObjectSlot:
+ *   Returns the slot holding an object in a thread's table of server
+ * objects, or the empty slot where it should be inserted. The table must
+ * have slots.
+ *
+ ============================================================================ */
+static IUnknown ** FindObjectSlot(DH_SCHEDULER_THREAD * pThread, IUnknown * pIdentity)
+{
+	UINT iSlot = (UINT) (((ULONG_PTR) pIdentity >> 3) * 2654435761UL) & (pThread->cSlots - 1);
+
+	while (pThread->rgSlots[iSlot] && pThread->rgSlots[iSlot] != pIdentity)
+	{
+		iSlot = (iSlot + 1) & (pThread->cSlots - 1);
+	}
+
+	return &pThread->rgSlots[iSlot];
+}
+
+
+
+/* **************************************************************************
+ * RebuildObjects:
+ *   Moves a thread's server objects to a new table of cSlots slots, leaving
+ * out those that have been dropped from the old one.
+ *
+ ============================================================================ */
+static BOOL RebuildObjects(DH_SCHEDULER_THREAD * pThread, UINT cSlots)
+{
+	IUnknown ** rgOld = pThread->rgSlots;
+	UINT cOld = pThread->cSlots, iSlot;
+
+	if (!(pThread->rgSlots = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, cSlots * sizeof(IUnknown *))))
+	{
+		pThread->rgSlots = rgOld;
+		return FALSE;
+	}
+
+	pThread->cSlots = cSlots;
+
+	for (iSlot = 0; iSlot < cOld; iSlot++)
+	{
+		if (rgOld[iSlot]) *FindObjectSlot(pThread, rgOld[iSlot]) = rgOld[iSlot];
+	}
+
+	if (rgOld) HeapFree(GetProcessHeap(), 0, rgOld);
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * SweepObjects:
+ *   Drops the server objects which the thread's table is the last to hold,
+ * such as the ranges of a loop which have since been released.
+ *
+ ============================================================================ */
+static void SweepObjects(DH_SCHEDULER_THREAD * pThread)
+{
+	IUnknown * pIdentity;
+	UINT iSlot;
+
+	for (iSlot = 0; iSlot < pThread->cSlots; iSlot++)
+	{
+		if (!(pIdentity = pThread->rgSlots[iSlot])) continue;
+
+		/* Holding our reference, nobody can release the object meanwhile */
+		pIdentity->lpVtbl->AddRef(pIdentity);
+
+		if (pIdentity->lpVtbl->Release(pIdentity) == 1)
+		{
+			pIdentity->lpVtbl->Release(pIdentity);
+			pThread->rgSlots[iSlot] = NULL;
+			pThread->cObjects--;
+		}
+	}
+
+	/* Dropped slots would break the probe sequences of those after them */
+	if (pThread->cSlots) RebuildObjects(pThread, pThread->cSlots);
+
+	pThread->cSweepAt = pThread->cObjects * 2;
+	if (pThread->cSweepAt < DH_SCHEDULER_MIN_SWEEP) pThread->cSweepAt = DH_SCHEDULER_MIN_SWEEP;
+}
+
+
+
+/* **************************************************************************
+ * AddObject:
+ *   Adds an object to a thread's server objects, taking over the caller's
+ * reference on its IUnknown. The table is swept once it has doubled since
+ * the last sweep, and grown to keep its load factor under 3/4.
+ *
+ ============================================================================ */
+static BOOL AddObject(DH_SCHEDULER_THREAD * pThread, IUnknown * pIdentity)
+{
+	IUnknown ** pSlot;
+
+	if (pThread->cSlots && *(pSlot = FindObjectSlot(pThread, pIdentity)))
+	{
+		pIdentity->lpVtbl->Release(pIdentity);
+		return TRUE;
+	}
+
+	if (pThread->cObjects >= pThread->cSweepAt) SweepObjects(pThread);
+
+	if ((pThread->cObjects + 1) * 4 >= pThread->cSlots * 3 &&
+	    !RebuildObjects(pThread, pThread->cSlots ? pThread->cSlots * 2 : DH_SCHEDULER_MIN_SWEEP * 2))
+	{
+		pIdentity->lpVtbl->Release(pIdentity);
+		return FALSE;
+	}
+
+	*FindObjectSlot(pThread, pIdentity) = pIdentity;
+	pThread->cObjects++;
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * IsServerObject:
+ *   Checks whether an object is one of the thread's server objects.
+ *
+ ============================================================================ */
+static BOOL IsServerObject(DH_SCHEDULER_THREAD * pThread, IDispatch * pDisp)
+{
+	IUnknown * pIdentity;
+	BOOL bFound;
+
+	if (pThread->cObjects == 0) return FALSE;
+
+	if (FAILED(pDisp->lpVtbl->QueryInterface(pDisp, &IID_IUnknown, (void **) &pIdentity))) return FALSE;
+
+	bFound = (*FindObjectSlot(pThread, pIdentity) != NULL);
+
+	pIdentity->lpVtbl->Release(pIdentity);
+
+	return bFound;
+}
+
+
+
+/* **************************************************************************
+ * FreeObjects:
+ *   Releases all of a thread's server objects.
+ *
+ ============================================================================ */
+static void FreeObjects(DH_SCHEDULER_THREAD * pThread)
+{
+	UINT iSlot;
+
+	for (iSlot = 0; iSlot < pThread->cSlots; iSlot++)
+	{
+		if (pThread->rgSlots[iSlot]) pThread->rgSlots[iSlot]->lpVtbl->Release(pThread->rgSlots[iSlot]);
+	}
+
+	if (pThread->rgSlots) HeapFree(GetProcessHeap(), 0, pThread->rgSlots);
+
+	pThread->rgSlots  = NULL;
+	pThread->cSlots   = 0;
+	pThread->cObjects = 0;
+	pThread->cSweepAt = DH_SCHEDULER_MIN_SWEEP;
+}
+
+
+
+/* **************************************************************************
+ * AdmitNext:
+ *   Takes the next call off the queues, or returns NULL if none is waiting.
+ * The most urgent class goes first, where each aging period a call has
+ * waited raises it by one class. A class which has had its batch of calls
+ * in a row gives way to any other waiting class. The scheduler must be
+ * locked.
+ *
+ ============================================================================ */
+static DH_SCHEDULER_THREAD * AdmitNext(PDH_SCHEDULER pScheduler)
+{
+	DH_SCHEDULER_THREAD * pThread;
+	DWORD dwNow = GetTickCount();
+	int rgnEffective[DH_PRIORITY_CLASSES];
+	int nClass, nBest = -1;
+	UINT cWaitingClasses = 0, cBatchMax;
+
+	for (nClass = 0; nClass < DH_PRIORITY_CLASSES; nClass++)
+	{
+		if (!(pThread = pScheduler->rgQueues[nClass].pHead)) continue;
+
+		rgnEffective[nClass] = nClass - (int) ((dwNow - pThread->dwQueued) / pScheduler->options.dwAging);
+		if (rgnEffective[nClass] < 0) rgnEffective[nClass] = 0;
+
+		cWaitingClasses++;
+	}
+
+	for (nClass = 0; nClass < DH_PRIORITY_CLASSES; nClass++)
+	{
+		if (!pScheduler->rgQueues[nClass].pHead) continue;
+
+		cBatchMax = pScheduler->options.rgcBatchMax[nClass];
+
+		if (cBatchMax && cWaitingClasses > 1 && nClass == pScheduler->nLastPriority && pScheduler->cInRow >= cBatchMax)
+		{
+			pScheduler->rgStats[nClass].cYielded++;
+			continue;
+		}
+
+		/* On a tie, the class which is most urgent without aging wins */
+		if (nBest < 0 || rgnEffective[nClass] < rgnEffective[nBest]) nBest = nClass;
+	}
+
+	if (nBest < 0) return NULL;
+
+	/* Count the calls which aging let through ahead of a more urgent class */
+	for (nClass = 0; nClass < nBest; nClass++)
+	{
+		if (pScheduler->rgQueues[nClass].pHead)
+		{
+			pScheduler->rgStats[nBest].cPromoted++;
+			break;
+		}
+	}
+
+	pThread = pScheduler->rgQueues[nBest].pHead;
+	pScheduler->rgQueues[nBest].pHead = pThread->pNext;
+	if (!pThread->pNext) pScheduler->rgQueues[nBest].pTail = NULL;
+	pThread->pNext = NULL;
+
+	pScheduler->rgStats[nBest].cQueued--;
+
+	if (nBest == pScheduler->nLastPriority)
+	{
+		pScheduler->cInRow++;
+	}
+	else
+	{
+		pScheduler->nLastPriority = nBest;
+		pScheduler->cInRow = 1;
+	}
+
+	pScheduler->cRunning++;
+
+	return pThread;
+}
+
+
+
+/* **************************************************************************
+ * Dispatch:
+ *   Lets waiting calls through while the scheduler has free slots, waking
+ * their threads. Returns TRUE if pSelf, which is not woken, was let through.
+ * The scheduler must be locked.
+ *
+ ============================================================================ */
+static BOOL Dispatch(PDH_SCHEDULER pScheduler, DH_SCHEDULER_THREAD * pSelf)
+{
+	DH_SCHEDULER_THREAD * pThread;
+	BOOL bSelf = FALSE;
+
+	while (pScheduler->cRunning < pScheduler->options.cConcurrent && (pThread = AdmitNext(pScheduler)) != NULL)
+	{
+		if (pThread == pSelf)
+			bSelf = TRUE;
+		else
+			SetEvent(pThread->hTurn);
+	}
+
+	return bSelf;
+}
+
+
+
+/* **************************************************************************
+ * RecordCall:
+ *   Adds a completed call to the statistics of its class. The scheduler
+ * must be locked.
+ *
+ ============================================================================ */
+static void RecordCall(PDH_SCHEDULER pScheduler, int nPriority, ULONG ulWaitUs, ULONG ulLatencyUs)
+{
+	PDH_SCHEDULER_STATISTICS pStats = &pScheduler->rgStats[nPriority];
+	DWORD dwTarget = pScheduler->options.rgdwTarget[nPriority];
+	ULONG iBucket;
+
+	for (iBucket = 0; iBucket < DH_SCHEDULER_HISTOGRAM_BUCKETS - 1 && ulLatencyUs >= f_rgSchedulerHistogramBounds[iBucket]; iBucket++);
+
+	pStats->cCalls++;
+	pStats->ullWaitTotalUs += ulWaitUs;
+	if (ulWaitUs > pStats->ulWaitMaxUs) pStats->ulWaitMaxUs = ulWaitUs;
+	pStats->ullLatencyTotalUs += ulLatencyUs;
+	if (ulLatencyUs > pStats->ulLatencyMaxUs) pStats->ulLatencyMaxUs = ulLatencyUs;
+	pStats->rgHistogram[iBucket]++;
+
+	if (dwTarget && ulLatencyUs > dwTarget * 1000) pStats->cOverTarget++;
+}
+
+
+
+/* **************************************************************************
+ * SchedulerPreInvoke:
+ *   Waits for the calling thread's turn on its scheduler, if the call is
+ * made on one of the thread's server objects. Calls on other objects, and
+ * calls made while the thread is already in a scheduled call, such as calls
+ * made by incoming calls dispatched while it waits, are let through at once.
+ *
+ ============================================================================ */
+static HRESULT SchedulerPreInvoke(PDH_INVOKE_CONTEXT pCall, LPVOID pContext)
+{
+	DH_SCHEDULER_THREAD * pThread = (f_lngSchedulerInitEnd == 0 ? GetSchedulerThread() : NULL);
+	PDH_SCHEDULER pScheduler;
+	BOOL bAdmitted;
+	DWORD dwIndex;
+
+	if (!pThread) return S_OK;
+
+	if (pThread->cDepth > 0)
+	{
+		pThread->cDepth++;
+		return S_OK;
+	}
+
+	if (!IsServerObject(pThread, pCall->pDisp)) return S_OK;
+
+	pScheduler = pThread->pScheduler;
+	pThread->cDepth = 1;
+
+	QueryPerformanceCounter(&pThread->liQueued);
+	pThread->dwQueued = GetTickCount();
+
+	EnterCriticalSection(&pScheduler->cs);
+
+	if (pScheduler->rgQueues[pThread->nPriority].pTail)
+		pScheduler->rgQueues[pThread->nPriority].pTail->pNext = pThread;
+	else
+		pScheduler->rgQueues[pThread->nPriority].pHead = pThread;
+
+	pScheduler->rgQueues[pThread->nPriority].pTail = pThread;
+	pScheduler->rgStats[pThread->nPriority].cQueued++;
+
+	bAdmitted = Dispatch(pScheduler, pThread);
+
+	LeaveCriticalSection(&pScheduler->cs);
+
+	if (!bAdmitted) CoWaitForMultipleHandles(0, INFINITE, 1, &pThread->hTurn, &dwIndex);
+
+	pThread->ulWaitUs = ElapsedMicroseconds(&pThread->liQueued);
+
+	return S_OK;
+}
+
+
+
+/* **************************************************************************
+ * SchedulerPostInvoke:
+ *   Records the call and hands its slot to the next waiting call. An object
+ * returned by the call, such as a worksheet or range, is added to the
+ * thread's server objects.
+ *
+ ============================================================================ */
+static void SchedulerPostInvoke(PDH_INVOKE_CONTEXT pCall, LPVOID pContext)
+{
+	DH_SCHEDULER_THREAD * pThread = (f_lngSchedulerInitEnd == 0 ? GetSchedulerThread() : NULL);
+	PDH_SCHEDULER pScheduler;
+	IUnknown * pIdentity;
+	ULONG ulLatencyUs;
+
+	if (!pThread || pThread->cDepth == 0 || --pThread->cDepth > 0) return;
+
+	pScheduler  = pThread->pScheduler;
+	ulLatencyUs = ElapsedMicroseconds(&pThread->liQueued);
+
+	EnterCriticalSection(&pScheduler->cs);
+
+	RecordCall(pScheduler, pThread->nPriority, pThread->ulWaitUs, ulLatencyUs);
+
+	pScheduler->cRunning--;
+	Dispatch(pScheduler, NULL);
+
+	LeaveCriticalSection(&pScheduler->cs);
+
+	if (SUCCEEDED(pCall->hr) && pCall->pvResult && V_VT(pCall->pvResult) == VT_DISPATCH && V_DISPATCH(pCall->pvResult) &&
+	    SUCCEEDED(V_DISPATCH(pCall->pvResult)->lpVtbl->QueryInterface(V_DISPATCH(pCall->pvResult), &IID_IUnknown, (void **) &pIdentity)))
+	{
+		AddObject(pThread, pIdentity);
+	}
+}
+
+
+
+/* **************************************************************************
+ * ReleaseScheduler:
+ *   Releases a reference to a scheduler, freeing it with the last one. The
+ * interceptor is removed with the last scheduler.
+ *
+ ============================================================================ */
+static void ReleaseScheduler(PDH_SCHEDULER pScheduler)
+{
+	if (InterlockedDecrement(&pScheduler->cRefs) != 0) return;
+
+	DeleteCriticalSection(&pScheduler->cs);
+	HeapFree(GetProcessHeap(), 0, pScheduler);
+
+	EnterCriticalSection(&f_csSchedulers);
+
+	if (--f_cSchedulers == 0)
+	{
+		dhRemoveInterceptor(f_dwSchedulerInterceptor);
+		f_dwSchedulerInterceptor = 0;
+	}
+
+	LeaveCriticalSection(&f_csSchedulers);
+}
+
+
+
+/* **************************************************************************
+ * dhCreateScheduler:
+ *   This function creates a scheduler to put in front of a server shared
+ * by several threads, such as an Excel or Word instance. Each thread is
+ * attached to the scheduler with dhSetCallPriority and binds its pointer to
+ * the server with dhSchedulerAddObject. Each call the thread then makes on
+ * the server waits for its turn, which is given by priority class rather
+ * than by arrival, so that a long batch job cannot hold up interactive
+ * calls.
+ *
+ * Parameter Info:
+ *   pOptions    - The options, or NULL for the defaults:
+ *     cConcurrent - How many calls are let through at once, or zero for one.
+ * A single threaded server runs one call at a time anyway.
+ *     dwAging     - How long, in milliseconds, a call waits before it is
+ * raised by one class, so that less urgent classes are not starved, or zero
+ * for one second.
+ *     rgcBatchMax - For each class, how many calls it may be let through in
+ * a row while another class waits, or zero for no limit.
+ *     rgdwTarget  - For each class, a latency target in milliseconds, or
+ * zero for none. Calls over their target are counted in the statistics.
+ *   ppScheduler - Receives the scheduler, which must be freed with
+ * dhDestroyScheduler.
+ *
+ * Notes:
+ *   Schedulers are built on an interceptor, installed with the first
+ * scheduler. Interceptors added before it, such as caches, run before a
+ * call waits for its turn.
+ *   A thread with no objects added lets every call through.
+ *
+ ============================================================================ */
+HRESULT dhCreateScheduler(PDH_SCHEDULER_OPTIONS pOptions, PDH_SCHEDULER * ppScheduler)
+{
+	PDH_SCHEDULER pScheduler;
+	HRESULT hr = NOERROR;
+
+	DH_ENTER(L"CreateScheduler");
+
+	if (!ppScheduler) return DH_EXIT(E_INVALIDARG, NULL);
+
+	*ppScheduler = NULL;
+
+	CheckSchedulerInitialized();
+
+	if (!(pScheduler = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(struct tagDH_SCHEDULER))))
+	{
+		return DH_EXIT(E_OUTOFMEMORY, NULL);
+	}
+
+	if (pOptions) pScheduler->options = *pOptions;
+	if (!pScheduler->options.cConcurrent) pScheduler->options.cConcurrent = 1;
+	if (!pScheduler->options.dwAging)     pScheduler->options.dwAging     = DH_SCHEDULER_DEFAULT_AGING;
+
+	pScheduler->cRefs = 1;
+	pScheduler->nLastPriority = -1;
+
+	EnterCriticalSection(&f_csSchedulers);
+
+	if (f_cSchedulers == 0)
+	{
+		hr = dhAddInterceptor(SchedulerPreInvoke, SchedulerPostInvoke, NULL, &f_dwSchedulerInterceptor);
+	}
+
+	if (SUCCEEDED(hr)) f_cSchedulers++;
+
+	LeaveCriticalSection(&f_csSchedulers);
+
+	if (FAILED(hr))
+	{
+		HeapFree(GetProcessHeap(), 0, pScheduler);
+		return DH_EXIT(hr, NULL);
+	}
+
+	InitializeCriticalSection(&pScheduler->cs);
+
+	*ppScheduler = pScheduler;
+
+	return DH_EXIT(NOERROR, NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhDestroyScheduler:
+ *   This function frees a scheduler. Threads still attached to it keep it
+ * alive until they detach.
+ *
+ ============================================================================ */
+void dhDestroyScheduler(PDH_SCHEDULER pScheduler)
+{
+	if (pScheduler) ReleaseScheduler(pScheduler);
+}
+
+
+
+/* **************************************************************************
+ * dhSchedulerAddObject:
+ *   This function binds the calling thread's pointer to a server to the
+ * scheduler the thread is attached to. Calls the thread makes on the object,
+ * and on the objects returned by those calls, such as the sub objects
+ * reached in a member string, are scheduled.
+ *
+ * Notes:
+ *   Objects are known by identity, with a reference held on each. Those
+ * nobody else holds any longer are dropped as more objects are returned, and
+ * the rest are released when the thread detaches or changes scheduler.
+ *
+ ============================================================================ */
+HRESULT dhSchedulerAddObject(PDH_SCHEDULER pScheduler, IDispatch * pDisp)
+{
+	DH_SCHEDULER_THREAD * pThread;
+	IUnknown * pIdentity;
+	HRESULT hr;
+
+	if (!pScheduler || !pDisp) return E_INVALIDARG;
+
+	CheckSchedulerInitialized();
+
+	pThread = GetSchedulerThread();
+
+	if (!pThread || pThread->pScheduler != pScheduler) return E_UNEXPECTED;
+
+	hr = pDisp->lpVtbl->QueryInterface(pDisp, &IID_IUnknown, (void **) &pIdentity);
+
+	if (FAILED(hr)) return hr;
+
+	return (AddObject(pThread, pIdentity) ? NOERROR : E_OUTOFMEMORY);
+}
+
+
+
+/* **************************************************************************
+ * dhSetCallPriority:
+ *   This function attaches the calling thread to a scheduler. From then on
+ * each call the thread makes on the objects added with dhSchedulerAddObject
+ * waits for its turn in the given priority class.
+ *
+ * Parameter Info:
+ *   pScheduler - The scheduler, or NULL to detach the thread.
+ *   nPriority  - DH_PRIORITY_INTERACTIVE, DH_PRIORITY_NORMAL or
+ * DH_PRIORITY_BATCH.
+ *
+ * Notes:
+ *   A thread must detach before it exits, and cannot change its scheduler
+ * or class while it is in a call.
+ *   Only the invokes of members, which make up nearly all of the calls to
+ * a server, are scheduled.
+ *
+ ============================================================================ */
+HRESULT dhSetCallPriority(PDH_SCHEDULER pScheduler, int nPriority)
+{
+	DH_SCHEDULER_THREAD * pThread;
+
+	if (pScheduler && (nPriority < 0 || nPriority >= DH_PRIORITY_CLASSES)) return E_INVALIDARG;
+
+	CheckSchedulerInitialized();
+
+	pThread = GetSchedulerThread();
+
+	if (pThread && pThread->cDepth) return E_UNEXPECTED;
+
+	if (!pScheduler)
+	{
+		if (pThread)
+		{
+			FreeObjects(pThread);
+			ReleaseScheduler(pThread->pScheduler);
+			CloseHandle(pThread->hTurn);
+			HeapFree(GetProcessHeap(), 0, pThread);
+			SetSchedulerThread(NULL);
+		}
+
+		return NOERROR;
+	}
+
+	if (!pThread)
+	{
+		if (!(pThread = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_SCHEDULER_THREAD)))) return E_OUTOFMEMORY;
+
+		if (!(pThread->hTurn = CreateEvent(NULL, FALSE, FALSE, NULL)))
+		{
+			HeapFree(GetProcessHeap(), 0, pThread);
+			return HRESULT_FROM_WIN32(GetLastError());
+		}
+
+		pThread->cSweepAt = DH_SCHEDULER_MIN_SWEEP;
+		SetSchedulerThread(pThread);
+	}
+
+	/* The objects of another scheduler's server are not this one's */
+	if (pThread->pScheduler && pThread->pScheduler != pScheduler) FreeObjects(pThread);
+
+	InterlockedIncrement(&pScheduler->cRefs);
+	if (pThread->pScheduler) ReleaseScheduler(pThread->pScheduler);
+
+	pThread->pScheduler = pScheduler;
+	pThread->nPriority  = nPriority;
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhSchedulerGetStatistics:
+ *   This function gets the counters of one priority class of a scheduler,
+ * optionally resetting them, for instance to check latency targets over
+ * successive periods.
+ *
+ ============================================================================ */
+HRESULT dhSchedulerGetStatistics(PDH_SCHEDULER pScheduler, int nPriority, PDH_SCHEDULER_STATISTICS pStatistics, BOOL bReset)
+{
+	UINT cQueued;
+
+	if (!pScheduler || !pStatistics || nPriority < 0 || nPriority >= DH_PRIORITY_CLASSES) return E_INVALIDARG;
+
+	EnterCriticalSection(&pScheduler->cs);
+
+	*pStatistics = pScheduler->rgStats[nPriority];
+
+	if (bReset)
+	{
+		cQueued = pScheduler->rgStats[nPriority].cQueued;
+		ZeroMemory(&pScheduler->rgStats[nPriority], sizeof(DH_SCHEDULER_STATISTICS));
+		pScheduler->rgStats[nPriority].cQueued = cQueued;
+	}
+
+	LeaveCriticalSection(&pScheduler->cs);
+
+	return NOERROR;
+}
@@ -0,0 +1,667 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+#define DH_SNAPSHOT_MAGIC        0x43444844   /* "DHDC" */
+#define DH_SNAPSHOT_VERSION      1
+#define DH_SNAPSHOT_DEFAULT_SIZE (1024 * 1024)
+#define DH_SNAPSHOT_MIN_SIZE     (64 * 1024)
+
+/* Most names resolved together that are kept in the file */
+#define DH_SNAPSHOT_MAX_NAMES 64
+
+/* Header at the start of the file. cbUsed is only raised once the records
+ * below it are complete, so readers in other processes need no lock. */
+typedef struct tagDH_SNAPSHOT_HEADER
+{
+	DWORD dwMagic;
+	DWORD dwVersion;
+	DWORD cbFile;
+	volatile LONG cbUsed;
+} DH_SNAPSHOT_HEADER;
+
+/* A set of names resolved together on a type, followed by its DISPIDs and
+ * its names, each with its terminator. Records are DWORD aligned. */
+typedef struct tagDH_SNAPSHOT_RECORD
+{
+	DWORD cbRecord;
+	DH_TYPE_KEY key;
+	ULONG ulHash;
+	UINT cNames;
+} DH_SNAPSHOT_RECORD;
+
+#define RecordDispIds(pRecord) ((DISPID *) ((pRecord) + 1))
+#define RecordNames(pRecord)   ((LPCWSTR) (RecordDispIds(pRecord) + (pRecord)->cNames))
+
+static LPWSTR f_szSnapshotFile = NULL;
+static DWORD f_cbSnapshotMax = DH_SNAPSHOT_DEFAULT_SIZE;
+static BOOL f_bSnapshotOpened = FALSE;
+
+static HANDLE f_hSnapshotFile = NULL;
+static HANDLE f_hSnapshotMapping = NULL;
+static HANDLE f_hSnapshotMutex = NULL;
+static DH_SNAPSHOT_HEADER * f_pSnapshot = NULL;
+
+/* In-process index of the records (open addressing), by offset */
+static DWORD * f_rgSnapshotSlots = NULL;
+static UINT f_cSnapshotSlots = 0;
+static UINT f_cSnapshotEntries = 0;
+static DWORD f_cbSnapshotIndexed = 0;
+
+static DH_DISPID_FILE_STATISTICS f_SnapshotStatistics;
+
+static CRITICAL_SECTION f_csSnapshot;
+static LONG f_lngSnapshotInitBegin = -1, f_lngSnapshotInitEnd = -1;
+
+#define CheckSnapshotInitialized() if (f_lngSnapshotInitEnd != 0) InitializeSnapshot();
+
+
+
+/* **************************************************************************
+ * InitializeSnapshot:
+ *   Initializes the critical section which protects the DISPID file.
+ *
+ ============================================================================ */
+static void InitializeSnapshot(void)
+{
+	if (0 == InterlockedIncrement(&f_lngSnapshotInitBegin))
+	{
+		InitializeCriticalSection(&f_csSnapshot);
+		f_lngSnapshotInitEnd = 0;
+	}
+	else
+	{
+		/* Deal with extremely unlikely race condition */
+		while (f_lngSnapshotInitEnd != 0) Sleep(5);
+	}
+}
+
+
+
+/* **************************************************************************
+ * HashRecordKey:
+ *   Returns the hash of a type and of a set of names, used by the index.
+ *
+ ============================================================================ */
+static ULONG HashRecordKey(const DH_TYPE_KEY * pKey, ULONG ulNamesHash)
+{
+	const BYTE * pb = (const BYTE *) pKey;
+	ULONG ulHash = ulNamesHash ^ 2166136261UL;
+	UINT ib;
+
+	for (ib = 0; ib < sizeof(DH_TYPE_KEY); ib++)
+	{
+		ulHash = (ulHash ^ pb[ib]) * 16777619UL;
+	}
+
+	return ulHash;
+}
+
+#define RecordAt(cbOffset) ((DH_SNAPSHOT_RECORD *) ((BYTE *) f_pSnapshot + (cbOffset)))
+
+
+
+/* **************************************************************************
+ * FindSnapshotSlot:
+ *   Returns the index slot holding the record for a type and set of names,
+ * or the empty slot where it should be inserted.
+ *
+ ============================================================================ */
+static DWORD * FindSnapshotSlot(const DH_TYPE_KEY * pKey, ULONG ulHash, LPOLESTR * rgszNames, UINT cNames)
+{
+	DH_SNAPSHOT_RECORD * pRecord;
+	UINT iSlot = (UINT) HashRecordKey(pKey, ulHash) & (f_cSnapshotSlots - 1);
+
+	while (f_rgSnapshotSlots[iSlot])
+	{
+		pRecord = RecordAt(f_rgSnapshotSlots[iSlot]);
+
+		if (pRecord->ulHash == ulHash && pRecord->cNames == cNames &&
+		    memcmp(&pRecord->key, pKey, sizeof(DH_TYPE_KEY)) == 0 &&
+		    dhNamesMatch(RecordNames(pRecord), pRecord->cNames, rgszNames, cNames))
+		{
+			break;
+		}
+
+		iSlot = (iSlot + 1) & (f_cSnapshotSlots - 1);
+	}
+
+	return &f_rgSnapshotSlots[iSlot];
+}
+
+
+
+/* **************************************************************************
+ * IndexRecord:
+ *   Adds a record to the index, growing it if needed. A record for the same
+ * names, appended by another process, replaces the earlier one. Returns
+ * FALSE if the DISPIDs or names of the record run past cbRecord, its size
+ * already checked against the file.
+ *
+ ============================================================================ */
+static BOOL IndexRecord(DWORD cbOffset, DWORD cbRecord)
+{
+	DH_SNAPSHOT_RECORD * pRecord = RecordAt(cbOffset);
+	LPOLESTR rgszNames[DH_SNAPSHOT_MAX_NAMES];
+	LPCWSTR szName;
+	DWORD * rgOld = f_rgSnapshotSlots, * pSlot;
+	UINT cOld = f_cSnapshotSlots, iSlot, iName;
+	DWORD cchLeft;
+
+	if (pRecord->cNames == 0 || pRecord->cNames > DH_SNAPSHOT_MAX_NAMES ||
+	    pRecord->cNames * sizeof(DISPID) > cbRecord - sizeof(DH_SNAPSHOT_RECORD))
+	{
+		return FALSE;
+	}
+
+	szName  = RecordNames(pRecord);
+	cchLeft = (cbRecord - sizeof(DH_SNAPSHOT_RECORD) - pRecord->cNames * sizeof(DISPID)) / sizeof(WCHAR);
+
+	/* Each name must be terminated within the record */
+	for (iName = 0; iName < pRecord->cNames; iName++)
+	{
+		rgszNames[iName] = (LPOLESTR) szName;
+
+		while (cchLeft && *szName) { szName++; cchLeft--; }
+
+		if (cchLeft == 0) return FALSE;
+
+		szName++;
+		cchLeft--;
+	}
+
+	/* Keep the load factor under 3/4 */
+	if ((f_cSnapshotEntries + 1) * 4 >= f_cSnapshotSlots * 3)
+	{
+		UINT cSlots = (cOld ? cOld * 2 : 256);
+
+		if (!(f_rgSnapshotSlots = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, cSlots * sizeof(DWORD))))
+		{
+			/* The record is sound, it is only left out of the index */
+			f_rgSnapshotSlots = rgOld;
+			return TRUE;
+		}
+
+		f_cSnapshotSlots = cSlots;
+
+		for (iSlot = 0; iSlot < cOld; iSlot++)
+		{
+			if (rgOld[iSlot])
+			{
+				DH_SNAPSHOT_RECORD * pOld = RecordAt(rgOld[iSlot]);
+				UINT iProbe = (UINT) HashRecordKey(&pOld->key, pOld->ulHash) & (cSlots - 1);
+
+				while (f_rgSnapshotSlots[iProbe]) iProbe = (iProbe + 1) & (cSlots - 1);
+				f_rgSnapshotSlots[iProbe] = rgOld[iSlot];
+			}
+		}
+
+		if (rgOld) HeapFree(GetProcessHeap(), 0, rgOld);
+	}
+
+	pSlot = FindSnapshotSlot(&pRecord->key, pRecord->ulHash, rgszNames, pRecord->cNames);
+
+	if (!*pSlot) f_cSnapshotEntries++;
+	*pSlot = cbOffset;
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * IndexNewRecords:
+ *   Indexes the records appended since the last call, including those
+ * appended by other processes. The snapshot must be locked.
+ *
+ ============================================================================ */
+static void IndexNewRecords(void)
+{
+	DWORD cbUsed = (DWORD) f_pSnapshot->cbUsed, cbRecord;
+
+	if (cbUsed > f_pSnapshot->cbFile) return;
+
+	while (f_cbSnapshotIndexed + sizeof(DH_SNAPSHOT_RECORD) <= cbUsed)
+	{
+		cbRecord = RecordAt(f_cbSnapshotIndexed)->cbRecord;
+
+		/* A damaged record ends the usable part of the file */
+		if (cbRecord < sizeof(DH_SNAPSHOT_RECORD) || cbRecord % sizeof(DWORD) || cbRecord > cbUsed - f_cbSnapshotIndexed ||
+		    !IndexRecord(f_cbSnapshotIndexed, cbRecord))
+		{
+			f_cbSnapshotIndexed = cbUsed;
+			break;
+		}
+
+		f_cbSnapshotIndexed += cbRecord;
+	}
+}
+
+
+
+/* **************************************************************************
+ * CloseSnapshot:
+ *   Unmaps the DISPID file and frees the index. The snapshot must be locked.
+ *
+ ============================================================================ */
+static void CloseSnapshot(void)
+{
+	if (f_pSnapshot)        UnmapViewOfFile(f_pSnapshot);
+	if (f_hSnapshotMapping) CloseHandle(f_hSnapshotMapping);
+	if (f_hSnapshotFile)    CloseHandle(f_hSnapshotFile);
+	if (f_hSnapshotMutex)   CloseHandle(f_hSnapshotMutex);
+	if (f_rgSnapshotSlots)  HeapFree(GetProcessHeap(), 0, f_rgSnapshotSlots);
+
+	f_pSnapshot = NULL;
+	f_hSnapshotMapping = f_hSnapshotFile = f_hSnapshotMutex = NULL;
+	f_rgSnapshotSlots = NULL;
+	f_cSnapshotSlots = f_cSnapshotEntries = 0;
+	f_cbSnapshotIndexed = 0;
+}
+
+
+
+/* **************************************************************************
+ * OpenSnapshot:
+ *   Maps the DISPID file, creating it or starting it over if it is not a
+ * file of this version, and indexes its records. Processes sharing the file
+ * append to it under a mutex named after it. The snapshot must be locked.
+ *
+ ============================================================================ */
+static BOOL OpenSnapshot(void)
+{
+	WCHAR szMutex[48] = L"Local\\DispHelperDispIdFile";
+	ULONG ulHash = dhHashName(0, f_szSnapshotFile);
+	LARGE_INTEGER liSize;
+	BOOL bCreate;
+	UINT iDigit;
+
+	f_bSnapshotOpened = TRUE;
+
+	/* The mutex is named after the case folded path */
+	for (iDigit = 0; iDigit < 8; iDigit++)
+	{
+		szMutex[26 + iDigit] = L"0123456789abcdef"[(ulHash >> (28 - iDigit * 4)) & 0xF];
+	}
+
+	if (!(f_hSnapshotMutex = CreateMutexW(NULL, FALSE, szMutex))) return FALSE;
+
+	f_hSnapshotFile = CreateFileW(f_szSnapshotFile, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+	                              NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (f_hSnapshotFile == INVALID_HANDLE_VALUE)
+	{
+		f_hSnapshotFile = NULL;
+		CloseSnapshot();
+		return FALSE;
+	}
+
+	WaitForSingleObject(f_hSnapshotMutex, INFINITE);
+
+	bCreate = (!GetFileSizeEx(f_hSnapshotFile, &liSize) || liSize.QuadPart < sizeof(DH_SNAPSHOT_HEADER));
+
+	if (bCreate)
+	{
+		liSize.QuadPart = f_cbSnapshotMax;
+
+		if (!SetFilePointerEx(f_hSnapshotFile, liSize, NULL, FILE_BEGIN) || !SetEndOfFile(f_hSnapshotFile))
+		{
+			liSize.QuadPart = 0;
+		}
+	}
+
+	if (liSize.QuadPart >= sizeof(DH_SNAPSHOT_HEADER) && liSize.QuadPart <= MAXLONG &&
+	    (f_hSnapshotMapping = CreateFileMappingW(f_hSnapshotFile, NULL, PAGE_READWRITE, 0, 0, NULL)) != NULL)
+	{
+		f_pSnapshot = MapViewOfFile(f_hSnapshotMapping, FILE_MAP_WRITE, 0, 0, 0);
+	}
+
+	if (f_pSnapshot && (bCreate || f_pSnapshot->dwMagic != DH_SNAPSHOT_MAGIC || f_pSnapshot->dwVersion != DH_SNAPSHOT_VERSION ||
+	                    f_pSnapshot->cbFile != (DWORD) liSize.QuadPart))
+	{
+		f_pSnapshot->dwMagic   = DH_SNAPSHOT_MAGIC;
+		f_pSnapshot->dwVersion = DH_SNAPSHOT_VERSION;
+		f_pSnapshot->cbFile    = (DWORD) liSize.QuadPart;
+		InterlockedExchange(&f_pSnapshot->cbUsed, sizeof(DH_SNAPSHOT_HEADER));
+	}
+
+	ReleaseMutex(f_hSnapshotMutex);
+
+	if (!f_pSnapshot)
+	{
+		CloseSnapshot();
+		return FALSE;
+	}
+
+	f_cbSnapshotIndexed = sizeof(DH_SNAPSHOT_HEADER);
+	IndexNewRecords();
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * dhSnapshotEnabled:
+ *   Checks whether a DISPID file is used.
+ *
+ ============================================================================ */
+BOOL dhSnapshotEnabled(void)
+{
+	return (f_szSnapshotFile != NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhSnapshotReadTypeKey:
+ *   Reads the key under which the names of a type are kept in the DISPID
+ * file: the type, its type library, and their versions. Only the types of
+ * registered type libraries are kept.
+ *
+ ============================================================================ */
+HRESULT dhSnapshotReadTypeKey(ITypeInfo * pTypeInfo, DH_TYPE_KEY * pKey)
+{
+	ITypeLib * pTypeLib = NULL;
+	TYPEATTR * pTypeAttr;
+	TLIBATTR * pLibAttr;
+	UINT iIndex;
+	HRESULT hr;
+
+	ZeroMemory(pKey, sizeof(DH_TYPE_KEY));
+
+	if (SUCCEEDED(hr = pTypeInfo->lpVtbl->GetTypeAttr(pTypeInfo, &pTypeAttr)))
+	{
+		pKey->guidType     = pTypeAttr->guid;
+		pKey->wMajorVerNum = pTypeAttr->wMajorVerNum;
+		pKey->wMinorVerNum = pTypeAttr->wMinorVerNum;
+		pTypeInfo->lpVtbl->ReleaseTypeAttr(pTypeInfo, pTypeAttr);
+
+		hr = pTypeInfo->lpVtbl->GetContainingTypeLib(pTypeInfo, &pTypeLib, &iIndex);
+	}
+
+	if (SUCCEEDED(hr) && SUCCEEDED(hr = pTypeLib->lpVtbl->GetLibAttr(pTypeLib, &pLibAttr)))
+	{
+		pKey->guidLib         = pLibAttr->guid;
+		pKey->wLibMajorVerNum = pLibAttr->wMajorVerNum;
+		pKey->wLibMinorVerNum = pLibAttr->wMinorVerNum;
+		pKey->lcid            = pLibAttr->lcid;
+		pTypeLib->lpVtbl->ReleaseTLibAttr(pTypeLib, pLibAttr);
+	}
+
+	if (pTypeLib) pTypeLib->lpVtbl->Release(pTypeLib);
+
+	if (SUCCEEDED(hr) && (IsEqualGUID(&pKey->guidLib, &GUID_NULL) || IsEqualGUID(&pKey->guidType, &GUID_NULL))) hr = E_FAIL;
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * dhSnapshotGetTypeKey:
+ *   Gets the key under which the names of an object are kept in the DISPID
+ * file, and the object's type info. The caller must release *ppTypeInfo.
+ *
+ ============================================================================ */
+HRESULT dhSnapshotGetTypeKey(IDispatch * pDisp, DH_TYPE_KEY * pKey, ITypeInfo ** ppTypeInfo)
+{
+	ITypeInfo * pTypeInfo = NULL;
+	HRESULT hr;
+
+	*ppTypeInfo = NULL;
+	ZeroMemory(pKey, sizeof(DH_TYPE_KEY));
+
+	hr = pDisp->lpVtbl->GetTypeInfo(pDisp, 0, LOCALE_USER_DEFAULT, &pTypeInfo);
+
+	if (SUCCEEDED(hr)) hr = dhSnapshotReadTypeKey(pTypeInfo, pKey);
+
+	if (FAILED(hr))
+	{
+		if (pTypeInfo) pTypeInfo->lpVtbl->Release(pTypeInfo);
+		return hr;
+	}
+
+	*ppTypeInfo = pTypeInfo;
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhSnapshotLookup:
+ *   Looks up a set of names in the DISPID file, mapping the file on first
+ * use. Returns TRUE and the DISPIDs if found.
+ *
+ ============================================================================ */
+BOOL dhSnapshotLookup(const DH_TYPE_KEY * pKey, ULONG ulHash, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DWORD * pSlot;
+	BOOL bFound = FALSE;
+
+	if (!f_szSnapshotFile) return FALSE;
+
+	EnterCriticalSection(&f_csSnapshot);
+
+	if (f_bSnapshotOpened || OpenSnapshot())
+	{
+		if (f_pSnapshot) IndexNewRecords();
+
+		if (f_cSnapshotSlots && *(pSlot = FindSnapshotSlot(pKey, ulHash, rgszNames, cNames)))
+		{
+			CopyMemory(rgDispId, RecordDispIds(RecordAt(*pSlot)), cNames * sizeof(DISPID));
+			bFound = TRUE;
+		}
+	}
+
+	if (bFound)
+		f_SnapshotStatistics.cHits++;
+	else
+		f_SnapshotStatistics.cMisses++;
+
+	LeaveCriticalSection(&f_csSnapshot);
+
+	return bFound;
+}
+
+
+
+/* **************************************************************************
+ * dhSnapshotAppend:
+ *   Appends a set of names of a type, and their DISPIDs, to the DISPID file,
+ * mapping the file on first use, unless the file already holds them.
+ *
+ ============================================================================ */
+void dhSnapshotAppend(const DH_TYPE_KEY * pKey, ULONG ulHash, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DH_SNAPSHOT_RECORD * pRecord;
+	DWORD cbRecord, cbUsed;
+	UINT iName, cchNames = 0;
+	LPWSTR szDest;
+
+	if (!f_szSnapshotFile || cNames == 0 || cNames > DH_SNAPSHOT_MAX_NAMES) return;
+
+	for (iName = 0; iName < cNames; iName++)
+	{
+		cchNames += wcslen(rgszNames[iName]) + 1;
+	}
+
+	cbRecord = sizeof(DH_SNAPSHOT_RECORD) + cNames * sizeof(DISPID) + cchNames * sizeof(WCHAR);
+	cbRecord = (cbRecord + sizeof(DWORD) - 1) & ~(sizeof(DWORD) - 1);
+
+	EnterCriticalSection(&f_csSnapshot);
+
+	if (!f_bSnapshotOpened) OpenSnapshot();
+
+	if (f_pSnapshot && WaitForSingleObject(f_hSnapshotMutex, INFINITE) != WAIT_FAILED)
+	{
+		IndexNewRecords();
+
+		cbUsed = (DWORD) f_pSnapshot->cbUsed;
+
+		/* Another thread or process may have added the names meanwhile */
+		if (cbUsed <= f_pSnapshot->cbFile && cbRecord <= f_pSnapshot->cbFile - cbUsed &&
+		    !(f_cSnapshotSlots && *FindSnapshotSlot(pKey, ulHash, rgszNames, cNames)))
+		{
+			pRecord = RecordAt(cbUsed);
+
+			pRecord->cbRecord = cbRecord;
+			pRecord->key      = *pKey;
+			pRecord->ulHash   = ulHash;
+			pRecord->cNames   = cNames;
+			CopyMemory(RecordDispIds(pRecord), rgDispId, cNames * sizeof(DISPID));
+
+			for (iName = 0, szDest = (LPWSTR) RecordNames(pRecord); iName < cNames; iName++)
+			{
+				LPCWSTR szSrc = rgszNames[iName];
+				while ((*szDest++ = *szSrc++));
+			}
+
+			/* Publish the record once it is complete */
+			InterlockedExchange(&f_pSnapshot->cbUsed, (LONG) (cbUsed + cbRecord));
+
+			IndexNewRecords();
+			f_SnapshotStatistics.cAppended++;
+		}
+
+		ReleaseMutex(f_hSnapshotMutex);
+	}
+
+	LeaveCriticalSection(&f_csSnapshot);
+}
+
+
+
+/* **************************************************************************
+ * dhSnapshotRecord:
+ *   Appends a set of names resolved by an object to the DISPID file. The
+ * names are first resolved by the object's type info, and only kept if it
+ * gives the same DISPIDs, so that names an object adds at run time, which
+ * may differ from one object or process to the next, are never kept.
+ *
+ ============================================================================ */
+void dhSnapshotRecord(const DH_TYPE_KEY * pKey, ITypeInfo * pTypeInfo, ULONG ulHash, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId)
+{
+	DISPID rgTypeDispId[DH_SNAPSHOT_MAX_NAMES];
+
+	if (!f_szSnapshotFile || !f_pSnapshot || cNames > DH_SNAPSHOT_MAX_NAMES) return;
+
+	if (FAILED(pTypeInfo->lpVtbl->GetIDsOfNames(pTypeInfo, rgszNames, cNames, rgTypeDispId)) ||
+	    memcmp(rgTypeDispId, rgDispId, cNames * sizeof(DISPID)) != 0)
+	{
+		InterlockedIncrement((LONG *) &f_SnapshotStatistics.cUnverified);
+		return;
+	}
+
+	dhSnapshotAppend(pKey, ulHash, rgszNames, cNames, rgDispId);
+}
+
+
+
+/* **************************************************************************
+ * dhSetDispIdCacheFile:
+ *   This function keeps the names resolved through the DISPID cache in a
+ * file, shared by the processes which use it, so that a process can find
+ * the names resolved by earlier ones without asking the objects. The file
+ * is mapped in memory on first use and the names resolved since are added
+ * to it.
+ *
+ * Parameter Info:
+ *   szFile   - The path of the file, or NULL to stop using the file.
+ *   cbMaxSize - The size of the file when it is created, in bytes, or zero
+ * for one megabyte. Names are no longer added once it is full.
+ *
+ * Notes:
+ *   The DISPID cache must be enabled with dhSetDispIdCacheSize.
+ *   Names are kept by type, type library and their versions, so the names
+ * of a server are resolved again once it is upgraded. Only names resolved
+ * by objects with the type info of a registered type library are kept.
+ *   Using the file costs one call to each object cached, to get its type
+ * info, and on each thread four more calls to the type info of the first
+ * object of each type. Names missing from the file are also resolved by
+ * the type info, once, before they are added.
+ *   Call this at start up, before other threads make calls.
+ *
+ * Example(s):
+ *   dhSetDispIdCacheSize(32);
+ *   dhSetDispIdCacheFile(L"C:\\Temp\\mytool.dispids", 0);
+ *
+ ============================================================================ */
+HRESULT dhSetDispIdCacheFile(LPCWSTR szFile, DWORD cbMaxSize)
+{
+	LPWSTR szCopy = NULL;
+	SIZE_T cb;
+
+	CheckSnapshotInitialized();
+
+	if (szFile)
+	{
+		cb = (wcslen(szFile) + 1) * sizeof(WCHAR);
+		if (!(szCopy = HeapAlloc(GetProcessHeap(), 0, cb))) return E_OUTOFMEMORY;
+		CopyMemory(szCopy, szFile, cb);
+	}
+
+	EnterCriticalSection(&f_csSnapshot);
+
+	CloseSnapshot();
+
+	if (f_szSnapshotFile) HeapFree(GetProcessHeap(), 0, f_szSnapshotFile);
+
+	f_szSnapshotFile  = szCopy;
+	f_cbSnapshotMax   = (cbMaxSize >= DH_SNAPSHOT_MIN_SIZE ? cbMaxSize : DH_SNAPSHOT_DEFAULT_SIZE);
+	f_bSnapshotOpened = FALSE;
+
+	LeaveCriticalSection(&f_csSnapshot);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhGetDispIdCacheFileStatistics:
+ *   This function gets the counters of the DISPID file, optionally
+ * resetting them.
+ *
+ ============================================================================ */
+HRESULT dhGetDispIdCacheFileStatistics(PDH_DISPID_FILE_STATISTICS pStatistics, BOOL bReset)
+{
+	if (!pStatistics) return E_INVALIDARG;
+
+	CheckSnapshotInitialized();
+
+	EnterCriticalSection(&f_csSnapshot);
+
+	*pStatistics = f_SnapshotStatistics;
+	pStatistics->cEntries = f_cSnapshotEntries;
+	pStatistics->cbUsed   = (f_pSnapshot ? (DWORD) f_pSnapshot->cbUsed : 0);
+
+	if (bReset)
+	{
+		f_SnapshotStatistics.cHits = f_SnapshotStatistics.cMisses = 0;
+		InterlockedExchange((LONG *) &f_SnapshotStatistics.cAppended, 0);
+		InterlockedExchange((LONG *) &f_SnapshotStatistics.cUnverified, 0);
+	}
+
+	LeaveCriticalSection(&f_csSnapshot);
+
+	return NOERROR;
+}
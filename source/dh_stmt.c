@@ -0,0 +1,470 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+#include "convert.h"
+
+/* An argument bound to a caller's variable */
+typedef struct tagDH_STMT_SLOT
+{
+	WCHAR chIdentifier;
+	INT size;
+	LPVOID pBound;
+} DH_STMT_SLOT;
+
+/* Structure to store a prepared statement. The arguments are packed in
+ * reverse order in rgArgs, as required by DISPPARAMS. */
+struct tagDH_STMT
+{
+	IDispatch * pTarget;
+	DISPID dispID;
+	DISPID dispIDPut;
+	int invokeType;
+	VARTYPE returnType;
+	DISPPARAMS dp;
+
+	UINT cArgs;
+	DH_STMT_SLOT rgSlots[DH_MAX_ARGS];
+	VARIANT rgArgs[DH_MAX_ARGS];
+
+	WCHAR szName[DH_MAX_MEMBER];
+	WCHAR szMember[DH_MAX_MEMBER];
+};
+
+
+
+/* **************************************************************************
+ * BindSlot:
+ *   Parses the identifier at szIdentifier and takes the address bound to it
+ * from the va_list. Returns a pointer past the identifier, or NULL if the
+ * identifier can not be bound.
+ *
+ ============================================================================ */
+static LPCWSTR BindSlot(DH_STMT_SLOT * pSlot, LPCWSTR szIdentifier, va_list * marker)
+{
+	INT size = 0;
+	WCHAR chIdentifier;
+
+	/* By reference arguments are already bound to a variable */
+	if (*szIdentifier == L'&') return NULL;
+
+	for (;; szIdentifier++)
+	{
+		if (*szIdentifier == L'h')      size--;
+		else if (*szIdentifier == L'l') size++;
+		else if (*szIdentifier == L'L') size = 2;
+		else if (*szIdentifier != L'k') break; /* Strings are always reused */
+	}
+
+	chIdentifier = *szIdentifier;
+	if (chIdentifier == L'T') chIdentifier = (dh_g_bIsUnicodeMode ? L'S' : L's');
+
+	switch (chIdentifier)
+	{
+		case L'd': case L'u': case L'e': case L'b': case L'D': case L't':
+		case L'S': case L's': case L'B': case L'o': case L'O': case L'v':
+			pSlot->pBound = va_arg(*marker, LPVOID);
+			if (!pSlot->pBound) return NULL;
+			break;
+
+		case L'm':
+			break;
+
+		default:
+			DEBUG_NOTIFY_INVALID_IDENTIFIER(chIdentifier);
+			return NULL;
+	}
+
+	pSlot->chIdentifier = chIdentifier;
+	pSlot->size         = size;
+
+	return szIdentifier + 1;
+}
+
+
+
+/* **************************************************************************
+ * SetStringArgument:
+ *   Copies a string into a BSTR argument owned by the statement, reusing its
+ * buffer when the length is unchanged.
+ *
+ ============================================================================ */
+static HRESULT SetStringArgument(VARIANT * pvArg, LPCWSTR szValue, LPCSTR szAnsiValue)
+{
+	UINT cch;
+
+	if (!szValue && !szAnsiValue)
+	{
+		SysFreeString(V_BSTR(pvArg));
+		V_BSTR(pvArg) = NULL;
+		return NOERROR;
+	}
+
+	if (szValue)
+		cch = (UINT) wcslen(szValue);
+	else
+		cch = MultiByteToWideChar(CP_ACP, 0, szAnsiValue, -1, NULL, 0) - 1;
+
+	if (!V_BSTR(pvArg) || SysStringLen(V_BSTR(pvArg)) != cch)
+	{
+		if (!SysReAllocStringLen(&V_BSTR(pvArg), NULL, cch)) return E_OUTOFMEMORY;
+	}
+
+	if (szValue)
+		CopyMemory(V_BSTR(pvArg), szValue, cch * sizeof(WCHAR));
+	else
+		MultiByteToWideChar(CP_ACP, 0, szAnsiValue, -1, V_BSTR(pvArg), cch + 1);
+
+	V_BSTR(pvArg)[cch] = L'\0';
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * LoadArgument:
+ *   Reads the current value of a bound variable into its argument.
+ *
+ ============================================================================ */
+static HRESULT LoadArgument(DH_STMT_SLOT * pSlot, VARIANT * pvArg)
+{
+	switch (pSlot->chIdentifier)
+	{
+		case L'd':
+		case L'u':
+			if (pSlot->size >= 2 || (pSlot->size == 1 && sizeof(long) == 8))
+			{
+				V_VT(pvArg) = (pSlot->chIdentifier == L'd' ? VT_I8 : VT_UI8);
+				V_I8(pvArg) = *(LONGLONG *) pSlot->pBound;
+			}
+			else if (pSlot->size < 0)
+			{
+				V_VT(pvArg) = VT_I4;
+				V_I4(pvArg) = (pSlot->chIdentifier == L'd' ? (LONG) *(short *) pSlot->pBound : (LONG) *(unsigned short *) pSlot->pBound);
+			}
+			else
+			{
+				V_VT(pvArg) = (pSlot->chIdentifier == L'd' ? VT_I4 : VT_UI4);
+				V_I4(pvArg) = *(LONG *) pSlot->pBound;
+			}
+			return NOERROR;
+
+		case L'e':
+			V_VT(pvArg) = VT_R8;
+			V_R8(pvArg) = *(DOUBLE *) pSlot->pBound;
+			return NOERROR;
+
+		case L'b':
+			V_VT(pvArg)   = VT_BOOL;
+			V_BOOL(pvArg) = (*(BOOL *) pSlot->pBound ? VARIANT_TRUE : VARIANT_FALSE);
+			return NOERROR;
+
+		case L'D':
+			V_VT(pvArg)   = VT_DATE;
+			V_DATE(pvArg) = *(DATE *) pSlot->pBound;
+			return NOERROR;
+
+		case L't':
+			V_VT(pvArg) = VT_DATE;
+			return ConvertTimeTToVariantTime(*(time_t *) pSlot->pBound, &V_DATE(pvArg));
+
+		case L'S':
+			return SetStringArgument(pvArg, *(LPCWSTR *) pSlot->pBound, NULL);
+
+		case L's':
+			return SetStringArgument(pvArg, NULL, *(LPCSTR *) pSlot->pBound);
+
+		case L'B':
+			V_BSTR(pvArg) = *(BSTR *) pSlot->pBound;
+			return NOERROR;
+
+		case L'o':
+			V_DISPATCH(pvArg) = *(IDispatch **) pSlot->pBound;
+			return NOERROR;
+
+		case L'O':
+			V_UNKNOWN(pvArg) = *(IUnknown **) pSlot->pBound;
+			return NOERROR;
+
+		case L'v':
+			*pvArg = *(VARIANT *) pSlot->pBound;
+			return NOERROR;
+
+		case L'm':
+			return NOERROR;
+	}
+
+	return E_UNEXPECTED;
+}
+
+
+
+/* **************************************************************************
+ * dhStmtPrepareV:
+ *   This function prepares a statement which invokes a member repeatedly with
+ * the current values of bound variables. The object path and DISPID are
+ * resolved once, here, so each execution costs a single Invoke.
+ *
+ * Parameter Info:
+ *   ppStmt     - Receives the statement, which must be freed with dhStmtFree.
+ *   invokeType - DISPATCH_METHOD, DISPATCH_PROPERTYGET, DISPATCH_PROPERTYPUT...
+ *   returnType - The type to coerce the result to, or VT_EMPTY.
+ *   pDisp      - The object.
+ *   szMember   - The member, in the same format as dhInvoke. The object path
+ * before the member can not take arguments and named arguments and by
+ * reference (%&) arguments are not supported.
+ *   marker     - The address of a variable for each identifier (other than %m),
+ * e.g. LONG * for %d, DOUBLE * for %e, LPCWSTR * for %S.
+ *
+ * Example(s):
+ *   dhStmtPrepare(&pStmt, DISPATCH_PROPERTYPUT, VT_EMPTY, xlSheet, L".Cells(%d,%d) = %e", &r, &c, &v);
+ *
+ ============================================================================ */
+HRESULT dhStmtPrepareV(PDH_STMT * ppStmt, int invokeType, VARTYPE returnType, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker)
+{
+	PDH_STMT pStmt;
+	LPWSTR szPath, szName, szArgs, szDot;
+	LPCWSTR szIdentifier;
+	DH_STMT_SLOT rgSlots[DH_MAX_ARGS];
+	UINT cArgs = 0, iArg;
+	HRESULT hr = NOERROR;
+
+	DH_ENTER(L"StmtPrepareV");
+
+	if (!ppStmt || !pDisp || !szMember || !marker) return DH_EXIT(E_INVALIDARG, szMember);
+
+	*ppStmt = NULL;
+
+	if (wcslen(szMember) >= DH_MAX_MEMBER || wcsstr(szMember, L":=")) return DH_EXIT(E_INVALIDARG, szMember);
+
+	if (!(pStmt = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(struct tagDH_STMT)))) return DH_EXIT(E_OUTOFMEMORY, szMember);
+
+	wcscpy(pStmt->szMember, szMember);
+	wcscpy(pStmt->szName, (*szMember == L'.' ? szMember + 1 : szMember));
+
+	/* Split "Path.To.Member(args) = value" into the path, name and arguments */
+	szPath = pStmt->szName;
+	szArgs = szPath;
+	szDot  = NULL;
+
+	for (;;)
+	{
+		szArgs += wcscspn(szArgs, L".( =");
+
+		if (*szArgs == L'.')
+		{
+			szDot = szArgs++;
+			continue;
+		}
+
+		/* Arguments followed by a '.' belong to the object path */
+		if (*szArgs == L'(')
+		{
+			LPWSTR szClose = wcschr(szArgs, L')');
+
+			if (szClose && szClose[1] == L'.')
+			{
+				szArgs = szClose + 1;
+				continue;
+			}
+		}
+
+		break;
+	}
+
+	/* Bind the arguments before szArgs is terminated */
+	for (szIdentifier = szArgs; *szIdentifier && SUCCEEDED(hr); )
+	{
+		if (*szIdentifier++ != L'%') continue;
+
+		if (cArgs == DH_MAX_ARGS || !(szIdentifier = BindSlot(&rgSlots[cArgs++], szIdentifier, marker)))
+		{
+			hr = E_INVALIDARG;
+		}
+	}
+
+	*szArgs = L'\0';
+
+	if (SUCCEEDED(hr) && szDot)
+	{
+		/* Resolve the object path once */
+		*szDot = L'\0';
+		szName = szDot + 1;
+
+		if (wcschr(szPath, L'%'))
+			hr = E_INVALIDARG;
+		else
+			hr = dhGetValue(L"%o", &pStmt->pTarget, pDisp, szPath);
+	}
+	else if (SUCCEEDED(hr))
+	{
+		szName = szPath;
+		pStmt->pTarget = pDisp;
+		pDisp->lpVtbl->AddRef(pDisp);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		/* Keep only the member name, for error reporting */
+		MoveMemory(pStmt->szName, szName, (wcslen(szName) + 1) * sizeof(WCHAR));
+		szName = pStmt->szName;
+
+		hr = dhCacheGetIDsOfNames(pStmt->pTarget, &szName, 1, &pStmt->dispID);
+	}
+
+	if (FAILED(hr))
+	{
+		dhStmtFree(pStmt);
+		return DH_EXIT(hr, szMember);
+	}
+
+	pStmt->invokeType = invokeType;
+	pStmt->returnType = returnType;
+	pStmt->cArgs      = cArgs;
+
+	/* Pack the slots in reverse order so that they line up with rgArgs */
+	for (iArg = 0; iArg < cArgs; iArg++)
+	{
+		DH_STMT_SLOT * pSlot = &pStmt->rgSlots[cArgs - 1 - iArg];
+		VARIANT * pvArg      = &pStmt->rgArgs[cArgs - 1 - iArg];
+
+		*pSlot = rgSlots[iArg];
+
+		VariantInit(pvArg);
+
+		switch (pSlot->chIdentifier)
+		{
+			case L'S': case L's': case L'B': V_VT(pvArg) = VT_BSTR;     break;
+			case L'o':                       V_VT(pvArg) = VT_DISPATCH; break;
+			case L'O':                       V_VT(pvArg) = VT_UNKNOWN;  break;
+			case L'm': V_VT(pvArg) = VT_ERROR; V_ERROR(pvArg) = DISP_E_PARAMNOTFOUND; break;
+		}
+	}
+
+	pStmt->dp.cArgs  = cArgs;
+	pStmt->dp.rgvarg = pStmt->rgArgs;
+
+	/* The property value is the last argument, so it is rgvarg[0] */
+	if (invokeType & (DISPATCH_PROPERTYPUT | DISPATCH_PROPERTYPUTREF))
+	{
+		pStmt->dispIDPut            = DISPID_PROPERTYPUT;
+		pStmt->dp.cNamedArgs        = 1;
+		pStmt->dp.rgdispidNamedArgs = &pStmt->dispIDPut;
+	}
+
+	*ppStmt = pStmt;
+
+	return DH_EXIT(NOERROR, szMember);
+}
+
+
+
+/* ========================================================================== */
+HRESULT dhStmtPrepare(PDH_STMT * ppStmt, int invokeType, VARTYPE returnType, IDispatch * pDisp, LPCOLESTR szMember, ...)
+{
+	HRESULT hr;
+	va_list marker;
+
+	DH_ENTER(L"StmtPrepare");
+
+	va_start(marker, szMember);
+
+	hr = dhStmtPrepareV(ppStmt, invokeType, returnType, pDisp, szMember, &marker);
+
+	va_end(marker);
+
+	return DH_EXIT(hr, szMember);
+}
+
+
+
+/* **************************************************************************
+ * dhStmtExecute:
+ *   This function executes a prepared statement with the current values of
+ * its bound variables. pvResult may be NULL if the result is not needed.
+ *
+ * Notes:
+ *   The arguments are reused between executions: numbers are written in
+ * place and string buffers are only reallocated when the length changes.
+ *
+ ============================================================================ */
+HRESULT dhStmtExecute(PDH_STMT pStmt, VARIANT * pvResult)
+{
+	EXCEPINFO excep = { 0 };
+	UINT uiArgErr = 0, iArg;
+	HRESULT hr = NOERROR;
+
+	DH_ENTER(L"StmtExecute");
+
+	if (!pStmt) return DH_EXIT(E_INVALIDARG, NULL);
+
+	for (iArg = 0; iArg < pStmt->cArgs && SUCCEEDED(hr); iArg++)
+	{
+		hr = LoadArgument(&pStmt->rgSlots[iArg], &pStmt->rgArgs[iArg]);
+	}
+
+	if (FAILED(hr)) return DH_EXIT(hr, pStmt->szMember);
+
+	if (pvResult) VariantInit(pvResult);
+
+	hr = dhInterceptInvoke(pStmt->pTarget, pStmt->szName, pStmt->dispID, pStmt->invokeType,
+	                       &pStmt->dp, pvResult, &excep, &uiArgErr);
+
+	/* Coerce the result, as dhInvoke does */
+	if (SUCCEEDED(hr) && pvResult && pStmt->returnType != VT_EMPTY && V_VT(pvResult) != pStmt->returnType)
+	{
+		hr = VariantChangeType(pvResult, pvResult, 16 /* = VARIANT_LOCALBOOL */, pStmt->returnType);
+		if (FAILED(hr)) VariantClear(pvResult);
+	}
+
+	return DH_EXITEX(hr, TRUE, pStmt->szName, pStmt->szMember, &excep, uiArgErr);
+}
+
+
+
+/* **************************************************************************
+ * dhStmtFree:
+ *   This function frees a prepared statement and releases its target object.
+ *
+ ============================================================================ */
+void dhStmtFree(PDH_STMT pStmt)
+{
+	UINT iArg;
+
+	if (!pStmt) return;
+
+	/* Only the string buffers for %S and %s are owned by the statement */
+	for (iArg = 0; iArg < pStmt->cArgs; iArg++)
+	{
+		if (pStmt->rgSlots[iArg].chIdentifier == L'S' || pStmt->rgSlots[iArg].chIdentifier == L's')
+		{
+			SysFreeString(V_BSTR(&pStmt->rgArgs[iArg]));
+		}
+	}
+
+	SAFE_RELEASE(pStmt->pTarget);
+
+	HeapFree(GetProcessHeap(), 0, pStmt);
+}
@@ -0,0 +1,841 @@
+/* This file is part of the source code for the DispHelper COM helper library.
+ * DispHelper allows you to call COM objects with an extremely simple printf style syntax.
+ * DispHelper can be used from C++ or even plain C. It works with most Windows compilers
+ * including Dev-CPP, Visual C++ and LCC-WIN32. Including DispHelper in your project
+ * couldn't be simpler as it is available in a compacted single file version.
+ *
+ * Included with DispHelper are over 20 samples that demonstrate using COM objects
+ * including ADO, CDO, Outlook, Eudora, Excel, Word, Internet Explorer, MSHTML,
+ * PocketSoap, Word Perfect, MS Agent, SAPI, MSXML, WIA, dexplorer and WMI.
+ *
+ * DispHelper is free open source software provided under the BSD license.
+ *
+ * Find out more and download DispHelper at:
+ * http://sourceforge.net/projects/disphelper/
+ * http://disphelper.sourceforge.net/
+ */
+
+
+/* Note: The functions in this file are not available in the DispHelper
+ * single file version and are considered extras.
+ */
+
+
+#define DISPHELPER_INTERNAL_BUILD
+#include "disphelper.h"
+
+/* The kinds of task processed by a worker */
+#define DH_TASK_RUN     0
+#define DH_TASK_CALL    1
+#define DH_TASK_CREATE  2
+#define DH_TASK_DETACH  3
+#define DH_TASK_RELEASE 4
+
+/* Structure to store a queued task */
+typedef struct tagDH_WORKER_TASK
+{
+	SLIST_ENTRY entry; /* Must be first */
+	int nKind;
+	DH_WORKER_JOB pfnJob;
+	DH_WORKER_CALL pfnCall;
+	LPVOID pContext;
+	PDH_WORKER_OBJECT pObject;
+
+	/* DH_TASK_CREATE only, which is waited for by the caller */
+	LPCOLESTR szProgId;
+	LPCWSTR szMachine;
+	HANDLE hDone;
+	HRESULT hr;
+} DH_WORKER_TASK;
+
+/* Structure to store a worker thread and its queues. Tasks for the objects
+ * pinned to the worker are only run by it, in the order they were queued.
+ * Apartment neutral jobs may be stolen by any idle worker. */
+typedef struct tagDH_WORKER
+{
+	SLIST_HEADER slPinned;  /* Must be first, for alignment */
+	SLIST_HEADER slNeutral;
+	PDH_WORKER_POOL pPool;
+	UINT iWorker;
+	HANDLE hThread;
+	DWORD dwThreadId;
+	HANDLE hWake;
+	LONG bIdle;
+} DH_WORKER;
+
+/* Structure to store a worker pool */
+struct tagDH_WORKER_POOL
+{
+	DH_WORKER * rgWorkers;
+	UINT cWorkers;
+	BOOL bMultiThreaded;
+	IGlobalInterfaceTable * pGIT;
+	LONG iNextWorker;
+	LONG cPending;
+	CRITICAL_SECTION csQuiet;
+	HANDLE hQuiet;
+	LONG bStop;
+};
+
+/* Structure to store an object pinned to a worker. The object is held by the
+ * global interface table, and each worker which calls it keeps its own
+ * pointer in rgpDisp, which is only used on that worker. */
+struct tagDH_WORKER_OBJECT
+{
+	PDH_WORKER_POOL pPool;
+	LONG iOwner;
+	LONG cReleases;
+	DWORD dwCookie;
+	IDispatch * rgpDisp[1];
+};
+
+
+
+/* **************************************************************************
+ * FindCurrentWorker:
+ *   Returns the worker running on the calling thread, or NULL.
+ *
+ ============================================================================ */
+static DH_WORKER * FindCurrentWorker(PDH_WORKER_POOL pPool)
+{
+	DWORD dwThreadId = GetCurrentThreadId();
+	UINT iWorker;
+
+	for (iWorker = 0; iWorker < pPool->cWorkers; iWorker++)
+	{
+		if (pPool->rgWorkers[iWorker].dwThreadId == dwThreadId) return &pPool->rgWorkers[iWorker];
+	}
+
+	return NULL;
+}
+
+
+
+/* **************************************************************************
+ * NextWorker:
+ *   Picks a worker in turn for a task or an object with no other preference.
+ *
+ ============================================================================ */
+static UINT NextWorker(PDH_WORKER_POOL pPool)
+{
+	return (UINT) InterlockedIncrement(&pPool->iNextWorker) % pPool->cWorkers;
+}
+
+
+
+/* **************************************************************************
+ * CreateTask:
+ *   Allocates a task.
+ *
+ ============================================================================ */
+static DH_WORKER_TASK * CreateTask(int nKind, PDH_WORKER_OBJECT pObject)
+{
+	DH_WORKER_TASK * pTask = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DH_WORKER_TASK));
+
+	if (pTask)
+	{
+		pTask->nKind   = nKind;
+		pTask->pObject = pObject;
+	}
+
+	return pTask;
+}
+
+
+
+/* **************************************************************************
+ * UpdateQuiet:
+ *   Sets hQuiet if no tasks are pending and resets it otherwise. This is called
+ * after cPending goes from zero to one or back, under a lock and reading the
+ * count again, so that a completion racing a submission can not leave the
+ * event set while tasks are still pending.
+ *
+ ============================================================================ */
+static void UpdateQuiet(PDH_WORKER_POOL pPool)
+{
+	EnterCriticalSection(&pPool->csQuiet);
+
+	if (pPool->cPending == 0) SetEvent(pPool->hQuiet);
+	else ResetEvent(pPool->hQuiet);
+
+	LeaveCriticalSection(&pPool->csQuiet);
+}
+
+
+
+/* **************************************************************************
+ * QueueTask:
+ *   Adds a task to a worker's pinned or neutral queue and wakes the worker.
+ * A neutral task queued to a busy worker also wakes an idle worker to steal it.
+ *
+ ============================================================================ */
+static void QueueTask(PDH_WORKER_POOL pPool, UINT iWorker, DH_WORKER_TASK * pTask, BOOL bNeutral)
+{
+	DH_WORKER * pWorker = &pPool->rgWorkers[iWorker];
+	UINT iIdle;
+
+	/* Reset before the task can run, so its completion can not be missed */
+	if (InterlockedIncrement(&pPool->cPending) == 1) UpdateQuiet(pPool);
+
+	InterlockedPushEntrySList(bNeutral ? &pWorker->slNeutral : &pWorker->slPinned, &pTask->entry);
+
+	SetEvent(pWorker->hWake);
+
+	if (bNeutral && !pWorker->bIdle)
+	{
+		for (iIdle = 0; iIdle < pPool->cWorkers; iIdle++)
+		{
+			if (pPool->rgWorkers[iIdle].bIdle)
+			{
+				SetEvent(pPool->rgWorkers[iIdle].hWake);
+				break;
+			}
+		}
+	}
+}
+
+
+
+/* **************************************************************************
+ * ReleaseLocal:
+ *   Releases a worker's own pointer to an object. Must be called on the worker.
+ *
+ ============================================================================ */
+static void ReleaseLocal(DH_WORKER * pWorker, PDH_WORKER_OBJECT pObject)
+{
+	IDispatch * pDisp = pObject->rgpDisp[pWorker->iWorker];
+
+	if (pDisp)
+	{
+		pObject->rgpDisp[pWorker->iWorker] = NULL;
+		pDisp->lpVtbl->Release(pDisp);
+	}
+}
+
+
+
+/* **************************************************************************
+ * CreatePinned:
+ *   Creates an object on a worker, which becomes its owner. Must be called
+ * on the worker.
+ *
+ ============================================================================ */
+static HRESULT CreatePinned(DH_WORKER * pWorker, PDH_WORKER_OBJECT pObject, LPCOLESTR szProgId, LPCWSTR szMachine)
+{
+	IDispatch * pDisp = NULL;
+	HRESULT hr;
+
+	hr = dhCreateObject(szProgId, szMachine, &pDisp);
+
+	if (SUCCEEDED(hr))
+	{
+		hr = pObject->pPool->pGIT->lpVtbl->RegisterInterfaceInGlobal(pObject->pPool->pGIT, (IUnknown *) pDisp,
+		                                                              &IID_IDispatch, &pObject->dwCookie);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		pObject->iOwner = pWorker->iWorker;
+		pObject->rgpDisp[pWorker->iWorker] = pDisp;
+	}
+	else if (pDisp)
+	{
+		pDisp->lpVtbl->Release(pDisp);
+	}
+
+	return hr;
+}
+
+
+
+/* **************************************************************************
+ * RunTask:
+ *   Carries out a task on a worker. hrInit is the result of initializing the
+ * worker's apartment.
+ *
+ ============================================================================ */
+static void RunTask(DH_WORKER * pWorker, DH_WORKER_TASK * pTask, HRESULT hrInit)
+{
+	PDH_WORKER_POOL pPool = pWorker->pPool;
+	PDH_WORKER_OBJECT pObject = pTask->pObject;
+	IDispatch ** ppDisp;
+	HRESULT hr = hrInit;
+
+	switch (pTask->nKind)
+	{
+		case DH_TASK_RUN:
+			pTask->pfnJob(pTask->pContext);
+			break;
+
+		case DH_TASK_CALL:
+			ppDisp = &pObject->rgpDisp[pWorker->iWorker];
+
+			/* The object was attached from, or moved from, another apartment */
+			if (SUCCEEDED(hr) && !*ppDisp)
+			{
+				hr = pPool->pGIT->lpVtbl->GetInterfaceFromGlobal(pPool->pGIT, pObject->dwCookie,
+				                                                  &IID_IDispatch, (void **) ppDisp);
+			}
+
+			pTask->pfnCall(hr, (SUCCEEDED(hr) ? *ppDisp : NULL), pTask->pContext);
+			break;
+
+		case DH_TASK_CREATE:
+			if (SUCCEEDED(hr)) hr = CreatePinned(pWorker, pObject, pTask->szProgId, pTask->szMachine);
+
+			/* The task belongs to the waiting caller */
+			pTask->hr = hr;
+			SetEvent(pTask->hDone);
+			pTask = NULL;
+			break;
+
+		case DH_TASK_DETACH:
+			ReleaseLocal(pWorker, pObject);
+			break;
+
+		case DH_TASK_RELEASE:
+			ReleaseLocal(pWorker, pObject);
+
+			if (InterlockedDecrement(&pObject->cReleases) == 0)
+			{
+				pPool->pGIT->lpVtbl->RevokeInterfaceFromGlobal(pPool->pGIT, pObject->dwCookie);
+				HeapFree(GetProcessHeap(), 0, pObject);
+			}
+			break;
+	}
+
+	if (pTask) HeapFree(GetProcessHeap(), 0, pTask);
+
+	if (InterlockedDecrement(&pPool->cPending) == 0) UpdateQuiet(pPool);
+}
+
+
+
+/* **************************************************************************
+ * RunPinnedTasks:
+ *   Runs all the tasks queued for the objects pinned to a worker, in the
+ * order they were queued. Returns FALSE if there were none.
+ *
+ ============================================================================ */
+static BOOL RunPinnedTasks(DH_WORKER * pWorker, HRESULT hrInit)
+{
+	PSLIST_ENTRY pEntry, pOrdered = NULL, pNext;
+
+	if (!(pEntry = InterlockedFlushSList(&pWorker->slPinned))) return FALSE;
+
+	/* The list is in the reverse order of submission */
+	while (pEntry)
+	{
+		pNext = pEntry->Next;
+		pEntry->Next = pOrdered;
+		pOrdered = pEntry;
+		pEntry = pNext;
+	}
+
+	while (pOrdered)
+	{
+		pNext = pOrdered->Next;
+		RunTask(pWorker, (DH_WORKER_TASK *) pOrdered, hrInit);
+		pOrdered = pNext;
+	}
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * RunNeutralTask:
+ *   Runs one apartment neutral job, from the worker's own queue or else
+ * stolen from another worker. Returns FALSE if there was none.
+ *
+ ============================================================================ */
+static BOOL RunNeutralTask(DH_WORKER * pWorker, HRESULT hrInit)
+{
+	PDH_WORKER_POOL pPool = pWorker->pPool;
+	PSLIST_ENTRY pEntry = NULL;
+	UINT i;
+
+	for (i = 0; i < pPool->cWorkers && !pEntry; i++)
+	{
+		pEntry = InterlockedPopEntrySList(&pPool->rgWorkers[(pWorker->iWorker + i) % pPool->cWorkers].slNeutral);
+	}
+
+	if (!pEntry) return FALSE;
+
+	RunTask(pWorker, (DH_WORKER_TASK *) pEntry, hrInit);
+
+	return TRUE;
+}
+
+
+
+/* **************************************************************************
+ * WorkerThread:
+ *   A worker initializes its apartment with dhInitializeImp (or
+ * CoInitializeEx for a multithreaded pool), then runs its pinned tasks
+ * ahead of neutral jobs until the pool is destroyed.
+ *
+ ============================================================================ */
+static DWORD WINAPI WorkerThread(LPVOID lpParameter)
+{
+	DH_WORKER * pWorker = lpParameter;
+	PDH_WORKER_POOL pPool = pWorker->pPool;
+	DWORD dwIndex;
+	HRESULT hrInit;
+
+	if (pPool->bMultiThreaded)
+	{
+		hrInit = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+		if (SUCCEEDED(hrInit)) dhInitializeImp(FALSE, dh_g_bIsUnicodeMode);
+	}
+	else
+	{
+		hrInit = dhInitializeImp(TRUE, dh_g_bIsUnicodeMode);
+	}
+
+	for (;;)
+	{
+		if (RunPinnedTasks(pWorker, hrInit) || RunNeutralTask(pWorker, hrInit)) continue;
+
+		if (pPool->bStop) break;
+
+		InterlockedExchange(&pWorker->bIdle, TRUE);
+
+		/* Keep dispatching messages while idle, as required in an STA */
+		CoWaitForMultipleHandles(0, INFINITE, 1, &pWorker->hWake, &dwIndex);
+
+		InterlockedExchange(&pWorker->bIdle, FALSE);
+	}
+
+	dhUninitialize(SUCCEEDED(hrInit));
+
+	return 0;
+}
+
+
+
+/* **************************************************************************
+ * dhCreateWorkerPool:
+ *   This function starts a pool of worker threads, each in its own single
+ * threaded apartment or all in the multithreaded apartment.
+ *
+ * Parameter Info:
+ *   cWorkers       - The number of workers, or zero for one per processor.
+ *   bMultiThreaded - TRUE for MTA workers, FALSE for STA workers.
+ *   ppPool         - Receives the pool.
+ *
+ * Notes:
+ *   COM must be initialized on the calling thread.
+ *
+ ============================================================================ */
+HRESULT dhCreateWorkerPool(UINT cWorkers, BOOL bMultiThreaded, PDH_WORKER_POOL * ppPool)
+{
+	PDH_WORKER_POOL pPool;
+	SYSTEM_INFO si;
+	UINT iWorker;
+	HRESULT hr;
+
+	DH_ENTER(L"CreateWorkerPool");
+
+	if (!ppPool) return DH_EXIT(E_INVALIDARG, NULL);
+
+	*ppPool = NULL;
+
+	if (cWorkers == 0)
+	{
+		GetSystemInfo(&si);
+		cWorkers = (si.dwNumberOfProcessors ? si.dwNumberOfProcessors : 1);
+	}
+
+	pPool = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(struct tagDH_WORKER_POOL));
+	if (!pPool) return DH_EXIT(E_OUTOFMEMORY, NULL);
+
+	pPool->bMultiThreaded = bMultiThreaded;
+	InitializeCriticalSection(&pPool->csQuiet);
+
+	/* The heap returns blocks aligned as SLIST_HEADER requires */
+	pPool->rgWorkers = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, cWorkers * sizeof(DH_WORKER));
+
+	if (!pPool->rgWorkers)
+		hr = E_OUTOFMEMORY;
+	else if (!(pPool->hQuiet = CreateEvent(NULL, TRUE, TRUE, NULL)))
+		hr = HRESULT_FROM_WIN32(GetLastError());
+	else
+		hr = CoCreateInstance(&CLSID_StdGlobalInterfaceTable, NULL, CLSCTX_INPROC_SERVER,
+		                      &IID_IGlobalInterfaceTable, (void **) &pPool->pGIT);
+
+	for (iWorker = 0; SUCCEEDED(hr) && iWorker < cWorkers; iWorker++)
+	{
+		DH_WORKER * pWorker = &pPool->rgWorkers[iWorker];
+
+		InitializeSListHead(&pWorker->slPinned);
+		InitializeSListHead(&pWorker->slNeutral);
+		pWorker->pPool   = pPool;
+		pWorker->iWorker = iWorker;
+
+		if (!(pWorker->hWake = CreateEvent(NULL, FALSE, FALSE, NULL)) ||
+		    !(pWorker->hThread = CreateThread(NULL, 0, WorkerThread, pWorker, 0, &pWorker->dwThreadId)))
+		{
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		}
+
+		/* Only started workers are stopped by dhDestroyWorkerPool */
+		pPool->cWorkers = iWorker + (pWorker->hThread ? 1 : 0);
+	}
+
+	if (FAILED(hr))
+	{
+		if (pPool->rgWorkers && pPool->cWorkers < cWorkers && pPool->rgWorkers[pPool->cWorkers].hWake)
+		{
+			CloseHandle(pPool->rgWorkers[pPool->cWorkers].hWake);
+		}
+
+		dhDestroyWorkerPool(pPool);
+		return DH_EXIT(hr, NULL);
+	}
+
+	*ppPool = pPool;
+
+	return DH_EXIT(NOERROR, NULL);
+}
+
+
+
+/* **************************************************************************
+ * dhDestroyWorkerPool:
+ *   This function completes the tasks already queued, then stops the
+ * workers. Objects should be released with dhWorkerPoolReleaseObject
+ * beforehand.
+ *
+ ============================================================================ */
+void dhDestroyWorkerPool(PDH_WORKER_POOL pPool)
+{
+	UINT iWorker;
+
+	if (!pPool) return;
+
+	InterlockedExchange(&pPool->bStop, TRUE);
+
+	for (iWorker = 0; iWorker < pPool->cWorkers; iWorker++) SetEvent(pPool->rgWorkers[iWorker].hWake);
+
+	for (iWorker = 0; iWorker < pPool->cWorkers; iWorker++)
+	{
+		WaitForSingleObject(pPool->rgWorkers[iWorker].hThread, INFINITE);
+		CloseHandle(pPool->rgWorkers[iWorker].hThread);
+		CloseHandle(pPool->rgWorkers[iWorker].hWake);
+	}
+
+	if (pPool->pGIT) pPool->pGIT->lpVtbl->Release(pPool->pGIT);
+	if (pPool->hQuiet) CloseHandle(pPool->hQuiet);
+	DeleteCriticalSection(&pPool->csQuiet);
+	if (pPool->rgWorkers) HeapFree(GetProcessHeap(), 0, pPool->rgWorkers);
+
+	HeapFree(GetProcessHeap(), 0, pPool);
+}
+
+
+
+/* **************************************************************************
+ * dhWorkerPoolSubmit:
+ *   This function queues an apartment neutral job, which may run on any
+ * worker. A job submitted from a worker is queued to that worker, other jobs
+ * are spread across the workers in turn, and idle workers steal jobs queued
+ * to busy ones. Jobs are not run in any particular order.
+ *
+ ============================================================================ */
+HRESULT dhWorkerPoolSubmit(PDH_WORKER_POOL pPool, DH_WORKER_JOB pfnJob, LPVOID pContext)
+{
+	DH_WORKER_TASK * pTask;
+	DH_WORKER * pWorker;
+
+	if (!pPool || !pfnJob) return E_INVALIDARG;
+
+	if (!(pTask = CreateTask(DH_TASK_RUN, NULL))) return E_OUTOFMEMORY;
+
+	pTask->pfnJob   = pfnJob;
+	pTask->pContext = pContext;
+
+	pWorker = FindCurrentWorker(pPool);
+
+	QueueTask(pPool, (pWorker ? pWorker->iWorker : NextWorker(pPool)), pTask, TRUE);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * AllocObject:
+ *   Allocates an object record with a pointer slot per worker.
+ *
+ ============================================================================ */
+static PDH_WORKER_OBJECT AllocObject(PDH_WORKER_POOL pPool)
+{
+	PDH_WORKER_OBJECT pObject = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
+	                                      sizeof(struct tagDH_WORKER_OBJECT) + pPool->cWorkers * sizeof(IDispatch *));
+
+	if (pObject) pObject->pPool = pPool;
+
+	return pObject;
+}
+
+
+
+/* **************************************************************************
+ * dhWorkerPoolCreateObject:
+ *   This function creates an object on a worker and pins it there. An
+ * object created from a worker's own job is pinned to that worker, otherwise
+ * the workers are used in turn.
+ *
+ ============================================================================ */
+HRESULT dhWorkerPoolCreateObject(PDH_WORKER_POOL pPool, LPCOLESTR szProgId, LPCWSTR szMachine, PDH_WORKER_OBJECT * ppObject)
+{
+	PDH_WORKER_OBJECT pObject;
+	DH_WORKER_TASK * pTask;
+	DH_WORKER * pWorker;
+	HRESULT hr;
+
+	DH_ENTER(L"WorkerPoolCreateObject");
+
+	if (!pPool || !szProgId || !ppObject) return DH_EXIT(E_INVALIDARG, szProgId);
+
+	*ppObject = NULL;
+
+	if (!(pObject = AllocObject(pPool))) return DH_EXIT(E_OUTOFMEMORY, szProgId);
+
+	if ((pWorker = FindCurrentWorker(pPool)) != NULL)
+	{
+		hr = CreatePinned(pWorker, pObject, szProgId, szMachine);
+	}
+	else if (!(pTask = CreateTask(DH_TASK_CREATE, pObject)))
+	{
+		hr = E_OUTOFMEMORY;
+	}
+	else
+	{
+		pTask->szProgId  = szProgId;
+		pTask->szMachine = szMachine;
+
+		if (!(pTask->hDone = CreateEvent(NULL, TRUE, FALSE, NULL)))
+		{
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		}
+		else
+		{
+			QueueTask(pPool, NextWorker(pPool), pTask, FALSE);
+			WaitForSingleObject(pTask->hDone, INFINITE);
+			hr = pTask->hr;
+			CloseHandle(pTask->hDone);
+		}
+
+		HeapFree(GetProcessHeap(), 0, pTask);
+	}
+
+	if (FAILED(hr))
+	{
+		HeapFree(GetProcessHeap(), 0, pObject);
+		return DH_EXIT(hr, szProgId);
+	}
+
+	*ppObject = pObject;
+
+	return DH_EXIT(NOERROR, szProgId);
+}
+
+
+
+/* **************************************************************************
+ * dhWorkerPoolAttachObject:
+ *   This function pins an existing object to a worker. An object attached
+ * from a worker's own job is pinned to that worker, otherwise the workers
+ * are used in turn and the object is marshalled to its owner on first use.
+ *
+ ============================================================================ */
+HRESULT dhWorkerPoolAttachObject(PDH_WORKER_POOL pPool, IDispatch * pDisp, PDH_WORKER_OBJECT * ppObject)
+{
+	PDH_WORKER_OBJECT pObject;
+	DH_WORKER * pWorker;
+	HRESULT hr;
+
+	if (!pPool || !pDisp || !ppObject) return E_INVALIDARG;
+
+	*ppObject = NULL;
+
+	if (!(pObject = AllocObject(pPool))) return E_OUTOFMEMORY;
+
+	hr = pPool->pGIT->lpVtbl->RegisterInterfaceInGlobal(pPool->pGIT, (IUnknown *) pDisp, &IID_IDispatch, &pObject->dwCookie);
+
+	if (FAILED(hr))
+	{
+		HeapFree(GetProcessHeap(), 0, pObject);
+		return hr;
+	}
+
+	if ((pWorker = FindCurrentWorker(pPool)) != NULL)
+	{
+		pDisp->lpVtbl->AddRef(pDisp);
+		pObject->rgpDisp[pWorker->iWorker] = pDisp;
+		pObject->iOwner = pWorker->iWorker;
+	}
+	else
+	{
+		pObject->iOwner = NextWorker(pPool);
+	}
+
+	*ppObject = pObject;
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhWorkerPoolCall:
+ *   This function queues a call to the worker which owns an object. Calls
+ * to an object run in the order they were queued. pfnCall receives a pointer
+ * to the object which is valid on that worker, or the error if the object
+ * could not be marshalled there.
+ *
+ ============================================================================ */
+HRESULT dhWorkerPoolCall(PDH_WORKER_OBJECT pObject, DH_WORKER_CALL pfnCall, LPVOID pContext)
+{
+	DH_WORKER_TASK * pTask;
+
+	if (!pObject || !pfnCall) return E_INVALIDARG;
+
+	if (!(pTask = CreateTask(DH_TASK_CALL, pObject))) return E_OUTOFMEMORY;
+
+	pTask->pfnCall  = pfnCall;
+	pTask->pContext = pContext;
+
+	QueueTask(pObject->pPool, (UINT) pObject->iOwner, pTask, FALSE);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhWorkerPoolMoveObject:
+ *   This function pins an object to another worker. Calls already queued
+ * still run on the previous owner, which then releases its pointer. The new
+ * owner gets the object from the global interface table on first use.
+ *
+ ============================================================================ */
+HRESULT dhWorkerPoolMoveObject(PDH_WORKER_OBJECT pObject, UINT iWorker)
+{
+	DH_WORKER_TASK * pTask;
+	LONG iPrevious;
+
+	if (!pObject || iWorker >= pObject->pPool->cWorkers) return E_INVALIDARG;
+
+	if (!(pTask = CreateTask(DH_TASK_DETACH, pObject))) return E_OUTOFMEMORY;
+
+	iPrevious = InterlockedExchange(&pObject->iOwner, (LONG) iWorker);
+
+	if ((UINT) iPrevious == iWorker)
+		HeapFree(GetProcessHeap(), 0, pTask);
+	else
+		QueueTask(pObject->pPool, (UINT) iPrevious, pTask, FALSE);
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhWorkerPoolGetObject:
+ *   This function returns a pointer to an object which is valid in the
+ * calling thread's apartment. The caller must release it.
+ *
+ ============================================================================ */
+HRESULT dhWorkerPoolGetObject(PDH_WORKER_OBJECT pObject, IDispatch ** ppDisp)
+{
+	IGlobalInterfaceTable * pGIT;
+
+	if (!pObject || !ppDisp) return E_INVALIDARG;
+
+	pGIT = pObject->pPool->pGIT;
+
+	return pGIT->lpVtbl->GetInterfaceFromGlobal(pGIT, pObject->dwCookie, &IID_IDispatch, (void **) ppDisp);
+}
+
+
+
+/* **************************************************************************
+ * dhWorkerPoolGetOwner:
+ *   This function returns the index of the worker an object is pinned to.
+ *
+ ============================================================================ */
+UINT dhWorkerPoolGetOwner(PDH_WORKER_OBJECT pObject)
+{
+	return (pObject ? (UINT) pObject->iOwner : 0);
+}
+
+
+
+/* **************************************************************************
+ * dhWorkerPoolReleaseObject:
+ *   This function queues the release of an object. Each worker releases
+ * its own pointer to it after the calls already queued to it.
+ *
+ ============================================================================ */
+HRESULT dhWorkerPoolReleaseObject(PDH_WORKER_OBJECT pObject)
+{
+	PDH_WORKER_POOL pPool;
+	DH_WORKER_TASK * pTasks = NULL, * pTask;
+	UINT iWorker;
+
+	if (!pObject) return E_INVALIDARG;
+
+	pPool = pObject->pPool;
+
+	/* Allocate every task first, so that the release is all or nothing */
+	for (iWorker = 0; iWorker < pPool->cWorkers; iWorker++)
+	{
+		if (!(pTask = CreateTask(DH_TASK_RELEASE, pObject)))
+		{
+			while (pTasks)
+			{
+				pTask = (DH_WORKER_TASK *) pTasks->entry.Next;
+				HeapFree(GetProcessHeap(), 0, pTasks);
+				pTasks = pTask;
+			}
+
+			return E_OUTOFMEMORY;
+		}
+
+		pTask->entry.Next = (PSLIST_ENTRY) pTasks;
+		pTasks = pTask;
+	}
+
+	pObject->cReleases = (LONG) pPool->cWorkers;
+
+	for (iWorker = 0; iWorker < pPool->cWorkers; iWorker++)
+	{
+		pTask  = pTasks;
+		pTasks = (DH_WORKER_TASK *) pTask->entry.Next;
+		QueueTask(pPool, iWorker, pTask, FALSE);
+	}
+
+	return NOERROR;
+}
+
+
+
+/* **************************************************************************
+ * dhWorkerPoolWait:
+ *   This function waits until every task queued to the pool has completed,
+ * or returns HRESULT_FROM_WIN32(WAIT_TIMEOUT). It must not be called from
+ * a worker.
+ *
+ ============================================================================ */
+HRESULT dhWorkerPoolWait(PDH_WORKER_POOL pPool, DWORD dwTimeout)
+{
+	if (!pPool || FindCurrentWorker(pPool)) return E_INVALIDARG;
+
+	if (WaitForSingleObject(pPool->hQuiet, dwTimeout) != WAIT_OBJECT_0) return HRESULT_FROM_WIN32(WAIT_TIMEOUT);
+
+	return NOERROR;
+}
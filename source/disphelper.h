@@ -37,14 +37,30 @@ HRESULT dhCallMethod(IDispatch * pDisp, LPCOLESTR szMember, ...);
 HRESULT dhPutValue(IDispatch * pDisp, LPCOLESTR szMember, ...);
 HRESULT dhPutRef(IDispatch * pDisp, LPCOLESTR szMember, ...);
 HRESULT dhGetValue(LPCWSTR szIdentifier, void * pResult, IDispatch * pDisp, LPCOLESTR szMember, ...);
+HRESULT dhGetValues(IDispatch * pDisp, LPCOLESTR szFields, ...);
+HRESULT dhGetValuesEx(HRESULT * rghrFields, UINT cFields, IDispatch * pDisp, LPCOLESTR szFields, ...);
 
 HRESULT dhInvoke(int invokeType, VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember, ...);
 HRESULT dhInvokeArray(int invokeType, VARIANT * pvResult, UINT cArgs, IDispatch * pDisp, LPCOLESTR szMember, VARIANT * pArgs);
+HRESULT dhInvokeArrayEx(int invokeType, VARIANT * pvResult, UINT cArgs, IDispatch * pDisp, LPCOLESTR szMember, VARIANT * pArgs, UINT cNamedArgs, LPCOLESTR * pszArgNames);
+
+/* A member name with its length and case insensitive hash computed ahead of
+ * time, with dhInitAtom or the _dh literals of the C++ API */
+typedef struct tagDH_ATOM
+{
+	LPCOLESTR szName;
+	UINT cchName;
+	ULONG ulHash;
+} DH_ATOM, * PDH_ATOM;
+
+HRESULT dhInitAtom(PDH_ATOM pAtom, LPCOLESTR szName);
+HRESULT dhInvokeAtom(int invokeType, VARIANT * pvResult, UINT cArgs, IDispatch * pDisp, const DH_ATOM * pAtom, VARIANT * pArgs);
 
 HRESULT dhCallMethodV(IDispatch * pDisp, LPCOLESTR szMember, va_list * marker);
 HRESULT dhPutValueV(IDispatch * pDisp, LPCOLESTR szMember, va_list * marker);
 HRESULT dhPutRefV(IDispatch * pDisp, LPCOLESTR szMember, va_list * marker);
 HRESULT dhGetValueV(LPCWSTR szIdentifier, void * pResult, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker);
+HRESULT dhGetValuesV(HRESULT * rghrFields, UINT cFields, IDispatch * pDisp, LPCOLESTR szFields, va_list * marker);
 HRESULT dhInvokeV(int invokeType, VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker);
 
 HRESULT dhAutoWrap(int invokeType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember, UINT cArgs, ...);
@@ -55,9 +71,103 @@ HRESULT dhEnumBeginV(IEnumVARIANT ** ppEnum, IDispatch * pDisp, LPCOLESTR szMemb
 HRESULT dhEnumNextObject(IEnumVARIANT * pEnum, IDispatch ** ppDisp);
 HRESULT dhEnumNextVariant(IEnumVARIANT * pEnum, VARIANT * pvResult);
 
+/* Ways for dhEnumSlice to reach the items of a collection */
+#define DH_SLICE_NEWENUM 0
+#define DH_SLICE_ITEM0   1
+#define DH_SLICE_ITEM1   2
+
+HRESULT dhEnumSlice(IEnumVARIANT ** ppEnum, IDispatch * pColl, ULONG iStart, ULONG cItems, int nMethod);
+HRESULT dhEnumSliceEnum(IEnumVARIANT ** ppEnum, IEnumVARIANT * pSource, ULONG iStart, ULONG cItems);
+
 HRESULT dhInitializeImp(BOOL bInitializeCOM, BOOL bUnicode);
 void dhUninitialize(BOOL bUninitializeCOM);
 
+HRESULT dhSetDispIdCacheSize(UINT cObjects);
+HRESULT dhFlushDispIdCache(IDispatch * pDisp);
+
+/* Counters reported by dhGetDispIdCacheFileStatistics */
+typedef struct tagDH_DISPID_FILE_STATISTICS
+{
+	ULONG cHits;
+	ULONG cMisses;
+	ULONG cAppended;
+	ULONG cUnverified;
+	UINT cEntries;
+	DWORD cbUsed;
+} DH_DISPID_FILE_STATISTICS, * PDH_DISPID_FILE_STATISTICS;
+
+HRESULT dhSetDispIdCacheFile(LPCWSTR szFile, DWORD cbMaxSize);
+HRESULT dhGetDispIdCacheFileStatistics(PDH_DISPID_FILE_STATISTICS pStatistics, BOOL bReset);
+
+HRESULT dhPrewarm(IDispatch * pDisp, LPCOLESTR szNames);
+HRESULT dhPrewarmTypeLib(IDispatch * pDisp);
+
+HRESULT dhSetClassFactoryCache(UINT cEntries, DWORD dwTimeToLive);
+HRESULT dhFlushClassFactoryCache(LPCOLESTR szProgId);
+
+/* Counters reported by dhGetSingleFlightStatistics */
+typedef struct tagDH_SINGLEFLIGHT_STATISTICS
+{
+	ULONG cCalls;
+	ULONG cInvokes;
+	ULONG cCoalesced;
+} DH_SINGLEFLIGHT_STATISTICS, * PDH_SINGLEFLIGHT_STATISTICS;
+
+HRESULT dhSetSingleFlight(LPCOLESTR szMember, BOOL bEnable);
+HRESULT dhGetSingleFlightStatistics(PDH_SINGLEFLIGHT_STATISTICS pStatistics, BOOL bReset);
+
+HRESULT dhSetPropertyCache(LPCOLESTR szMember, DWORD dwTimeToLive);
+HRESULT dhFlushPropertyCache(IDispatch * pDisp);
+
+/* Counters reported by dhGetMessageFilterStatistics */
+typedef struct tagDH_MESSAGE_FILTER_STATISTICS
+{
+	ULONG cRejections;
+	ULONG cRetries;
+	ULONG cCancelled;
+	ULONG ulDelayMs;
+} DH_MESSAGE_FILTER_STATISTICS, * PDH_MESSAGE_FILTER_STATISTICS;
+
+HRESULT dhSetMessageFilter(BOOL bEnable, DWORD dwDeadline, DWORD dwMaxDelay);
+HRESULT dhGetMessageFilterStatistics(PDH_MESSAGE_FILTER_STATISTICS pStatistics, BOOL bReset);
+
+/* Returned by a call cancelled because it passed the timeout set with dhSetCallTimeout */
+#define DH_E_CALL_TIMEOUT MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x0201)
+
+/* Call latency buckets: < 1ms, < 10ms, < 100ms, < 1s and longer */
+#define DH_CALL_HISTOGRAM_BUCKETS 5
+
+/* Counters reported by dhGetCallStatistics */
+typedef struct tagDH_CALL_STATISTICS
+{
+	ULONG cCalls;
+	ULONG cTimeouts;
+	ULONG rgHistogram[DH_CALL_HISTOGRAM_BUCKETS];
+} DH_CALL_STATISTICS, * PDH_CALL_STATISTICS;
+
+DWORD dhSetCallTimeout(DWORD dwTimeout);
+HRESULT dhGetCallStatistics(PDH_CALL_STATISTICS pStatistics, BOOL bReset);
+
+/* A call seen by an interceptor added with dhAddInterceptor */
+typedef struct tagDH_INVOKE_CONTEXT
+{
+	IDispatch * pDisp;
+	LPCOLESTR szMember;
+	DISPID dispID;
+	int invokeType;
+	DISPPARAMS * pDispParams;
+	VARIANT * pvResult;
+	EXCEPINFO * pExcepInfo;
+	UINT * puArgErr;
+	HRESULT hr;
+} DH_INVOKE_CONTEXT, * PDH_INVOKE_CONTEXT;
+
+typedef HRESULT (*DH_PRE_INVOKE) (PDH_INVOKE_CONTEXT pCall, LPVOID pContext);
+typedef void (*DH_POST_INVOKE) (PDH_INVOKE_CONTEXT pCall, LPVOID pContext);
+
+HRESULT dhAddInterceptor(DH_PRE_INVOKE pfnPreInvoke, DH_POST_INVOKE pfnPostInvoke, LPVOID pContext, DWORD * pdwCookie);
+HRESULT dhRemoveInterceptor(DWORD dwCookie);
+
 #define dhInitializeA(bInitializeCOM) dhInitializeImp(bInitializeCOM, FALSE)
 #define dhInitializeW(bInitializeCOM) dhInitializeImp(bInitializeCOM, TRUE)
 
@@ -164,6 +274,339 @@ void dhUninitialize(BOOL bUninitializeCOM);
 
 
 
+/* ===================================================================== */
+
+/* Structure to store one column read by dhEnumProject */
+typedef struct tagDH_COLUMN
+{
+	LPCWSTR szName;
+	VARTYPE vt;
+	WCHAR chIdentifier;
+	UINT cbElement;
+
+	LPVOID pData;
+	BYTE * pbNull;
+} DH_COLUMN;
+
+/* Structure to store the columns read by dhEnumProject */
+typedef struct tagDH_COLUMNS
+{
+	UINT cColumns;
+	UINT cRows;
+	DH_COLUMN * rgColumns;
+
+	UINT cRowsAllocated;
+	LPBYTE pbPool;
+	SIZE_T cbPool;
+	SIZE_T cbPoolAllocated;
+	BSTR bstrSpec;
+} DH_COLUMNS, * PDH_COLUMNS;
+
+HRESULT dhEnumProject(IDispatch * pDisp, LPCOLESTR szColumns, PDH_COLUMNS * ppColumns, UINT * pcRows);
+void dhFreeColumns(PDH_COLUMNS pColumns);
+
+/* Functions to fill column buffers from other sources */
+HRESULT dhCreateColumns(LPCOLESTR szColumns, PDH_COLUMNS * ppColumns);
+HRESULT dhColumnsAddRow(PDH_COLUMNS pColumns, UINT * piRow);
+HRESULT dhColumnsSetValue(PDH_COLUMNS pColumns, UINT iColumn, UINT iRow, VARIANT * pvValue);
+void dhColumnsComplete(PDH_COLUMNS pColumns);
+void dhColumnsReset(PDH_COLUMNS pColumns);
+
+#define DH_COLUMN_DATA(pColumns, iColumn, type) ((type *) (pColumns)->rgColumns[iColumn].pData)
+
+/* Reader returned by dhRecordsetOpen */
+typedef struct tagDH_RECORDSET_READER * PDH_RECORDSET_READER;
+
+HRESULT dhRecordsetOpen(IDispatch * pRecordset, LPCOLESTR szColumns, UINT cPageSize, BOOL bPrefetch, PDH_RECORDSET_READER * ppReader);
+HRESULT dhRecordsetRead(PDH_RECORDSET_READER pReader, PDH_COLUMNS * ppColumns, UINT * piRow);
+void dhRecordsetClose(PDH_RECORDSET_READER pReader);
+
+
+
+
+/* ===================================================================== */
+
+/* Executor thread and completion handle used by dhInvokeAsync */
+typedef struct tagDH_EXECUTOR * PDH_EXECUTOR;
+typedef struct tagDH_ASYNC * PDH_ASYNC;
+
+typedef void (*DH_ASYNC_CALLBACK) (HRESULT hr, VARIANT * pvResult, LPVOID pContext);
+
+HRESULT dhCreateExecutor(PDH_EXECUTOR * ppExecutor);
+void dhDestroyExecutor(PDH_EXECUTOR pExecutor);
+HRESULT dhExecutorCreateObject(PDH_EXECUTOR pExecutor, LPCOLESTR szProgId, LPCWSTR szMachine, IDispatch ** ppDisp);
+HRESULT dhExecutorAttachObject(PDH_EXECUTOR pExecutor, IDispatch * pDisp, IDispatch ** ppExecutorDisp);
+HRESULT dhExecutorReleaseObject(PDH_EXECUTOR pExecutor, IDispatch * pDisp);
+void dhExecutorBeginBatch(PDH_EXECUTOR pExecutor);
+void dhExecutorEndBatch(PDH_EXECUTOR pExecutor);
+
+HRESULT dhInvokeAsync(PDH_EXECUTOR pExecutor, PDH_ASYNC * ppAsync, int invokeType, VARTYPE returnType, IDispatch * pDisp, LPCOLESTR szMember, ...);
+HRESULT dhInvokeAsyncCallback(PDH_EXECUTOR pExecutor, DH_ASYNC_CALLBACK pfnCallback, LPVOID pContext, int invokeType, VARTYPE returnType, IDispatch * pDisp, LPCOLESTR szMember, ...);
+HRESULT dhInvokeAsyncV(PDH_EXECUTOR pExecutor, PDH_ASYNC * ppAsync, DH_ASYNC_CALLBACK pfnCallback, LPVOID pContext, int invokeType, VARTYPE returnType, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker);
+
+HRESULT dhAsyncWait(PDH_ASYNC pAsync, DWORD dwTimeout, VARIANT * pvResult);
+BOOL dhAsyncIsComplete(PDH_ASYNC pAsync);
+void dhAsyncRelease(PDH_ASYNC pAsync);
+
+
+
+
+/* ===================================================================== */
+
+/* Callback used by an object pool to check or reset an object */
+typedef HRESULT (*DH_POOL_CALLBACK) (IDispatch * pDisp, LPVOID pContext);
+
+/* Structure to store the options of an object pool */
+typedef struct tagDH_POOL_OPTIONS
+{
+	LPCOLESTR szProgId;
+	LPCWSTR szMachine;
+	UINT cMin;
+	UINT cMax;
+	DWORD dwIdleTimeout;
+	DH_POOL_CALLBACK pfnHealthCheck;
+	DH_POOL_CALLBACK pfnReset;
+	LPVOID pContext;
+} DH_POOL_OPTIONS, * PDH_POOL_OPTIONS;
+
+/* Checkout latency buckets: < 1ms, < 10ms, < 100ms, < 1s and longer */
+#define DH_POOL_HISTOGRAM_BUCKETS 5
+
+/* Structure to store the counters of an object pool */
+typedef struct tagDH_POOL_STATISTICS
+{
+	UINT cIdle;
+	UINT cInUse;
+	ULONG cCreated;
+	ULONG cDiscarded;
+	ULONG cEvicted;
+	ULONG cCheckouts;
+	ULONG cWaits;
+	ULONGLONG ullCheckoutTotalUs;
+	ULONG ulCheckoutMaxUs;
+	ULONG rgCheckoutHistogram[DH_POOL_HISTOGRAM_BUCKETS];
+} DH_POOL_STATISTICS, * PDH_POOL_STATISTICS;
+
+typedef struct tagDH_OBJECT_POOL * PDH_OBJECT_POOL;
+
+HRESULT dhCreateObjectPool(PDH_POOL_OPTIONS pOptions, PDH_OBJECT_POOL * ppPool);
+void dhDestroyObjectPool(PDH_OBJECT_POOL pPool);
+HRESULT dhPoolCheckout(PDH_OBJECT_POOL pPool, DWORD dwTimeout, IDispatch ** ppDisp);
+HRESULT dhPoolReturn(PDH_OBJECT_POOL pPool, IDispatch * pDisp, BOOL bDiscard);
+void dhPoolTrim(PDH_OBJECT_POOL pPool);
+HRESULT dhPoolGetStatistics(PDH_OBJECT_POOL pPool, PDH_POOL_STATISTICS pStatistics);
+
+
+
+
+/* ===================================================================== */
+
+/* Worker threads and the objects pinned to them */
+typedef struct tagDH_WORKER_POOL * PDH_WORKER_POOL;
+typedef struct tagDH_WORKER_OBJECT * PDH_WORKER_OBJECT;
+
+typedef void (*DH_WORKER_JOB) (LPVOID pContext);
+typedef void (*DH_WORKER_CALL) (HRESULT hr, IDispatch * pDisp, LPVOID pContext);
+
+HRESULT dhCreateWorkerPool(UINT cWorkers, BOOL bMultiThreaded, PDH_WORKER_POOL * ppPool);
+void dhDestroyWorkerPool(PDH_WORKER_POOL pPool);
+HRESULT dhWorkerPoolSubmit(PDH_WORKER_POOL pPool, DH_WORKER_JOB pfnJob, LPVOID pContext);
+HRESULT dhWorkerPoolWait(PDH_WORKER_POOL pPool, DWORD dwTimeout);
+
+HRESULT dhWorkerPoolCreateObject(PDH_WORKER_POOL pPool, LPCOLESTR szProgId, LPCWSTR szMachine, PDH_WORKER_OBJECT * ppObject);
+HRESULT dhWorkerPoolAttachObject(PDH_WORKER_POOL pPool, IDispatch * pDisp, PDH_WORKER_OBJECT * ppObject);
+HRESULT dhWorkerPoolCall(PDH_WORKER_OBJECT pObject, DH_WORKER_CALL pfnCall, LPVOID pContext);
+HRESULT dhWorkerPoolMoveObject(PDH_WORKER_OBJECT pObject, UINT iWorker);
+HRESULT dhWorkerPoolGetObject(PDH_WORKER_OBJECT pObject, IDispatch ** ppDisp);
+UINT dhWorkerPoolGetOwner(PDH_WORKER_OBJECT pObject);
+HRESULT dhWorkerPoolReleaseObject(PDH_WORKER_OBJECT pObject);
+
+
+
+
+/* ===================================================================== */
+
+/* Jobs run by a fan-out executor against one of its server instances */
+typedef HRESULT (*DH_FANOUT_JOB) (IDispatch * pServer, LPVOID pContext);
+typedef HRESULT (*DH_FANOUT_FACTORY) (IDispatch ** ppServer, LPVOID pContext);
+
+/* Structure to store the counters of a fan-out instance */
+typedef struct tagDH_FANOUT_STATISTICS
+{
+	UINT cQueued;
+	BOOL bRunning;
+	ULONG cCompleted;
+	ULONG cFailed;
+	ULONG cStolen;
+	ULONGLONG ullBusyUs;
+	ULONGLONG ullElapsedUs;
+} DH_FANOUT_STATISTICS, * PDH_FANOUT_STATISTICS;
+
+typedef struct tagDH_FANOUT * PDH_FANOUT;
+
+HRESULT dhCreateFanOut(LPCOLESTR szProgId, LPCWSTR szMachine, UINT cInstances, PDH_FANOUT * ppFanOut);
+HRESULT dhCreateFanOutEx(DH_FANOUT_FACTORY pfnFactory, LPVOID pFactoryContext, UINT cInstances, PDH_FANOUT * ppFanOut);
+void dhDestroyFanOut(PDH_FANOUT pFanOut);
+HRESULT dhFanOutSubmit(PDH_FANOUT pFanOut, DH_FANOUT_JOB pfnJob, LPVOID pContext);
+HRESULT dhFanOutWait(PDH_FANOUT pFanOut, DWORD dwTimeout);
+UINT dhFanOutGetInstanceCount(PDH_FANOUT pFanOut);
+HRESULT dhFanOutGetStatistics(PDH_FANOUT pFanOut, UINT iInstance, PDH_FANOUT_STATISTICS pStatistics);
+
+
+
+
+/* ===================================================================== */
+
+/* Structure to store the options of a remote host */
+typedef struct tagDH_REMOTE_HOST_OPTIONS
+{
+	LPCWSTR szMachine;
+	LPCWSTR szUser;
+	LPCWSTR szPassword;
+	LPCWSTR szDomain;
+	DWORD dwAuthnLevel;
+	DWORD dwImpLevel;
+	DWORD dwClsContext;
+	UINT nWeight;
+} DH_REMOTE_HOST_OPTIONS, * PDH_REMOTE_HOST_OPTIONS;
+
+/* Structure to store the load and counters of a remote host */
+typedef struct tagDH_REMOTE_HOST_STATISTICS
+{
+	UINT cActive;
+	ULONG cCreated;
+	ULONG cFailed;
+	ULONG cFactoryHits;
+	ULONG ulLatencyUs;
+	BOOL bAvailable;
+} DH_REMOTE_HOST_STATISTICS, * PDH_REMOTE_HOST_STATISTICS;
+
+HRESULT dhAddRemoteHost(PDH_REMOTE_HOST_OPTIONS pOptions);
+HRESULT dhRemoveRemoteHost(LPCWSTR szMachine);
+HRESULT dhCreateRemoteObject(LPCOLESTR szProgId, LPCWSTR szMachine, IDispatch ** ppDisp);
+HRESULT dhReleaseRemoteObject(IDispatch * pDisp);
+HRESULT dhCopyRemoteBlanket(IDispatch * pFrom, IDispatch * pTo);
+HRESULT dhGetRemoteHostStatistics(LPCWSTR szMachine, PDH_REMOTE_HOST_STATISTICS pStatistics);
+
+
+
+
+/* ===================================================================== */
+
+/* Callback called by dhEnumParallel for each item */
+typedef HRESULT (*DH_ENUM_CALLBACK) (IDispatch * pItem, ULONG iItem, LPVOID pContext);
+
+HRESULT dhEnumParallel(IDispatch * pColl, int nMethod, UINT cPartitions, DH_ENUM_CALLBACK pfnCallback, LPVOID pContext);
+
+
+
+
+/* ===================================================================== */
+
+/* Statement prepared by dhStmtPrepare */
+typedef struct tagDH_STMT * PDH_STMT;
+
+HRESULT dhStmtPrepare(PDH_STMT * ppStmt, int invokeType, VARTYPE returnType, IDispatch * pDisp, LPCOLESTR szMember, ...);
+HRESULT dhStmtPrepareV(PDH_STMT * ppStmt, int invokeType, VARTYPE returnType, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker);
+HRESULT dhStmtExecute(PDH_STMT pStmt, VARIANT * pvResult);
+void dhStmtFree(PDH_STMT pStmt);
+
+
+
+
+/* ===================================================================== */
+
+/* Write-behind buffer of cell values for an Excel worksheet */
+typedef struct tagDH_RANGE_WRITER * PDH_RANGE_WRITER;
+
+HRESULT dhCreateRangeWriter(IDispatch * pSheet, UINT cMaxCells, PDH_RANGE_WRITER * ppWriter);
+HRESULT dhRangeWriterPut(PDH_RANGE_WRITER pWriter, LONG iRow, LONG iCol, VARIANT * pvValue);
+HRESULT dhRangeWriterPutValue(PDH_RANGE_WRITER pWriter, LPCOLESTR szMember, ...);
+HRESULT dhRangeWriterPutValueV(PDH_RANGE_WRITER pWriter, LPCOLESTR szMember, va_list * marker);
+HRESULT dhRangeWriterGet(PDH_RANGE_WRITER pWriter, LONG iRow, LONG iCol, VARIANT * pvResult);
+HRESULT dhRangeWriterFlush(PDH_RANGE_WRITER pWriter);
+HRESULT dhRangeWriterClose(PDH_RANGE_WRITER pWriter);
+
+
+
+
+/* ===================================================================== */
+
+/* Priority classes of a scheduler, most urgent first */
+#define DH_PRIORITY_INTERACTIVE 0
+#define DH_PRIORITY_NORMAL      1
+#define DH_PRIORITY_BATCH       2
+#define DH_PRIORITY_CLASSES     3
+
+/* Structure to store the options of a scheduler */
+typedef struct tagDH_SCHEDULER_OPTIONS
+{
+	UINT cConcurrent;
+	DWORD dwAging;
+	UINT rgcBatchMax[DH_PRIORITY_CLASSES];
+	DWORD rgdwTarget[DH_PRIORITY_CLASSES];
+} DH_SCHEDULER_OPTIONS, * PDH_SCHEDULER_OPTIONS;
+
+/* Call latency buckets: < 1ms, < 10ms, < 100ms, < 1s and longer */
+#define DH_SCHEDULER_HISTOGRAM_BUCKETS 5
+
+/* Structure to store the counters of a scheduler's priority class */
+typedef struct tagDH_SCHEDULER_STATISTICS
+{
+	UINT cQueued;
+	ULONG cCalls;
+	ULONG cPromoted;
+	ULONG cYielded;
+	ULONG cOverTarget;
+	ULONGLONG ullWaitTotalUs;
+	ULONG ulWaitMaxUs;
+	ULONGLONG ullLatencyTotalUs;
+	ULONG ulLatencyMaxUs;
+	ULONG rgHistogram[DH_SCHEDULER_HISTOGRAM_BUCKETS];
+} DH_SCHEDULER_STATISTICS, * PDH_SCHEDULER_STATISTICS;
+
+typedef struct tagDH_SCHEDULER * PDH_SCHEDULER;
+
+HRESULT dhCreateScheduler(PDH_SCHEDULER_OPTIONS pOptions, PDH_SCHEDULER * ppScheduler);
+void dhDestroyScheduler(PDH_SCHEDULER pScheduler);
+HRESULT dhSchedulerAddObject(PDH_SCHEDULER pScheduler, IDispatch * pDisp);
+HRESULT dhSetCallPriority(PDH_SCHEDULER pScheduler, int nPriority);
+HRESULT dhSchedulerGetStatistics(PDH_SCHEDULER pScheduler, int nPriority, PDH_SCHEDULER_STATISTICS pStatistics, BOOL bReset);
+
+
+
+
+/* ===================================================================== */
+
+/* Connection to the events of an object made by dhAdvise */
+typedef struct tagDH_EVENT_SINK * PDH_EVENT_SINK;
+
+/* Callback called with each event. The arguments are in the order of the
+ * event's declaration. */
+typedef void (*DH_EVENT_CALLBACK) (LPCOLESTR szEvent, DISPID dispID, UINT cArgs, VARIANT * rgArgs, LPVOID pContext);
+
+/* Calls the callback on the thread receiving the event, with its original
+ * arguments, instead of queuing the event to the sink's handler thread */
+#define DH_EVENT_INLINE 0x0001
+
+/* Counters reported by dhGetEventStatistics */
+typedef struct tagDH_EVENT_STATISTICS
+{
+	ULONG cReceived;
+	ULONG cIgnored;
+	ULONG cDropped;
+	ULONG cDelivered;
+} DH_EVENT_STATISTICS, * PDH_EVENT_STATISTICS;
+
+HRESULT dhAdvise(IDispatch * pDisp, LPCOLESTR szEvents, DH_EVENT_CALLBACK pfnCallback, LPVOID pContext, PDH_EVENT_SINK * ppSink);
+HRESULT dhAdviseEx(IDispatch * pDisp, const IID * piidSource, LPCOLESTR szEvents, DWORD dwFlags,
+                   DH_EVENT_CALLBACK pfnCallback, LPVOID pContext, PDH_EVENT_SINK * ppSink);
+HRESULT dhUnadvise(PDH_EVENT_SINK pSink);
+HRESULT dhGetEventStatistics(PDH_EVENT_SINK pSink, PDH_EVENT_STATISTICS pStatistics, BOOL bReset);
+
+
+
+
 /* ===================================================================== */
 #ifndef DISPHELPER_NO_EXCEPTIONS
 
@@ -289,6 +732,85 @@ extern BOOL dh_g_bIsUnicodeMode;
 /* Maximum length of a member string */
 #define DH_MAX_MEMBER 512
 
+/* Maximum number of fields read by dhGetValues */
+#define DH_MAX_FIELDS 64
+
+/* va_copy is missing from older compilers where a va_list can simply be assigned */
+#ifndef va_copy
+#define va_copy(dest, src) ((dest) = (src))
+#endif
+
+/* Maximum number of arguments (including those of sub objects) of a call
+ * captured by the property cache, dhSetSingleFlight or dhInvokeAsync */
+#define DH_MAX_CAPTURED_ARGS 32
+
+/* Consumes the arguments of a member without invoking it */
+HRESULT dhSkipArguments(LPCOLESTR szMember, va_list * marker);
+HRESULT dhCaptureArguments(LPCOLESTR szMember, LPWSTR szCaptured, VARIANT * rgArgs, UINT cMaxArgs, UINT * pcArgs, va_list * marker);
+HRESULT dhInvokeCaptured(int invokeType, VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szCaptured, VARIANT * rgArgs);
+
+/* DISPID cache functions */
+ULONG dhHashName(ULONG ulHash, LPCOLESTR szName);
+HRESULT dhCacheGetIDsOfNames(IDispatch * pDisp, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId);
+HRESULT dhCacheGetIDOfAtom(IDispatch * pDisp, const DH_ATOM * pAtom, DISPID * pDispId);
+void dhCleanupThreadCache(void);
+HRESULT dhCacheLiteral(LPCVOID pString, BOOL bAnsi, BSTR * pbstr, BOOL * pbFree);
+void dhCleanupThreadLiterals(void);
+void dhCleanupThreadFactoryCache(void);
+BOOL dhNamesMatch(LPCWSTR szCached, UINT cCachedNames, LPOLESTR * rgszNames, UINT cNames);
+
+/* The type, type library and versions under which names are kept in the DISPID file */
+typedef struct tagDH_TYPE_KEY
+{
+	GUID guidLib;
+	WORD wLibMajorVerNum;
+	WORD wLibMinorVerNum;
+	LCID lcid;
+	GUID guidType;
+	WORD wMajorVerNum;
+	WORD wMinorVerNum;
+} DH_TYPE_KEY;
+
+/* DISPID file functions */
+BOOL dhSnapshotEnabled(void);
+HRESULT dhSnapshotReadTypeKey(ITypeInfo * pTypeInfo, DH_TYPE_KEY * pKey);
+HRESULT dhSnapshotGetTypeKey(IDispatch * pDisp, DH_TYPE_KEY * pKey, ITypeInfo ** ppTypeInfo);
+BOOL dhSnapshotLookup(const DH_TYPE_KEY * pKey, ULONG ulHash, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId);
+void dhSnapshotRecord(const DH_TYPE_KEY * pKey, ITypeInfo * pTypeInfo, ULONG ulHash, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId);
+void dhSnapshotAppend(const DH_TYPE_KEY * pKey, ULONG ulHash, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId);
+void dhCacheAddNames(IDispatch * pDisp, const DH_TYPE_KEY * pKey, ITypeInfo * pTypeInfo, LPOLESTR * rgszNames, UINT cNames, DISPID * rgDispId);
+
+/* Registers and revokes the message filter enabled with dhSetMessageFilter */
+void dhRegisterThreadMessageFilter(void);
+void dhCleanupThreadMessageFilter(void);
+
+/* Calls IDispatch::Invoke within the thread's call timeout */
+HRESULT dhTimedInvoke(IDispatch * pDisp, DISPID dispID, int invokeType, DISPPARAMS * pDispParams,
+                      VARIANT * pvResult, EXCEPINFO * pExcepInfo, UINT * puArgErr);
+void dhCleanupThreadDeadline(void);
+
+/* Coalesces concurrent gets of members enabled with dhSetSingleFlight */
+BOOL dhArgumentsMatch(VARIANT * rgArgs1, VARIANT * rgArgs2, UINT cArgs);
+HRESULT dhSingleFlightGet(VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember,
+                          LPCOLESTR szCaptured, VARIANT * rgArgs, UINT cArgs);
+HRESULT dhSingleFlightGetV(VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker);
+
+/* Property cache functions */
+HRESULT dhPropertyCacheGetV(VARTYPE returnType, VARIANT * pvResult, IDispatch * pDisp, LPCOLESTR szMember, va_list * marker);
+void dhPropertyCacheInvalidate(IDispatch * pDisp);
+void dhCleanupThreadPropertyCache(void);
+
+/* Slices an enumerator without cloning it */
+HRESULT dhEnumSliceWrap(IEnumVARIANT ** ppEnum, IEnumVARIANT * pInner, ULONG iStart, ULONG cItems);
+
+/* Invokes a resolved member through any interceptors */
+HRESULT dhInterceptInvoke(IDispatch * pDisp, LPCOLESTR szMember, DISPID dispID, int invokeType,
+                          DISPPARAMS * pDispParams, VARIANT * pvResult, EXCEPINFO * pExcepInfo, UINT * puArgErr);
+
+/* Called by TraverseSubObjects with each sub object it reads */
+typedef void (*DH_SUB_OBJECT_HOOK) (IDispatch * pParent, IDispatch * pSubObject);
+extern DH_SUB_OBJECT_HOOK dh_g_pfnSubObjectHook;
+
 /* This macro is missing from Dev-Cpp/Mingw */
 #ifndef V_UI4
 #define V_UI4(X) V_UNION(X, ulVal)
@@ -347,30 +869,39 @@ DBG_CODE( { \
 #pragma warning( disable : 4290 ) /* throw() specification ignored */
 #endif
 
+/* Dynamic exception specifications were removed in C++17 */
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define DH_THROWS(type)
+#define DH_NOTHROW noexcept
+#else
+#define DH_THROWS(type) throw(type)
+#define DH_NOTHROW throw()
+#endif
+
 #ifndef DISPHELPER_USE_MS_SMART_PTR
 
 template <class T>
 class CDhComPtr
 {
 public:
-	CDhComPtr() throw() : m_pInterface (NULL) {}
+	CDhComPtr() DH_NOTHROW : m_pInterface (NULL) {}
 
-	CDhComPtr(T* pInterface) throw() : m_pInterface (pInterface)
+	CDhComPtr(T* pInterface) DH_NOTHROW : m_pInterface (pInterface)
 	{
 		if (m_pInterface) m_pInterface->AddRef();
 	}
 
-	CDhComPtr(const CDhComPtr& original) throw() : m_pInterface (original.m_pInterface)
+	CDhComPtr(const CDhComPtr& original) DH_NOTHROW : m_pInterface (original.m_pInterface)
 	{
 		if (m_pInterface) m_pInterface->AddRef();
 	}
 
-	~CDhComPtr() throw()
+	~CDhComPtr() DH_NOTHROW
 	{
 		Dispose();
 	}
 
-	void Dispose() throw()
+	void Dispose() DH_NOTHROW
 	{
 		if (m_pInterface)
 		{
@@ -379,31 +910,31 @@ public:
 		}
 	}
 
-	T* Detach() throw()
+	T* Detach() DH_NOTHROW
 	{
 		T* temp = m_pInterface;
 		m_pInterface = NULL;
 		return temp;
 	}
 
-	inline operator T*() const throw()
+	inline operator T*() const DH_NOTHROW
 	{
         	return m_pInterface;
 	}
 
-	T** operator&() throw()
+	T** operator&() DH_NOTHROW
 	{
 		Dispose();
         	return &m_pInterface;
 	}
 
-	T* operator->() const throw(HRESULT)
+	T* operator->() const DH_THROWS(HRESULT)
 	{
 		if (!m_pInterface) throw E_POINTER;
 		return m_pInterface;
 	}
 
-	CDhComPtr& operator=(T* pInterface) throw()
+	CDhComPtr& operator=(T* pInterface) DH_NOTHROW
 	{
 		if (m_pInterface != pInterface)
 		{
@@ -416,13 +947,13 @@ public:
 		return *this;
 	}
 
-	CDhComPtr& operator=(const int null) throw(HRESULT)
+	CDhComPtr& operator=(const int null) DH_THROWS(HRESULT)
 	{
 		if (null != 0) throw(E_POINTER);
 		return operator=((T*) NULL);
 	}
 
-	CDhComPtr& operator=(const CDhComPtr& rhs) throw()
+	CDhComPtr& operator=(const CDhComPtr& rhs) DH_NOTHROW
 	{
 		return operator=(rhs.m_pInterface);
 	}
@@ -452,48 +983,48 @@ template <class T>
 class CDhStringTemplate
 {
 public:
-	CDhStringTemplate() throw() : m_strptr (NULL) {}
+	CDhStringTemplate() DH_NOTHROW : m_strptr (NULL) {}
 
-	CDhStringTemplate(const CDhStringTemplate& original) throw()
+	CDhStringTemplate(const CDhStringTemplate& original) DH_NOTHROW
 	{
 		Copy(original.m_strptr);
 	}
 
-	CDhStringTemplate(const int null) throw(HRESULT) : m_strptr (NULL)
+	CDhStringTemplate(const int null) DH_THROWS(HRESULT) : m_strptr (NULL)
 	{
 		if (null != 0) throw(E_POINTER);
 	}
 
-	~CDhStringTemplate() throw()
+	~CDhStringTemplate() DH_NOTHROW
 	{
 		Dispose();
 	}
 
-	void Dispose() throw()
+	void Dispose() DH_NOTHROW
 	{
 		dhFreeString(m_strptr);
 		m_strptr = NULL;
 	}
 
-	T* Detach() throw()
+	T* Detach() DH_NOTHROW
 	{
 		T* temp = m_strptr;
 		m_strptr = NULL;
 		return temp;
 	}
 
-	T** operator&() throw()
+	T** operator&() DH_NOTHROW
 	{
 		Dispose();
 		return &m_strptr;
 	}
 
-	inline operator T*() const throw()
+	inline operator T*() const DH_NOTHROW
 	{
 		return m_strptr;
 	}
 
-	inline T& operator[](int nIndex) const throw()
+	inline T& operator[](int nIndex) const DH_NOTHROW
 	{
 		return m_strptr[nIndex];
 	}
@@ -510,7 +1041,7 @@ public:
 		return *this;
 	}
 
-	CDhStringTemplate& operator=(const int null) throw(HRESULT)
+	CDhStringTemplate& operator=(const int null) DH_THROWS(HRESULT)
 	{
 		if (null != 0) throw(E_POINTER);
 		Dispose();
@@ -561,12 +1092,12 @@ inline std::wostream& operator<<(std::wostream& os, const CDhStringW& s)
 class CDhInitialize
 {
 public:
-	CDhInitialize(const BOOL bInitCom = TRUE) throw() : m_bInitCom (bInitCom)
+	CDhInitialize(const BOOL bInitCom = TRUE) DH_NOTHROW : m_bInitCom (bInitCom)
 	{
 		dhInitialize(m_bInitCom);
 	}
 
-	~CDhInitialize() throw()
+	~CDhInitialize() DH_NOTHROW
 	{
 		dhUninitialize(m_bInitCom);
 	}
@@ -577,26 +1108,202 @@ private:
 
 
 
+/* ===================================================================== */
+/* Flushes a range writer when it goes out of scope */
+class CDhRangeWriter
+{
+public:
+	CDhRangeWriter(IDispatch * pSheet, UINT cMaxCells = 0) DH_NOTHROW : m_pWriter (NULL)
+	{
+		dhCreateRangeWriter(pSheet, cMaxCells, &m_pWriter);
+	}
+
+	~CDhRangeWriter() DH_NOTHROW
+	{
+		dhRangeWriterClose(m_pWriter);
+	}
+
+	operator PDH_RANGE_WRITER() const DH_NOTHROW
+	{
+		return m_pWriter;
+	}
+private:
+	CDhRangeWriter(const CDhRangeWriter &);
+	CDhRangeWriter & operator=(const CDhRangeWriter &);
+
+	PDH_RANGE_WRITER m_pWriter;
+};
+
+
+
+
+/* ===================================================================== */
+/* Sets the thread's call timeout until it goes out of scope */
+class CDhCallTimeout
+{
+public:
+	CDhCallTimeout(DWORD dwTimeout) DH_NOTHROW : m_dwPrevious (dhSetCallTimeout(dwTimeout))
+	{
+	}
+
+	~CDhCallTimeout() DH_NOTHROW
+	{
+		dhSetCallTimeout(m_dwPrevious);
+	}
+private:
+	CDhCallTimeout(const CDhCallTimeout &);
+	CDhCallTimeout & operator=(const CDhCallTimeout &);
+
+	DWORD m_dwPrevious;
+};
+
+
+
+
+/* ===================================================================== */
+#if !defined(DISPHELPER_NO_ATOMS) && (__cplusplus >= 201103L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L))
+
+namespace dh {
+namespace detail {
+
+/* Must hash names exactly as dhHashName does */
+constexpr ULONG fold_char(wchar_t ch)
+{
+	return (ch >= L'A' && ch <= L'Z') ? (ULONG) (ch + (L'a' - L'A')) : (ULONG) ch;
+}
+
+constexpr ULONG hash_name(const wchar_t * szName, size_t cchName, ULONG ulHash)
+{
+	return cchName == 0 ? (ULONG) (ulHash * 16777619UL) :
+	       hash_name(szName + 1, cchName - 1, (ULONG) ((ulHash ^ fold_char(*szName)) * 16777619UL));
+}
+
+/* Packs an argument for dhInvokeAtom. Returns true if the VARIANT owns a
+ * copy which must be cleared after the call. Objects and VARIANTs are
+ * passed without being copied. */
+inline bool pack(VARIANT& v, int nVal)          { V_VT(&v) = VT_I4;   V_I4(&v)   = nVal;   return false; }
+inline bool pack(VARIANT& v, long lVal)         { V_VT(&v) = VT_I4;   V_I4(&v)   = lVal;   return false; }
+inline bool pack(VARIANT& v, unsigned long ulVal) { V_VT(&v) = VT_UI4; V_UNION(&v, ulVal) = ulVal; return false; }
+inline bool pack(VARIANT& v, double dblVal)     { V_VT(&v) = VT_R8;   V_R8(&v)   = dblVal; return false; }
+inline bool pack(VARIANT& v, bool bVal)         { V_VT(&v) = VT_BOOL; V_BOOL(&v) = bVal ? VARIANT_TRUE : VARIANT_FALSE; return false; }
+inline bool pack(VARIANT& v, IDispatch * pDisp) { V_VT(&v) = VT_DISPATCH; V_DISPATCH(&v) = pDisp; return false; }
+inline bool pack(VARIANT& v, const VARIANT& vtVal) { v = vtVal; return false; }
+
+inline bool pack(VARIANT& v, LPCOLESTR szVal)
+{
+	V_VT(&v)   = VT_BSTR;
+	V_BSTR(&v) = SysAllocString(szVal);
+	return true;
+}
+
+/* Unpacks the result of dhInvokeAtom, taking ownership of it */
+inline HRESULT unpack(VARIANT& v, VARTYPE vt)
+{
+	HRESULT hr = VariantChangeType(&v, &v, 0, vt);
+	if (FAILED(hr)) VariantClear(&v);
+	return hr;
+}
+
+inline HRESULT unpack(VARIANT& v, VARIANT * pResult) { *pResult = v; return NOERROR; }
+inline HRESULT unpack(VARIANT& v, int * pResult)     { HRESULT hr = unpack(v, VT_I4);   if (SUCCEEDED(hr)) *pResult = V_I4(&v);  return hr; }
+inline HRESULT unpack(VARIANT& v, long * pResult)    { HRESULT hr = unpack(v, VT_I4);   if (SUCCEEDED(hr)) *pResult = V_I4(&v);  return hr; }
+inline HRESULT unpack(VARIANT& v, unsigned long * pResult) { HRESULT hr = unpack(v, VT_UI4); if (SUCCEEDED(hr)) *pResult = V_UNION(&v, ulVal); return hr; }
+inline HRESULT unpack(VARIANT& v, double * pResult)  { HRESULT hr = unpack(v, VT_R8);   if (SUCCEEDED(hr)) *pResult = V_R8(&v);  return hr; }
+inline HRESULT unpack(VARIANT& v, bool * pResult)    { HRESULT hr = unpack(v, VT_BOOL); if (SUCCEEDED(hr)) *pResult = V_BOOL(&v) != VARIANT_FALSE; return hr; }
+inline HRESULT unpack(VARIANT& v, BSTR * pResult)    { HRESULT hr = unpack(v, VT_BSTR); if (SUCCEEDED(hr)) *pResult = V_BSTR(&v); return hr; }
+
+inline HRESULT unpack(VARIANT& v, IDispatch ** ppResult)
+{
+	HRESULT hr = unpack(v, VT_DISPATCH);
+	if (SUCCEEDED(hr) && (*ppResult = V_DISPATCH(&v)) == NULL) hr = E_NOINTERFACE;
+	return hr;
+}
+
+/* Packs the arguments, last first as IDispatch expects, and invokes the atom */
+template <class... Args>
+inline HRESULT invoke_atom(int invokeType, VARIANT * pvResult, IDispatch * pDisp, const DH_ATOM& atom, const Args&... args)
+{
+	VARIANT rgArgs[sizeof...(Args) + 1];
+	bool rgbOwned[sizeof...(Args) + 1];
+	UINT iArg = sizeof...(Args);
+	HRESULT hr;
+
+	int expand[] = { 0, (--iArg, rgbOwned[iArg] = pack(rgArgs[iArg], args), 0)... };
+	(void) expand;
+
+	hr = dhInvokeAtom(invokeType, pvResult, (UINT) sizeof...(Args), pDisp, &atom, rgArgs);
+
+	for (iArg = 0; iArg < sizeof...(Args); iArg++)
+	{
+		if (rgbOwned[iArg]) VariantClear(&rgArgs[iArg]);
+	}
+
+	return hr;
+}
+
+} /* namespace detail */
+} /* namespace dh */
+
+/* A member name hashed at compile time, eg. L"Cells"_dh. Declare atoms used
+ * in hot loops as static constexpr to be sure the hash is not computed at run time. */
+constexpr DH_ATOM operator"" _dh(const wchar_t * szName, size_t cchName)
+{
+	return DH_ATOM{ szName, (UINT) cchName, dh::detail::hash_name(szName, cchName, 2166136261UL) };
+}
+
+/* Overloads of dhCallMethod, dhPutValue and dhGetValue taking an atom and
+ * typed arguments in place of a member string. The atom is resolved without
+ * being parsed or hashed. For dhPutValue the property value comes last. */
+template <class... Args>
+inline HRESULT dhCallMethod(IDispatch * pDisp, const DH_ATOM& atom, const Args&... args)
+{
+	HRESULT hr = dh::detail::invoke_atom(DISPATCH_METHOD, NULL, pDisp, atom, args...);
+	dhFlushPropertyCache(pDisp);
+	return hr;
+}
+
+template <class... Args>
+inline HRESULT dhPutValue(IDispatch * pDisp, const DH_ATOM& atom, const Args&... args)
+{
+	HRESULT hr = dh::detail::invoke_atom(DISPATCH_PROPERTYPUT, NULL, pDisp, atom, args...);
+	dhFlushPropertyCache(pDisp);
+	return hr;
+}
+
+template <class T, class... Args>
+inline HRESULT dhGetValue(T * pResult, IDispatch * pDisp, const DH_ATOM& atom, const Args&... args)
+{
+	VARIANT vtResult;
+	HRESULT hr = dh::detail::invoke_atom(DISPATCH_PROPERTYGET | DISPATCH_METHOD, &vtResult, pDisp, atom, args...);
+	if (SUCCEEDED(hr)) hr = dh::detail::unpack(vtResult, pResult);
+	return hr;
+}
+
+#endif /* DISPHELPER_NO_ATOMS */
+
+
+
+
 /* ===================================================================== */
 #ifndef DISPHELPER_NO_EXCEPTIONS
 class dhThrowFunctions
 {
 public:
-	static void throw_string() throw(std::string)
+	static void throw_string() DH_THROWS(std::string)
 	{
 		CHAR szMessage[512];
 		dhFormatExceptionA(NULL, szMessage, sizeof(szMessage)/sizeof(szMessage[0]), TRUE);
 		throw std::string(szMessage);
 	}
 
-	static void throw_wstring() throw(std::wstring)
+	static void throw_wstring() DH_THROWS(std::wstring)
 	{
 		WCHAR szMessage[512];
 		dhFormatExceptionW(NULL, szMessage, sizeof(szMessage)/sizeof(szMessage[0]), TRUE);
 		throw std::wstring(szMessage);
 	}
 	
-	static void throw_dhexception() throw(PDH_EXCEPTION)
+	static void throw_dhexception() DH_THROWS(PDH_EXCEPTION)
 	{
 		PDH_EXCEPTION pException = NULL;
 		dhGetLastException(&pException);
@@ -610,19 +1317,19 @@ public:
 
 /* ===================================================================== */
 #ifndef DISPHELPER_NO_EXCEPTIONS
-inline bool dhIfFailThrowString(HRESULT hr) throw(std::string)
+inline bool dhIfFailThrowString(HRESULT hr) DH_THROWS(std::string)
 {
 	if (FAILED(hr)) dhThrowFunctions::throw_string();
 	return true;
 }
 
-inline bool dhIfFailThrowWString(HRESULT hr) throw(std::wstring)
+inline bool dhIfFailThrowWString(HRESULT hr) DH_THROWS(std::wstring)
 {
 	if (FAILED(hr)) dhThrowFunctions::throw_wstring();
 	return true;
 }
 
-inline bool dhIfFailThrowDhException(HRESULT hr) throw(PDH_EXCEPTION)
+inline bool dhIfFailThrowDhException(HRESULT hr) DH_THROWS(PDH_EXCEPTION)
 {
 	if (FAILED(hr)) dhThrowFunctions::throw_dhexception();
 	return true;
@@ -724,6 +1431,485 @@ inline bool dhIfFailThrowDhException(HRESULT hr) throw(PDH_EXCEPTION)
 
 #endif /* DISPHELPER_NO_FOR_EACH */
 
+
+
+
+/* ===================================================================== */
+
+/* Parallel FOR_EACH: calls func(pItem, iItem) for each item of a collection,
+ * on cPartitions threads at once. func must be thread safe and must not throw. */
+template <class F>
+inline HRESULT dhParallelForEach(IDispatch * pColl, int nMethod, UINT cPartitions, F func)
+{
+	struct thunk
+	{
+		static HRESULT call(IDispatch * pItem, ULONG iItem, LPVOID pContext)
+		{
+			return (*static_cast<F *>(pContext))(pItem, iItem);
+		}
+	};
+
+	return dhEnumParallel(pColl, nMethod, cPartitions, thunk::call, &func);
+}
+
+
+
+
+/* ===================================================================== */
+#if defined(__cpp_impl_coroutine) && !defined(DISPHELPER_NO_COROUTINES)
+
+/* Coroutine front end for the asynchronous functions (dh_async.c), which
+ * are extras not available in the single file version. */
+
+#include <coroutine>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace dh {
+
+/* Resumes coroutines once their calls complete */
+class scheduler
+{
+public:
+	virtual ~scheduler() {}
+	virtual void post(std::coroutine_handle<> h) = 0;
+};
+
+/* The scheduler of the current thread, set while a run_loop is running */
+inline thread_local scheduler * current_scheduler = nullptr;
+
+
+
+/* ===================================================================== */
+/* An object owned by an executor. Calls to it go through the executor and
+ * it is released there. */
+class object
+{
+public:
+	object() noexcept : m_pExecutor (nullptr), m_pDisp (nullptr) {}
+	object(PDH_EXECUTOR pExecutor, IDispatch * pDisp) noexcept : m_pExecutor (pExecutor), m_pDisp (pDisp) {}
+	object(object&& other) noexcept : m_pExecutor (other.m_pExecutor), m_pDisp (other.m_pDisp) { other.m_pDisp = nullptr; }
+	object(const object&) = delete;
+
+	~object() noexcept { Dispose(); }
+
+	object& operator=(object&& rhs) noexcept
+	{
+		if (this != &rhs)
+		{
+			Dispose();
+			m_pExecutor = rhs.m_pExecutor;
+			m_pDisp     = rhs.m_pDisp;
+			rhs.m_pDisp = nullptr;
+		}
+
+		return *this;
+	}
+
+	object& operator=(const object&) = delete;
+
+	void Dispose() noexcept
+	{
+		if (m_pDisp) dhExecutorReleaseObject(m_pExecutor, m_pDisp);
+		m_pDisp = nullptr;
+	}
+
+	PDH_EXECUTOR executor() const noexcept { return m_pExecutor; }
+	IDispatch * get() const noexcept { return m_pDisp; }
+	explicit operator bool() const noexcept { return m_pDisp != nullptr; }
+
+private:
+	PDH_EXECUTOR m_pExecutor;
+	IDispatch * m_pDisp;
+};
+
+/* Creates an object on an executor, throwing the HRESULT on failure */
+inline object create_object(PDH_EXECUTOR pExecutor, LPCOLESTR szProgId, LPCWSTR szMachine = nullptr)
+{
+	IDispatch * pDisp = nullptr;
+	HRESULT hr = dhExecutorCreateObject(pExecutor, szProgId, szMachine, &pDisp);
+	if (FAILED(hr)) throw hr;
+	return object(pExecutor, pDisp);
+}
+
+
+
+
+/* ===================================================================== */
+namespace detail {
+
+/* Maps a result type to the VARTYPE requested from dhInvoke */
+template <class T> struct result_traits;
+
+template <> struct result_traits<void>
+{
+	static const VARTYPE vt = VT_EMPTY;
+};
+
+template <> struct result_traits<long>
+{
+	static const VARTYPE vt = VT_I4;
+	static long extract(VARIANT& v, PDH_EXECUTOR) { return V_I4(&v); }
+};
+
+template <> struct result_traits<int>
+{
+	static const VARTYPE vt = VT_I4;
+	static int extract(VARIANT& v, PDH_EXECUTOR) { return V_I4(&v); }
+};
+
+template <> struct result_traits<LONGLONG>
+{
+	static const VARTYPE vt = VT_I8;
+	static LONGLONG extract(VARIANT& v, PDH_EXECUTOR) { return V_I8(&v); }
+};
+
+template <> struct result_traits<double>
+{
+	static const VARTYPE vt = VT_R8;
+	static double extract(VARIANT& v, PDH_EXECUTOR) { return V_R8(&v); }
+};
+
+template <> struct result_traits<bool>
+{
+	static const VARTYPE vt = VT_BOOL;
+	static bool extract(VARIANT& v, PDH_EXECUTOR) { return V_BOOL(&v) != VARIANT_FALSE; }
+};
+
+template <> struct result_traits<std::wstring>
+{
+	static const VARTYPE vt = VT_BSTR;
+	static std::wstring extract(VARIANT& v, PDH_EXECUTOR)
+	{
+		return V_BSTR(&v) ? std::wstring(V_BSTR(&v), SysStringLen(V_BSTR(&v))) : std::wstring();
+	}
+};
+
+template <> struct result_traits<object>
+{
+	static const VARTYPE vt = VT_DISPATCH;
+	static object extract(VARIANT& v, PDH_EXECUTOR pExecutor)
+	{
+		IDispatch * pDisp = V_DISPATCH(&v);
+		V_VT(&v) = VT_EMPTY;
+		return object(pExecutor, pDisp);
+	}
+};
+
+/* Arguments are stored by value until the call is queued. Objects are
+ * passed to the executor as the IDispatch it owns. */
+template <class T> inline typename std::decay<const T>::type argument(const T& arg) noexcept { return arg; }
+inline IDispatch * argument(const object& arg) noexcept { return arg.get(); }
+
+/* State shared by an awaiter and its completion callback */
+struct async_state
+{
+	HRESULT hr;
+	VARIANT vtResult;
+	scheduler * pScheduler;
+	std::coroutine_handle<> hCaller;
+
+	static void on_complete(HRESULT hr, VARIANT * pvResult, LPVOID pContext)
+	{
+		async_state * pState = static_cast<async_state *>(pContext);
+
+		pState->hr       = hr;
+		pState->vtResult = *pvResult;
+		VariantInit(pvResult);
+
+		if (pState->pScheduler)
+			pState->pScheduler->post(pState->hCaller);
+		else
+			pState->hCaller.resume();
+	}
+};
+
+} /* namespace detail */
+
+
+
+
+/* ===================================================================== */
+/* Awaitable returned by dh::call, dh::get and dh::put. The call is queued
+ * to the object's executor when awaited and the coroutine is resumed on
+ * the scheduler of the awaiting thread. */
+template <class T, class... Args>
+class async_call
+{
+public:
+	async_call(int invokeType, const object& obj, LPCOLESTR szMember, Args... args)
+		: m_invokeType (invokeType), m_obj (obj), m_szMember (szMember), m_args (args...) {}
+
+	bool await_ready() const noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> hCaller)
+	{
+		m_state.pScheduler = current_scheduler;
+		m_state.hCaller    = hCaller;
+		VariantInit(&m_state.vtResult);
+
+		HRESULT hr = std::apply([this](auto&... args) {
+			return dhInvokeAsyncCallback(m_obj.executor(), detail::async_state::on_complete, &m_state,
+			                             m_invokeType, detail::result_traits<T>::vt, m_obj.get(), m_szMember,
+			                             args...);
+		}, m_args);
+
+		/* If the call could not be queued, carry on without suspending */
+		if (FAILED(hr)) m_state.hr = hr;
+		return SUCCEEDED(hr);
+	}
+
+	T await_resume()
+	{
+		if (FAILED(m_state.hr)) throw m_state.hr;
+
+		if constexpr (std::is_void<T>::value)
+		{
+			VariantClear(&m_state.vtResult);
+		}
+		else
+		{
+			T result = detail::result_traits<T>::extract(m_state.vtResult, m_obj.executor());
+			VariantClear(&m_state.vtResult);
+			return result;
+		}
+	}
+
+private:
+	int m_invokeType;
+	const object& m_obj;
+	LPCOLESTR m_szMember;
+	std::tuple<Args...> m_args;
+	detail::async_state m_state;
+};
+
+/* co_await dh::call(doc, L".Close(%b)", FALSE); */
+template <class... Args>
+inline auto call(const object& obj, LPCOLESTR szMember, const Args&... args)
+{
+	return async_call<void, decltype(detail::argument(args))...>(DISPATCH_METHOD, obj, szMember, detail::argument(args)...);
+}
+
+/* double v = co_await dh::get<double>(xlApp, L".Range(%S).Value", L"A1"); */
+template <class T, class... Args>
+inline auto get(const object& obj, LPCOLESTR szMember, const Args&... args)
+{
+	return async_call<T, decltype(detail::argument(args))...>(DISPATCH_PROPERTYGET | DISPATCH_METHOD, obj, szMember, detail::argument(args)...);
+}
+
+/* co_await dh::put(xlApp, L".Visible = %b", TRUE); */
+template <class... Args>
+inline auto put(const object& obj, LPCOLESTR szMember, const Args&... args)
+{
+	return async_call<void, decltype(detail::argument(args))...>(DISPATCH_PROPERTYPUT, obj, szMember, detail::argument(args)...);
+}
+
+
+
+
+/* ===================================================================== */
+/* Lazily started coroutine which resumes its awaiter when it completes */
+template <class T = void>
+class task;
+
+namespace detail {
+
+struct promise_base
+{
+	std::coroutine_handle<> hContinuation;
+	std::exception_ptr pException;
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+
+	struct final_awaiter
+	{
+		bool await_ready() noexcept { return false; }
+
+		template <class P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+		{
+			std::coroutine_handle<> hNext = h.promise().hContinuation;
+			return hNext ? hNext : std::noop_coroutine();
+		}
+
+		void await_resume() noexcept {}
+	};
+
+	final_awaiter final_suspend() noexcept { return {}; }
+
+	void unhandled_exception() noexcept { pException = std::current_exception(); }
+};
+
+template <class T>
+struct task_promise : promise_base
+{
+	T value;
+
+	task<T> get_return_object() noexcept;
+	void return_value(T v) { value = std::move(v); }
+
+	T result()
+	{
+		if (pException) std::rethrow_exception(pException);
+		return std::move(value);
+	}
+};
+
+template <>
+struct task_promise<void> : promise_base
+{
+	task<void> get_return_object() noexcept;
+	void return_void() noexcept {}
+
+	void result()
+	{
+		if (pException) std::rethrow_exception(pException);
+	}
+};
+
+} /* namespace detail */
+
+template <class T>
+class task
+{
+public:
+	typedef detail::task_promise<T> promise_type;
+
+	explicit task(std::coroutine_handle<promise_type> h) noexcept : m_h (h) {}
+	task(task&& other) noexcept : m_h (other.m_h) { other.m_h = nullptr; }
+	task(const task&) = delete;
+	task& operator=(const task&) = delete;
+
+	~task() { if (m_h) m_h.destroy(); }
+
+	bool await_ready() const noexcept { return !m_h || m_h.done(); }
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> hCaller) noexcept
+	{
+		m_h.promise().hContinuation = hCaller;
+		return m_h;
+	}
+
+	T await_resume() { return m_h.promise().result(); }
+
+private:
+	std::coroutine_handle<promise_type> m_h;
+};
+
+namespace detail {
+
+template <class T>
+inline task<T> task_promise<T>::get_return_object() noexcept
+{
+	return task<T>(std::coroutine_handle<task_promise<T> >::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept
+{
+	return task<void>(std::coroutine_handle<task_promise<void> >::from_promise(*this));
+}
+
+} /* namespace detail */
+
+
+
+
+/* ===================================================================== */
+/* A scheduler which resumes coroutines on the thread calling run(). One
+ * thread can drive many pipelines started with spawn(). */
+class run_loop : public scheduler
+{
+public:
+	run_loop() : m_cOutstanding (0) {}
+
+	void post(std::coroutine_handle<> h)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(h);
+		m_cv.notify_one();
+	}
+
+	/* Starts a pipeline. Exceptions it throws are discarded. */
+	void spawn(task<void> t)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_cOutstanding++;
+		}
+
+		/* The pipeline runs here until it first suspends */
+		scheduler * pPrevious = current_scheduler;
+		current_scheduler = this;
+		run_detached(*this, std::move(t));
+		current_scheduler = pPrevious;
+	}
+
+	/* Resumes coroutines until every spawned pipeline has completed */
+	void run()
+	{
+		scheduler * pPrevious = current_scheduler;
+		current_scheduler = this;
+
+		for (;;)
+		{
+			std::coroutine_handle<> h;
+
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_cv.wait(lock, [this] { return !m_queue.empty() || m_cOutstanding == 0; });
+				if (m_queue.empty()) break;
+				h = m_queue.front();
+				m_queue.pop_front();
+			}
+
+			h.resume();
+		}
+
+		current_scheduler = pPrevious;
+	}
+
+private:
+	struct detached
+	{
+		struct promise_type
+		{
+			detached get_return_object() noexcept { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() noexcept {}
+			void unhandled_exception() noexcept {}
+		};
+	};
+
+	static detached run_detached(run_loop& loop, task<void> t)
+	{
+		try { co_await t; } catch (...) {}
+
+		loop.finished();
+	}
+
+	void finished()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_cOutstanding--;
+		m_cv.notify_one();
+	}
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::deque<std::coroutine_handle<> > m_queue;
+	size_t m_cOutstanding;
+};
+
+} /* namespace dh */
+
+#endif /* defined(__cpp_impl_coroutine) && !defined(DISPHELPER_NO_COROUTINES) */
+
 #ifdef _MSC_VER
 #pragma warning( default : 4290 )
 #endif